@@ -5,6 +5,7 @@
  */
 
 #include <gst/gst.h>
+#include "Http-Cache.h"
 
 int main()
 {
@@ -13,6 +14,8 @@ int main()
     GstMessage *msg;
 
     gst_init(NULL, NULL);
+    // The sintel trailer is read through the local range cache after the first run.
+    httpCacheRegister();
 
     // Used when pipeline is straightforward. More like a inline pipeline
     pipeline = gst_parse_launch("playbin uri=https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm", NULL);
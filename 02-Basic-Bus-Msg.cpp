@@ -5,16 +5,35 @@
  */
 #include <gst/gst.h>
 #include <iostream>
+#include "Bus-Dispatcher.h"
 
 using std::cout;
 using std::endl;
 
+static void onError(GstMessage *msg, GMainLoop *loop)
+{
+    GError *err;
+    gchar *debug_info;
+
+    gst_message_parse_error(msg, &err, &debug_info);
+    cout << "GST message error " << msg->src << "\t" << err->message << endl;
+    cout << "Debug info " << debug_info << endl;
+    g_clear_error(&err);
+    g_free(debug_info);
+    g_main_loop_quit(loop);
+}
+
+static void onEos(GstMessage *msg, GMainLoop *loop)
+{
+    cout << "End of stream" << endl;
+    g_main_loop_quit(loop);
+}
+
 int main()
 {
     GstElement *pipeline, *source, *sink;
-    GstBus *bus;
-    GstMessage *msg;
-    GstStateChangeReturn ret;
+    BusDispatcher *dispatcher;
+    GMainLoop *loop;
 
     gst_init(NULL, NULL);
 
@@ -51,40 +70,16 @@ int main()
         return -1;
     }
 
-    // Wait for the End of Stream
-    bus = gst_element_get_bus(pipeline);
-    msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_ERROR);
-
-    if (msg != NULL)
-    {
-        GError *err;
-        gchar *debug_info;
-
-        switch (GST_MESSAGE_TYPE(msg))
-        {
-        case GST_MESSAGE_ERROR:
-        {
-            gst_message_parse_error(msg, &err, &debug_info);
-            cout << "GST message error " << msg->src << "\t" << err->message << endl;
-            cout << "Debug info " << debug_info << endl;
-            g_clear_error(&err);
-            g_free(debug_info);
-            break;
-        }
-        case GST_MESSAGE_EOS:
-        {
-            cout << "End of stream" << endl;
-            break;
-        }
-        default:
-            cout << "Something went wrong. " << endl;
-            break;
-        }
-        gst_object_unref(msg);
-    }
+    // Wait for an error or the End of Stream
+    loop = g_main_loop_new(NULL, FALSE);
+    dispatcher = busDispatcherNew(pipeline, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, loop);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, loop);
+    g_main_loop_run(loop);
 
     // Deallocate
-    gst_object_unref(bus);
+    busDispatcherFree(dispatcher);
+    g_main_loop_unref(loop);
     gst_element_set_state(pipeline, GST_STATE_NULL);
     gst_object_unref(pipeline);
 
@@ -12,6 +12,8 @@
 
 #include <iostream>
 #include <gst/gst.h>
+#include "Bus-Dispatcher.h"
+#include "Http-Cache.h"
 
 using std::cout;
 using std::endl;
@@ -19,6 +21,7 @@ using std::endl;
 typedef struct
 {
     GstElement *pipeline, *source, *convert, *resample, *sink;
+    GMainLoop *loop;
 } CustomData;
 
 static void pad_added_handler(GstElement *source, GstPad *new_pad, CustomData *data)
@@ -36,9 +39,10 @@ static void pad_added_handler(GstElement *source, GstPad *new_pad, CustomData *d
     {
         cout << "We are already linked." << endl;
         gst_object_unref(sink_pad);
+        return;
     }
 
-    // Check new pads type
+    // Check new pads type. Every pad but the first raw audio one stays unlinked here; Stream-Router.h routes them all.
     new_pad_caps = gst_pad_get_current_caps(new_pad);
     new_pad_struct = gst_caps_get_structure(new_pad_caps, 0);
     new_pad_type = gst_structure_get_name(new_pad_struct);
@@ -47,6 +51,7 @@ static void pad_added_handler(GstElement *source, GstPad *new_pad, CustomData *d
         cout << "Not a raw audio. Invalid type: " << new_pad_type << endl;
         gst_caps_unref(new_pad_caps);
         gst_object_unref(sink_pad);
+        return;
     }
 
     // Attempt linking
@@ -59,16 +64,45 @@ static void pad_added_handler(GstElement *source, GstPad *new_pad, CustomData *d
     {
         cout << new_pad_type << " type linked successfully." << endl;
     }
+    gst_caps_unref(new_pad_caps);
+    gst_object_unref(sink_pad);
+}
+
+static void onError(GstMessage *msg, CustomData *data)
+{
+    GError *err;
+    gchar *debug_info;
+
+    gst_message_parse_error(msg, &err, &debug_info);
+    gst_printerr("Error Message: \n%s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
+    gst_printerr("Debug Message: \n%s", debug_info ? debug_info : "none");
+    g_clear_error(&err);
+    g_free(debug_info);
+    g_main_loop_quit(data->loop);
+}
+
+static void onEos(GstMessage *msg, CustomData *data)
+{
+    cout << "End of stream reached." << endl;
+    g_main_loop_quit(data->loop);
+}
+
+// We are only intererted in state-changed messages from pipeline, see the registration in main().
+static void onStateChanged(GstMessage *msg, CustomData *data)
+{
+    GstState old_state, new_state, pending_state;
+    gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
+    cout << "Pipeline state changed from " << old_state << " to " << new_state << endl;
 }
 
 int main()
 {
     CustomData data;
-    GstBus *bus;
-    GstMessage *msg;
-    gboolean terminateLoop = FALSE;
+    BusDispatcher *dispatcher;
 
     gst_init(NULL, NULL);
+    // uridecodebin picks cachehttpsrc for the trailer URI.
+    httpCacheRegister();
 
     // Create the gst element and empty pipeline
     data.source = gst_element_factory_make("uridecodebin", "source");
@@ -114,57 +148,16 @@ int main()
     }
 
     // Listen to the bus.
-    bus = gst_element_get_bus(data.pipeline);
-    do
-    {
-        msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
-                                         (GstMessageType)(GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
-        if (msg != NULL)
-        {
-            GError *err;
-            gchar *debug_info;
-
-            switch (GST_MESSAGE_TYPE(msg))
-            {
-            case GST_MESSAGE_ERROR:
-            {
-                gst_message_parse_error(msg, &err, &debug_info);
-                gst_printerr("Error Message: \n%s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
-                gst_printerr("Debug Message: \n%s", debug_info ? debug_info : "none");
-                g_clear_error(&err);
-                g_free(debug_info);
-                terminateLoop = TRUE;
-                break;
-            }
-            case GST_MESSAGE_EOS:
-            {
-                cout << "End of stream reached." << endl;
-                terminateLoop = TRUE;
-                break;
-            }
-            case GST_MESSAGE_STATE_CHANGED:
-            {
-                // We are only intererted in state-changed messages from pipeline.
-                if (GST_MESSAGE_SRC(msg) == GST_OBJECT(data.pipeline))
-                {
-                    GstState old_state, new_state, pending_state;
-                    gst_message_parse_state_changed(msg, &old_state, &new_state, &pending_state);
-                    cout << "Pipeline state changed from " << old_state << " to " << new_state << endl;
-                }
-                break;
-            }
-            default:
-            {
-                cout << "Unexpected meesage." << endl;
-                break;
-            }
-            }
-            gst_message_unref(msg);
-        }
-    } while (!terminateLoop);
+    data.loop = g_main_loop_new(NULL, FALSE);
+    dispatcher = busDispatcherNew(data.pipeline, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_STATE_CHANGED, GST_OBJECT(data.pipeline), (BusHandler)onStateChanged, &data);
+    g_main_loop_run(data.loop);
 
     // Deallocate
-    gst_object_unref(bus);
+    busDispatcherFree(dispatcher);
+    g_main_loop_unref(data.loop);
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
     gst_object_unref(data.pipeline);
 
@@ -3,129 +3,160 @@
  * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/time-management.html?gi-language=c
  * @link https://gstreamer.freedesktop.org/documentation/additional/design/seeking.html?gi-language=c
  *
- * In this program, we run a basic Playbin pipeline. We extract the bus messages out of it and process it via a Handler Function.
- * This handler function will run on every bus message. One of the things we can extract out of these bus messages is stream duration.
+ * In this program, we run a basic Playbin pipeline. Its bus messages are delivered by a Bus-Dispatcher.h watch to one
+ * handler per message type, so the main loop sleeps until something actually happens.
+ * One of the things we can extract out of these bus messages is stream duration.
  * We store this info in a custom strcture. We mark the stream duration as Invalid because we want to re-query it.
- * This is important, See handleMessage()'s `case GST_MESSAGE_DURATION` where we do the same.
- * By doing are able to re-query the duration, check if the stream is seekable(i.e. ability to jump to certain duration),
+ * This is important, See onDurationChanged() where we do the same.
+ * The position/duration queries run from a 100 ms timer (onRefresh()) instead of from bus pop timeouts.
+ * There we are able to re-query the duration, check if the stream is seekable(i.e. ability to jump to certain duration),
  * if yes, then we perform a simple seek operation whick skips us to the desired time. *
  */
 
 #include <gst/gst.h>
+#include "Bus-Dispatcher.h"
+#include "Http-Cache.h"
 
 typedef struct
 {
     GstElement *playbin;
-    gboolean isPlaying, isTerminated, isSeekEnabled, isSeekDone;
+    GMainLoop *mainLoop;
+    gboolean isPlaying, isSeekEnabled, isSeekDone;
     gint64 duration;
 
 } CustomData;
 
-/*!
- * @breif  Processes all messages received through the pipeline's bus
- */
-static void handleMessage(CustomData *data, GstMessage *msg)
+static void onError(GstMessage *msg, CustomData *data)
 {
     GError *err;
     gchar *debug_info;
 
-    switch (GST_MESSAGE_TYPE(msg))
-    {
-    case GST_MESSAGE_ERROR:
+    gst_message_parse_error(msg, &err, &debug_info);
+    gst_printerr("\nError Message: %s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
+    gst_printerr("\nDebug Message: \n %s", debug_info ? debug_info : "none");
+    g_clear_error(&err);
+    g_free(debug_info);
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onEos(GstMessage *msg, CustomData *data)
+{
+    g_print("\nReached End of Stream.");
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onDurationChanged(GstMessage *msg, CustomData *data)
+{
+    // The duration has changed, mark the current one as invalid so it gets re-queried later
+    // i.e. in onRefresh()
+    data->duration = GST_CLOCK_TIME_NONE;
+}
+
+/*!
+ * @brief Only registered for state-changed messages from the playbin itself.
+ */
+static void onStateChanged(GstMessage *msg, CustomData *data)
+{
+    GstState oldState, newState, pendingState;
+    gst_message_parse_state_changed(msg, &oldState, &newState, &pendingState);
+    g_print("\nState changed from %s to %s",
+            gst_element_state_get_name(oldState),
+            gst_element_state_get_name(newState));
+
+    data->isPlaying = (newState == GST_STATE_PLAYING);
+
+    // Seeks and time queries generally only get a valid reply when in the PAUSED or PLAYING state.
+    if (data->isPlaying)
     {
-        gst_message_parse_error(msg, &err, &debug_info);
-        gst_printerr("\nError Message: %s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
-        gst_printerr("\nDebug Message: \n %s", debug_info ? debug_info : "none");
-        g_clear_error(&err);
-        g_free(debug_info);
-        data->isTerminated = TRUE;
-        break;
+        GstQuery *query;
+        gint64 start, end;
+
+        // Creating a query object which queries "seeking properties" from stream.
+        // GST_FORMAT_TIME means we are interested in seeking by specifying the new time to which we want to move.
+        query = gst_query_new_seeking(GST_FORMAT_TIME);
+
+        // Perform the query on pipeline
+        if (gst_element_query(data->playbin, query))
+        {
+            gst_query_parse_seeking(query, NULL, &data->isSeekEnabled, &start, &end);
+            if (data->isSeekEnabled)
+            {
+                g_print(
+                    "\nSeeking is enabled from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
+                    GST_TIME_ARGS(start),
+                    GST_TIME_ARGS(end));
+            }
+            else
+            {
+                g_print("\nSeeking is disabled.");
+            }
+        }
+        else
+        {
+            g_print("\nSeeking query failed.");
+        }
+        gst_query_unref(query);
     }
-    case GST_MESSAGE_EOS:
+}
+
+/*!
+ * @brief Timer callback. Prints the position and performs the seek once we are past 10 seconds.
+ */
+static gboolean onRefresh(CustomData *data)
+{
+    if (!data->isPlaying)
     {
-        g_print("\nReached End of Stream.");
-        data->isTerminated = TRUE;
-        break;
+        return G_SOURCE_CONTINUE;
     }
-    case GST_MESSAGE_DURATION:
+
+    gint64 currentPos = -1;
+
+    // Query current position
+    if (!gst_element_query_position(data->playbin, GST_FORMAT_TIME, &currentPos))
     {
-        // The duration has changed, mark the current one as invalid so it gets re-queried later
-        // i.e. "else-part" of the bus listener in main()
-        data->duration = GST_CLOCK_TIME_NONE;
-        break;
+        g_print("\nCouldn't retrive current position");
     }
-    case GST_MESSAGE_STATE_CHANGED:
+
+    // Query stream duration
+    if (!GST_CLOCK_TIME_IS_VALID(data->duration))
     {
-        GstState oldState, newState, pendingState;
-        gst_message_parse_state_changed(msg, &oldState, &newState, &pendingState);
-        // We are only intererted in state-changed messages from pipeline.
-        if (GST_MESSAGE_SRC(msg) == GST_OBJECT(data->playbin))
+        if (!gst_element_query_duration(data->playbin, GST_FORMAT_TIME, &data->duration))
         {
-            g_print("\nState changed from %s to %s",
-                    gst_element_state_get_name(oldState),
-                    gst_element_state_get_name(newState));
-
-            data->isPlaying = (newState == GST_STATE_PLAYING);
-
-            // Seeks and time queries generally only get a valid reply when in the PAUSED or PLAYING state.
-            if (data->isPlaying)
-            {
-                GstQuery *query;
-                gint64 start, end;
-
-                // Creating a query object which queries "seeking properties" from stream.
-                // GST_FORMAT_TIME means we are interested in seeking by specifying the new time to which we want to move.
-                query = gst_query_new_seeking(GST_FORMAT_TIME);
-
-                // Perform the query on pipeline
-                if (gst_element_query(data->playbin, query))
-                {
-                    gst_query_parse_seeking(query, NULL, &data->isSeekEnabled, &start, &end);
-                    if (data->isSeekEnabled)
-                    {
-                        g_print(
-                            "\nSeeking is enabled from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
-                            GST_TIME_ARGS(start),
-                            GST_TIME_ARGS(end));
-                    }
-                    else
-                    {
-                        g_print("\nSeeking is disabled.");
-                    }
-                }
-                else
-                {
-                    g_print("\nSeeking query failed.");
-                }
-                gst_query_unref(query);
-            }
+            g_print("\nCouldn't retrive stream duration.");
         }
-        break;
     }
-    default:
+
+    // If everything is fine, print current position and total stream duration.
+    g_print("\nPosition %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT "\r",
+            GST_TIME_ARGS(currentPos), GST_TIME_ARGS(data->duration));
+    if (data->isSeekEnabled && !data->isSeekDone && currentPos > (10 * GST_SECOND))
     {
-        // We should not reach here
-        g_print("\nUnexpected Message recieved.");
-        break;
+        g_print("\nReached 10s. Performing seek...");
+        gst_element_seek_simple(
+            data->playbin,
+            GST_FORMAT_TIME,
+            (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+            15 * GST_SECOND); // Skip to the 15th second.
+
+        data->isSeekDone = TRUE;
     }
-    }
-    gst_message_unref(msg);
+    return G_SOURCE_CONTINUE;
 }
 
 int main()
 {
     CustomData data;
-    GstBus *bus;
-    GstMessage *msg;
+    BusDispatcher *dispatcher;
     char const *url = "https://www.freedesktop.org/software/gstreamer-sdk/data/media/sintel_trailer-480p.webm";
 
     data.isPlaying = FALSE;
-    data.isTerminated = FALSE;
     data.isSeekEnabled = FALSE;
     data.isSeekDone = FALSE;
     data.duration = GST_CLOCK_TIME_NONE;
 
     gst_init(NULL, NULL);
+    // Seeks back into already played parts read the local cache, not the network.
+    httpCacheRegister();
 
     // Create element
     data.playbin = gst_element_factory_make("playbin", "playbin");
@@ -133,71 +164,31 @@ int main()
     // Set the URL for Playbin
     g_object_set(data.playbin, "uri", url, NULL);
 
+    // Register one handler per message type. State changes are only interesting when they come from the playbin.
+    dispatcher = busDispatcherNew(data.playbin, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_DURATION_CHANGED, NULL, (BusHandler)onDurationChanged, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_STATE_CHANGED, GST_OBJECT(data.playbin), (BusHandler)onStateChanged, &data);
+
+    // Position queries come from a timer, not from bus wake-ups.
+    busDispatcherAddTimer(dispatcher, 100, (GSourceFunc)onRefresh, &data);
+
     // Start playing
     if (gst_element_set_state(data.playbin, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
     {
         g_print("\nFailed to start the plabin.");
+        busDispatcherFree(dispatcher);
         gst_object_unref(data.playbin);
         return -1;
     }
 
-    // Listen to the bus
-    bus = gst_element_get_bus(data.playbin);
-    do
-    {
-        // 100 milli second time out for each bus message.
-        msg = gst_bus_timed_pop_filtered(
-            bus,
-            100 * GST_MSECOND,
-            (GstMessageType)(GST_MESSAGE_STATE_CHANGED | GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_DURATION));
-
-        if (msg != NULL)
-        {
-            handleMessage(&data, msg);
-        }
-        else
-        {
-            // If no message is recieved it means timeout expired i.e. case GST_MESSAGE_DURATION of handleMessage().
-            if (data.isPlaying)
-            {
-                gint64 currentPos = -1;
-
-                // Query current position
-                if (!gst_element_query_position(data.playbin, GST_FORMAT_TIME, &currentPos))
-                {
-                    g_print("\nCouldn't retrive current position");
-                }
-
-                // Query stream duration
-                if (!GST_CLOCK_TIME_IS_VALID(data.duration))
-                {
-                    if (!gst_element_query_duration(data.playbin, GST_FORMAT_TIME, &data.duration))
-                    {
-                        g_print("\nCouldn't retrive stream duration.");
-                    }
-                }
-
-                // If everything is fine, print current position and total stream duration.
-                g_print("\nPosition %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT "\r",
-                        GST_TIME_ARGS(currentPos), GST_TIME_ARGS(data.duration));
-                if (data.isSeekEnabled && !data.isSeekDone && currentPos > (10 * GST_SECOND))
-                {
-                    g_print("\nReached 10s. Performing seek...");
-                    gst_element_seek_simple(
-                        data.playbin,
-                        GST_FORMAT_TIME,
-                        (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
-                        15 * GST_SECOND); // Skip to the 15th second.
-
-                    data.isSeekDone = TRUE;
-                }
-            }
-        }
-
-    } while (!data.isTerminated);
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(data.mainLoop);
 
     // Deallocate
-    gst_object_unref(bus);
+    g_main_loop_unref(data.mainLoop);
+    busDispatcherFree(dispatcher);
     gst_element_set_state(data.playbin, GST_STATE_NULL);
     gst_object_unref(data.playbin);
 
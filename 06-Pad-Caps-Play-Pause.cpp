@@ -1,21 +1,41 @@
 /*!
  * @brief Print Pad caps. The pipeline picks up video from the webcam and saves it in a file.
- * The video can be paused/played during recording.
- * @note Pipeline:- gst-launch-1.0 -e v4l2src device=/dev/video0 io-mode=0 ! capsfilter caps=video/x-raw,format=YUY2,width=320,height=240,framerate=30/1 ! videoconvert ! x264enc ! h264parse ! mp4mux ! filesink location= /home/sagar/Desktop/x.mp4
+ * The recording can be paused/resumed with 'p': Record-Pause.h drops frames in front of the encoder while the camera
+ * and x264enc keep running, so the file has no timestamp gap and continues with a keyframe.
+ * @note Pipeline:- gst-launch-1.0 -e v4l2src device=/dev/video0 io-mode=0 ! capsfilter caps=video/x-raw,format=YUY2,width=320,height=240,framerate=30/1 ! yuy2convert ! x264enc ! h264parse ! mp4mux ! filesink location= /home/sagar/Desktop/x.mp4
+ * @note Usage:- ./06-Pad-Caps-Play-Pause.o [--segment-time=SEC] [--segment-size=MB] [--fragment-ms=MS]
+ * With --segment-time/--segment-size mp4mux ! filesink is replaced by a Segmented-Sink.h splitmuxsink writing
+ * ./test-00000.mp4, ./test-00001.mp4, ... cut on keyframes. --fragment-ms writes fragmented MP4, so the file (or the
+ * last segment) stays playable up to the last fragment if the process dies.
  * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/media-formats-and-pad-capabilities.html?gi-language=c
  */
 
 #include <gst/gst.h>
 #include <stdio.h>
+#include "Latency-Tracer.h"
+#include "Record-Pause.h"
+#include "Segmented-Sink.h"
+#include "Yuy2-Convert.h"
 
 typedef struct
 {
     GstElement *pipeline, *source, *capsFilter, *converter, *encoder, *parser, *mux, *sink;
     GstElementFactory *sourceFactory, *capsFilterFactory, *converterFactory, *encoderFactory, *parserFactory, *muxFactory, *sinkFactory;
     GMainLoop *mainLoop;
-    gboolean playing;
+    LatencyTracer *tracer;
+    RecordPause *recordPause;
 } CustomData;
 
+static gint segmentTime = 0;
+static gint segmentSize = 0;
+static gint fragmentMs = 0;
+
+static GOptionEntry entries[] = {
+    {"segment-time", 't', 0, G_OPTION_ARG_INT, &segmentTime, "Start a new file every SEC seconds", "SEC"},
+    {"segment-size", 'z', 0, G_OPTION_ARG_INT, &segmentSize, "Start a new file every MB megabytes", "MB"},
+    {"fragment-ms", 'f', 0, G_OPTION_ARG_INT, &fragmentMs, "Write fragmented MP4 with fragments of MS milliseconds", "MS"},
+    {NULL}};
+
 /* ======= Helper functions picked up from site ==========*/
 
 /* Functions below print the Capabilities in a human-friendly format */
@@ -145,13 +165,10 @@ static gboolean handleKeyboard(GIOChannel *source, GIOCondition cond, CustomData
     {
     case 'p':
     {
-        if (gst_element_set_state(data->pipeline, data->playing ? GST_STATE_PAUSED : GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
-        {
-            g_print("\nFailed to pause/play the pipeline");
-            return FALSE;
-        }
-        data->playing = !data->playing;
-        g_print("\nSettings pipeline to %s", data->playing ? "playing" : "paused.");
+        // The pipeline stays in PLAYING, only the frames going into the encoder are dropped.
+        gboolean paused = !recordPauseIsPaused(data->recordPause);
+        recordPauseSet(data->recordPause, paused);
+        g_print("\nRecording %s", paused ? "paused." : "resumed.");
         break;
     }
     case 's':
@@ -192,6 +209,8 @@ static gboolean busCallBack(GstBus *bus, GstMessage *message, gpointer data)
     case GST_MESSAGE_EOS:
     {
         gst_printerr("\nReached End of the stream.");
+        latencyTracerPrint(dataPtr->tracer);
+        recordPausePrint(dataPtr->recordPause);
         g_main_loop_quit(dataPtr->mainLoop);
         break;
     }
@@ -208,6 +227,20 @@ static gboolean busCallBack(GstBus *bus, GstMessage *message, gpointer data)
         }
         break;
     }
+    case GST_MESSAGE_ELEMENT:
+    {
+        // Periodic per-element latency posted by the tracer, or a finished segment.
+        const GstStructure *structure = gst_message_get_structure(message);
+        if (segmentedSinkHandleMessage(message))
+        {
+            break;
+        }
+        if (gst_structure_has_name(structure, "latency-tracer"))
+        {
+            latencyTracerPrintStructure(structure);
+        }
+        break;
+    }
 
     default:
     {
@@ -219,17 +252,32 @@ static gboolean busCallBack(GstBus *bus, GstMessage *message, gpointer data)
     return TRUE; // https://github1s.com/GStreamer/gst-docs/blob/master/examples/bus_example.c#L36-L37
 }
 
-int main()
+int main(int argc, char **argv)
 {
     CustomData data;
     GIOChannel *ioStdin;
+    GError *err = NULL;
 
-    gst_init(NULL, NULL);
+    GOptionContext *context = g_option_context_new("- record the webcam");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    gboolean segmented = segmentTime > 0 || segmentSize > 0;
+
+    // yuy2convert (Yuy2-Convert.h) is registered by this program and replaces videoconvert for YUY2 -> I420.
+    yuy2ConvertRegister();
 
     // Create FACTORY ELEMENT not the actual element
     data.sourceFactory = gst_element_factory_find("v4l2src");
     data.capsFilterFactory = gst_element_factory_find("capsfilter");
-    data.converterFactory = gst_element_factory_find("videoconvert");
+    data.converterFactory = gst_element_factory_find("yuy2convert");
     data.encoderFactory = gst_element_factory_find("x264enc");
     data.parserFactory = gst_element_factory_find("h264parse");
     data.muxFactory = gst_element_factory_find("mp4mux");
@@ -254,8 +302,11 @@ int main()
     data.converter = gst_element_factory_create(data.converterFactory, NULL);
     data.encoder = gst_element_factory_create(data.encoderFactory, NULL);
     data.parser = gst_element_factory_create(data.parserFactory, NULL);
-    data.mux = gst_element_factory_create(data.muxFactory, NULL);
-    data.sink = gst_element_factory_create(data.sinkFactory, NULL);
+    // splitmuxsink brings its own mp4mux and filesink.
+    data.mux = segmented ? NULL : gst_element_factory_create(data.muxFactory, NULL);
+    data.sink = segmented ? segmentedSinkNew("./test-%05d.mp4", (guint64)segmentTime * GST_SECOND,
+                                             (guint64)segmentSize * 1024 * 1024, fragmentMs)
+                          : gst_element_factory_create(data.sinkFactory, NULL);
     data.pipeline = gst_pipeline_new("test_pipeline");
     if (
         !data.source ||
@@ -263,7 +314,7 @@ int main()
         !data.converter ||
         !data.encoder ||
         !data.parser ||
-        !data.mux ||
+        (!data.mux && !segmented) ||
         !data.sink ||
         !data.pipeline)
     {
@@ -287,17 +338,46 @@ int main()
     g_object_set(data.source, "io-mode", 0, NULL);
     g_object_set(data.capsFilter, "caps", caps, NULL); //
     // g_object_set(data.encoder, "bitrate", 8000, NULL);
-    g_object_set(data.sink, "location", "./test.mp4", NULL);
+    if (!segmented)
+    {
+        g_object_set(data.sink, "location", "./test.mp4", NULL);
+        if (fragmentMs > 0)
+        {
+            g_object_set(data.mux, "fragment-duration", fragmentMs, NULL);
+        }
+    }
 
     // Build the pipeline by adding them in a group(GstBin) and linking them.
-    gst_bin_add_many(GST_BIN(data.pipeline), data.source, data.capsFilter, data.converter, data.encoder, data.parser, data.mux, data.sink, NULL);
-    if (gst_element_link_many(data.source, data.capsFilter, data.converter, data.encoder, data.parser, data.mux, data.sink, NULL) == FALSE)
+    gst_bin_add_many(GST_BIN(data.pipeline), data.source, data.capsFilter, data.converter, data.encoder, data.parser, data.sink, NULL);
+    gboolean linked = gst_element_link_many(data.source, data.capsFilter, data.converter, data.encoder, data.parser, NULL);
+    if (segmented)
+    {
+        // Requests splitmuxsink's "video" pad.
+        linked = linked && gst_element_link(data.parser, data.sink);
+    }
+    else
+    {
+        gst_bin_add(GST_BIN(data.pipeline), data.mux);
+        linked = linked && gst_element_link_many(data.parser, data.mux, data.sink, NULL);
+    }
+    if (!linked)
     {
         gst_printerr("\nFailed to link the pipeline.");
         gst_object_unref(data.pipeline);
         return -1;
     }
 
+    data.recordPause = recordPauseAttach(data.converter, data.encoder);
+    if (!data.recordPause)
+    {
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+
+    // Trace how long every element holds a buffer, and report it every 5 seconds.
+    data.tracer = latencyTracerAttach(GST_BIN(data.pipeline));
+    latencyTracerStartPeriodic(data.tracer, 5000);
+
     // Setting up a keyboard watch so we get notified of keystrokes
     ioStdin = g_io_channel_unix_new(fileno(stdin));
     g_io_add_watch(ioStdin, G_IO_IN, (GIOFunc)handleKeyboard, &data);
@@ -314,7 +394,6 @@ int main()
         gst_object_unref(data.pipeline);
         return -1;
     }
-    data.playing = TRUE;
 
     // Create a GLib Main Loop and set it to run. This is for Bus Message handler.
     data.mainLoop = g_main_loop_new(NULL, FALSE);
@@ -324,6 +403,8 @@ int main()
     g_io_channel_unref(ioStdin);
     gst_object_unref(bus);
     gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    latencyTracerFree(data.tracer);
+    recordPauseFree(data.recordPause);
     gst_object_unref(data.pipeline);
 
     return 0;
@@ -1,16 +1,19 @@
 /*!
  * @brief Worked with "On Request Pad" instead of "Always available" and did manual linking of those pads.
  * Added multi threading by introducing Queue elements.
+ * The scope is waveformscope (Waveform-Scope.h) instead of wavescope, it outputs a format the video sink takes, so the
+ * branch needs no videoconvert.
  * @note Refer diagram on the tutorials page. Straight forward pipeline.
  * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/multithreading-and-pad-availability.html?gi-language=c
  */
 
 #include <gst/gst.h>
+#include "Waveform-Scope.h"
 
 typedef struct
 {
     GstElement *pipeline, *audioSource, *tee, *audioQueue, *audioConvert, *audioResample, *audioSink;
-    GstElement *videoQueue, *visualizer, *videoConvert, *videoSink;
+    GstElement *videoQueue, *visualizer, *videoSink;
     GstPad *teeAudioPad, *teeVideoPad;
     GstPad *queueAudioPad, *queueVideoPad;
 
@@ -21,6 +24,7 @@ int main()
     CustomData data;
 
     gst_init(NULL, NULL);
+    waveformScopeRegister();
 
     // Create Elements
     data.audioSource = gst_element_factory_make("audiotestsrc", NULL);
@@ -30,8 +34,7 @@ int main()
     data.audioResample = gst_element_factory_make("audioresample", NULL);
     data.audioSink = gst_element_factory_make("autoaudiosink", NULL);
     data.videoQueue = gst_element_factory_make("queue", NULL);
-    data.visualizer = gst_element_factory_make("wavescope", NULL);
-    data.videoConvert = gst_element_factory_make("videoconvert", NULL);
+    data.visualizer = gst_element_factory_make("waveformscope", NULL);
     data.videoSink = gst_element_factory_make("autovideosink", NULL);
 
     // Create empty pipeline
@@ -45,7 +48,6 @@ int main()
         !data.audioSink ||
         !data.videoQueue ||
         !data.visualizer ||
-        !data.videoConvert ||
         !data.videoSink)
     {
         gst_printerr("\nFailed to make one of the GST elements.");
@@ -54,7 +56,6 @@ int main()
 
     // Set element properties
     g_object_set(data.audioSource, "freq", 235.0f, NULL);
-    g_object_set(data.visualizer, "shader", 0, NULL);
 
     // Add to elements to bin
     gst_bin_add_many(GST_BIN(data.pipeline),
@@ -66,14 +67,13 @@ int main()
                      data.audioSink,
                      data.videoQueue,
                      data.visualizer,
-                     data.videoConvert,
                      data.videoSink,
                      NULL);
 
     // #00 Link "Always Avialable" elements.
     if (!gst_element_link_many(data.audioSource, data.tee, NULL) ||
         !gst_element_link_many(data.audioQueue, data.audioConvert, data.audioResample, data.audioSink, NULL) ||
-        !gst_element_link_many(data.videoQueue, data.visualizer, data.videoConvert, data.videoSink, NULL))
+        !gst_element_link_many(data.videoQueue, data.visualizer, data.videoSink, NULL))
     {
         gst_printerr("\nUnable to link 'Always Avialable' GST Elements");
         gst_object_unref(data.pipeline);
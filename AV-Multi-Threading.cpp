@@ -1,14 +1,26 @@
 #include <gst/gst.h>
+#include <glib-unix.h>
+#include <atomic>
+#include "Yuy2-Convert.h"
 /*!
     Implement interpipes. Make a sophisticated pipeline. Here is a webcam recording pipeline (with audio)
     gst-launch-1.0 -e
-    v4l2src device=/dev/video2 ! queue ! videoconvert ! x264enc tune=zerolatency ! h264parse ! mux.
+    v4l2src device=/dev/video2 ! queue ! yuy2convert ! x264enc tune=zerolatency ! h264parse ! mux.
     alsasrc device="hw:2,0" ! queue ! audioconvert ! avenc_aac ! mp4mux name=mux !
     filesink location=/home/sagar/Desktop/a.mp4
+
+    The queues split the pipeline in three streaming threads: capture, video encoding and audio encoding.
+    Both branches join again in mp4mux.
+    Queue limits and leaky mode are configurable so the queues can be sized for minimum latency.
+    Dropped buffers, underruns and the A/V drift at the muxer are reported every second.
+
+    Usage:- ./AV-Multi-Threading.o --test-sources --duration=10 --max-time=200 --leaky=downstream
  */
+
 typedef struct
 {
     GstElement *pipeline, *videoSource, *audioSource;
+    GstElement *videoCapsFilter, *audioCapsFilter;
     GstElement *videoQueue, *videoConvert, *videoEncoder, *videoParser;
     GstElement *audioQueue, *audioConvert, *audioEncoder, *audioVideoMuxer;
     GstElement *fileSink;
@@ -16,17 +28,352 @@ typedef struct
     GstPad *queueAudioPad;
     GstPad *queueVideoPad;
 
-    GMainLoop mainLoop;
+    GMainLoop *mainLoop;
+
+    // Updated from the streaming threads.
+    gint videoIn, videoOut, audioIn, audioOut;
+    gint videoUnderruns, audioUnderruns;
+    std::atomic<gint64> lastVideoPts, lastAudioPts;
 } CustomData;
 
-int main()
+// Command line options
+static gchar *videoDevice = (gchar *)"/dev/video0";
+static gchar *audioDevice = NULL;
+static gchar *outputLocation = (gchar *)"./av.mp4";
+static gchar *leakyMode = (gchar *)"none";
+static gboolean useTestSources = FALSE;
+static gint maxBuffers = 200;
+static gint maxBytes = 10 * 1024 * 1024;
+static gint maxTimeMs = 1000;
+static gint durationSec = 0;
+
+static GOptionEntry entries[] = {
+    {"video-device", 0, 0, G_OPTION_ARG_STRING, &videoDevice, "v4l2 device", "PATH"},
+    {"audio-device", 0, 0, G_OPTION_ARG_STRING, &audioDevice, "ALSA device e.g. hw:2,0", "NAME"},
+    {"output", 'o', 0, G_OPTION_ARG_STRING, &outputLocation, "Output mp4 file", "PATH"},
+    {"test-sources", 't', 0, G_OPTION_ARG_NONE, &useTestSources, "Use videotestsrc/audiotestsrc (headless)", NULL},
+    {"max-buffers", 0, 0, G_OPTION_ARG_INT, &maxBuffers, "Queue limit in buffers (0 = unlimited)", "N"},
+    {"max-bytes", 0, 0, G_OPTION_ARG_INT, &maxBytes, "Queue limit in bytes (0 = unlimited)", "N"},
+    {"max-time", 0, 0, G_OPTION_ARG_INT, &maxTimeMs, "Queue limit in milliseconds (0 = unlimited)", "MS"},
+    {"leaky", 0, 0, G_OPTION_ARG_STRING, &leakyMode, "Queue leaky mode: none, upstream or downstream", "MODE"},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &durationSec, "Stop after this many seconds (0 = run until Ctrl+C)", "SEC"},
+    {NULL}};
+
+/*!
+ * @brief Creates the live source on device (NULL for the default one), falling back to the test source if the device
+ * plugin is not available or the device can't be opened.
+ */
+static GstElement *makeSource(const gchar *liveFactory, const gchar *device, const gchar *testFactory)
+{
+    GstElement *source = NULL;
+    if (!useTestSources)
+    {
+        source = gst_element_factory_make(liveFactory, NULL);
+        if (!source)
+        {
+            g_print("\n%s is not available, falling back to %s.", liveFactory, testFactory);
+        }
+    }
+    if (source)
+    {
+        if (device && g_object_class_find_property(G_OBJECT_GET_CLASS(source), "device"))
+        {
+            g_object_set(source, "device", device, NULL);
+        }
+        // Capture sources open the device on NULL -> READY, so a missing or busy device fails here.
+        gboolean opened = gst_element_set_state(source, GST_STATE_READY) != GST_STATE_CHANGE_FAILURE;
+        gst_element_set_state(source, GST_STATE_NULL);
+        if (!opened)
+        {
+            g_print("\n%s can't open %s, falling back to %s.", liveFactory, device ? device : "the default device",
+                    testFactory);
+            gst_object_unref(gst_object_ref_sink(source));
+            source = NULL;
+        }
+    }
+    if (!source)
+    {
+        source = gst_element_factory_make(testFactory, NULL);
+        if (source)
+        {
+            // Behave like a capture device so leaky queues actually drop.
+            g_object_set(source, "is-live", TRUE, NULL);
+        }
+    }
+    return source;
+}
+
+/*!
+ * @brief The first AAC encoder we find. avenc_aac is not installed everywhere.
+ */
+static GstElement *makeAudioEncoder()
+{
+    const gchar *candidates[] = {"avenc_aac", "fdkaacenc", "voaacenc", "faac"};
+    for (const gchar *name : candidates)
+    {
+        GstElement *encoder = gst_element_factory_make(name, NULL);
+        if (encoder)
+        {
+            return encoder;
+        }
+    }
+    return NULL;
+}
+
+static void configureQueue(GstElement *queue)
+{
+    g_object_set(queue,
+                 "max-size-buffers", (guint)maxBuffers,
+                 "max-size-bytes", (guint)maxBytes,
+                 "max-size-time", (guint64)maxTimeMs * GST_MSECOND,
+                 NULL);
+    gst_util_set_object_arg(G_OBJECT(queue), "leaky", leakyMode);
+}
+
+static GstPadProbeReturn onQueueIn(GstPad *pad, GstPadProbeInfo *info, gint *counter)
+{
+    g_atomic_int_inc(counter);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn onQueueOut(GstPad *pad, GstPadProbeInfo *info, gint *counter)
+{
+    g_atomic_int_inc(counter);
+    return GST_PAD_PROBE_OK;
+}
+
+static void onVideoUnderrun(GstElement *queue, CustomData *data)
+{
+    g_atomic_int_inc(&data->videoUnderruns);
+}
+
+static void onAudioUnderrun(GstElement *queue, CustomData *data)
+{
+    g_atomic_int_inc(&data->audioUnderruns);
+}
+
+// Remember the running time of the last buffer each branch delivered to the muxer.
+static GstPadProbeReturn onMuxVideo(GstPad *pad, GstPadProbeInfo *info, CustomData *data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        data->lastVideoPts = (gint64)GST_BUFFER_PTS(buffer);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn onMuxAudio(GstPad *pad, GstPadProbeInfo *info, CustomData *data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        data->lastAudioPts = (gint64)GST_BUFFER_PTS(buffer);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Dropped = went into the queue - came out - still queued.
+ */
+static gint droppedBuffers(GstElement *queue, gint in, gint out)
+{
+    guint level = 0;
+    g_object_get(queue, "current-level-buffers", &level, NULL);
+    return MAX(0, in - out - (gint)level);
+}
+
+static gboolean printStats(CustomData *data)
+{
+    gint64 videoPts = data->lastVideoPts;
+    gint64 audioPts = data->lastAudioPts;
+
+    g_print("\nvideo: dropped %d underruns %d | audio: dropped %d underruns %d | A/V drift %.1f ms",
+            droppedBuffers(data->videoQueue, g_atomic_int_get(&data->videoIn), g_atomic_int_get(&data->videoOut)),
+            g_atomic_int_get(&data->videoUnderruns),
+            droppedBuffers(data->audioQueue, g_atomic_int_get(&data->audioIn), g_atomic_int_get(&data->audioOut)),
+            g_atomic_int_get(&data->audioUnderruns),
+            (videoPts >= 0 && audioPts >= 0) ? (videoPts - audioPts) / (gdouble)GST_MSECOND : 0.0);
+    return TRUE;
+}
+
+// Stop the recording with EOS so mp4mux can write its moov atom. Used for --duration and Ctrl+C.
+static gboolean sendEos(CustomData *data)
+{
+    g_print("\nStopping the recording.");
+    gst_element_send_event(data->pipeline, gst_event_new_eos());
+    return FALSE;
+}
+
+static gboolean busCallBack(GstBus *bus, GstMessage *message, CustomData *data)
+{
+    switch (GST_MESSAGE_TYPE(message))
+    {
+    case GST_MESSAGE_ERROR:
+    {
+        GError *err;
+        gchar *debugInfo;
+        gst_message_parse_error(message, &err, &debugInfo);
+        gst_printerr("\nError from %s: %s", GST_OBJECT_NAME(message->src), err->message);
+        g_free(debugInfo);
+        g_clear_error(&err);
+        g_main_loop_quit(data->mainLoop);
+        break;
+    }
+    case GST_MESSAGE_EOS:
+    {
+        g_print("\nReached End of the stream.");
+        g_main_loop_quit(data->mainLoop);
+        break;
+    }
+    default:
+        break;
+    }
+    return TRUE;
+}
+
+int main(int argc, char **argv)
 {
     CustomData data;
+    GError *err = NULL;
 
-    gst_init(NULL, NULL);
+    GOptionContext *context = g_option_context_new("- record audio and video to mp4");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\nFailed to parse options: %s", err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+    g_option_context_free(context);
+    const gchar *leakyModes[] = {"none", "upstream", "downstream", NULL};
+    if (!g_strv_contains(leakyModes, leakyMode))
+    {
+        gst_printerr("\nInvalid --leaky value %s, expected none, upstream or downstream.", leakyMode);
+        return -1;
+    }
+
+    data.videoIn = data.videoOut = data.audioIn = data.audioOut = 0;
+    data.videoUnderruns = data.audioUnderruns = 0;
+    data.lastVideoPts = data.lastAudioPts = -1;
 
     GstCaps *videoCaps = gst_caps_from_string("video/x-raw, format=YUY2, width=640, height=480");
     GstCaps *audioCaps = gst_caps_from_string("audio/x-raw, format=S16, rate=44100, channels=1");
 
+    // Create elements
+    data.videoSource = makeSource("v4l2src", videoDevice, "videotestsrc");
+    data.audioSource = makeSource("alsasrc", audioDevice, "audiotestsrc");
+    data.videoCapsFilter = gst_element_factory_make("capsfilter", NULL);
+    data.audioCapsFilter = gst_element_factory_make("capsfilter", NULL);
+    data.videoQueue = gst_element_factory_make("queue", "videoQueue");
+    // The capture caps are YUY2 and x264enc wants 4:2:0, which is all yuy2convert does.
+    yuy2ConvertRegister();
+    data.videoConvert = gst_element_factory_make("yuy2convert", NULL);
+    data.videoEncoder = gst_element_factory_make("x264enc", NULL);
+    data.videoParser = gst_element_factory_make("h264parse", NULL);
+    data.audioQueue = gst_element_factory_make("queue", "audioQueue");
+    data.audioConvert = gst_element_factory_make("audioconvert", NULL);
+    data.audioEncoder = makeAudioEncoder();
+    data.audioVideoMuxer = gst_element_factory_make("mp4mux", NULL);
+    data.fileSink = gst_element_factory_make("filesink", NULL);
+    data.pipeline = gst_pipeline_new("av-pipeline");
+
+    if (!data.videoSource || !data.audioSource ||
+        !data.videoCapsFilter || !data.audioCapsFilter ||
+        !data.videoQueue || !data.videoConvert || !data.videoEncoder || !data.videoParser ||
+        !data.audioQueue || !data.audioConvert || !data.audioEncoder ||
+        !data.audioVideoMuxer || !data.fileSink || !data.pipeline)
+    {
+        gst_printerr("\nFailed to make one of the GST elements.");
+        return -1;
+    }
+
+    // Set element properties
+    g_object_set(data.videoCapsFilter, "caps", videoCaps, NULL);
+    g_object_set(data.audioCapsFilter, "caps", audioCaps, NULL);
+    gst_util_set_object_arg(G_OBJECT(data.videoEncoder), "tune", "zerolatency");
+    g_object_set(data.fileSink, "location", outputLocation, NULL);
+    gst_caps_unref(videoCaps);
+    gst_caps_unref(audioCaps);
+
+    configureQueue(data.videoQueue);
+    configureQueue(data.audioQueue);
+    g_signal_connect(data.videoQueue, "underrun", G_CALLBACK(onVideoUnderrun), &data);
+    g_signal_connect(data.audioQueue, "underrun", G_CALLBACK(onAudioUnderrun), &data);
+
+    gst_bin_add_many(GST_BIN(data.pipeline),
+                     data.videoSource, data.videoCapsFilter, data.videoQueue, data.videoConvert,
+                     data.videoEncoder, data.videoParser,
+                     data.audioSource, data.audioCapsFilter, data.audioQueue, data.audioConvert,
+                     data.audioEncoder,
+                     data.audioVideoMuxer, data.fileSink,
+                     NULL);
+
+    // Each branch links into its own request pad of mp4mux.
+    if (!gst_element_link_many(data.videoSource, data.videoCapsFilter, data.videoQueue, data.videoConvert,
+                               data.videoEncoder, data.videoParser, data.audioVideoMuxer, NULL) ||
+        !gst_element_link_many(data.audioSource, data.audioCapsFilter, data.audioQueue, data.audioConvert,
+                               data.audioEncoder, data.audioVideoMuxer, NULL) ||
+        !gst_element_link(data.audioVideoMuxer, data.fileSink))
+    {
+        gst_printerr("\nFailed to link the pipeline.");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+
+    // Count buffers in and out of both queues to work out how many a leaky queue dropped.
+    data.queueVideoPad = gst_element_get_static_pad(data.videoQueue, "sink");
+    data.queueAudioPad = gst_element_get_static_pad(data.audioQueue, "sink");
+    gst_pad_add_probe(data.queueVideoPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onQueueIn, &data.videoIn, NULL);
+    gst_pad_add_probe(data.queueAudioPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onQueueIn, &data.audioIn, NULL);
+
+    GstPad *pad = gst_element_get_static_pad(data.videoQueue, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onQueueOut, &data.videoOut, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(data.audioQueue, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onQueueOut, &data.audioOut, NULL);
+    gst_object_unref(pad);
+
+    // Watch what actually arrives at the muxer to measure the drift between the branches.
+    pad = gst_element_get_static_pad(data.videoParser, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onMuxVideo, &data, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(data.audioEncoder, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onMuxAudio, &data, NULL);
+    gst_object_unref(pad);
+
+    GstBus *bus = gst_element_get_bus(data.pipeline);
+    gst_bus_add_watch(bus, (GstBusFunc)busCallBack, &data);
+
+    if (gst_element_set_state(data.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the pipeline.");
+        gst_object_unref(bus);
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+
+    g_timeout_add_seconds(1, (GSourceFunc)printStats, &data);
+    if (durationSec > 0)
+    {
+        g_timeout_add_seconds(durationSec, (GSourceFunc)sendEos, &data);
+    }
+    g_unix_signal_add(SIGINT, (GSourceFunc)sendEos, &data);
+
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(data.mainLoop);
+
+    printStats(&data);
+    g_print("\n");
+
+    // Dereference
+    g_main_loop_unref(data.mainLoop);
+    gst_object_unref(data.queueVideoPad);
+    gst_object_unref(data.queueAudioPad);
+    gst_object_unref(bus);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    gst_object_unref(data.pipeline);
+
     return 0;
-}
\ No newline at end of file
+}
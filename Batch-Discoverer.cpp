@@ -0,0 +1,457 @@
+/*!
+ * @brief Batch version of 09-Discoverer. Indexes a whole media library with one GstDiscoverer per core.
+ * @note Usage:- ./Batch-Discoverer.o <directory | list-file> [--jobs=N] [--timeout=SEC] [--queue=N] [--cache=FILE]
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/media-information-gathering.html?gi-language=c
+ *
+ * A producer thread walks the directory (or reads the list file, one path or URI per line) and pushes URIs into a
+ * bounded work queue, so tens of thousands of files never sit in memory at once.
+ * Every worker thread owns a GstDiscoverer and runs it synchronously. The discoverer's own timeout makes sure one
+ * slow or broken file only costs its worker `timeout` seconds.
+ *
+ * Output is one JSON object per file on stdout (codecs, resolution, framerate, bitrate, tags, seekability).
+ * The summary with files/second goes to stderr.
+ *
+ * With --cache, results of unchanged files come from a Discovery-Cache.h file instead, so a nightly rescan of an
+ * unchanged library costs a stat() per file.
+ */
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include "Discovery-Cache.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct
+{
+    // Bounded work queue
+    std::mutex lock;
+    std::condition_variable notEmpty, notFull;
+    std::deque<std::string> uris;
+    size_t capacity;
+    gboolean producerDone;
+
+    // Output and counters, guarded by outputLock.
+    std::mutex outputLock;
+    guint ok, failed, timeouts;
+
+    DiscoveryCache *cache;
+} CustomData;
+
+static gint jobs = 0;
+static gint timeoutSec = 10;
+static gint queueSize = 256;
+static gchar *cacheLocation = NULL;
+static gboolean hashContent = FALSE;
+static gboolean refresh = FALSE;
+static gboolean compact = FALSE;
+
+static GOptionEntry entries[] = {
+    {"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of discoverer threads (default: number of cores)", "N"},
+    {"timeout", 't', 0, G_OPTION_ARG_INT, &timeoutSec, "Per-file timeout in seconds", "SEC"},
+    {"queue", 'q', 0, G_OPTION_ARG_INT, &queueSize, "Work queue capacity", "N"},
+    {"cache", 'c', 0, G_OPTION_ARG_FILENAME, &cacheLocation, "Discovery cache file", "FILE"},
+    {"hash-content", 0, 0, G_OPTION_ARG_NONE, &hashContent, "Also key the cache on a hash of each file's head and tail", NULL},
+    {"refresh", 0, 0, G_OPTION_ARG_NONE, &refresh, "Invalidate the cached entry of every input file and rediscover it", NULL},
+    {"compact", 0, 0, G_OPTION_ARG_NONE, &compact, "Rewrite the cache file without stale records when done", NULL},
+    {NULL}};
+
+/* ======= Work queue ==========*/
+
+static void pushUri(CustomData *data, const std::string &uri)
+{
+    std::unique_lock<std::mutex> guard(data->lock);
+    data->notFull.wait(guard, [data]
+                       { return data->uris.size() < data->capacity; });
+    data->uris.push_back(uri);
+    data->notEmpty.notify_one();
+}
+
+// Returns FALSE once the producer is done and the queue is drained.
+static gboolean popUri(CustomData *data, std::string &uri)
+{
+    std::unique_lock<std::mutex> guard(data->lock);
+    data->notEmpty.wait(guard, [data]
+                        { return !data->uris.empty() || data->producerDone; });
+    if (data->uris.empty())
+    {
+        return FALSE;
+    }
+    uri = data->uris.front();
+    data->uris.pop_front();
+    data->notFull.notify_one();
+    return TRUE;
+}
+
+/* ======= Producer ==========*/
+
+static void pushPath(CustomData *data, const gchar *path)
+{
+    if (gst_uri_is_valid(path))
+    {
+        pushUri(data, path);
+        return;
+    }
+
+    gchar *uri = gst_filename_to_uri(path, NULL);
+    if (uri)
+    {
+        pushUri(data, uri);
+        g_free(uri);
+    }
+}
+
+static void walkDirectory(CustomData *data, const gchar *directory)
+{
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (!dir)
+    {
+        return;
+    }
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL)
+    {
+        gchar *path = g_build_filename(directory, name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_SYMLINK))
+        {
+            // Don't follow links, they can loop.
+        }
+        else if (g_file_test(path, G_FILE_TEST_IS_DIR))
+        {
+            walkDirectory(data, path);
+        }
+        else if (g_file_test(path, G_FILE_TEST_IS_REGULAR))
+        {
+            pushPath(data, path);
+        }
+        g_free(path);
+    }
+    g_dir_close(dir);
+}
+
+static void readListFile(CustomData *data, const gchar *listFile)
+{
+    GIOChannel *channel = g_io_channel_new_file(listFile, "r", NULL);
+    if (!channel)
+    {
+        gst_printerr("\nFailed to open list file %s", listFile);
+        return;
+    }
+
+    gchar *line = NULL;
+    while (g_io_channel_read_line(channel, &line, NULL, NULL, NULL) == G_IO_STATUS_NORMAL)
+    {
+        g_strstrip(line);
+        if (line[0] != '\0' && line[0] != '#')
+        {
+            pushPath(data, line);
+        }
+        g_free(line);
+    }
+    g_io_channel_unref(channel);
+}
+
+static void producer(CustomData *data, const gchar *input)
+{
+    if (g_file_test(input, G_FILE_TEST_IS_DIR))
+        walkDirectory(data, input);
+    else
+        readListFile(data, input);
+
+    std::lock_guard<std::mutex> guard(data->lock);
+    data->producerDone = TRUE;
+    data->notEmpty.notify_all();
+}
+
+/* ======= JSON output ==========*/
+
+static void appendJsonString(GString *out, const gchar *str)
+{
+    g_string_append_c(out, '"');
+    for (const gchar *p = str ? str : ""; *p; p++)
+    {
+        switch (*p)
+        {
+        case '"':
+            g_string_append(out, "\\\"");
+            break;
+        case '\\':
+            g_string_append(out, "\\\\");
+            break;
+        case '\n':
+            g_string_append(out, "\\n");
+            break;
+        case '\t':
+            g_string_append(out, "\\t");
+            break;
+        default:
+            if ((guchar)*p < 0x20)
+                g_string_append_printf(out, "\\u%04x", (guchar)*p);
+            else
+                g_string_append_c(out, *p);
+            break;
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+static void appendTag(const GstTagList *tags, const gchar *tag, gpointer userData)
+{
+    GString *out = (GString *)userData;
+    const GValue *value = gst_tag_list_get_value_index(tags, tag, 0);
+    gchar *str = G_VALUE_HOLDS_STRING(value) ? g_value_dup_string(value) : gst_value_serialize(value);
+
+    if (out->str[out->len - 1] != '{')
+    {
+        g_string_append(out, ", ");
+    }
+    appendJsonString(out, tag);
+    g_string_append(out, ": ");
+    appendJsonString(out, str);
+    g_free(str);
+}
+
+static void appendTags(GString *out, const GstTagList *tags)
+{
+    g_string_append(out, "{");
+    if (tags)
+    {
+        gst_tag_list_foreach(tags, appendTag, out);
+    }
+    g_string_append(out, "}");
+}
+
+static void appendStream(GString *out, GstDiscovererStreamInfo *stream)
+{
+    GstCaps *caps = gst_discoverer_stream_info_get_caps(stream);
+    gchar *codec = caps ? gst_pb_utils_get_codec_description(caps) : NULL;
+    gchar *capsStr = caps ? gst_caps_to_string(caps) : NULL;
+
+    g_string_append(out, "{\"type\": ");
+    appendJsonString(out, gst_discoverer_stream_info_get_stream_type_nick(stream));
+    g_string_append(out, ", \"codec\": ");
+    appendJsonString(out, codec);
+    g_string_append(out, ", \"caps\": ");
+    appendJsonString(out, capsStr);
+
+    if (GST_IS_DISCOVERER_VIDEO_INFO(stream))
+    {
+        GstDiscovererVideoInfo *video = GST_DISCOVERER_VIDEO_INFO(stream);
+        g_string_append_printf(out, ", \"width\": %u, \"height\": %u, \"framerate\": \"%u/%u\", \"bitrate\": %u",
+                               gst_discoverer_video_info_get_width(video),
+                               gst_discoverer_video_info_get_height(video),
+                               gst_discoverer_video_info_get_framerate_num(video),
+                               gst_discoverer_video_info_get_framerate_denom(video),
+                               gst_discoverer_video_info_get_bitrate(video));
+    }
+    else if (GST_IS_DISCOVERER_AUDIO_INFO(stream))
+    {
+        GstDiscovererAudioInfo *audio = GST_DISCOVERER_AUDIO_INFO(stream);
+        g_string_append_printf(out, ", \"channels\": %u, \"rate\": %u, \"bitrate\": %u",
+                               gst_discoverer_audio_info_get_channels(audio),
+                               gst_discoverer_audio_info_get_sample_rate(audio),
+                               gst_discoverer_audio_info_get_bitrate(audio));
+    }
+
+    g_string_append(out, ", \"tags\": ");
+    appendTags(out, gst_discoverer_stream_info_get_tags(stream));
+    g_string_append(out, "}");
+
+    g_free(codec);
+    g_free(capsStr);
+    if (caps)
+    {
+        gst_caps_unref(caps);
+    }
+}
+
+static const gchar *resultName(GstDiscovererResult result)
+{
+    switch (result)
+    {
+    case GST_DISCOVERER_OK:
+        return "ok";
+    case GST_DISCOVERER_URI_INVALID:
+        return "uri-invalid";
+    case GST_DISCOVERER_ERROR:
+        return "error";
+    case GST_DISCOVERER_TIMEOUT:
+        return "timeout";
+    case GST_DISCOVERER_BUSY:
+        return "busy";
+    case GST_DISCOVERER_MISSING_PLUGINS:
+        return "missing-plugins";
+    }
+    return "unknown";
+}
+
+/*!
+ * @brief Builds the JSON line for one discovered file.
+ */
+static GString *describe(const std::string &uri, GstDiscovererInfo *info, GError *err, gint64 elapsedUs)
+{
+    GstDiscovererResult result = info ? gst_discoverer_info_get_result(info) : GST_DISCOVERER_ERROR;
+    GString *out = g_string_new("{\"uri\": ");
+
+    appendJsonString(out, uri.c_str());
+    g_string_append(out, ", \"result\": ");
+    appendJsonString(out, resultName(result));
+    g_string_append_printf(out, ", \"elapsed_ms\": %.1f", elapsedUs / 1000.0);
+
+    if (err)
+    {
+        g_string_append(out, ", \"error\": ");
+        appendJsonString(out, err->message);
+    }
+
+    if (info && result == GST_DISCOVERER_OK)
+    {
+        GstClockTime duration = gst_discoverer_info_get_duration(info);
+        g_string_append_printf(out, ", \"duration_s\": %.3f, \"seekable\": %s",
+                               GST_CLOCK_TIME_IS_VALID(duration) ? duration / (gdouble)GST_SECOND : 0.0,
+                               gst_discoverer_info_get_seekable(info) ? "true" : "false");
+
+        g_string_append(out, ", \"tags\": ");
+        appendTags(out, gst_discoverer_info_get_tags(info));
+
+        g_string_append(out, ", \"streams\": [");
+        GList *streams = gst_discoverer_info_get_stream_list(info);
+        for (GList *l = streams; l; l = l->next)
+        {
+            appendStream(out, (GstDiscovererStreamInfo *)l->data);
+            if (l->next)
+            {
+                g_string_append(out, ", ");
+            }
+        }
+        gst_discoverer_stream_info_list_free(streams);
+        g_string_append(out, "]");
+    }
+
+    g_string_append(out, "}\n");
+    return out;
+}
+
+/* ======= Workers ==========*/
+
+static void worker(CustomData *data)
+{
+    GError *err = NULL;
+    GstDiscoverer *disc = gst_discoverer_new(timeoutSec * GST_SECOND, &err);
+    if (!disc)
+    {
+        gst_printerr("\nFailed to instantiate discoverer object: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return;
+    }
+
+    std::string uri;
+    while (popUri(data, uri))
+    {
+        gint64 start = g_get_monotonic_time();
+        GstDiscovererInfo *info = NULL;
+        if (data->cache)
+        {
+            if (refresh)
+                discoveryCacheInvalidate(data->cache, uri.c_str());
+            else
+                info = discoveryCacheLookup(data->cache, uri.c_str());
+        }
+        if (!info)
+        {
+            info = gst_discoverer_discover_uri(disc, uri.c_str(), &err);
+            if (info && data->cache)
+            {
+                discoveryCacheStore(data->cache, uri.c_str(), info);
+            }
+        }
+        GString *line = describe(uri, info, err, g_get_monotonic_time() - start);
+        GstDiscovererResult result = info ? gst_discoverer_info_get_result(info) : GST_DISCOVERER_ERROR;
+
+        {
+            std::lock_guard<std::mutex> guard(data->outputLock);
+            fputs(line->str, stdout);
+            if (result == GST_DISCOVERER_OK)
+                data->ok++;
+            else if (result == GST_DISCOVERER_TIMEOUT)
+                data->timeouts++;
+            else
+                data->failed++;
+        }
+
+        g_string_free(line, TRUE);
+        g_clear_error(&err);
+        if (info)
+        {
+            gst_discoverer_info_unref(info);
+        }
+    }
+
+    g_object_unref(disc);
+}
+
+int main(int argc, char **argv)
+{
+    CustomData data;
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("<directory | list-file> - discover a media library");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || argc < 2)
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing directory or list file.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    if (jobs <= 0)
+    {
+        jobs = g_get_num_processors();
+    }
+
+    data.capacity = MAX(queueSize, 1);
+    data.producerDone = FALSE;
+    data.ok = data.failed = data.timeouts = 0;
+    data.cache = cacheLocation ? discoveryCacheOpen(cacheLocation, hashContent) : NULL;
+
+    gint64 start = g_get_monotonic_time();
+
+    std::thread producerThread(producer, &data, argv[1]);
+    std::vector<std::thread> workers;
+    for (gint i = 0; i < jobs; i++)
+    {
+        workers.emplace_back(worker, &data);
+    }
+
+    producerThread.join();
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+    fflush(stdout);
+
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+    guint total = data.ok + data.failed + data.timeouts;
+    gst_printerr("\nDiscovered %u files (%u ok, %u failed, %u timed out) with %d workers in %.2f s: %.1f files/s\n",
+                 total, data.ok, data.failed, data.timeouts, jobs, seconds, seconds > 0 ? total / seconds : 0.0);
+
+    if (data.cache)
+    {
+        gst_printerr("Cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses (%" G_GUINT64_FORMAT " stale)\n",
+                     data.cache->hits, data.cache->misses, data.cache->stale);
+        if (compact && !discoveryCacheCompact(data.cache))
+        {
+            gst_printerr("Failed to compact the discovery cache.\n");
+        }
+        discoveryCacheClose(data.cache);
+    }
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/*!
+ * @brief Headless throughput benchmark for the exercise pipelines.
+ * @note Usage:- ./Benchmark-Harness.o [num-buffers] [local-media-file]
+ *
+ * Each exercise renders to autovideosink/autoaudiosink and streams a remote URI, so none of them can run on a box
+ * without a display or network. Here we rebuild their topologies with videotestsrc/audiotestsrc/filesrc inputs and
+ * fakesink sync=false, run each one for N buffers and print fps, per-buffer latency percentiles, CPU time and peak RSS
+ * as JSON. Topologies share the process, so getrusage()'s ru_maxrss would only ever report the largest one so far:
+ * RSS is sampled from /proc/self/statm every 20 ms while a topology runs instead, and reported as the peak during the
+ * run and its growth over the RSS before the pipeline was built.
+ *
+ * Every topology names two elements: "src" and "out". A probe on the src pad of "src" stamps each buffer by its PTS,
+ * a probe on the sink pad of "out" looks the PTS up again. The difference is the per-buffer latency through the chain.
+ * The run ends on EOS or once "out" has seen N buffers, whichever comes first.
+ */
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef struct
+{
+    const gchar *name;
+    std::string description;
+} Topology;
+
+typedef struct
+{
+    GstElement *pipeline;
+    guint64 maxBuffers;
+    guint64 outBuffers;
+    gboolean limitPosted;
+
+    // PTS -> monotonic time at which the buffer left "src". Touched from several streaming threads.
+    std::mutex lock;
+    std::unordered_map<GstClockTime, gint64> entryTimes;
+    std::vector<gint64> latencies;
+} CustomData;
+
+/*!
+ * @brief Stamps every buffer leaving the "src" element.
+ */
+static GstPadProbeReturn onSrcBuffer(GstPad *pad, GstPadProbeInfo *info, CustomData *data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        std::lock_guard<std::mutex> guard(data->lock);
+        data->entryTimes[GST_BUFFER_PTS(buffer)] = g_get_monotonic_time();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Counts buffers reaching the "out" element and records their latency.
+ */
+static GstPadProbeReturn onOutBuffer(GstPad *pad, GstPadProbeInfo *info, CustomData *data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now = g_get_monotonic_time();
+    gboolean limitReached = FALSE;
+
+    {
+        std::lock_guard<std::mutex> guard(data->lock);
+        if (GST_BUFFER_PTS_IS_VALID(buffer))
+        {
+            auto it = data->entryTimes.find(GST_BUFFER_PTS(buffer));
+            if (it != data->entryTimes.end())
+            {
+                data->latencies.push_back(now - it->second);
+                data->entryTimes.erase(it);
+            }
+        }
+
+        data->outBuffers++;
+        if (data->outBuffers >= data->maxBuffers && !data->limitPosted)
+        {
+            data->limitPosted = TRUE;
+            limitReached = TRUE;
+        }
+    }
+
+    // Sources such as filesrc don't know about our buffer budget, so tell the bus loop to stop.
+    if (limitReached)
+    {
+        gst_element_post_message(data->pipeline,
+                                 gst_message_new_application(GST_OBJECT(data->pipeline),
+                                                             gst_structure_new_empty("benchmark-limit")));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Returns the value at the given percentile of an already sorted vector.
+ */
+static gint64 percentile(const std::vector<gint64> &sorted, gdouble pct)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)((pct / 100.0) * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static gdouble cpuSeconds(const struct rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static long residentKb()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*!
+ * @brief Builds, runs and reports a single topology. Returns FALSE if the pipeline could not be run.
+ */
+static gboolean runTopology(const Topology &topology, guint64 numBuffers, gboolean isFirst)
+{
+    CustomData data;
+    GError *err = NULL;
+    gboolean terminateLoop = FALSE;
+    const gchar *status = "eos";
+
+    data.maxBuffers = numBuffers;
+    data.outBuffers = 0;
+    data.limitPosted = FALSE;
+    long rssBeforeKb = residentKb();
+    long peakRssKb = rssBeforeKb;
+
+    data.pipeline = gst_parse_launch(topology.description.c_str(), &err);
+    if (!data.pipeline)
+    {
+        gst_printerr("\nFailed to build topology %s: %s", topology.name, err ? err->message : "unknown");
+        g_clear_error(&err);
+        return FALSE;
+    }
+    g_clear_error(&err);
+
+    GstElement *src = gst_bin_get_by_name(GST_BIN(data.pipeline), "src");
+    GstElement *out = gst_bin_get_by_name(GST_BIN(data.pipeline), "out");
+    if (!src || !out)
+    {
+        gst_printerr("\nTopology %s doesn't name a 'src' and 'out' element.", topology.name);
+        if (src)
+            gst_object_unref(src);
+        if (out)
+            gst_object_unref(out);
+        gst_object_unref(data.pipeline);
+        return FALSE;
+    }
+
+    GstPad *srcPad = gst_element_get_static_pad(src, "src");
+    GstPad *outPad = gst_element_get_static_pad(out, "sink");
+    gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onSrcBuffer, &data, NULL);
+    gst_pad_add_probe(outPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onOutBuffer, &data, NULL);
+    gst_object_unref(srcPad);
+    gst_object_unref(outPad);
+    gst_object_unref(src);
+    gst_object_unref(out);
+
+    struct rusage usageBefore, usageAfter;
+    getrusage(RUSAGE_SELF, &usageBefore);
+    gint64 startTime = g_get_monotonic_time();
+
+    if (gst_element_set_state(data.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start topology %s.", topology.name);
+        gst_object_unref(data.pipeline);
+        return FALSE;
+    }
+
+    GstBus *bus = gst_element_get_bus(data.pipeline);
+    do
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(
+            bus,
+            20 * GST_MSECOND,
+            (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_APPLICATION));
+        peakRssKb = MAX(peakRssKb, residentKb());
+        if (!msg)
+        {
+            continue;
+        }
+
+        switch (GST_MESSAGE_TYPE(msg))
+        {
+        case GST_MESSAGE_ERROR:
+        {
+            gchar *debugInfo;
+            gst_message_parse_error(msg, &err, &debugInfo);
+            gst_printerr("\nError in %s from %s: %s", topology.name, GST_OBJECT_NAME(msg->src), err->message);
+            g_clear_error(&err);
+            g_free(debugInfo);
+            status = "error";
+            terminateLoop = TRUE;
+            break;
+        }
+        case GST_MESSAGE_EOS:
+            terminateLoop = TRUE;
+            break;
+        case GST_MESSAGE_APPLICATION:
+            status = "limit";
+            terminateLoop = TRUE;
+            break;
+        default:
+            break;
+        }
+        gst_message_unref(msg);
+    } while (!terminateLoop);
+
+    gint64 wallTime = g_get_monotonic_time() - startTime;
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    getrusage(RUSAGE_SELF, &usageAfter);
+
+    gst_object_unref(bus);
+    gst_object_unref(data.pipeline);
+
+    std::sort(data.latencies.begin(), data.latencies.end());
+    gdouble seconds = wallTime / 1e6;
+
+    g_print("%s    {\"name\": \"%s\", \"status\": \"%s\", \"buffers\": %" G_GUINT64_FORMAT
+            ", \"wall_s\": %.3f, \"fps\": %.1f, \"latency_us\": {\"samples\": %u, \"p50\": %" G_GINT64_FORMAT
+            ", \"p90\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT
+            "}, \"cpu_s\": %.3f, \"peak_rss_kb\": %ld, \"rss_growth_kb\": %ld}",
+            isFirst ? "" : ",\n",
+            topology.name,
+            status,
+            data.outBuffers,
+            seconds,
+            seconds > 0 ? data.outBuffers / seconds : 0.0,
+            (guint)data.latencies.size(),
+            percentile(data.latencies, 50),
+            percentile(data.latencies, 90),
+            percentile(data.latencies, 99),
+            data.latencies.empty() ? 0 : data.latencies.back(),
+            cpuSeconds(usageAfter) - cpuSeconds(usageBefore),
+            peakRssKb,
+            peakRssKb - rssBeforeKb);
+
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    guint64 numBuffers = 1000;
+    const gchar *mediaFile = NULL;
+
+    if (argc > 1)
+    {
+        numBuffers = g_ascii_strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        mediaFile = argv[2];
+    }
+    if (numBuffers == 0)
+    {
+        gst_printerr("\nNumber of buffers must be positive.");
+        return -1;
+    }
+
+    gst_init(NULL, NULL);
+
+    gchar *num = g_strdup_printf("%" G_GUINT64_FORMAT, numBuffers);
+    std::vector<Topology> topologies;
+
+    // 02-Basic-Bus-Msg: videotestsrc straight into a sink.
+    topologies.push_back({"02-basic-bus-msg",
+                          std::string("videotestsrc name=src pattern=0 num-buffers=") + num +
+                              " ! fakesink name=out sync=false"});
+
+    // 03-Dynamic-Linking: decode a local file and run the audio through convert/resample.
+    // decodebin's pad is linked dynamically by gst_parse_launch just like pad_added_handler() did by hand.
+    if (mediaFile)
+    {
+        gchar *quoted = g_shell_quote(mediaFile);
+        topologies.push_back({"03-dynamic-linking",
+                              std::string("filesrc location=") + quoted +
+                                  " ! decodebin ! audioconvert name=src ! audioresample ! fakesink name=out sync=false"});
+        g_free(quoted);
+    }
+    else
+    {
+        gst_printerr("\nNo local media file given, skipping 03-dynamic-linking.");
+    }
+
+    // 06-Pad-Caps-Play-Pause: the webcam recorder with videotestsrc in place of v4l2src.
+    // We measure at the parser because mp4mux only emits a few large chunks.
+    topologies.push_back({"06-pad-caps-record",
+                          std::string("videotestsrc name=src num-buffers=") + num +
+                              " ! capsfilter caps=video/x-raw,format=YUY2,width=320,height=240,framerate=30/1"
+                              " ! videoconvert ! x264enc ! h264parse name=out ! mp4mux ! fakesink sync=false"});
+
+    // 07-Multi-Threading: audio tee with a playback branch and a wavescope branch.
+    topologies.push_back({"07-multi-threading",
+                          std::string("audiotestsrc name=src freq=235 num-buffers=") + num +
+                              " ! tee name=t"
+                              " t. ! queue ! audioconvert ! audioresample ! fakesink name=out sync=false"
+                              " t. ! queue ! wavescope shader=0 ! videoconvert ! fakesink sync=false"});
+
+    g_free(num);
+
+    gboolean failed = FALSE;
+    gboolean isFirst = TRUE;
+    g_print("{\n  \"num_buffers\": %" G_GUINT64_FORMAT ",\n  \"topologies\": [\n", numBuffers);
+    for (const Topology &topology : topologies)
+    {
+        if (runTopology(topology, numBuffers, isFirst))
+        {
+            isFirst = FALSE;
+        }
+        else
+        {
+            failed = TRUE;
+        }
+    }
+    g_print("\n  ]\n}\n");
+
+    return failed ? -1 : 0;
+}
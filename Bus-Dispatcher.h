@@ -0,0 +1,108 @@
+/*!
+ * @brief Event-driven bus dispatcher. Replaces the gst_bus_timed_pop_filtered() loops and their switch statements.
+ * @link https://gstreamer.freedesktop.org/documentation/application-development/basics/bus.html?gi-language=c
+ *
+ * A GstBus watch source is attached to a GMainContext, so the thread sleeps until a message actually arrives.
+ * Handlers are registered per message type mask and optionally per source object; every matching handler runs in
+ * registration order. Periodic work (e.g. position queries) goes through busDispatcherAddTimer() on the same context
+ * instead of piggybacking on a bus pop timeout.
+ *
+ * Since nothing blocks, one thread running one GMainContext can supervise any number of pipelines: create one
+ * dispatcher per pipeline on the shared context.
+ */
+
+#ifndef BUS_DISPATCHER_H
+#define BUS_DISPATCHER_H
+
+#include <gst/gst.h>
+#include <vector>
+
+typedef void (*BusHandler)(GstMessage *msg, gpointer userData);
+
+typedef struct
+{
+    GstMessageType types;
+    GstObject *source; // NULL = any source
+    BusHandler handler;
+    gpointer userData;
+} BusRegistration;
+
+typedef struct
+{
+    GstBus *bus;
+    GMainContext *context;
+    GSource *watch;
+    std::vector<BusRegistration> registrations;
+    std::vector<GSource *> timers;
+} BusDispatcher;
+
+static gboolean busDispatcherOnMessage(GstBus *bus, GstMessage *msg, gpointer userData)
+{
+    BusDispatcher *dispatcher = (BusDispatcher *)userData;
+
+    // Index based: a handler may register more handlers.
+    for (size_t i = 0; i < dispatcher->registrations.size(); i++)
+    {
+        const BusRegistration registration = dispatcher->registrations[i];
+        if ((GST_MESSAGE_TYPE(msg) & registration.types) &&
+            (!registration.source || GST_MESSAGE_SRC(msg) == registration.source))
+        {
+            registration.handler(msg, registration.userData);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * @brief Starts dispatching the pipeline's bus on the given context (NULL = the default main context).
+ */
+static BusDispatcher *busDispatcherNew(GstElement *pipeline, GMainContext *context)
+{
+    BusDispatcher *dispatcher = new BusDispatcher();
+    dispatcher->bus = gst_element_get_bus(pipeline);
+    dispatcher->context = context ? g_main_context_ref(context) : NULL;
+
+    dispatcher->watch = gst_bus_create_watch(dispatcher->bus);
+    g_source_set_callback(dispatcher->watch, (GSourceFunc)busDispatcherOnMessage, dispatcher, NULL);
+    g_source_attach(dispatcher->watch, context);
+    return dispatcher;
+}
+
+/*!
+ * @brief Calls handler for every message whose type is in the mask and, if source isn't NULL, comes from source.
+ */
+static void busDispatcherConnect(BusDispatcher *dispatcher, GstMessageType types, GstObject *source,
+                                 BusHandler handler, gpointer userData)
+{
+    dispatcher->registrations.push_back({types, source, handler, userData});
+}
+
+/*!
+ * @brief Runs callback every intervalMs on the dispatcher's context until it returns FALSE or the dispatcher is freed.
+ */
+static void busDispatcherAddTimer(BusDispatcher *dispatcher, guint intervalMs, GSourceFunc callback, gpointer userData)
+{
+    GSource *timer = g_timeout_source_new(intervalMs);
+    g_source_set_callback(timer, callback, userData, NULL);
+    g_source_attach(timer, dispatcher->context);
+    dispatcher->timers.push_back(timer);
+}
+
+static void busDispatcherFree(BusDispatcher *dispatcher)
+{
+    for (GSource *timer : dispatcher->timers)
+    {
+        g_source_destroy(timer);
+        g_source_unref(timer);
+    }
+    g_source_destroy(dispatcher->watch);
+    g_source_unref(dispatcher->watch);
+    gst_object_unref(dispatcher->bus);
+    if (dispatcher->context)
+    {
+        g_main_context_unref(dispatcher->context);
+    }
+    delete dispatcher;
+}
+
+#endif // BUS_DISPATCHER_H
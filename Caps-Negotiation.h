@@ -0,0 +1,333 @@
+/*!
+ * @brief Caps negotiation profiler and a memoizing link-compatibility cache.
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/negotiation.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/probes.html?gi-language=c
+ *
+ * CapsProfiler: capsProfilerAttach() puts a query probe on every pad of a bin, including elements and pads created
+ * later (deep-element-added / pad-added). Query probes fire twice, once before the query is handled (PUSH) and once
+ * with the answer (PULL), so the difference is the time the pad spent on it, including everything it forwarded.
+ * CAPS, ACCEPT_CAPS and ALLOCATION queries are recorded per pad until capsProfilerStop(), typically at the first
+ * ASYNC_DONE. capsProfilerPrint() lists the most expensive pads and totals per query type. Queries that fail get no
+ * PULL callback and are not counted.
+ *
+ * CapsCache: gst_pad_link() queries the caps of both pads and intersects them on every link. For topologies that
+ * are built over and over, capsCacheLink() remembers which pairs of (element factory, pad template, capsfilter "caps")
+ * linked before. The key is kept that cheap on purpose: building it must cost less than the queries it saves. A
+ * known pair is linked with the hierarchy and template caps checks only, i.e. without asking the pads (and whatever
+ * they proxy upstream) for their current caps. The key can't see that upstream state, so a hit that fails the
+ * template check drops its entry and falls back to gst_pad_link(), and failures are never cached. What the template
+ * check can't catch (say an upstream capsfilter narrowing what a converter can produce) fails later, at caps
+ * negotiation, as it would with GST_PAD_LINK_CHECK_NOTHING. The cache is process wide and thread safe.
+ */
+
+#ifndef CAPS_NEGOTIATION_H
+#define CAPS_NEGOTIATION_H
+
+#include <gst/gst.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+typedef struct
+{
+    guint count, refused; // refused: ACCEPT_CAPS answered FALSE
+    gint64 totalUs, maxUs;
+} QueryStat;
+
+typedef struct
+{
+    std::mutex lock;
+    std::atomic<gboolean> active; // checked by the probes without the lock
+    gint64 startedAt, stoppedAt;
+    std::map<std::pair<GstPad *, GstQuery *>, gint64> pending;
+    std::map<std::string, QueryStat> stats; // "element:pad query"
+    QueryStat totals[3];                    // caps, accept-caps, allocation
+} CapsProfiler;
+
+static gint capsProfilerQueryIndex(GstQueryType type)
+{
+    switch (type)
+    {
+    case GST_QUERY_CAPS:
+        return 0;
+    case GST_QUERY_ACCEPT_CAPS:
+        return 1;
+    case GST_QUERY_ALLOCATION:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+static void capsProfilerAddStat(QueryStat *stat, gint64 elapsed, gboolean refused)
+{
+    stat->count++;
+    stat->refused += refused ? 1 : 0;
+    stat->totalUs += elapsed;
+    stat->maxUs = MAX(stat->maxUs, elapsed);
+}
+
+static GstPadProbeReturn capsProfilerOnQuery(GstPad *pad, GstPadProbeInfo *info, CapsProfiler *profiler)
+{
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+    gint index = capsProfilerQueryIndex(GST_QUERY_TYPE(query));
+    if (index < 0 || !profiler->active)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(profiler->lock);
+    auto key = std::make_pair(pad, query);
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_PUSH)
+    {
+        profiler->pending[key] = now;
+        return GST_PAD_PROBE_OK;
+    }
+
+    auto it = profiler->pending.find(key);
+    if (it == profiler->pending.end())
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    gint64 elapsed = now - it->second;
+    profiler->pending.erase(it);
+
+    gboolean refused = FALSE;
+    if (GST_QUERY_TYPE(query) == GST_QUERY_ACCEPT_CAPS)
+    {
+        gst_query_parse_accept_caps_result(query, &refused);
+        refused = !refused;
+    }
+
+    gchar *name = g_strdup_printf("%s:%s %s", GST_DEBUG_PAD_NAME(pad), GST_QUERY_TYPE_NAME(query));
+    capsProfilerAddStat(&profiler->stats[name], elapsed, refused);
+    capsProfilerAddStat(&profiler->totals[index], elapsed, refused);
+    g_free(name);
+    return GST_PAD_PROBE_OK;
+}
+
+static void capsProfilerWatchPad(GstElement *element, GstPad *pad, CapsProfiler *profiler)
+{
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_BOTH, (GstPadProbeCallback)capsProfilerOnQuery, profiler, NULL);
+}
+
+static void capsProfilerWatchElement(GstElement *element, CapsProfiler *profiler)
+{
+    GstIterator *it = gst_element_iterate_pads(element);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        capsProfilerWatchPad(element, GST_PAD(g_value_get_object(&item)), profiler);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    g_signal_connect(element, "pad-added", G_CALLBACK(capsProfilerWatchPad), profiler);
+}
+
+static void capsProfilerOnElementAdded(GstBin *bin, GstBin *subBin, GstElement *element, CapsProfiler *profiler)
+{
+    capsProfilerWatchElement(element, profiler);
+}
+
+/*!
+ * @brief Starts recording negotiation queries on every pad of bin. Attach before the first state change.
+ */
+static CapsProfiler *capsProfilerAttach(GstBin *bin)
+{
+    CapsProfiler *profiler = new CapsProfiler();
+    profiler->active = TRUE;
+    profiler->startedAt = g_get_monotonic_time();
+    profiler->stoppedAt = 0;
+    memset(profiler->totals, 0, sizeof(profiler->totals));
+
+    GstIterator *it = gst_bin_iterate_recurse(bin);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        capsProfilerWatchElement(GST_ELEMENT(g_value_get_object(&item)), profiler);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    g_signal_connect(bin, "deep-element-added", G_CALLBACK(capsProfilerOnElementAdded), profiler);
+    return profiler;
+}
+
+/*!
+ * @brief Stops recording. The probes stay installed but return immediately.
+ */
+static void capsProfilerStop(CapsProfiler *profiler)
+{
+    std::lock_guard<std::mutex> guard(profiler->lock);
+    profiler->active = FALSE;
+    profiler->stoppedAt = g_get_monotonic_time();
+    profiler->pending.clear();
+}
+
+static void capsProfilerPrint(CapsProfiler *profiler, guint top)
+{
+    static const gchar *names[] = {"caps", "accept-caps", "allocation"};
+    std::lock_guard<std::mutex> guard(profiler->lock);
+
+    std::vector<std::pair<std::string, QueryStat>> sorted(profiler->stats.begin(), profiler->stats.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, QueryStat> &a, const std::pair<std::string, QueryStat> &b)
+              { return a.second.totalUs > b.second.totalUs; });
+
+    gint64 window = (profiler->stoppedAt ? profiler->stoppedAt : g_get_monotonic_time()) - profiler->startedAt;
+    g_print("\nNegotiation during the first %.1f ms (times include forwarded queries):", window / 1000.0);
+    for (gint i = 0; i < 3; i++)
+    {
+        QueryStat *stat = &profiler->totals[i];
+        g_print("\n  %-12s %5u queries  %8.2f ms total  %7.2f ms max  %u refused",
+                names[i], stat->count, stat->totalUs / 1000.0, stat->maxUs / 1000.0, stat->refused);
+    }
+    g_print("\nMost expensive pads:");
+    for (size_t i = 0; i < MIN((size_t)top, sorted.size()); i++)
+    {
+        QueryStat *stat = &sorted[i].second;
+        g_print("\n  %-60s %5u x  %8.2f ms total  %7.2f ms max", sorted[i].first.c_str(),
+                stat->count, stat->totalUs / 1000.0, stat->maxUs / 1000.0);
+    }
+}
+
+/*!
+ * @brief Free only after the bin went to NULL: the probes still point at the profiler.
+ */
+static void capsProfilerFree(CapsProfiler *profiler)
+{
+    delete profiler;
+}
+
+/* ======= Link compatibility cache ==========*/
+
+typedef struct
+{
+    std::mutex lock;
+    std::unordered_set<std::string> linked;
+    guint hits, misses, stale;
+} CapsCache;
+
+static CapsCache *capsCacheGet()
+{
+    static CapsCache cache;
+    return &cache;
+}
+
+// Factory and template name identify what a pad can do; a capsfilter's "caps" is the one property that is the whole
+// point of the element, so it is part of the key too.
+static void capsCacheAppendPad(std::string &key, GstPad *pad)
+{
+    GstElement *element = gst_pad_get_parent_element(pad);
+    GstElementFactory *factory = element ? gst_element_get_factory(element) : NULL;
+    GstPadTemplate *padTemplate = gst_pad_get_pad_template(pad);
+
+    key += factory ? GST_OBJECT_NAME(factory) : (element ? G_OBJECT_TYPE_NAME(element) : "?");
+    key += '/';
+    key += padTemplate ? GST_PAD_TEMPLATE_NAME_TEMPLATE(padTemplate) : GST_PAD_NAME(pad);
+
+    if (factory && g_str_equal(GST_OBJECT_NAME(factory), "capsfilter"))
+    {
+        GstCaps *caps = NULL;
+        g_object_get(element, "caps", &caps, NULL);
+        gchar *str = caps ? gst_caps_to_string(caps) : NULL;
+        key += '[';
+        key += str ? str : "";
+        key += ']';
+        g_free(str);
+        if (caps)
+            gst_caps_unref(caps);
+    }
+    if (padTemplate)
+        gst_object_unref(padTemplate);
+    if (element)
+        gst_object_unref(element);
+}
+
+/*!
+ * @brief gst_pad_link() that skips the caps query and intersection for pad pairs it has linked before.
+ */
+static GstPadLinkReturn capsCacheLink(GstPad *srcPad, GstPad *sinkPad)
+{
+    CapsCache *cache = capsCacheGet();
+    std::string key;
+    capsCacheAppendPad(key, srcPad);
+    key += " -> ";
+    capsCacheAppendPad(key, sinkPad);
+
+    gboolean known;
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        known = cache->linked.count(key) > 0;
+        if (known)
+            cache->hits++;
+        else
+            cache->misses++;
+    }
+    // Linking sends queries and events into the pads: never with the cache locked.
+    if (known)
+    {
+        GstPadLinkReturn ret = gst_pad_link_full(srcPad, sinkPad,
+                                                 (GstPadLinkCheck)(GST_PAD_LINK_CHECK_HIERARCHY |
+                                                                   GST_PAD_LINK_CHECK_TEMPLATE_CAPS));
+        if (ret != GST_PAD_LINK_NOFORMAT)
+        {
+            return ret;
+        }
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->linked.erase(key);
+        cache->stale++;
+    }
+
+    GstPadLinkReturn ret = gst_pad_link(srcPad, sinkPad);
+    if (ret == GST_PAD_LINK_OK)
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->linked.insert(key);
+    }
+    return ret;
+}
+
+/*!
+ * @brief sink's sinkTemplate pad (default "sink"), requested from that template if it isn't a static pad.
+ */
+static GstPad *capsCacheSinkPad(GstElement *sink, const gchar *sinkTemplate)
+{
+    GstPad *sinkPad = gst_element_get_static_pad(sink, sinkTemplate ? sinkTemplate : "sink");
+    if (!sinkPad && sinkTemplate)
+    {
+#if GST_CHECK_VERSION(1, 20, 0)
+        sinkPad = gst_element_request_pad_simple(sink, sinkTemplate);
+#else
+        sinkPad = gst_element_get_request_pad(sink, sinkTemplate);
+#endif
+    }
+    return sinkPad;
+}
+
+/*!
+ * @brief Element-level version of capsCacheLink(): links src's "src" pad to capsCacheSinkPad(sink, sinkTemplate).
+ */
+static gboolean capsCacheLinkElements(GstElement *src, GstElement *sink, const gchar *sinkTemplate)
+{
+    GstPad *srcPad = gst_element_get_static_pad(src, "src");
+    GstPad *sinkPad = capsCacheSinkPad(sink, sinkTemplate);
+    gboolean ok = srcPad && sinkPad && GST_PAD_LINK_SUCCESSFUL(capsCacheLink(srcPad, sinkPad));
+    if (srcPad)
+        gst_object_unref(srcPad);
+    if (sinkPad)
+        gst_object_unref(sinkPad);
+    return ok;
+}
+
+#endif // CAPS_NEGOTIATION_H
@@ -0,0 +1,180 @@
+/*!
+ * @brief Where does pipeline startup spend its negotiation time, and how much of it can a rebuild skip?
+ * @note Usage:- ./Caps-Profiler.o [--builds=N] [--top=N] ["<launch description>"]
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/negotiation.html?gi-language=c
+ *
+ * Part 1 attaches a Caps-Negotiation.h profiler to a gst_parse_launch() pipeline (by default the recording chain of
+ * 06-Pad-Caps-Play-Pause with videotestsrc as the camera), prerolls it and prints the CAPS / ACCEPT_CAPS / ALLOCATION
+ * queries by pad and their cost.
+ *
+ * Part 2 builds that recording chain N times element by element, the way 03/06 do it, once linking with
+ * gst_pad_link() and once with capsCacheLink(). Only the links are timed, the pads are looked up before. One untimed
+ * build fills the cache first, so every timed capsCacheLink() is a hit: a key built from factory and template names
+ * plus a template caps check, against two caps queries and an intersection. Exits with an error if the hits aren't
+ * faster.
+ */
+
+#include <gst/gst.h>
+#include "Caps-Negotiation.h"
+
+#define DEFAULT_DESCRIPTION                                                            \
+    "videotestsrc num-buffers=30 ! video/x-raw,format=YUY2,width=1280,height=720 ! " \
+    "videoconvert ! x264enc ! h264parse ! mp4mux ! fakesink"
+
+typedef struct
+{
+    const gchar *factory;
+    const gchar *sinkTemplate; // pad on this element the previous one links to
+} ChainElement;
+
+static const ChainElement chain[] = {
+    {"videotestsrc", NULL},
+    {"capsfilter", "sink"},
+    {"videoconvert", "sink"},
+    {"x264enc", "sink"},
+    {"h264parse", "sink"},
+    {"mp4mux", "video_%u"},
+    {"fakesink", "sink"},
+};
+
+static gint builds = 200;
+static gint top = 15;
+
+static GOptionEntry entries[] = {
+    {"builds", 'b', 0, G_OPTION_ARG_INT, &builds, "How often the chain is rebuilt in part 2", "N"},
+    {"top", 0, 0, G_OPTION_ARG_INT, &top, "How many pads to list in part 1", "N"},
+    {NULL}};
+
+static gboolean profileStartup(const gchar *description)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    CapsProfiler *profiler = capsProfilerAttach(GST_BIN(pipeline));
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gboolean ok = gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS;
+    capsProfilerStop(profiler);
+
+    if (ok)
+        capsProfilerPrint(profiler, top);
+    else
+        gst_printerr("\nThe pipeline didn't preroll.");
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    capsProfilerFree(profiler);
+    return ok;
+}
+
+/*!
+ * @brief Builds the chain once and returns the time spent linking in us, or -1 if a link failed.
+ */
+static gint64 buildChain(gboolean useCache)
+{
+    GstElement *pipeline = gst_pipeline_new(NULL);
+    GstElement *elements[G_N_ELEMENTS(chain)];
+
+    for (guint i = 0; i < G_N_ELEMENTS(chain); i++)
+    {
+        elements[i] = gst_element_factory_make(chain[i].factory, NULL);
+        gst_bin_add(GST_BIN(pipeline), elements[i]);
+    }
+    GstCaps *caps = gst_caps_from_string("video/x-raw,format=YUY2,width=1280,height=720");
+    g_object_set(elements[1], "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    GstPad *srcPads[G_N_ELEMENTS(chain)], *sinkPads[G_N_ELEMENTS(chain)];
+    for (guint i = 1; i < G_N_ELEMENTS(chain); i++)
+    {
+        srcPads[i] = gst_element_get_static_pad(elements[i - 1], "src");
+        sinkPads[i] = capsCacheSinkPad(elements[i], chain[i].sinkTemplate);
+    }
+
+    gint64 start = g_get_monotonic_time();
+    gboolean ok = TRUE;
+    for (guint i = 1; i < G_N_ELEMENTS(chain) && ok; i++)
+    {
+        GstPadLinkReturn ret = useCache ? capsCacheLink(srcPads[i], sinkPads[i]) : gst_pad_link(srcPads[i], sinkPads[i]);
+        ok = GST_PAD_LINK_SUCCESSFUL(ret);
+    }
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    for (guint i = 1; i < G_N_ELEMENTS(chain); i++)
+    {
+        gst_object_unref(srcPads[i]);
+        gst_object_unref(sinkPads[i]);
+    }
+    gst_object_unref(pipeline);
+    return ok ? elapsed : -1;
+}
+
+/*!
+ * @brief Returns TRUE if linking on cache hits is faster than gst_pad_link().
+ */
+static gboolean benchmarkRebuilds()
+{
+    CapsCache *cache = capsCacheGet();
+    if (buildChain(TRUE) < 0)
+    {
+        gst_printerr("\nLinking the chain failed.");
+        return FALSE;
+    }
+    guint hitsBefore = cache->hits, missesBefore = cache->misses;
+
+    gdouble perBuild[2];
+    for (gboolean useCache : {FALSE, TRUE})
+    {
+        gint64 total = 0;
+        for (gint i = 0; i < builds; i++)
+        {
+            gint64 elapsed = buildChain(useCache);
+            if (elapsed < 0)
+            {
+                gst_printerr("\nLinking the chain failed.");
+                return FALSE;
+            }
+            total += elapsed;
+        }
+        perBuild[useCache] = total / (gdouble)builds;
+        g_print("\n%-15s %d builds, %.1f us linking per build", useCache ? "capsCacheLink:" : "gst_pad_link:", builds,
+                perBuild[useCache]);
+    }
+
+    g_print("\nCaps cache: %u hits, %u misses, %u stale while timed, %u pairs; hits are %.2fx gst_pad_link()",
+            cache->hits - hitsBefore, cache->misses - missesBefore, cache->stale, (guint)cache->linked.size(),
+            perBuild[TRUE] > 0 ? perBuild[FALSE] / perBuild[TRUE] : 0.0);
+    return cache->misses == missesBefore && perBuild[TRUE] < perBuild[FALSE];
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("[\"<launch description>\"] - profile caps negotiation");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    builds = MAX(builds, 1);
+
+    if (!profileStartup(argc > 1 ? argv[1] : DEFAULT_DESCRIPTION))
+    {
+        return -1;
+    }
+    gboolean faster = benchmarkRebuilds();
+    g_print("\n");
+
+    return faster ? 0 : -1;
+}
@@ -0,0 +1,430 @@
+/*!
+ * @brief Persistent on-disk cache of GstDiscovererInfo results, so unchanged files are never typefound twice.
+ * @link https://gstreamer.freedesktop.org/documentation/pbutils/gstdiscoverer.html?gi-language=c#gst_discoverer_info_to_variant
+ *
+ * Results are serialized with gst_discoverer_info_to_variant() and appended to a single cache file.
+ * On open the file is memory-mapped and scanned once into a hash index (path -> record), so a lookup is a stat()
+ * plus a hash lookup, and the GVariant is read straight out of the mapping without copying.
+ *
+ * A record is valid while the file's size and mtime (and optionally a hash of its first and last 64 KiB) still match.
+ * Later records win over earlier ones, and an empty record is a tombstone. discoveryCacheCompact() rewrites the file
+ * with only the live records.
+ *
+ *   | header (40 bytes) | path, padded to 8 | GVariant type string, padded to 8 | GVariant data, padded to 8 |
+ */
+
+#ifndef DISCOVERY_CACHE_H
+#define DISCOVERY_CACHE_H
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define DISCOVERY_CACHE_MAGIC 0x31434447 // "GDC1"
+#define DISCOVERY_CACHE_HASH_SPAN (64 * 1024)
+#define DISCOVERY_CACHE_ALIGN(n) (((n) + 7) & ~(gsize)7)
+
+typedef struct
+{
+    guint32 magic;
+    guint32 keyLength;
+    guint32 typeLength;
+    guint32 valueLength; // 0 = tombstone
+    guint64 size;
+    gint64 mtime; // nanoseconds
+    guint64 contentHash;
+} DiscoveryCacheRecord;
+
+typedef struct
+{
+    guint64 size;
+    gint64 mtime;
+    guint64 contentHash;
+    std::string type;
+    const guint8 *value; // Into the mapping, or into owned for records added since open.
+    gsize valueLength;
+    GBytes *owned;
+} DiscoveryCacheEntry;
+
+typedef struct
+{
+    gchar *location;
+    gboolean hashContent;
+    GMappedFile *mapping;
+    FILE *appendFile;
+    std::unordered_map<std::string, DiscoveryCacheEntry> index;
+    std::mutex lock;
+
+    guint64 hits, misses, stale;
+} DiscoveryCache;
+
+/*!
+ * @brief FNV-1a over the first and last 64 KiB. Catches files rewritten with the same size and mtime.
+ */
+static guint64 discoveryCacheHashFile(const gchar *path, guint64 size)
+{
+    guint64 hash = 1469598103934665603ULL;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    guint8 *chunk = (guint8 *)g_malloc(DISCOVERY_CACHE_HASH_SPAN);
+    gint64 offsets[2] = {0, (gint64)size > DISCOVERY_CACHE_HASH_SPAN ? (gint64)size - DISCOVERY_CACHE_HASH_SPAN : -1};
+    for (gint64 offset : offsets)
+    {
+        if (offset < 0 || fseeko(file, offset, SEEK_SET) != 0)
+        {
+            continue;
+        }
+        size_t read = fread(chunk, 1, DISCOVERY_CACHE_HASH_SPAN, file);
+        for (size_t i = 0; i < read; i++)
+        {
+            hash = (hash ^ chunk[i]) * 1099511628211ULL;
+        }
+    }
+    g_free(chunk);
+    fclose(file);
+    return hash;
+}
+
+/*!
+ * @brief Fills in the identity of the file behind a file:// URI. Other URIs aren't cached.
+ */
+static gboolean discoveryCacheIdentify(DiscoveryCache *cache, const gchar *uri, std::string &path,
+                                       guint64 *size, gint64 *mtime, guint64 *contentHash)
+{
+    gchar *filename = g_filename_from_uri(uri, NULL, NULL);
+    if (!filename)
+    {
+        return FALSE;
+    }
+
+    struct stat st;
+    gboolean ok = stat(filename, &st) == 0 && S_ISREG(st.st_mode);
+    if (ok)
+    {
+        path = filename;
+        *size = st.st_size;
+        *mtime = (gint64)st.st_mtim.tv_sec * GST_SECOND + st.st_mtim.tv_nsec;
+        *contentHash = cache->hashContent ? discoveryCacheHashFile(filename, st.st_size) : 0;
+    }
+    g_free(filename);
+    return ok;
+}
+
+static void discoveryCacheDropEntry(DiscoveryCacheEntry &entry)
+{
+    if (entry.owned)
+    {
+        g_bytes_unref(entry.owned);
+        entry.owned = NULL;
+    }
+}
+
+/*!
+ * @brief Maps the cache file and indexes every record. A torn record at the end (crash during append) is cut off.
+ */
+static void discoveryCacheLoad(DiscoveryCache *cache)
+{
+    cache->mapping = g_mapped_file_new(cache->location, FALSE, NULL);
+    if (!cache->mapping)
+    {
+        return;
+    }
+
+    const guint8 *base = (const guint8 *)g_mapped_file_get_contents(cache->mapping);
+    gsize length = g_mapped_file_get_length(cache->mapping);
+    gsize offset = 0;
+
+    while (offset + sizeof(DiscoveryCacheRecord) <= length)
+    {
+        DiscoveryCacheRecord record;
+        memcpy(&record, base + offset, sizeof(record));
+        gsize keyOffset = offset + sizeof(record);
+        gsize typeOffset = keyOffset + DISCOVERY_CACHE_ALIGN(record.keyLength);
+        gsize valueOffset = typeOffset + DISCOVERY_CACHE_ALIGN(record.typeLength);
+        gsize end = valueOffset + DISCOVERY_CACHE_ALIGN(record.valueLength);
+        if (record.magic != DISCOVERY_CACHE_MAGIC || end > length)
+        {
+            break;
+        }
+
+        std::string key((const gchar *)base + keyOffset, record.keyLength);
+        auto it = cache->index.find(key);
+        if (it != cache->index.end())
+        {
+            discoveryCacheDropEntry(it->second);
+            cache->index.erase(it);
+        }
+        if (record.valueLength > 0)
+        {
+            DiscoveryCacheEntry entry;
+            entry.size = record.size;
+            entry.mtime = record.mtime;
+            entry.contentHash = record.contentHash;
+            entry.type.assign((const gchar *)base + typeOffset, record.typeLength);
+            entry.value = base + valueOffset;
+            entry.valueLength = record.valueLength;
+            entry.owned = NULL;
+            cache->index.emplace(key, entry);
+        }
+        offset = end;
+    }
+
+    if (offset < length)
+    {
+        gst_printerr("\nDiscovery cache %s has a damaged tail, dropping %" G_GSIZE_FORMAT " bytes.",
+                     cache->location, length - offset);
+        if (truncate(cache->location, offset) != 0)
+        {
+            gst_printerr("\nFailed to truncate %s: %s", cache->location, g_strerror(errno));
+        }
+    }
+}
+
+/*!
+ * @brief Opens (or creates) the cache file. hashContent adds the head/tail hash to the file identity.
+ */
+static DiscoveryCache *discoveryCacheOpen(const gchar *location, gboolean hashContent)
+{
+    DiscoveryCache *cache = new DiscoveryCache();
+    cache->location = g_strdup(location);
+    cache->hashContent = hashContent;
+    cache->mapping = NULL;
+    cache->hits = cache->misses = cache->stale = 0;
+
+    discoveryCacheLoad(cache);
+
+    cache->appendFile = fopen(location, "ab");
+    if (!cache->appendFile)
+    {
+        gst_printerr("\nFailed to open discovery cache %s: %s", location, g_strerror(errno));
+    }
+    return cache;
+}
+
+static void discoveryCacheWriteRecord(FILE *file, const std::string &key, const DiscoveryCacheEntry *entry)
+{
+    static const guint8 padding[8] = {0};
+    DiscoveryCacheRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = DISCOVERY_CACHE_MAGIC;
+    record.keyLength = key.size();
+    if (entry)
+    {
+        record.typeLength = entry->type.size();
+        record.valueLength = entry->valueLength;
+        record.size = entry->size;
+        record.mtime = entry->mtime;
+        record.contentHash = entry->contentHash;
+    }
+
+    fwrite(&record, sizeof(record), 1, file);
+    fwrite(key.data(), 1, key.size(), file);
+    fwrite(padding, 1, DISCOVERY_CACHE_ALIGN(key.size()) - key.size(), file);
+    if (entry)
+    {
+        fwrite(entry->type.data(), 1, entry->type.size(), file);
+        fwrite(padding, 1, DISCOVERY_CACHE_ALIGN(entry->type.size()) - entry->type.size(), file);
+        fwrite(entry->value, 1, entry->valueLength, file);
+        fwrite(padding, 1, DISCOVERY_CACHE_ALIGN(entry->valueLength) - entry->valueLength, file);
+    }
+}
+
+/*!
+ * @brief Returns the cached info for an unchanged file, or NULL on a miss. Free with gst_discoverer_info_unref().
+ */
+static GstDiscovererInfo *discoveryCacheLookup(DiscoveryCache *cache, const gchar *uri)
+{
+    std::string path;
+    guint64 size, contentHash;
+    gint64 mtime;
+
+    if (!discoveryCacheIdentify(cache, uri, path, &size, &mtime, &contentHash))
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->misses++;
+        return NULL;
+    }
+
+    GVariant *variant;
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        auto it = cache->index.find(path);
+        if (it == cache->index.end())
+        {
+            cache->misses++;
+            return NULL;
+        }
+
+        const DiscoveryCacheEntry &entry = it->second;
+        if (entry.size != size || entry.mtime != mtime || entry.contentHash != contentHash)
+        {
+            cache->stale++;
+            cache->misses++;
+            return NULL;
+        }
+
+        // Copied out of the mapping, so parsing it below doesn't hold up other lookups and stores.
+        GBytes *bytes = g_bytes_new(entry.value, entry.valueLength);
+        variant = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(entry.type.c_str()), bytes, FALSE));
+        g_bytes_unref(bytes);
+    }
+
+    GstDiscovererInfo *info = gst_discoverer_info_from_variant(variant);
+    g_variant_unref(variant);
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    if (info)
+        cache->hits++;
+    else
+        cache->misses++;
+    return info;
+}
+
+/*!
+ * @brief Stores a successful discovery. Failed results are not cached so they get retried next time.
+ */
+static void discoveryCacheStore(DiscoveryCache *cache, const gchar *uri, GstDiscovererInfo *info)
+{
+    DiscoveryCacheEntry entry;
+    std::string path;
+
+    if (!cache->appendFile || gst_discoverer_info_get_result(info) != GST_DISCOVERER_OK ||
+        !discoveryCacheIdentify(cache, uri, path, &entry.size, &entry.mtime, &entry.contentHash))
+    {
+        return;
+    }
+
+    GVariant *variant = gst_discoverer_info_to_variant(info, GST_DISCOVERER_SERIALIZE_ALL);
+    if (!variant)
+    {
+        return;
+    }
+    g_variant_ref_sink(variant);
+    entry.type = g_variant_get_type_string(variant);
+    entry.owned = g_variant_get_data_as_bytes(variant);
+    entry.value = (const guint8 *)g_bytes_get_data(entry.owned, &entry.valueLength);
+    g_variant_unref(variant);
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    discoveryCacheWriteRecord(cache->appendFile, path, &entry);
+    fflush(cache->appendFile);
+
+    auto it = cache->index.find(path);
+    if (it != cache->index.end())
+    {
+        discoveryCacheDropEntry(it->second);
+        it->second = entry;
+    }
+    else
+    {
+        cache->index.emplace(path, entry);
+    }
+}
+
+/*!
+ * @brief Forgets a file, e.g. when it's known to have changed in a way size/mtime don't show.
+ */
+static void discoveryCacheInvalidate(DiscoveryCache *cache, const gchar *uri)
+{
+    gchar *filename = g_filename_from_uri(uri, NULL, NULL);
+    if (!filename)
+    {
+        return;
+    }
+    std::string path = filename;
+    g_free(filename);
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    auto it = cache->index.find(path);
+    if (it == cache->index.end())
+    {
+        return;
+    }
+    discoveryCacheDropEntry(it->second);
+    cache->index.erase(it);
+    if (cache->appendFile)
+    {
+        discoveryCacheWriteRecord(cache->appendFile, path, NULL);
+        fflush(cache->appendFile);
+    }
+}
+
+/*!
+ * @brief Rewrites the cache file with only the live records and maps it again.
+ */
+static gboolean discoveryCacheCompact(DiscoveryCache *cache)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+    gchar *tmpLocation = g_strconcat(cache->location, ".tmp", NULL);
+    FILE *file = fopen(tmpLocation, "wb");
+    if (!file)
+    {
+        g_free(tmpLocation);
+        return FALSE;
+    }
+
+    for (auto &item : cache->index)
+    {
+        discoveryCacheWriteRecord(file, item.first, &item.second);
+    }
+    gboolean ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    fclose(file);
+    if (!ok || rename(tmpLocation, cache->location) != 0)
+    {
+        unlink(tmpLocation);
+        g_free(tmpLocation);
+        return FALSE;
+    }
+    g_free(tmpLocation);
+
+    // Every entry points into the old mapping or an owned copy; rebuild from the new file.
+    for (auto &item : cache->index)
+    {
+        discoveryCacheDropEntry(item.second);
+    }
+    cache->index.clear();
+    if (cache->mapping)
+    {
+        g_mapped_file_unref(cache->mapping);
+        cache->mapping = NULL;
+    }
+    if (cache->appendFile)
+    {
+        fclose(cache->appendFile);
+    }
+
+    discoveryCacheLoad(cache);
+    cache->appendFile = fopen(cache->location, "ab");
+    return TRUE;
+}
+
+static void discoveryCacheClose(DiscoveryCache *cache)
+{
+    for (auto &item : cache->index)
+    {
+        discoveryCacheDropEntry(item.second);
+    }
+    if (cache->appendFile)
+    {
+        fclose(cache->appendFile);
+    }
+    if (cache->mapping)
+    {
+        g_mapped_file_unref(cache->mapping);
+    }
+    g_free(cache->location);
+    delete cache;
+}
+
+#endif // DISCOVERY_CACHE_H
@@ -0,0 +1,217 @@
+/*!
+ * @brief Attaching and detaching tee branches while the pipeline keeps PLAYING. 07-Multi-Threading links its tee pads
+ * once before PLAYING; here recording/preview branches come and go at runtime without pausing the main path.
+ * @note Usage:- ./Dynamic-Tee-Branches.o [iterations] [interval-ms]
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/probes.html?gi-language=c#dynamically-switching-an-element-in-a-playing-pipeline
+ *
+ * Branches are added and removed with TeeBranch (Tee-Branch.h), which reports every finished removal back here.
+ *
+ * The stress test keeps a live videotestsrc -> tee -> queue -> fakesink main path running while it adds and removes
+ * branches `iterations` times, and reports dropped frames and stalls seen by the main sink.
+ */
+
+#include <gst/gst.h>
+#include <atomic>
+#include <vector>
+#include "Tee-Branch.h"
+
+#define FRAME_RATE 30
+
+typedef struct
+{
+    GstElement *pipeline, *tee;
+    GMainLoop *mainLoop;
+    std::vector<TeeBranch *> branches;
+    guint iterations, added, removed;
+    guint targetIterations;
+    gint64 removeLatencySum, removeLatencyMax;
+
+    // Main branch health, updated from its streaming thread.
+    std::atomic<guint64> mainFrames;
+    std::atomic<guint64> ptsGaps;
+    std::atomic<guint64> stalls;
+    std::atomic<gint64> maxArrivalGap;
+    GstClockTime lastPts;
+    gint64 lastArrival;
+} CustomData;
+
+/* ======= Stress test ==========*/
+
+static void onBranchRemoved(gint64 latencyUs, CustomData *data)
+{
+    data->removed++;
+    data->removeLatencySum += latencyUs;
+    data->removeLatencyMax = MAX(data->removeLatencyMax, latencyUs);
+    if (data->iterations >= data->targetIterations && data->removed == data->added)
+    {
+        g_main_loop_quit(data->mainLoop);
+    }
+}
+
+// Watches PTS continuity and wall-clock arrival on the main sink.
+static GstPadProbeReturn onMainBuffer(GstPad *pad, GstPadProbeInfo *info, CustomData *data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime frameDuration = GST_SECOND / FRAME_RATE;
+    gint64 now = g_get_monotonic_time();
+
+    if (GST_CLOCK_TIME_IS_VALID(data->lastPts) && GST_BUFFER_PTS_IS_VALID(buffer) &&
+        GST_BUFFER_PTS(buffer) > data->lastPts + frameDuration * 3 / 2)
+    {
+        data->ptsGaps += (GST_BUFFER_PTS(buffer) - data->lastPts) / frameDuration - 1;
+    }
+    if (data->lastArrival > 0)
+    {
+        gint64 gap = now - data->lastArrival;
+        if (gap > (gint64)(2 * frameDuration / GST_USECOND))
+        {
+            data->stalls++;
+        }
+        if (gap > data->maxArrivalGap)
+        {
+            data->maxArrivalGap = gap;
+        }
+    }
+
+    data->lastPts = GST_BUFFER_PTS(buffer);
+    data->lastArrival = now;
+    data->mainFrames++;
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean onTick(CustomData *data)
+{
+    // Alternate between a preview and a recording branch; recording drains through an encoder and a muxer.
+    static const gchar *descriptions[] = {
+        "queue ! videoconvert ! videoscale ! video/x-raw,width=160,height=120 ! fakesink sync=false async=false",
+        "queue ! videoconvert ! x264enc tune=zerolatency speed-preset=ultrafast ! h264parse ! mp4mux"
+        " ! fakesink sync=false async=false",
+    };
+
+    if (data->iterations >= data->targetIterations)
+    {
+        for (TeeBranch *branch : data->branches)
+        {
+            teeBranchRemove(branch);
+        }
+        data->branches.clear();
+        if (data->removed == data->added)
+        {
+            g_main_loop_quit(data->mainLoop);
+        }
+        return G_SOURCE_REMOVE;
+    }
+
+    // Keep up to two branches alive; remove the oldest, add a new one.
+    if (data->branches.size() >= 2)
+    {
+        teeBranchRemove(data->branches.front());
+        data->branches.erase(data->branches.begin());
+    }
+    TeeBranch *branch = teeBranchAdd(data->pipeline, data->tee, descriptions[data->iterations % 2],
+                                     (TeeBranchRemovedCallback)onBranchRemoved, data);
+    if (branch)
+    {
+        data->branches.push_back(branch);
+        data->added++;
+    }
+    data->iterations++;
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean busCallBack(GstBus *bus, GstMessage *message, CustomData *data)
+{
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR)
+    {
+        GError *err;
+        gchar *debugInfo;
+        gst_message_parse_error(message, &err, &debugInfo);
+        gst_printerr("\nError from %s: %s", GST_OBJECT_NAME(message->src), err->message);
+        g_free(debugInfo);
+        g_clear_error(&err);
+        g_main_loop_quit(data->mainLoop);
+    }
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    CustomData data;
+    GError *err = NULL;
+    guint intervalMs = 50;
+
+    data.targetIterations = 300;
+    if (argc > 1)
+    {
+        data.targetIterations = (guint)g_ascii_strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        intervalMs = (guint)g_ascii_strtoull(argv[2], NULL, 10);
+    }
+
+    gst_init(NULL, NULL);
+
+    data.iterations = data.added = data.removed = 0;
+    data.removeLatencySum = data.removeLatencyMax = 0;
+    data.mainFrames = data.ptsGaps = data.stalls = 0;
+    data.maxArrivalGap = 0;
+    data.lastPts = GST_CLOCK_TIME_NONE;
+    data.lastArrival = 0;
+
+    gchar *description = g_strdup_printf(
+        "videotestsrc is-live=true ! video/x-raw,width=320,height=240,framerate=%d/1 ! tee name=tee allow-not-linked=true"
+        " tee. ! queue ! fakesink name=mainSink sync=true",
+        FRAME_RATE);
+    data.pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!data.pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    data.tee = gst_bin_get_by_name(GST_BIN(data.pipeline), "tee");
+
+    GstElement *mainSink = gst_bin_get_by_name(GST_BIN(data.pipeline), "mainSink");
+    GstPad *mainPad = gst_element_get_static_pad(mainSink, "sink");
+    gst_pad_add_probe(mainPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onMainBuffer, &data, NULL);
+    gst_object_unref(mainPad);
+    gst_object_unref(mainSink);
+
+    GstBus *bus = gst_element_get_bus(data.pipeline);
+    gst_bus_add_watch(bus, (GstBusFunc)busCallBack, &data);
+
+    if (gst_element_set_state(data.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the pipeline.");
+        gst_object_unref(data.pipeline);
+        return -1;
+    }
+
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    gint64 start = g_get_monotonic_time();
+    g_timeout_add(intervalMs, (GSourceFunc)onTick, &data);
+    g_main_loop_run(data.mainLoop);
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+    guint64 expected = (guint64)(seconds * FRAME_RATE);
+    guint64 frames = data.mainFrames;
+    g_print("\nIterations %u: %u branches added, %u removed in %.1f s", data.iterations, data.added, data.removed, seconds);
+    g_print("\nRemove latency: mean %.1f ms, max %.1f ms",
+            data.removed ? data.removeLatencySum / 1000.0 / data.removed : 0.0,
+            data.removeLatencyMax / 1000.0);
+    g_print("\nMain branch: %" G_GUINT64_FORMAT " frames (~%" G_GUINT64_FORMAT " expected), %" G_GUINT64_FORMAT
+            " dropped, %" G_GUINT64_FORMAT " stalls, max gap %.1f ms\n",
+            frames, expected, (guint64)data.ptsGaps, (guint64)data.stalls, data.maxArrivalGap / 1000.0);
+
+    gboolean glitchFree = data.ptsGaps == 0 && data.stalls == 0;
+
+    g_main_loop_unref(data.mainLoop);
+    gst_object_unref(bus);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    gst_object_unref(data.tee);
+    gst_object_unref(data.pipeline);
+
+    return glitchFree ? 0 : -1;
+}
@@ -0,0 +1,427 @@
+/*!
+ * @brief x264enc tuning matrix for the recording chain of 06-Pad-Caps-Play-Pause. No hardware needed.
+ * @note Usage:- ./Encoder-Matrix.o [--frames=N] [--width=PX] [--height=PX] [--presets=a,b] [--tunes=a,b]
+ *               [--threads=a,b] [--bitrates=a,b] [--key-ints=a,b]
+ * @link https://gstreamer.freedesktop.org/documentation/x264/index.html?gi-language=c
+ *
+ * For every combination of speed-preset, tune, threads, bitrate (kbit/s) and key-int-max, two passes run:
+ *  1. Encode: videotestsrc ! videoconvert ! x264enc ! h264parse ! mp4mux ! filesink, unsynced, into a temp file.
+ *     Probes on the encoder's sink pad and the parser's src pad give per-frame encoder latency (by PTS, so B-frame
+ *     reordering and lookahead show up as latency); source, conversion and muxing are not included. fps is frames /
+ *     wall time.
+ *  2. Quality: the file is decoded again and compared frame by frame against a second, identical videotestsrc run.
+ *     The source is deterministic (SMPTE bars scrolling with horizontal-speed), so no reference frames are stored.
+ *     PSNR and SSIM (8x8 blocks) are computed on luma. Both appsinks hold at most QUALITY_MAX_BUFFERS frames and
+ *     block rather than drop, so the two pipelines run in lockstep with the comparison.
+ * Every configuration prints one JSON line, like Benchmark-Harness.
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Frames either quality pipeline may run ahead of the comparison.
+#define QUALITY_MAX_BUFFERS 4
+
+typedef struct
+{
+    std::string preset, tune;
+    gint threads, bitrate, keyInt;
+} EncoderConfig;
+
+typedef struct
+{
+    std::mutex lock;
+    std::unordered_map<GstClockTime, gint64> entryTimes;
+    std::vector<gint64> latencies;
+} LatencyProbe;
+
+static gint frames = 300;
+static gint width = 1280;
+static gint height = 720;
+static gchar *presets = NULL;
+static gchar *tunes = NULL;
+static gchar *threadCounts = NULL;
+static gchar *bitrates = NULL;
+static gchar *keyInts = NULL;
+
+static GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames, "Frames per configuration", "N"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width", "PX"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height", "PX"},
+    {"presets", 0, 0, G_OPTION_ARG_STRING, &presets, "speed-preset values (default ultrafast,veryfast,medium)", "LIST"},
+    {"tunes", 0, 0, G_OPTION_ARG_STRING, &tunes, "tune values, none for no tune (default none,zerolatency)", "LIST"},
+    {"threads", 0, 0, G_OPTION_ARG_STRING, &threadCounts, "threads values, 0 = auto (default 1,0)", "LIST"},
+    {"bitrates", 0, 0, G_OPTION_ARG_STRING, &bitrates, "bitrate values in kbit/s (default 1000,4000)", "LIST"},
+    {"key-ints", 0, 0, G_OPTION_ARG_STRING, &keyInts, "key-int-max values (default 30,250)", "LIST"},
+    {NULL}};
+
+static gchar *sourceDescription()
+{
+    return g_strdup_printf("videotestsrc num-buffers=%d pattern=smpte horizontal-speed=4 ! "
+                           "video/x-raw,format=I420,width=%d,height=%d,framerate=30/1",
+                           frames, width, height);
+}
+
+static std::vector<std::string> splitList(const gchar *list, const gchar *fallback)
+{
+    std::vector<std::string> values;
+    gchar **parts = g_strsplit(list ? list : fallback, ",", -1);
+    for (gchar **part = parts; *part; part++)
+    {
+        if (**part)
+        {
+            values.push_back(g_strstrip(*part));
+        }
+    }
+    g_strfreev(parts);
+    return values;
+}
+
+static gboolean waitForEos(GstElement *pipeline)
+{
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok)
+    {
+        GError *err;
+        gst_message_parse_error(msg, &err, NULL);
+        gst_printerr("\nError from %s: %s", GST_OBJECT_NAME(msg->src), err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    return ok;
+}
+
+/* ======= Encode pass ==========*/
+
+static GstPadProbeReturn onEncoderIn(GstPad *pad, GstPadProbeInfo *info, LatencyProbe *probe)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    std::lock_guard<std::mutex> guard(probe->lock);
+    probe->entryTimes[GST_BUFFER_PTS(buffer)] = g_get_monotonic_time();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn onParserOut(GstPad *pad, GstPadProbeInfo *info, LatencyProbe *probe)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    gint64 now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(probe->lock);
+    auto it = probe->entryTimes.find(GST_BUFFER_PTS(buffer));
+    if (it != probe->entryTimes.end())
+    {
+        probe->latencies.push_back(now - it->second);
+        probe->entryTimes.erase(it);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void addProbe(GstElement *pipeline, const gchar *element, const gchar *padName, GstPadProbeCallback callback,
+                     LatencyProbe *probe)
+{
+    GstElement *e = gst_bin_get_by_name(GST_BIN(pipeline), element);
+    GstPad *pad = gst_element_get_static_pad(e, padName);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, probe, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(e);
+}
+
+/*!
+ * @brief Encodes into location. Returns the wall time in seconds, or -1 on failure.
+ */
+static gdouble encode(const EncoderConfig &config, const gchar *location, LatencyProbe *probe)
+{
+    GError *err = NULL;
+    gchar *source = sourceDescription();
+    gchar *tune = config.tune == "none" ? g_strdup("") : g_strdup_printf(" tune=%s", config.tune.c_str());
+    gchar *description = g_strdup_printf(
+        "%s ! videoconvert ! x264enc name=enc speed-preset=%s%s threads=%d bitrate=%d key-int-max=%d ! "
+        "h264parse name=parse ! mp4mux ! filesink location=\"%s\"",
+        source, config.preset.c_str(), tune, config.threads, config.bitrate, config.keyInt, location);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    g_free(tune);
+    g_free(source);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the encoder: %s", err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+
+    addProbe(pipeline, "enc", "sink", (GstPadProbeCallback)onEncoderIn, probe);
+    addProbe(pipeline, "parse", "src", (GstPadProbeCallback)onParserOut, probe);
+
+    gint64 start = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    gboolean ok = waitForEos(pipeline);
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok ? seconds : -1;
+}
+
+/* ======= Quality pass ==========*/
+
+static gdouble blockSsim(const guint8 *a, gint strideA, const guint8 *b, gint strideB)
+{
+    const gdouble c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+    gdouble sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+
+    for (gint y = 0; y < 8; y++)
+    {
+        for (gint x = 0; x < 8; x++)
+        {
+            gdouble va = a[y * strideA + x], vb = b[y * strideB + x];
+            sumA += va;
+            sumB += vb;
+            sumAA += va * va;
+            sumBB += vb * vb;
+            sumAB += va * vb;
+        }
+    }
+    gdouble meanA = sumA / 64, meanB = sumB / 64;
+    gdouble varA = sumAA / 64 - meanA * meanA, varB = sumBB / 64 - meanB * meanB;
+    gdouble cov = sumAB / 64 - meanA * meanB;
+    return ((2 * meanA * meanB + c1) * (2 * cov + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+}
+
+/*!
+ * @brief Luma squared error sum and mean block SSIM of one frame pair. FALSE if either frame can't be mapped.
+ */
+static gboolean compareFrames(GstSample *reference, GstSample *decoded, gdouble *sse, gdouble *ssim)
+{
+    GstVideoInfo info;
+    GstVideoFrame a, b;
+    if (!gst_video_info_from_caps(&info, gst_sample_get_caps(reference)) ||
+        !gst_video_frame_map(&a, &info, gst_sample_get_buffer(reference), GST_MAP_READ))
+    {
+        return FALSE;
+    }
+    if (!gst_video_info_from_caps(&info, gst_sample_get_caps(decoded)) ||
+        !gst_video_frame_map(&b, &info, gst_sample_get_buffer(decoded), GST_MAP_READ))
+    {
+        gst_video_frame_unmap(&a);
+        return FALSE;
+    }
+
+    const guint8 *pa = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&a, 0);
+    const guint8 *pb = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&b, 0);
+    gint sa = GST_VIDEO_FRAME_PLANE_STRIDE(&a, 0), sb = GST_VIDEO_FRAME_PLANE_STRIDE(&b, 0);
+    gint w = MIN(GST_VIDEO_FRAME_WIDTH(&a), GST_VIDEO_FRAME_WIDTH(&b));
+    gint h = MIN(GST_VIDEO_FRAME_HEIGHT(&a), GST_VIDEO_FRAME_HEIGHT(&b));
+
+    *sse = 0;
+    for (gint y = 0; y < h; y++)
+    {
+        for (gint x = 0; x < w; x++)
+        {
+            gdouble d = (gdouble)pa[y * sa + x] - pb[y * sb + x];
+            *sse += d * d;
+        }
+    }
+
+    gdouble sum = 0;
+    guint blocks = 0;
+    for (gint y = 0; y + 8 <= h; y += 8)
+    {
+        for (gint x = 0; x + 8 <= w; x += 8)
+        {
+            sum += blockSsim(pa + y * sa + x, sa, pb + y * sb + x, sb);
+            blocks++;
+        }
+    }
+    *ssim = blocks ? sum / blocks : 1.0;
+
+    gst_video_frame_unmap(&a);
+    gst_video_frame_unmap(&b);
+    return TRUE;
+}
+
+static GstElement *startAppSinkPipeline(const gchar *description, GstElement **sink)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build \"%s\": %s", description, err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+    *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    return pipeline;
+}
+
+/*!
+ * @brief Mean luma PSNR and SSIM of the encoded file against a fresh run of the source. FALSE if nothing decoded or a
+ * frame couldn't be read.
+ */
+static gboolean measureQuality(const gchar *location, gdouble *psnr, gdouble *ssim)
+{
+    gchar *source = sourceDescription();
+    gchar *referenceDescription =
+        g_strdup_printf("%s ! appsink name=sink sync=false max-buffers=%d drop=false", source, QUALITY_MAX_BUFFERS);
+    gchar *decodedDescription = g_strdup_printf(
+        "filesrc location=\"%s\" ! decodebin ! videoconvert ! video/x-raw,format=I420 ! "
+        "appsink name=sink sync=false max-buffers=%d drop=false",
+        location, QUALITY_MAX_BUFFERS);
+    GstElement *referenceSink = NULL, *decodedSink = NULL;
+    GstElement *reference = startAppSinkPipeline(referenceDescription, &referenceSink);
+    GstElement *decoded = startAppSinkPipeline(decodedDescription, &decodedSink);
+    g_free(decodedDescription);
+    g_free(referenceDescription);
+    g_free(source);
+
+    guint compared = 0;
+    gboolean unreadable = FALSE;
+    gdouble sseSum = 0, ssimSum = 0;
+    gdouble pixels = (gdouble)width * height;
+
+    while (reference && decoded)
+    {
+        GstSample *a = gst_app_sink_try_pull_sample(GST_APP_SINK(referenceSink), 10 * GST_SECOND);
+        GstSample *b = a ? gst_app_sink_try_pull_sample(GST_APP_SINK(decodedSink), 10 * GST_SECOND) : NULL;
+        if (!a || !b)
+        {
+            if (a)
+                gst_sample_unref(a);
+            break;
+        }
+        gdouble sse, frameSsim;
+        unreadable = !compareFrames(a, b, &sse, &frameSsim);
+        gst_sample_unref(a);
+        gst_sample_unref(b);
+        if (unreadable)
+        {
+            gst_printerr("\nCouldn't map frame %u for comparison.", compared);
+            break;
+        }
+        sseSum += sse;
+        ssimSum += frameSsim;
+        compared++;
+    }
+
+    for (GstElement *pipeline : {reference, decoded})
+    {
+        if (pipeline)
+        {
+            gst_element_set_state(pipeline, GST_STATE_NULL);
+            gst_object_unref(pipeline);
+        }
+    }
+    if (referenceSink)
+        gst_object_unref(referenceSink);
+    if (decodedSink)
+        gst_object_unref(decodedSink);
+
+    if (compared == 0 || unreadable)
+    {
+        return FALSE;
+    }
+    gdouble mse = sseSum / (compared * pixels);
+    *psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    *ssim = ssimSum / compared;
+    return TRUE;
+}
+
+/* ======= Matrix ==========*/
+
+static gint64 percentile(const std::vector<gint64> &sorted, gdouble pct)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)((pct / 100.0) * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static gboolean runConfig(const EncoderConfig &config, const gchar *location)
+{
+    LatencyProbe probe;
+    gdouble seconds = encode(config, location, &probe);
+    gdouble psnr = 0, ssim = 0;
+    GStatBuf st;
+
+    if (seconds <= 0 || g_stat(location, &st) != 0 || !measureQuality(location, &psnr, &ssim))
+    {
+        gst_printerr("\nConfiguration %s/%s/%d/%d/%d failed.", config.preset.c_str(), config.tune.c_str(),
+                     config.threads, config.bitrate, config.keyInt);
+        return FALSE;
+    }
+
+    std::sort(probe.latencies.begin(), probe.latencies.end());
+    g_print("{\"speed_preset\": \"%s\", \"tune\": \"%s\", \"threads\": %d, \"bitrate_kbps\": %d, \"key_int_max\": %d, "
+            "\"fps\": %.1f, \"encoder_latency_ms\": {\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+            "\"size_bytes\": %" G_GINT64_FORMAT ", \"psnr_y_db\": %.2f, \"ssim_y\": %.4f}\n",
+            config.preset.c_str(), config.tune.c_str(), config.threads, config.bitrate, config.keyInt,
+            frames / seconds,
+            percentile(probe.latencies, 50) / 1000.0, percentile(probe.latencies, 99) / 1000.0,
+            probe.latencies.empty() ? 0.0 : probe.latencies.back() / 1000.0,
+            (gint64)st.st_size, psnr, ssim);
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- benchmark x264enc settings");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    frames = MAX(frames, 1);
+
+    std::vector<std::string> presetList = splitList(presets, "ultrafast,veryfast,medium");
+    std::vector<std::string> tuneList = splitList(tunes, "none,zerolatency");
+    std::vector<std::string> threadList = splitList(threadCounts, "1,0");
+    std::vector<std::string> bitrateList = splitList(bitrates, "1000,4000");
+    std::vector<std::string> keyIntList = splitList(keyInts, "30,250");
+
+    gchar *location = g_build_filename(g_get_tmp_dir(), "encoder-matrix.mp4", NULL);
+    guint failed = 0;
+
+    for (const std::string &preset : presetList)
+        for (const std::string &tune : tuneList)
+            for (const std::string &threads : threadList)
+                for (const std::string &bitrate : bitrateList)
+                    for (const std::string &keyInt : keyIntList)
+                    {
+                        EncoderConfig config = {preset, tune, atoi(threads.c_str()), atoi(bitrate.c_str()),
+                                                atoi(keyInt.c_str())};
+                        if (!runConfig(config, location))
+                        {
+                            failed++;
+                        }
+                    }
+
+    g_remove(location);
+    g_free(location);
+    g_free(presets);
+    g_free(tunes);
+    g_free(threadCounts);
+    g_free(bitrates);
+    g_free(keyInts);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,149 @@
+/*!
+ * @brief Compares the zero-copy FrameBridge against the naive gst_buffer_new_allocate() + memcpy path at 1080p60.
+ * @note Usage:- ./Frame-Bridge-Benchmark.o [num-frames]
+ *
+ * Pipeline:- videotestsrc ! video/x-raw,format=I420,width=1920,height=1080,framerate=60/1 ! appsink
+ *            appsrc ! fakesink
+ * The two halves are connected by a FrameBridge (see Frame-Bridge.h) whose callback inverts the luma plane.
+ * The videotestsrc isn't live, so the measured fps is how fast the bridge can go, not the nominal 60.
+ */
+
+#include <gst/gst.h>
+#include <string.h>
+#include "Frame-Bridge.h"
+
+typedef struct
+{
+    GstElement *pipeline, *appSink, *appSrc;
+    FrameBridge *bridge;
+} CustomData;
+
+/*!
+ * @brief Our "processing": inverted luma, chroma copied over.
+ */
+static void invertLuma(GstVideoFrame *in, GstVideoFrame *out, gpointer userData)
+{
+    guint width = GST_VIDEO_FRAME_COMP_WIDTH(in, 0);
+    guint height = GST_VIDEO_FRAME_COMP_HEIGHT(in, 0);
+    const guint8 *src = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(in, 0);
+    guint8 *dst = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(out, 0);
+    gint srcStride = GST_VIDEO_FRAME_PLANE_STRIDE(in, 0);
+    gint dstStride = GST_VIDEO_FRAME_PLANE_STRIDE(out, 0);
+
+    for (guint y = 0; y < height; y++)
+    {
+        for (guint x = 0; x < width; x++)
+        {
+            dst[y * dstStride + x] = 255 - src[y * srcStride + x];
+        }
+    }
+
+    for (guint plane = 1; plane < GST_VIDEO_FRAME_N_PLANES(in); plane++)
+    {
+        gst_video_frame_copy_plane(out, in, plane);
+    }
+}
+
+/*!
+ * @brief Runs numFrames through the bridge and prints the throughput. Returns FALSE on failure.
+ */
+static gboolean runBenchmark(guint numFrames, gboolean copyMode)
+{
+    CustomData data;
+    GError *err = NULL;
+
+    gchar *description = g_strdup_printf(
+        "videotestsrc num-buffers=%u ! video/x-raw,format=I420,width=1920,height=1080,framerate=60/1"
+        " ! appsink name=bridgeIn"
+        " appsrc name=bridgeOut ! fakesink sync=false",
+        numFrames);
+    data.pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!data.pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    data.appSink = gst_bin_get_by_name(GST_BIN(data.pipeline), "bridgeIn");
+    data.appSrc = gst_bin_get_by_name(GST_BIN(data.pipeline), "bridgeOut");
+
+    GstCaps *caps = gst_caps_from_string("video/x-raw,format=I420,width=1920,height=1080,framerate=60/1");
+    data.bridge = frameBridgeNew(data.appSink, data.appSrc, caps, 8, 8, invertLuma, NULL, copyMode);
+    gst_caps_unref(caps);
+    if (!data.bridge)
+    {
+        gst_object_unref(data.appSink);
+        gst_object_unref(data.appSrc);
+        gst_object_unref(data.pipeline);
+        return FALSE;
+    }
+
+    gint64 startTime = g_get_monotonic_time();
+    if (gst_element_set_state(data.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the pipeline.");
+        frameBridgeStop(data.bridge);
+        gst_element_set_state(data.pipeline, GST_STATE_NULL);
+        frameBridgeFree(data.bridge);
+        gst_object_unref(data.appSink);
+        gst_object_unref(data.appSrc);
+        gst_object_unref(data.pipeline);
+        return FALSE;
+    }
+
+    // EOS only reaches the bus once appsrc has forwarded it, i.e. after the last processed frame.
+    GstBus *bus = gst_element_get_bus(data.pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gint64 elapsed = g_get_monotonic_time() - startTime;
+
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok)
+    {
+        gchar *debugInfo;
+        gst_message_parse_error(msg, &err, &debugInfo);
+        gst_printerr("\nError from %s: %s", GST_OBJECT_NAME(msg->src), err->message);
+        g_clear_error(&err);
+        g_free(debugInfo);
+    }
+    gst_message_unref(msg);
+
+    guint64 framesOut = data.bridge->framesOut;
+    guint64 allocations = data.bridge->allocations;
+    gdouble fps = framesOut / (elapsed / 1e6);
+    g_print("\n%-10s frames %-6" G_GUINT64_FORMAT " time %8.3f s  fps %7.1f  (%s 1080p60)  allocations/frame %.2f",
+            copyMode ? "naive" : "zero-copy",
+            framesOut,
+            elapsed / 1e6,
+            fps,
+            fps >= 60.0 ? "sustains" : "misses",
+            framesOut ? (gdouble)allocations / framesOut : 0.0);
+
+    frameBridgeStop(data.bridge);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+    frameBridgeFree(data.bridge);
+    gst_object_unref(bus);
+    gst_object_unref(data.appSink);
+    gst_object_unref(data.appSrc);
+    gst_object_unref(data.pipeline);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    guint numFrames = 600;
+    if (argc > 1)
+    {
+        numFrames = (guint)g_ascii_strtoull(argv[1], NULL, 10);
+    }
+
+    gst_init(NULL, NULL);
+
+    gboolean ok = runBenchmark(numFrames, TRUE);
+    ok = runBenchmark(numFrames, FALSE) && ok;
+    g_print("\n");
+
+    return ok ? 0 : -1;
+}
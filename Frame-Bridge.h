@@ -0,0 +1,338 @@
+/*!
+ * @brief FrameBridge. Pulls raw video frames out of a pipeline through appsink, hands them to our own C++ code and
+ * pushes the result back in through appsrc.
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/short-cutting-the-pipeline.html?gi-language=c
+ *
+ * The appsink callback runs on the upstream streaming thread and only refs the GstBuffer into a fixed size
+ * single-producer/single-consumer ring. Either side blocks on a condition variable while the ring is full or empty.
+ * A worker thread pops the buffer, maps it in place (no copy) and maps an output buffer acquired from a GstBufferPool
+ * which was allocated up front. Once appsrc and downstream are done with an output buffer it goes back to the pool, so
+ * in steady state nothing is malloc'ed per frame.
+ *
+ * A frame which can't be mapped is dropped and the error flow goes back upstream from the next appsink callback, as
+ * does any downstream flow other than FLUSHING.
+ *
+ * copyMode keeps the naive path around for comparison: the input is copied into a gst_buffer_new_allocate() buffer
+ * and the output is freshly allocated for every frame.
+ */
+
+#ifndef FRAME_BRIDGE_H
+#define FRAME_BRIDGE_H
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideopool.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Processes one frame. Both frames are mapped and have the same format and size.
+typedef void (*FrameCallback)(GstVideoFrame *in, GstVideoFrame *out, gpointer userData);
+
+typedef struct
+{
+    GstAppSink *appSink;
+    GstAppSrc *appSrc;
+    GstVideoInfo info;
+    GstBufferPool *pool;
+    FrameCallback callback;
+    gpointer userData;
+    gboolean copyMode;
+
+    // SPSC ring. head is only written by the appsink thread, tail only by the worker.
+    GstBuffer **ring;
+    guint ringSize;
+    std::atomic<guint> head, tail;
+
+    // Held around ring updates and the eos/stop/flow changes the other side waits for.
+    std::mutex waitLock;
+    std::condition_variable dataReady, spaceFree;
+    std::atomic<gboolean> eos, stop;
+    // Set by the worker when it gives up; returned to upstream.
+    std::atomic<GstFlowReturn> flow;
+    std::thread worker;
+
+    std::atomic<guint64> framesIn, framesOut, allocations;
+} FrameBridge;
+
+static gboolean frameBridgeRingPush(FrameBridge *bridge, GstBuffer *buffer)
+{
+    guint head = bridge->head.load(std::memory_order_relaxed);
+    guint next = (head + 1) % bridge->ringSize;
+    if (next == bridge->tail.load(std::memory_order_acquire))
+    {
+        return FALSE;
+    }
+    bridge->ring[head] = buffer;
+    bridge->head.store(next, std::memory_order_release);
+    return TRUE;
+}
+
+static GstBuffer *frameBridgeRingPop(FrameBridge *bridge)
+{
+    guint tail = bridge->tail.load(std::memory_order_relaxed);
+    if (tail == bridge->head.load(std::memory_order_acquire))
+    {
+        return NULL;
+    }
+    GstBuffer *buffer = bridge->ring[tail];
+    bridge->tail.store((tail + 1) % bridge->ringSize, std::memory_order_release);
+    return buffer;
+}
+
+static GstFlowReturn frameBridgeOnNewSample(GstAppSink *appSink, gpointer userData)
+{
+    FrameBridge *bridge = (FrameBridge *)userData;
+    GstSample *sample = gst_app_sink_pull_sample(appSink);
+    if (!sample)
+    {
+        return GST_FLOW_EOS;
+    }
+
+    GstBuffer *buffer = gst_buffer_ref(gst_sample_get_buffer(sample));
+    gst_sample_unref(sample);
+
+    // Ring full: the worker is behind, hold the streaming thread back instead of dropping.
+    std::unique_lock<std::mutex> guard(bridge->waitLock);
+    while (bridge->flow == GST_FLOW_OK && !bridge->stop && !frameBridgeRingPush(bridge, buffer))
+    {
+        bridge->spaceFree.wait(guard);
+    }
+    GstFlowReturn flow = bridge->stop ? GST_FLOW_FLUSHING : bridge->flow.load();
+    guard.unlock();
+
+    if (flow != GST_FLOW_OK)
+    {
+        gst_buffer_unref(buffer);
+        return flow;
+    }
+    bridge->dataReady.notify_one();
+    bridge->framesIn++;
+    return GST_FLOW_OK;
+}
+
+static void frameBridgeOnEos(GstAppSink *appSink, gpointer userData)
+{
+    FrameBridge *bridge = (FrameBridge *)userData;
+    {
+        std::lock_guard<std::mutex> guard(bridge->waitLock);
+        bridge->eos = TRUE;
+    }
+    bridge->dataReady.notify_one();
+}
+
+/*!
+ * @brief Gets the buffer the result is written to. From the pool, or freshly allocated in copyMode.
+ */
+static GstFlowReturn frameBridgeOutputBuffer(FrameBridge *bridge, GstBuffer **out)
+{
+    if (bridge->copyMode)
+    {
+        bridge->allocations++;
+        *out = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&bridge->info), NULL);
+        return *out ? GST_FLOW_OK : GST_FLOW_ERROR;
+    }
+    return gst_buffer_pool_acquire_buffer(bridge->pool, out, NULL);
+}
+
+/*!
+ * @brief Runs the callback on one frame and pushes the result. A frame which can't be mapped is dropped with
+ * GST_FLOW_ERROR; otherwise returns what acquiring the output buffer or pushing it returned.
+ */
+static GstFlowReturn frameBridgeProcess(FrameBridge *bridge, GstBuffer *in)
+{
+    GstVideoFrame inFrame, outFrame;
+    GstBuffer *source = in;
+
+    if (bridge->copyMode)
+    {
+        GstMapInfo map;
+        if (!gst_buffer_map(in, &map, GST_MAP_READ))
+        {
+            GST_ELEMENT_ERROR(bridge->appSrc, RESOURCE, READ, ("Failed to map an input frame."), (NULL));
+            return GST_FLOW_ERROR;
+        }
+        source = gst_buffer_new_allocate(NULL, map.size, NULL);
+        gst_buffer_fill(source, 0, map.data, map.size);
+        gst_buffer_unmap(in, &map);
+        bridge->allocations++;
+    }
+
+    GstBuffer *out = NULL;
+    GstFlowReturn flow = frameBridgeOutputBuffer(bridge, &out);
+    if (flow != GST_FLOW_OK)
+    {
+        if (source != in)
+            gst_buffer_unref(source);
+        return flow;
+    }
+
+    gboolean mapped = FALSE;
+    if (gst_video_frame_map(&inFrame, &bridge->info, source, GST_MAP_READ))
+    {
+        if (gst_video_frame_map(&outFrame, &bridge->info, out, GST_MAP_WRITE))
+        {
+            bridge->callback(&inFrame, &outFrame, bridge->userData);
+            gst_video_frame_unmap(&outFrame);
+            mapped = TRUE;
+        }
+        gst_video_frame_unmap(&inFrame);
+    }
+
+    GST_BUFFER_PTS(out) = GST_BUFFER_PTS(in);
+    GST_BUFFER_DTS(out) = GST_BUFFER_DTS(in);
+    GST_BUFFER_DURATION(out) = GST_BUFFER_DURATION(in);
+
+    if (source != in)
+    {
+        gst_buffer_unref(source);
+    }
+    if (!mapped)
+    {
+        // Never push the output: it holds whatever the pool's memory held before.
+        gst_buffer_unref(out);
+        GST_ELEMENT_ERROR(bridge->appSrc, RESOURCE, READ, ("Failed to map a frame for the callback."), (NULL));
+        return GST_FLOW_ERROR;
+    }
+
+    // appsrc takes ownership. The buffer returns to the pool once downstream drops it.
+    flow = gst_app_src_push_buffer(bridge->appSrc, out);
+    if (flow == GST_FLOW_OK)
+    {
+        bridge->framesOut++;
+    }
+    return flow;
+}
+
+static void frameBridgeWorker(FrameBridge *bridge)
+{
+    std::unique_lock<std::mutex> guard(bridge->waitLock);
+    while (!bridge->stop)
+    {
+        GstBuffer *in = frameBridgeRingPop(bridge);
+        if (!in)
+        {
+            // Ring drained after EOS: forward it.
+            if (bridge->eos)
+            {
+                guard.unlock();
+                gst_app_src_end_of_stream(bridge->appSrc);
+                return;
+            }
+            bridge->dataReady.wait(guard);
+            continue;
+        }
+        guard.unlock();
+        bridge->spaceFree.notify_one();
+
+        GstFlowReturn flow = frameBridgeProcess(bridge, in);
+        gst_buffer_unref(in);
+
+        guard.lock();
+        // Flushing only drops the frame (e.g. during a seek); anything else ends the stream.
+        if (flow != GST_FLOW_OK && flow != GST_FLOW_FLUSHING)
+        {
+            bridge->flow = flow;
+            guard.unlock();
+            bridge->spaceFree.notify_one();
+            return;
+        }
+    }
+}
+
+/*!
+ * @brief Connects appsink -> callback -> appsrc. caps must be fixed raw video caps; they are used on both ends.
+ * At most ringSize input frames wait for the worker and poolSize output buffers are in flight.
+ */
+static FrameBridge *frameBridgeNew(GstElement *appSink, GstElement *appSrc, GstCaps *caps, guint ringSize,
+                                   guint poolSize, FrameCallback callback, gpointer userData, gboolean copyMode)
+{
+    FrameBridge *bridge = new FrameBridge();
+
+    if (!gst_video_info_from_caps(&bridge->info, caps))
+    {
+        gst_printerr("\nFrameBridge needs fixed raw video caps.");
+        delete bridge;
+        return NULL;
+    }
+
+    bridge->appSink = GST_APP_SINK(gst_object_ref(appSink));
+    bridge->appSrc = GST_APP_SRC(gst_object_ref(appSrc));
+    bridge->callback = callback;
+    bridge->userData = userData;
+    bridge->copyMode = copyMode;
+    bridge->ringSize = ringSize + 1;
+    bridge->ring = g_new0(GstBuffer *, bridge->ringSize);
+    bridge->head = 0;
+    bridge->tail = 0;
+    bridge->eos = FALSE;
+    bridge->stop = FALSE;
+    bridge->flow = GST_FLOW_OK;
+    bridge->framesIn = 0;
+    bridge->framesOut = 0;
+    bridge->allocations = 0;
+
+    // All output buffers are allocated when the pool is activated; max == min so it never grows.
+    bridge->pool = gst_video_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(bridge->pool);
+    gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(&bridge->info), poolSize, poolSize);
+    gst_buffer_pool_set_config(bridge->pool, config);
+    gst_buffer_pool_set_active(bridge->pool, TRUE);
+
+    g_object_set(appSink, "sync", FALSE, "caps", caps, NULL);
+    g_object_set(appSrc, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+
+    GstAppSinkCallbacks callbacks = {};
+    callbacks.eos = frameBridgeOnEos;
+    callbacks.new_sample = frameBridgeOnNewSample;
+    gst_app_sink_set_callbacks(bridge->appSink, &callbacks, bridge, NULL);
+
+    bridge->worker = std::thread(frameBridgeWorker, bridge);
+    return bridge;
+}
+
+/*!
+ * @brief Stops the worker. Call before setting the pipeline to NULL so no streaming thread is left waiting on us.
+ */
+static void frameBridgeStop(FrameBridge *bridge)
+{
+    if (bridge->stop)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(bridge->waitLock);
+        bridge->stop = TRUE;
+    }
+    bridge->dataReady.notify_one();
+    bridge->spaceFree.notify_one();
+    // Wakes the worker up if it waits for a free output buffer.
+    gst_buffer_pool_set_flushing(bridge->pool, TRUE);
+    bridge->worker.join();
+}
+
+/*!
+ * @brief Releases everything. The pipeline must be in NULL state.
+ */
+static void frameBridgeFree(FrameBridge *bridge)
+{
+    frameBridgeStop(bridge);
+
+    GstBuffer *in;
+    while ((in = frameBridgeRingPop(bridge)) != NULL)
+    {
+        gst_buffer_unref(in);
+    }
+
+    gst_buffer_pool_set_active(bridge->pool, FALSE);
+    gst_object_unref(bridge->pool);
+    gst_object_unref(bridge->appSink);
+    gst_object_unref(bridge->appSrc);
+    g_free(bridge->ring);
+    delete bridge;
+}
+
+#endif // FRAME_BRIDGE_H
@@ -0,0 +1,273 @@
+/*!
+ * @brief Samples per second and buffer allocations of fusedaudio (Fused-Audio.h) against audioconvert ! audioresample.
+ * @note Usage:- ./Fused-Audio-Benchmark.o [--buffers=N] [--samples-per-buffer=N] [--quality=0..10]
+ * @link https://gstreamer.freedesktop.org/documentation/audioconvert/index.html?gi-language=c
+ *
+ * Every run is audiotestsrc ! <input caps> ! <stage> ! <output caps> ! fakesink for these cases:
+ *   S16 mono 44.1k   -> F32 stereo 48k   (upsample, up-mix, format)
+ *   S16 stereo 48k   -> S16 stereo 44.1k (downsample only)
+ *   F32 stereo 48k   -> S16 stereo 48k   (format only)
+ *   S16 stereo 48k   -> F32 mono 48k     (same frame size: fusedaudio works in place)
+ * The stage is timed with pad probes (Stage-Timer.h) from its first sink pad to its last src pad. A buffer leaving an
+ * element of the stage counts as an allocation when it isn't the memory that came in and didn't come from a buffer
+ * pool.
+ * One JSON line per run. Fails if fusedaudio errors out, produces a different number of samples (beyond one per
+ * buffer of rounding) or allocates more than the chain.
+ *
+ * Then, for every quality 0..10, both fusedaudio and audioresample resample-method=blackman-nuttall take F32 mono 48k
+ * to 44.1k for a 1 kHz tone (pass band) and a 23 kHz one (above the output's Nyquist frequency, so whatever comes out
+ * is aliasing). One JSON line per quality with the gain of each tone in dB. Fails if fusedaudio's pass band is more
+ * than 0.5 dB off audioresample's or its alias rejection is more than 3 dB worse.
+ */
+
+#include <gst/gst.h>
+#include <math.h>
+#include "Fused-Audio.h"
+#include "Stage-Timer.h"
+
+// Frames at the start of a tone run that aren't measured, so the filters have settled.
+#define TONE_SETTLE_FRAMES 4096
+#define TONE_AMPLITUDE 0.5
+
+typedef struct
+{
+    GstMemory *entered; // Only compared, never dereferenced.
+    guint64 buffers, allocations;
+} AllocationCounter;
+
+typedef struct
+{
+    const gchar *name;
+    const gchar *inFormat;
+    gint inRate, inChannels;
+    const gchar *outFormat;
+    gint outRate, outChannels;
+} AudioCase;
+
+typedef struct
+{
+    guint64 frames;
+    gdouble sumSquares;
+} ToneMeter;
+
+typedef struct
+{
+    gdouble samplesPerSecond;
+    guint64 frames;
+    gdouble allocationsPerBuffer;
+} StageResult;
+
+static gint buffers = 2000;
+static gint samplesPerBuffer = 1024;
+static gint quality = GST_AUDIO_RESAMPLER_QUALITY_DEFAULT;
+
+static GOptionEntry entries[] = {
+    {"buffers", 'n', 0, G_OPTION_ARG_INT, &buffers, "Input buffers per run", "N"},
+    {"samples-per-buffer", 's', 0, G_OPTION_ARG_INT, &samplesPerBuffer, "Frames per input buffer", "N"},
+    {"quality", 'q', 0, G_OPTION_ARG_INT, &quality, "Resampler quality for both stages, 0..10", "Q"},
+    {NULL}};
+
+static GstPadProbeReturn onElementEnter(GstPad *pad, GstPadProbeInfo *info, AllocationCounter *counter)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    counter->entered = gst_buffer_n_memory(buffer) ? gst_buffer_peek_memory(buffer, 0) : NULL;
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn onElementLeave(GstPad *pad, GstPadProbeInfo *info, AllocationCounter *counter)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMemory *memory = gst_buffer_n_memory(buffer) ? gst_buffer_peek_memory(buffer, 0) : NULL;
+    counter->buffers++;
+    if (memory != counter->entered && buffer->pool == NULL)
+        counter->allocations++;
+    return GST_PAD_PROBE_OK;
+}
+
+static void countAllocations(GstElement *first, GstElement *last, AllocationCounter *counters)
+{
+    stageTimerAddProbe(first, "sink", (GstPadProbeCallback)onElementEnter, &counters[0]);
+    stageTimerAddProbe(first, "src", (GstPadProbeCallback)onElementLeave, &counters[0]);
+    if (last != first)
+    {
+        stageTimerAddProbe(last, "sink", (GstPadProbeCallback)onElementEnter, &counters[1]);
+        stageTimerAddProbe(last, "src", (GstPadProbeCallback)onElementLeave, &counters[1]);
+    }
+}
+
+/*!
+ * @brief stage is a pipeline fragment as in Stage-Timer.h. Returns FALSE on failure.
+ */
+static gboolean runStage(const AudioCase *audioCase, const gchar *stage, StageResult *result)
+{
+    gchar *description = g_strdup_printf(
+        "audiotestsrc num-buffers=%d samplesperbuffer=%d wave=sine ! "
+        "audio/x-raw,format=%s,rate=%d,channels=%d,layout=interleaved ! %s ! "
+        "audio/x-raw,format=%s,rate=%d,channels=%d ! fakesink",
+        buffers, samplesPerBuffer, audioCase->inFormat, audioCase->inRate, audioCase->inChannels, stage,
+        audioCase->outFormat, audioCase->outRate, audioCase->outChannels);
+    StageTimer timer;
+    AllocationCounter counters[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    gboolean ok = stageTimerRun(description, &timer, (StageCallback)countAllocations, NULL, counters);
+    g_free(description);
+    stageTimerClear(&timer);
+
+    result->frames = timer.frames;
+    result->samplesPerSecond = ok ? timer.frames * audioCase->outChannels * 1e6 / timer.busyUs : 0;
+    result->allocationsPerBuffer =
+        counters[0].buffers ? (gdouble)(counters[0].allocations + counters[1].allocations) / counters[0].buffers : 0;
+    return ok;
+}
+
+static GstPadProbeReturn onToneBuffer(GstPad *pad, GstPadProbeInfo *info, ToneMeter *meter)
+{
+    GstMapInfo map;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    const gfloat *samples = (const gfloat *)map.data;
+    for (gsize i = 0; i < map.size / sizeof(gfloat); i++, meter->frames++)
+    {
+        if (meter->frames >= TONE_SETTLE_FRAMES)
+            meter->sumSquares += (gdouble)samples[i] * samples[i];
+    }
+    gst_buffer_unmap(buffer, &map);
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Gain in dB of stage for a sine at frequency, F32 mono 48k -> 44.1k, or NAN on failure.
+ */
+static gdouble measureToneGain(const gchar *stage, gdouble frequency)
+{
+    GError *err = NULL;
+    gchar *description = g_strdup_printf(
+        "audiotestsrc num-buffers=64 samplesperbuffer=1024 wave=sine freq=%f volume=%f ! "
+        "audio/x-raw,format=F32LE,rate=48000,channels=1,layout=interleaved ! %s ! "
+        "audio/x-raw,format=F32LE,rate=44100,channels=1 ! fakesink name=sink",
+        frequency, TONE_AMPLITUDE, stage);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err->message);
+        g_clear_error(&err);
+        return NAN;
+    }
+
+    ToneMeter meter = {0, 0.0};
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    stageTimerAddProbe(sink, "sink", (GstPadProbeCallback)onToneBuffer, &meter);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (!ok || meter.frames <= TONE_SETTLE_FRAMES)
+    {
+        return NAN;
+    }
+    gdouble rms = sqrt(meter.sumSquares / (meter.frames - TONE_SETTLE_FRAMES));
+    // -200 dB stands for silence.
+    return rms > 0 ? 20 * log10(rms / (TONE_AMPLITUDE / G_SQRT2)) : -200.0;
+}
+
+/*!
+ * @brief Pass band and alias rejection of fusedaudio against audioresample at every quality. Returns FALSE if
+ * fusedaudio falls behind.
+ */
+static gboolean compareQualities()
+{
+    gboolean passed = TRUE;
+    for (gint q = 0; q <= 10; q++)
+    {
+        gchar *reference = g_strdup_printf("audioresample resample-method=blackman-nuttall quality=%d", q);
+        gchar *fused = g_strdup_printf("fusedaudio quality=%d", q);
+        gdouble referencePass = measureToneGain(reference, 1000), referenceAlias = measureToneGain(reference, 23000);
+        gdouble fusedPass = measureToneGain(fused, 1000), fusedAlias = measureToneGain(fused, 23000);
+        g_free(reference);
+        g_free(fused);
+
+        // NAN compares false, so a failed run fails the check.
+        gboolean ok = fabs(fusedPass - referencePass) <= 0.5 && fusedAlias <= referenceAlias + 3.0;
+        g_print("{\"check\": \"quality\", \"quality\": %d, \"audioresample_pass_db\": %.2f, \"fusedaudio_pass_db\": %.2f, "
+                "\"audioresample_alias_db\": %.1f, \"fusedaudio_alias_db\": %.1f, \"ok\": %s}\n",
+                q, referencePass, fusedPass, referenceAlias, fusedAlias, ok ? "true" : "false");
+        passed = passed && ok;
+    }
+    return passed;
+}
+
+static void printResult(const AudioCase *audioCase, const gchar *element, const StageResult *result)
+{
+    g_print("{\"case\": \"%s\", \"element\": \"%s\", \"quality\": %d, \"samples_per_second\": %.0f, \"frames\": %" G_GUINT64_FORMAT
+            ", \"allocations_per_buffer\": %.2f}\n",
+            audioCase->name, element, quality, result->samplesPerSecond, result->frames,
+            result->allocationsPerBuffer);
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- fusedaudio against audioconvert ! audioresample");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    fusedAudioRegister();
+    quality = CLAMP(quality, 0, 10);
+
+    const AudioCase cases[] = {
+        {"s16-mono-44k1-to-f32-stereo-48k", "S16LE", 44100, 1, "F32LE", 48000, 2},
+        {"s16-stereo-48k-to-s16-stereo-44k1", "S16LE", 48000, 2, "S16LE", 44100, 2},
+        {"f32-stereo-to-s16-stereo", "F32LE", 48000, 2, "S16LE", 48000, 2},
+        {"s16-stereo-to-f32-mono", "S16LE", 48000, 2, "F32LE", 48000, 1},
+    };
+    gboolean passed = TRUE;
+
+    for (const AudioCase &audioCase : cases)
+    {
+        gchar *chain = g_strdup_printf("audioconvert name=first ! audioresample name=last quality=%d", quality);
+        gchar *fused = g_strdup_printf("fusedaudio name=first quality=%d ! identity name=last", quality);
+        StageResult chainResult = {0, 0, 0}, fusedResult = {0, 0, 0};
+
+        gboolean chainOk = runStage(&audioCase, chain, &chainResult);
+        printResult(&audioCase, "audioconvert+audioresample", &chainResult);
+        gboolean fusedOk = runStage(&audioCase, fused, &fusedResult);
+        printResult(&audioCase, "fusedaudio", &fusedResult);
+        g_free(chain);
+        g_free(fused);
+
+        // Both resamplers round per buffer, so the totals may differ by a frame per buffer.
+        guint64 difference = chainResult.frames > fusedResult.frames ? chainResult.frames - fusedResult.frames
+                                                                     : fusedResult.frames - chainResult.frames;
+        gboolean ok = fusedOk && (!chainOk || (difference <= (guint64)buffers &&
+                                               fusedResult.allocationsPerBuffer <= chainResult.allocationsPerBuffer));
+        if (!ok)
+        {
+            gst_printerr("\n%s: fusedaudio produced %" G_GUINT64_FORMAT " frames, %.2f allocations per buffer",
+                         audioCase.name, fusedResult.frames, fusedResult.allocationsPerBuffer);
+        }
+        passed = passed && ok;
+    }
+    passed = compareQualities() && passed;
+
+    g_print("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : -1;
+}
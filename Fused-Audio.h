@@ -0,0 +1,948 @@
+/*!
+ * @brief fusedaudio: audioconvert ! audioresample in one GstBaseTransform. S16/F32 conversion, channel mixing and
+ * sample rate conversion happen in a single pass over each buffer, with SIMD kernels for the per-sample work.
+ * @link https://gstreamer.freedesktop.org/documentation/audioresample/index.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/base/gstbasetransform.html?gi-language=c
+ *
+ * The two-element chain converts every sample to the intermediate format, writes it to a new buffer, then reads it
+ * again to resample it into yet another buffer. Here a block of frames is converted to float in a small scratch
+ * area that stays in cache, mixed straight into the per-channel filter history and resampled from there:
+ * - rates equal and frame sizes equal (e.g. S16 stereo -> F32 mono): converted in place, no output buffer at all.
+ * - otherwise output buffers come from a pool owned by the element, so steady state does no allocation.
+ * Rate conversion is a windowed-sinc (Blackman-Nuttall) polyphase filter with FUSED_AUDIO_PHASES phases and linear
+ * interpolation between neighbouring phases. The quality property is 0..10 like audioresample's and picks the sinc
+ * length and cutoff from fusedAudioQualities, audioresample's own table for its Blackman-Nuttall method. When
+ * downsampling, the cutoff is scaled to the output rate and the sinc made longer by the same factor, as audioresample
+ * does.
+ * Channel mixing follows the channel positions, like audioconvert: a channel goes to the output with the same
+ * position, otherwise to the nearest outputs on its side (a centre channel to both sides at -3 dB, mono to all of
+ * them); an LFE without an LFE output is dropped. Rows are scaled down together so no output can clip. Unpositioned
+ * layouts map channels by index.
+ *
+ * Kernels (float <-> S16 and the filter dot product) come in AVX2+FMA, SSE2 and scalar versions, picked at runtime
+ * like Yuy2-Convert.h. Call fusedAudioRegister() once after gst_init().
+ */
+
+#ifndef FUSED_AUDIO_H
+#define FUSED_AUDIO_H
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/base/gstbasetransform.h>
+#include <math.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FUSED_AUDIO_X86 1
+#endif
+
+#define FUSED_AUDIO_CAPS                                                    \
+    "audio/x-raw, format = (string) { " GST_AUDIO_NE(S16) ", " GST_AUDIO_NE(F32) " }, " \
+    "rate = (int) [ 1, MAX ], channels = (int) [ 1, 8 ], layout = (string) interleaved"
+#define FUSED_AUDIO_PHASES 128
+// Frames converted to float per step; small enough for the scratch area to stay in L1.
+#define FUSED_AUDIO_BLOCK 256
+#define FUSED_AUDIO_MAX_TAPS 1024
+
+typedef struct
+{
+    guint taps;
+    gdouble cutoff; // fraction of the lower Nyquist frequency
+} FusedAudioQuality;
+
+// Per quality 0..10, as in audioresample's blackman_qualities (gst-libs/gst/audio/audio-resampler.c).
+static const FusedAudioQuality fusedAudioQualities[] = {
+    {8, 0.5}, {16, 0.6}, {24, 0.72}, {32, 0.8}, {48, 0.85}, {64, 0.90},
+    {80, 0.92}, {96, 0.933}, {128, 0.950}, {148, 0.955}, {160, 0.960},
+};
+
+/* ======= Kernels ==========*/
+
+typedef struct
+{
+    const gchar *name;
+    void (*s16ToFloat)(const gint16 *src, gfloat *dst, guint n);
+    void (*floatToS16)(const gfloat *src, gint16 *dst, guint n);
+    // n is a multiple of 8.
+    gfloat (*dot)(const gfloat *a, const gfloat *b, guint n);
+} FusedAudioKernels;
+
+static void s16ToFloatScalar(const gint16 *src, gfloat *dst, guint n)
+{
+    for (guint i = 0; i < n; i++)
+        dst[i] = src[i] * (1.0f / 32768.0f);
+}
+
+static void floatToS16Scalar(const gfloat *src, gint16 *dst, guint n)
+{
+    for (guint i = 0; i < n; i++)
+        dst[i] = (gint16)CLAMP(lrintf(src[i] * 32768.0f), -32768, 32767);
+}
+
+static gfloat dotScalar(const gfloat *a, const gfloat *b, guint n)
+{
+    gfloat sum = 0.0f;
+    for (guint i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static const FusedAudioKernels fusedAudioKernelsScalar = {"scalar", s16ToFloatScalar, floatToS16Scalar, dotScalar};
+
+#ifdef FUSED_AUDIO_X86
+
+static void s16ToFloatSse2(const gint16 *src, gfloat *dst, guint n)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    guint i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(src + i));
+        // Sign-extend by putting each sample in the high half of a 32-bit lane and shifting back.
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    s16ToFloatScalar(src + i, dst + i, n - i);
+}
+
+static void floatToS16Sse2(const gfloat *src, gint16 *dst, guint n)
+{
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lowest = _mm_set1_ps(-32768.0f), highest = _mm_set1_ps(32767.0f);
+    guint i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // Clamp before converting: out-of-range floats would turn into INT_MIN.
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lowest), highest);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lowest), highest);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    floatToS16Scalar(src + i, dst + i, n - i);
+}
+
+static gfloat dotSse2(const gfloat *a, const gfloat *b, guint n)
+{
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (guint i = 0; i < n; i += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    gfloat lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static const FusedAudioKernels fusedAudioKernelsSse2 = {"sse2", s16ToFloatSse2, floatToS16Sse2, dotSse2};
+
+__attribute__((target("avx2,fma"))) static void s16ToFloatAvx2(const gint16 *src, gfloat *dst, guint n)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    guint i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    s16ToFloatScalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static void floatToS16Avx2(const gfloat *src, gint16 *dst, guint n)
+{
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lowest = _mm256_set1_ps(-32768.0f), highest = _mm256_set1_ps(32767.0f);
+    guint i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lowest), highest);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), lowest), highest);
+        // packs works per 128-bit lane; the permute restores sample order.
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    floatToS16Sse2(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static gfloat dotAvx2(const gfloat *a, const gfloat *b, guint n)
+{
+    __m256 sum = _mm256_setzero_ps();
+    for (guint i = 0; i < n; i += 8)
+    {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    gfloat lanes[4];
+    _mm_storeu_ps(lanes, half);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+static const FusedAudioKernels fusedAudioKernelsAvx2 = {"avx2", s16ToFloatAvx2, floatToS16Avx2, dotAvx2};
+
+#endif // FUSED_AUDIO_X86
+
+static const FusedAudioKernels *fusedAudioKernelsBest()
+{
+#ifdef FUSED_AUDIO_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return &fusedAudioKernelsAvx2;
+    return &fusedAudioKernelsSse2;
+#else
+    return &fusedAudioKernelsScalar;
+#endif
+}
+
+/* ======= Element ==========*/
+
+typedef struct
+{
+    GstBaseTransform parent;
+    gint quality;
+
+    const FusedAudioKernels *kernels;
+    GstAudioInfo inInfo, outInfo;
+    gboolean resample;
+    gfloat *matrix; // outChannels x inChannels
+    gboolean passChannels; // Same channels in the same order: no mixing.
+    gfloat *scratchIn, *scratchOut;
+
+    // Resampler. history[c] holds planar float input; the next output sits at base + acc / outRate.
+    guint taps;
+    gfloat *filter; // (FUSED_AUDIO_PHASES + 1) rows of taps coefficients
+    gfloat *history[8];
+    guint historyLength, historyCapacity;
+    guint64 base, acc;
+    GstClockTime startTime;
+    guint64 outSamples;
+
+    GstBufferPool *pool;
+    gsize poolSize;
+} FusedAudio;
+
+typedef struct
+{
+    GstBaseTransformClass parentClass;
+} FusedAudioClass;
+
+enum
+{
+    FUSED_AUDIO_PROP_0,
+    FUSED_AUDIO_PROP_QUALITY
+};
+
+G_DEFINE_TYPE(FusedAudio, fused_audio, GST_TYPE_BASE_TRANSFORM)
+
+// side: -1 left, 0 centre, 1 right. depth: 0 front, 1 side, 2 rear; height is ignored. FALSE for LFE.
+static gboolean fusedAudioPlace(GstAudioChannelPosition position, gint *side, gint *depth)
+{
+    switch (position)
+    {
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_WIDE_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_FRONT_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_BOTTOM_FRONT_LEFT:
+        *side = -1, *depth = 0;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_WIDE_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_FRONT_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_BOTTOM_FRONT_RIGHT:
+        *side = 1, *depth = 0;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_SURROUND_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_SIDE_LEFT:
+        *side = -1, *depth = 1;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_SURROUND_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_SIDE_RIGHT:
+        *side = 1, *depth = 1;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_REAR_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_REAR_LEFT:
+        *side = -1, *depth = 2;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_REAR_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_REAR_RIGHT:
+        *side = 1, *depth = 2;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_TOP_CENTER:
+        *side = 0, *depth = 1;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_REAR_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_TOP_REAR_CENTER:
+        *side = 0, *depth = 2;
+        return TRUE;
+    case GST_AUDIO_CHANNEL_POSITION_LFE1:
+    case GST_AUDIO_CHANNEL_POSITION_LFE2:
+        return FALSE;
+    default: // MONO, FRONT_CENTER, TOP/BOTTOM_FRONT_CENTER
+        *side = 0, *depth = 0;
+        return TRUE;
+    }
+}
+
+/*!
+ * @brief Adds weight * input channel i to the outputs on side with the depth nearest to depth. Returns FALSE if no
+ * output is on that side.
+ */
+static gboolean fusedAudioMixToSide(FusedAudio *self, guint i, gint side, gint depth, gfloat weight)
+{
+    guint in = GST_AUDIO_INFO_CHANNELS(&self->inInfo), out = GST_AUDIO_INFO_CHANNELS(&self->outInfo);
+    gint best = G_MAXINT;
+    for (guint o = 0; o < out; o++)
+    {
+        gint outSide, outDepth;
+        if (fusedAudioPlace(GST_AUDIO_INFO_POSITION(&self->outInfo, o), &outSide, &outDepth) && outSide == side)
+            best = MIN(best, ABS(outDepth - depth));
+    }
+    if (best == G_MAXINT)
+    {
+        return FALSE;
+    }
+    for (guint o = 0; o < out; o++)
+    {
+        gint outSide, outDepth;
+        if (fusedAudioPlace(GST_AUDIO_INFO_POSITION(&self->outInfo, o), &outSide, &outDepth) && outSide == side &&
+            ABS(outDepth - depth) == best)
+            self->matrix[o * in + i] += weight;
+    }
+    return TRUE;
+}
+
+static void fusedAudioBuildMatrix(FusedAudio *self)
+{
+    guint in = GST_AUDIO_INFO_CHANNELS(&self->inInfo), out = GST_AUDIO_INFO_CHANNELS(&self->outInfo);
+    g_free(self->matrix);
+    self->matrix = g_new0(gfloat, in * out);
+
+    if (GST_AUDIO_INFO_IS_UNPOSITIONED(&self->inInfo) || GST_AUDIO_INFO_IS_UNPOSITIONED(&self->outInfo))
+    {
+        // Nothing to go by: input channel i goes to output i % out, averaged with the others landing there.
+        self->passChannels = in == out;
+        for (guint o = 0; o < out; o++)
+        {
+            guint sources = 0;
+            for (guint i = o; i < in; i += out)
+                sources++;
+            for (guint i = o; i < in; i += out)
+                self->matrix[o * in + i] = 1.0f / sources;
+        }
+        if (in == 1)
+            for (guint o = 0; o < out; o++)
+                self->matrix[o * in] = 1.0f;
+        return;
+    }
+
+    self->passChannels = in == out;
+    for (guint c = 0; c < MIN(in, out); c++)
+        self->passChannels = self->passChannels &&
+                             GST_AUDIO_INFO_POSITION(&self->inInfo, c) == GST_AUDIO_INFO_POSITION(&self->outInfo, c);
+
+    for (guint i = 0; i < in; i++)
+    {
+        GstAudioChannelPosition position = GST_AUDIO_INFO_POSITION(&self->inInfo, i);
+        gboolean placed = FALSE;
+        for (guint o = 0; o < out; o++)
+        {
+            if (GST_AUDIO_INFO_POSITION(&self->outInfo, o) == position)
+            {
+                self->matrix[o * in + i] = 1.0f;
+                placed = TRUE;
+            }
+        }
+        gint side, depth;
+        if (placed || !fusedAudioPlace(position, &side, &depth))
+        {
+            // Found its own output, or an LFE with no LFE output: bass management isn't ours to do.
+            continue;
+        }
+        if (position == GST_AUDIO_CHANNEL_POSITION_MONO)
+        {
+            for (guint o = 0; o < out; o++)
+            {
+                gint outSide, outDepth;
+                if (fusedAudioPlace(GST_AUDIO_INFO_POSITION(&self->outInfo, o), &outSide, &outDepth))
+                    self->matrix[o * in + i] = 1.0f;
+            }
+        }
+        else if (side != 0)
+        {
+            // No output on that side (e.g. mono out): the centre takes it.
+            if (!fusedAudioMixToSide(self, i, side, depth, 1.0f))
+                fusedAudioMixToSide(self, i, 0, depth, 1.0f);
+        }
+        else if (!fusedAudioMixToSide(self, i, 0, depth, 1.0f))
+        {
+            fusedAudioMixToSide(self, i, -1, depth, (gfloat)(1.0 / G_SQRT2));
+            fusedAudioMixToSide(self, i, 1, depth, (gfloat)(1.0 / G_SQRT2));
+        }
+    }
+
+    // Scale every row by the same factor, so the loudest output can't exceed full scale and the balance stays.
+    gfloat loudest = 0.0f;
+    for (guint o = 0; o < out; o++)
+    {
+        gfloat sum = 0.0f;
+        for (guint i = 0; i < in; i++)
+            sum += self->matrix[o * in + i];
+        loudest = MAX(loudest, sum);
+    }
+    if (loudest > 1.0f)
+    {
+        for (guint k = 0; k < in * out; k++)
+            self->matrix[k] /= loudest;
+    }
+}
+
+/*!
+ * @brief Windowed sinc, one row per phase. Row p is the filter for an output FUSED_AUDIO_PHASES - p phases before
+ * the next input sample; each row is normalized to unity gain. The window spans the quality's length; rows are
+ * padded with zeros on both ends to a multiple of 8 for the SIMD dot product.
+ */
+static void fusedAudioBuildFilter(FusedAudio *self)
+{
+    gint inRate = GST_AUDIO_INFO_RATE(&self->inInfo), outRate = GST_AUDIO_INFO_RATE(&self->outInfo);
+    gdouble ratio = (gdouble)inRate / outRate;
+    const FusedAudioQuality *quality = &fusedAudioQualities[self->quality];
+    gdouble length = MIN(quality->taps * MAX(ratio, 1.0), (gdouble)FUSED_AUDIO_MAX_TAPS);
+    guint taps = (guint)ceil(length / 8.0) * 8;
+    gdouble cutoff = quality->cutoff * MIN(1.0, 1.0 / ratio);
+
+    self->taps = taps;
+    g_free(self->filter);
+    self->filter = g_new(gfloat, (FUSED_AUDIO_PHASES + 1) * taps);
+    for (guint p = 0; p <= FUSED_AUDIO_PHASES; p++)
+    {
+        gdouble fraction = (gdouble)p / FUSED_AUDIO_PHASES, sum = 0.0;
+        gfloat *row = self->filter + p * taps;
+        for (guint j = 0; j < taps; j++)
+        {
+            gdouble d = (gdouble)j - taps / 2 + 1 - fraction;
+            gdouble x = M_PI * cutoff * d;
+            gdouble sinc = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+            gdouble n = (d + length / 2.0) / length;
+            gdouble window = 0.3635819 - 0.4891775 * cos(2 * M_PI * n) + 0.1365995 * cos(4 * M_PI * n) -
+                             0.0106411 * cos(6 * M_PI * n);
+            row[j] = n < 0.0 || n > 1.0 ? 0.0f : (gfloat)(sinc * MAX(window, 0.0));
+            sum += row[j];
+        }
+        for (guint j = 0; j < taps; j++)
+            row[j] = (gfloat)(row[j] / sum);
+    }
+}
+
+static void fusedAudioResetState(FusedAudio *self)
+{
+    // taps / 2 - 1 zeros in front: the first output lines up with the first input sample.
+    self->historyLength = self->resample ? self->taps / 2 - 1 : 0;
+    for (guint c = 0; c < 8 && self->history[c]; c++)
+        memset(self->history[c], 0, self->historyLength * sizeof(gfloat));
+    self->base = self->historyLength;
+    self->acc = 0;
+    self->startTime = GST_CLOCK_TIME_NONE;
+    self->outSamples = 0;
+}
+
+static void fusedAudioFreeState(FusedAudio *self)
+{
+    for (guint c = 0; c < 8; c++)
+    {
+        g_free(self->history[c]);
+        self->history[c] = NULL;
+    }
+    self->historyCapacity = 0;
+    g_clear_pointer(&self->matrix, g_free);
+    g_clear_pointer(&self->filter, g_free);
+    g_clear_pointer(&self->scratchIn, g_free);
+    g_clear_pointer(&self->scratchOut, g_free);
+    if (self->pool)
+    {
+        gst_buffer_pool_set_active(self->pool, FALSE);
+        gst_clear_object(&self->pool);
+    }
+    self->poolSize = 0;
+    self->resample = FALSE;
+    self->taps = 0;
+}
+
+/*!
+ * @brief Output frames the next inFrames input frames produce.
+ */
+static guint fusedAudioOutFrames(FusedAudio *self, guint inFrames)
+{
+    if (!self->resample)
+        return inFrames;
+    guint64 inRate = GST_AUDIO_INFO_RATE(&self->inInfo), outRate = GST_AUDIO_INFO_RATE(&self->outInfo);
+    guint64 available = self->historyLength + inFrames;
+    if (available <= self->taps / 2)
+        return 0;
+    // Outputs k with base_k < available - taps / 2, in units of 1 / outRate input samples.
+    guint64 position = self->base * outRate + self->acc;
+    guint64 limit = (available - self->taps / 2) * outRate;
+    return position < limit ? (guint)((limit - position + inRate - 1) / inRate) : 0;
+}
+
+static void fusedAudioEnsureHistory(FusedAudio *self, guint frames)
+{
+    if (frames <= self->historyCapacity)
+        return;
+    self->historyCapacity = frames * 2;
+    for (guint c = 0; c < GST_AUDIO_INFO_CHANNELS(&self->outInfo); c++)
+        self->history[c] = (gfloat *)g_realloc(self->history[c], self->historyCapacity * sizeof(gfloat));
+}
+
+/*!
+ * @brief Converts frames input frames to float and mixes them into interleaved output channels in scratchOut.
+ */
+static void fusedAudioConvertBlock(FusedAudio *self, const guint8 *in, guint frames)
+{
+    guint inChannels = GST_AUDIO_INFO_CHANNELS(&self->inInfo), outChannels = GST_AUDIO_INFO_CHANNELS(&self->outInfo);
+    const gfloat *source = (const gfloat *)in;
+    if (GST_AUDIO_INFO_FORMAT(&self->inInfo) == GST_AUDIO_FORMAT_S16)
+    {
+        self->kernels->s16ToFloat((const gint16 *)in, self->scratchIn, frames * inChannels);
+        source = self->scratchIn;
+    }
+    if (self->passChannels)
+    {
+        memcpy(self->scratchOut, source, frames * inChannels * sizeof(gfloat));
+        return;
+    }
+    for (guint f = 0; f < frames; f++)
+    {
+        for (guint o = 0; o < outChannels; o++)
+        {
+            gfloat sum = 0.0f;
+            for (guint i = 0; i < inChannels; i++)
+                sum += self->matrix[o * inChannels + i] * source[f * inChannels + i];
+            self->scratchOut[f * outChannels + o] = sum;
+        }
+    }
+}
+
+static void fusedAudioWriteBlock(FusedAudio *self, guint8 *out, guint frames)
+{
+    guint samples = frames * GST_AUDIO_INFO_CHANNELS(&self->outInfo);
+    if (GST_AUDIO_INFO_FORMAT(&self->outInfo) == GST_AUDIO_FORMAT_S16)
+        self->kernels->floatToS16(self->scratchOut, (gint16 *)out, samples);
+    else
+        memcpy(out, self->scratchOut, samples * sizeof(gfloat));
+}
+
+/*!
+ * @brief Appends inFrames input frames to the history and writes outFrames resampled frames to out.
+ * in may be NULL for inFrames zeros (draining). outFrames must be fusedAudioOutFrames(inFrames).
+ */
+static void fusedAudioResample(FusedAudio *self, const guint8 *in, guint inFrames, guint8 *out, guint outFrames)
+{
+    guint outChannels = GST_AUDIO_INFO_CHANNELS(&self->outInfo);
+    guint64 inRate = GST_AUDIO_INFO_RATE(&self->inInfo), outRate = GST_AUDIO_INFO_RATE(&self->outInfo);
+    fusedAudioEnsureHistory(self, self->historyLength + inFrames);
+
+    for (guint done = 0; done < inFrames; done += FUSED_AUDIO_BLOCK)
+    {
+        guint frames = MIN((guint)FUSED_AUDIO_BLOCK, inFrames - done);
+        if (in)
+            fusedAudioConvertBlock(self, in + done * GST_AUDIO_INFO_BPF(&self->inInfo), frames);
+        else
+            memset(self->scratchOut, 0, frames * outChannels * sizeof(gfloat));
+        for (guint f = 0; f < frames; f++)
+            for (guint c = 0; c < outChannels; c++)
+                self->history[c][self->historyLength + f] = self->scratchOut[f * outChannels + c];
+        self->historyLength += frames;
+    }
+
+    for (guint done = 0; done < outFrames; done += FUSED_AUDIO_BLOCK)
+    {
+        guint frames = MIN((guint)FUSED_AUDIO_BLOCK, outFrames - done);
+        for (guint f = 0; f < frames; f++)
+        {
+            guint64 scaled = self->acc * FUSED_AUDIO_PHASES;
+            guint phase = (guint)(scaled / outRate);
+            gfloat weight = (gfloat)(scaled % outRate) / outRate;
+            const gfloat *row0 = self->filter + phase * self->taps;
+            const gfloat *row1 = row0 + self->taps;
+            guint64 start = self->base + 1 - self->taps / 2;
+            for (guint c = 0; c < outChannels; c++)
+            {
+                const gfloat *samples = self->history[c] + start;
+                gfloat a = self->kernels->dot(samples, row0, self->taps);
+                gfloat b = self->kernels->dot(samples, row1, self->taps);
+                self->scratchOut[f * outChannels + c] = a + (b - a) * weight;
+            }
+            self->acc += inRate;
+            self->base += self->acc / outRate;
+            self->acc %= outRate;
+        }
+        fusedAudioWriteBlock(self, out + done * GST_AUDIO_INFO_BPF(&self->outInfo), frames);
+    }
+
+    // Keep only what the next output still needs.
+    guint keep = self->taps / 2 - 1;
+    if (self->base > keep)
+    {
+        guint drop = (guint)MIN(self->base - keep, (guint64)self->historyLength);
+        for (guint c = 0; c < outChannels; c++)
+            memmove(self->history[c], self->history[c] + drop, (self->historyLength - drop) * sizeof(gfloat));
+        self->historyLength -= drop;
+        self->base -= drop;
+    }
+}
+
+/*!
+ * @brief Same rate: converts and mixes block by block. Works in place when in and out frames have the same size,
+ * because a block is fully read into the scratch area before its output is written.
+ */
+static void fusedAudioConvert(FusedAudio *self, const guint8 *in, guint8 *out, guint frames)
+{
+    for (guint done = 0; done < frames; done += FUSED_AUDIO_BLOCK)
+    {
+        guint block = MIN((guint)FUSED_AUDIO_BLOCK, frames - done);
+        fusedAudioConvertBlock(self, in + done * GST_AUDIO_INFO_BPF(&self->inInfo), block);
+        fusedAudioWriteBlock(self, out + done * GST_AUDIO_INFO_BPF(&self->outInfo), block);
+    }
+}
+
+static void fusedAudioStamp(FusedAudio *self, GstBuffer *buffer, guint frames)
+{
+    gint rate = GST_AUDIO_INFO_RATE(&self->outInfo);
+    GstClockTime start = self->startTime + gst_util_uint64_scale_int(self->outSamples, GST_SECOND, rate);
+    GstClockTime end = self->startTime + gst_util_uint64_scale_int(self->outSamples + frames, GST_SECOND, rate);
+    GST_BUFFER_PTS(buffer) = start;
+    GST_BUFFER_DURATION(buffer) = end - start;
+    GST_BUFFER_OFFSET(buffer) = self->outSamples;
+    GST_BUFFER_OFFSET_END(buffer) = self->outSamples + frames;
+    self->outSamples += frames;
+}
+
+static gboolean fusedAudioSetCaps(GstBaseTransform *trans, GstCaps *incaps, GstCaps *outcaps)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    fusedAudioFreeState(self);
+    if (!gst_audio_info_from_caps(&self->inInfo, incaps) || !gst_audio_info_from_caps(&self->outInfo, outcaps))
+    {
+        return FALSE;
+    }
+
+    self->resample = GST_AUDIO_INFO_RATE(&self->inInfo) != GST_AUDIO_INFO_RATE(&self->outInfo);
+    fusedAudioBuildMatrix(self);
+    self->scratchIn = g_new(gfloat, FUSED_AUDIO_BLOCK * GST_AUDIO_INFO_CHANNELS(&self->inInfo));
+    self->scratchOut = g_new(gfloat, FUSED_AUDIO_BLOCK * MAX(GST_AUDIO_INFO_CHANNELS(&self->inInfo),
+                                                              GST_AUDIO_INFO_CHANNELS(&self->outInfo)));
+    if (self->resample)
+    {
+        fusedAudioBuildFilter(self);
+        fusedAudioEnsureHistory(self, self->taps + FUSED_AUDIO_BLOCK);
+    }
+    fusedAudioResetState(self);
+
+    gst_base_transform_set_in_place(trans, !self->resample &&
+                                               GST_AUDIO_INFO_BPF(&self->inInfo) == GST_AUDIO_INFO_BPF(&self->outInfo));
+    GST_INFO_OBJECT(self, "%s, %u taps, kernels %s", gst_base_transform_is_in_place(trans) ? "in place" : "pooled",
+                    self->taps, self->kernels->name);
+    return TRUE;
+}
+
+static GstFlowReturn fusedAudioPrepareOutputBuffer(GstBaseTransform *trans, GstBuffer *input, GstBuffer **outbuf)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    if (gst_base_transform_is_in_place(trans) || gst_base_transform_is_passthrough(trans))
+    {
+        return GST_BASE_TRANSFORM_CLASS(fused_audio_parent_class)->prepare_output_buffer(trans, input, outbuf);
+    }
+
+    if (GST_BUFFER_IS_DISCONT(input) || !GST_CLOCK_TIME_IS_VALID(self->startTime))
+    {
+        fusedAudioResetState(self);
+        self->startTime = GST_BUFFER_PTS_IS_VALID(input) ? GST_BUFFER_PTS(input) : 0;
+    }
+    guint frames = fusedAudioOutFrames(self, gst_buffer_get_size(input) / GST_AUDIO_INFO_BPF(&self->inInfo));
+    gsize size = frames * GST_AUDIO_INFO_BPF(&self->outInfo);
+
+    // Buffer sizes wobble by a frame with fractional ratios; size the pool with headroom.
+    if (!self->pool || size > self->poolSize)
+    {
+        if (self->pool)
+        {
+            gst_buffer_pool_set_active(self->pool, FALSE);
+            gst_object_unref(self->pool);
+        }
+        self->poolSize = size + size / 8 + GST_AUDIO_INFO_BPF(&self->outInfo);
+        self->pool = gst_buffer_pool_new();
+        GstStructure *config = gst_buffer_pool_get_config(self->pool);
+        gst_buffer_pool_config_set_params(config, NULL, self->poolSize, 4, 0);
+        if (!gst_buffer_pool_set_config(self->pool, config) || !gst_buffer_pool_set_active(self->pool, TRUE))
+        {
+            return GST_FLOW_ERROR;
+        }
+    }
+    GstFlowReturn ret = gst_buffer_pool_acquire_buffer(self->pool, outbuf, NULL);
+    if (ret == GST_FLOW_OK)
+    {
+        gst_buffer_resize(*outbuf, 0, size);
+    }
+    return ret;
+}
+
+static GstFlowReturn fusedAudioTransform(GstBaseTransform *trans, GstBuffer *inbuf, GstBuffer *outbuf)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    GstMapInfo in, out;
+    guint inFrames = gst_buffer_get_size(inbuf) / GST_AUDIO_INFO_BPF(&self->inInfo);
+    guint outFrames = gst_buffer_get_size(outbuf) / GST_AUDIO_INFO_BPF(&self->outInfo);
+
+    gst_buffer_map(inbuf, &in, GST_MAP_READ);
+    gst_buffer_map(outbuf, &out, GST_MAP_WRITE);
+    if (self->resample)
+    {
+        fusedAudioResample(self, in.data, inFrames, out.data, outFrames);
+    }
+    else
+    {
+        fusedAudioConvert(self, in.data, out.data, inFrames);
+    }
+    gst_buffer_unmap(inbuf, &in);
+    gst_buffer_unmap(outbuf, &out);
+
+    if (!self->resample)
+    {
+        gst_buffer_copy_into(outbuf, inbuf, (GstBufferCopyFlags)(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS), 0, -1);
+        return GST_FLOW_OK;
+    }
+    if (outFrames == 0)
+    {
+        // Still filling the filter.
+        return GST_BASE_TRANSFORM_FLOW_DROPPED;
+    }
+    fusedAudioStamp(self, outbuf, outFrames);
+    if (GST_BUFFER_IS_DISCONT(inbuf))
+        GST_BUFFER_FLAG_SET(outbuf, GST_BUFFER_FLAG_DISCONT);
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn fusedAudioTransformIp(GstBaseTransform *trans, GstBuffer *buffer)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_READWRITE);
+    fusedAudioConvert(self, map.data, map.data, map.size / GST_AUDIO_INFO_BPF(&self->inInfo));
+    gst_buffer_unmap(buffer, &map);
+    return GST_FLOW_OK;
+}
+
+/*!
+ * @brief Pushes the output still held back in the filter history (taps / 2 input frames) before EOS.
+ */
+static void fusedAudioDrain(FusedAudio *self)
+{
+    if (!self->resample || !GST_CLOCK_TIME_IS_VALID(self->startTime))
+        return;
+    guint zeros = self->taps / 2;
+    guint frames = fusedAudioOutFrames(self, zeros);
+    if (frames == 0)
+        return;
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, frames * GST_AUDIO_INFO_BPF(&self->outInfo), NULL);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    fusedAudioResample(self, NULL, zeros, map.data, frames);
+    gst_buffer_unmap(buffer, &map);
+    fusedAudioStamp(self, buffer, frames);
+    gst_pad_push(GST_BASE_TRANSFORM_SRC_PAD(self), buffer);
+}
+
+static gboolean fusedAudioSinkEvent(GstBaseTransform *trans, GstEvent *event)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    switch (GST_EVENT_TYPE(event))
+    {
+    case GST_EVENT_EOS:
+        fusedAudioDrain(self);
+        break;
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_SEGMENT:
+        fusedAudioResetState(self);
+        break;
+    default:
+        break;
+    }
+    return GST_BASE_TRANSFORM_CLASS(fused_audio_parent_class)->sink_event(trans, event);
+}
+
+static gboolean fusedAudioTransformSize(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, gsize size,
+                                        GstCaps *othercaps, gsize *othersize)
+{
+    GstAudioInfo from, to;
+    if (!gst_audio_info_from_caps(&from, caps) || !gst_audio_info_from_caps(&to, othercaps))
+    {
+        return FALSE;
+    }
+    // Upper bound; prepare_output_buffer computes the exact size.
+    guint64 frames = size / GST_AUDIO_INFO_BPF(&from);
+    frames = gst_util_uint64_scale_int_ceil(frames, GST_AUDIO_INFO_RATE(&to), GST_AUDIO_INFO_RATE(&from)) + 1;
+    *othersize = frames * GST_AUDIO_INFO_BPF(&to);
+    return TRUE;
+}
+
+static GstCaps *fusedAudioTransformCaps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, GstCaps *filter)
+{
+    GstCaps *result = gst_caps_new_empty();
+    for (guint i = 0; i < gst_caps_get_size(caps); i++)
+    {
+        GstStructure *structure = gst_structure_copy(gst_caps_get_structure(caps, i));
+        gst_structure_remove_fields(structure, "format", "rate", "channels", "channel-mask", NULL);
+        result = gst_caps_merge_structure(result, structure);
+    }
+    GstCaps *templateCaps = gst_caps_from_string(FUSED_AUDIO_CAPS);
+    GstCaps *intersection = gst_caps_intersect(templateCaps, result);
+    gst_caps_unref(templateCaps);
+    gst_caps_unref(result);
+    result = intersection;
+
+    if (filter)
+    {
+        intersection = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(result);
+        result = intersection;
+    }
+    return result;
+}
+
+static GstCaps *fusedAudioFixateCaps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, GstCaps *othercaps)
+{
+    othercaps = gst_caps_make_writable(gst_caps_truncate(othercaps));
+    GstStructure *from = gst_caps_get_structure(caps, 0);
+    GstStructure *to = gst_caps_get_structure(othercaps, 0);
+    gint rate, channels;
+    const gchar *format = gst_structure_get_string(from, "format");
+
+    if (format)
+        gst_structure_fixate_field_string(to, "format", format);
+    if (gst_structure_get_int(from, "rate", &rate))
+        gst_structure_fixate_field_nearest_int(to, "rate", rate);
+    if (gst_structure_get_int(from, "channels", &channels))
+        gst_structure_fixate_field_nearest_int(to, "channels", channels);
+    othercaps = gst_caps_fixate(othercaps);
+
+    // More than two channels need a layout.
+    to = gst_caps_get_structure(othercaps, 0);
+    if (gst_structure_get_int(to, "channels", &channels) && channels > 2 && !gst_structure_has_field(to, "channel-mask"))
+    {
+        gst_structure_set(to, "channel-mask", GST_TYPE_BITMASK, gst_audio_channel_get_fallback_mask(channels), NULL);
+    }
+    return othercaps;
+}
+
+static gboolean fusedAudioSrcQuery(GstBaseTransform *trans, GstPadDirection direction, GstQuery *query)
+{
+    FusedAudio *self = (FusedAudio *)trans;
+    gboolean ok = GST_BASE_TRANSFORM_CLASS(fused_audio_parent_class)->query(trans, direction, query);
+    if (ok && direction == GST_PAD_SRC && GST_QUERY_TYPE(query) == GST_QUERY_LATENCY && self->resample)
+    {
+        // The filter holds back taps / 2 input frames.
+        gboolean live;
+        GstClockTime min, max;
+        gst_query_parse_latency(query, &live, &min, &max);
+        GstClockTime added = gst_util_uint64_scale_int(self->taps / 2, GST_SECOND, GST_AUDIO_INFO_RATE(&self->inInfo));
+        gst_query_set_latency(query, live, min + added, GST_CLOCK_TIME_IS_VALID(max) ? max + added : max);
+    }
+    return ok;
+}
+
+static gboolean fusedAudioStop(GstBaseTransform *trans)
+{
+    fusedAudioFreeState((FusedAudio *)trans);
+    return TRUE;
+}
+
+static void fusedAudioFinalize(GObject *object)
+{
+    fusedAudioFreeState((FusedAudio *)object);
+    G_OBJECT_CLASS(fused_audio_parent_class)->finalize(object);
+}
+
+static void fusedAudioSetProperty(GObject *object, guint id, const GValue *value, GParamSpec *spec)
+{
+    if (id != FUSED_AUDIO_PROP_QUALITY)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    // Takes effect at the next caps.
+    ((FusedAudio *)object)->quality = g_value_get_int(value);
+}
+
+static void fusedAudioGetProperty(GObject *object, guint id, GValue *value, GParamSpec *spec)
+{
+    if (id != FUSED_AUDIO_PROP_QUALITY)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    g_value_set_int(value, ((FusedAudio *)object)->quality);
+}
+
+static void fused_audio_class_init(FusedAudioClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass *transformClass = GST_BASE_TRANSFORM_CLASS(klass);
+
+    objectClass->set_property = fusedAudioSetProperty;
+    objectClass->get_property = fusedAudioGetProperty;
+    objectClass->finalize = fusedAudioFinalize;
+    g_object_class_install_property(
+        objectClass, FUSED_AUDIO_PROP_QUALITY,
+        g_param_spec_int("quality", "Quality", "Resample quality, 0 (fastest) to 10 (best), like audioresample",
+                         0, 10, GST_AUDIO_RESAMPLER_QUALITY_DEFAULT,
+                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    GstCaps *caps = gst_caps_from_string(FUSED_AUDIO_CAPS);
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    gst_element_class_set_static_metadata(elementClass, "Fused audio converter", "Filter/Converter/Audio",
+                                          "Converts format and channels and resamples in one pass",
+                                          "GStreamer Exercises");
+
+    transformClass->transform_caps = fusedAudioTransformCaps;
+    transformClass->fixate_caps = fusedAudioFixateCaps;
+    transformClass->set_caps = fusedAudioSetCaps;
+    transformClass->transform_size = fusedAudioTransformSize;
+    transformClass->prepare_output_buffer = fusedAudioPrepareOutputBuffer;
+    transformClass->transform = fusedAudioTransform;
+    transformClass->transform_ip = fusedAudioTransformIp;
+    transformClass->sink_event = fusedAudioSinkEvent;
+    transformClass->query = fusedAudioSrcQuery;
+    transformClass->stop = fusedAudioStop;
+    transformClass->passthrough_on_same_caps = TRUE;
+}
+
+static void fused_audio_init(FusedAudio *self)
+{
+    self->quality = GST_AUDIO_RESAMPLER_QUALITY_DEFAULT;
+    self->kernels = fusedAudioKernelsBest();
+    self->matrix = self->filter = self->scratchIn = self->scratchOut = NULL;
+    memset(self->history, 0, sizeof(self->history));
+    self->historyLength = self->historyCapacity = 0;
+    self->taps = 0;
+    self->resample = FALSE;
+    self->pool = NULL;
+    self->poolSize = 0;
+    self->startTime = GST_CLOCK_TIME_NONE;
+}
+
+/*!
+ * @brief Makes "fusedaudio" available to gst_element_factory_make() and gst_parse_launch() in this process.
+ */
+static gboolean fusedAudioRegister()
+{
+    return gst_element_register(NULL, "fusedaudio", GST_RANK_NONE, fused_audio_get_type());
+}
+
+#endif // FUSED_AUDIO_H
@@ -0,0 +1,348 @@
+/*!
+ * @brief Gapless playlist. One playbin plays every item; the next URI is queued from "about-to-finish".
+ * @note Usage:- ./Gapless-Playlist.o [--playbin3] [--gap-budget=MS] <file-or-uri>...
+ *               ./Gapless-Playlist.o --test[=N] [--gap-budget=MS]
+ * @link https://gstreamer.freedesktop.org/documentation/playback/playbin.html?gi-language=c#playbin::about-to-finish
+ *
+ * Every exercise plays one URI and tears down at EOS, so a playlist pays a full NULL -> PLAYING per item and the
+ * sinks run dry in between. playbin emits about-to-finish (from a streaming thread) once the current item has been
+ * read completely. Setting "uri" there queues the next item behind the data still in flight: the sinks keep their
+ * clock and running time continues across items. With --playbin3 decoders are also kept when the caps of the next
+ * item are compatible.
+ *
+ * The gap is measured at the sinks. A probe on each sink pad tracks the segment and marks STREAM_START, the handoff
+ * of the first rendered buffer after it compares:
+ *  - running time: first buffer of the new item against the end of the last buffer of the previous one;
+ *  - wall clock:   when it was rendered against when the previous buffer finished rendering.
+ * Gaps per boundary are the larger of audio and video.
+ *
+ * --test generates N (default 100) half-second Matroska clips with raw audio and video, plays them back to back and
+ * fails unless the sum of all gaps stays within --gap-budget.
+ */
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "Bus-Dispatcher.h"
+
+typedef struct
+{
+    GstSegment segment;
+    gboolean boundary; // STREAM_START seen, the next buffer starts a new item
+    gboolean haveLast;
+    GstClockTime lastEnd;
+    gint64 lastRenderEnd; // monotonic, us
+    guint boundaries;
+    std::vector<gdouble> mediaGapsMs, wallGapsMs;
+} GapTracker;
+
+typedef struct
+{
+    GstElement *playbin;
+    GMainLoop *mainLoop;
+    std::vector<gchar *> uris;
+    std::atomic<guint> current;
+    gboolean failed;
+
+    // Trackers are written from the sinks' streaming threads, read from main at the end.
+    std::mutex lock;
+    GapTracker audio, video;
+} CustomData;
+
+static gboolean usePlaybin3 = FALSE;
+static gint testClips = 0;
+static gdouble gapBudgetMs = 100.0;
+
+static gboolean parseTest(const gchar *name, const gchar *value, gpointer data, GError **error)
+{
+    testClips = value ? atoi(value) : 100;
+    return testClips > 0;
+}
+
+static GOptionEntry entries[] = {
+    {"playbin3", 0, 0, G_OPTION_ARG_NONE, &usePlaybin3, "Use playbin3 (keeps decoders across compatible items)", NULL},
+    {"test", 't', G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK, (gpointer)parseTest, "Generate N clips (default 100) and check the gap budget", "N"},
+    {"gap-budget", 'g', 0, G_OPTION_ARG_DOUBLE, &gapBudgetMs, "Maximum sum of all gaps in ms", "MS"},
+    {NULL}};
+
+/* ======= Gap measurement ==========*/
+
+static GstPadProbeReturn onSinkEvent(GstPad *pad, GstPadProbeInfo *info, GapTracker *tracker)
+{
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    switch (GST_EVENT_TYPE(event))
+    {
+    case GST_EVENT_STREAM_START:
+        tracker->boundary = TRUE;
+        break;
+    case GST_EVENT_SEGMENT:
+        gst_event_copy_segment(event, &tracker->segment);
+        break;
+    default:
+        break;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// Handoff runs on the same streaming thread as the probe, after the sink waited for the buffer's clock time.
+static void onHandoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, CustomData *data)
+{
+    GapTracker *tracker = (GapTracker *)g_object_get_data(G_OBJECT(sink), "tracker");
+    gint64 now = g_get_monotonic_time();
+    GstClockTime start = gst_segment_to_running_time(&tracker->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    GstClockTime duration = GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0;
+
+    if (!GST_CLOCK_TIME_IS_VALID(start))
+    {
+        return;
+    }
+
+    if (tracker->boundary && tracker->haveLast)
+    {
+        std::lock_guard<std::mutex> guard(data->lock);
+        tracker->mediaGapsMs.push_back(GST_CLOCK_DIFF(tracker->lastEnd, start) / (gdouble)GST_MSECOND);
+        tracker->wallGapsMs.push_back((now - tracker->lastRenderEnd) / 1000.0);
+        tracker->boundaries++;
+    }
+    tracker->boundary = FALSE;
+    tracker->haveLast = TRUE;
+    tracker->lastEnd = start + duration;
+    tracker->lastRenderEnd = now + duration / GST_USECOND;
+}
+
+static GstElement *makeTrackedSink(CustomData *data, GapTracker *tracker)
+{
+    GstElement *sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(sink, "sync", TRUE, "signal-handoffs", TRUE, NULL);
+    g_object_set_data(G_OBJECT(sink), "tracker", tracker);
+    g_signal_connect(sink, "handoff", G_CALLBACK(onHandoff), data);
+
+    gst_segment_init(&tracker->segment, GST_FORMAT_TIME);
+    tracker->boundary = FALSE;
+    tracker->haveLast = FALSE;
+    tracker->boundaries = 0;
+
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, (GstPadProbeCallback)onSinkEvent, tracker, NULL);
+    gst_object_unref(pad);
+    return sink;
+}
+
+/* ======= Playlist ==========*/
+
+// Streaming thread. Queue the next item; playbin switches to it once the current one has drained.
+static void onAboutToFinish(GstElement *playbin, CustomData *data)
+{
+    guint next = data->current + 1;
+    if (next < data->uris.size())
+    {
+        data->current = next;
+        g_object_set(playbin, "uri", data->uris[next], NULL);
+    }
+}
+
+static void onError(GstMessage *msg, CustomData *data)
+{
+    GError *err;
+    gchar *debug_info;
+
+    gst_message_parse_error(msg, &err, &debug_info);
+    gst_printerr("\nError Message: %s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
+    gst_printerr("\nDebug Message: \n %s", debug_info ? debug_info : "none");
+    g_clear_error(&err);
+    g_free(debug_info);
+    data->failed = TRUE;
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onEos(GstMessage *msg, CustomData *data)
+{
+    g_print("\nReached end of playlist.");
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onStreamStart(GstMessage *msg, CustomData *data)
+{
+    g_print("\rPlaying item %u / %u", data->current + 1, (guint)data->uris.size());
+}
+
+/* ======= Test clips ==========*/
+
+static gboolean generateClips(const gchar *directory, gint numClips, std::vector<gchar *> &uris)
+{
+    for (gint i = 0; i < numClips; i++)
+    {
+        GError *err = NULL;
+        gchar *location = g_strdup_printf("%s/clip-%03d.mkv", directory, i);
+
+        // 0.5 s: 15 frames at 30 fps and 15 x 1470 samples at 44.1 kHz, so both streams end together.
+        gchar *description = g_strdup_printf(
+            "matroskamux name=mux ! filesink location=%s "
+            "videotestsrc num-buffers=15 pattern=%d ! video/x-raw,format=I420,width=160,height=120,framerate=30/1 ! mux. "
+            "audiotestsrc num-buffers=15 samplesperbuffer=1470 freq=%d ! audio/x-raw,format=S16LE,rate=44100,channels=2 ! mux.",
+            location, i % 20, 220 + 20 * (i % 20));
+        GstElement *pipeline = gst_parse_launch(description, &err);
+        g_free(description);
+        if (!pipeline)
+        {
+            gst_printerr("\nFailed to build the clip generator: %s", err->message);
+            g_clear_error(&err);
+            g_free(location);
+            return FALSE;
+        }
+
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        GstBus *bus = gst_element_get_bus(pipeline);
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        gst_message_unref(msg);
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+
+        if (!ok)
+        {
+            gst_printerr("\nFailed to write %s", location);
+            g_free(location);
+            return FALSE;
+        }
+        uris.push_back(gst_filename_to_uri(location, NULL));
+        g_free(location);
+    }
+    return TRUE;
+}
+
+static void removeClips(const gchar *directory, gint numClips)
+{
+    for (gint i = 0; i < numClips; i++)
+    {
+        gchar *location = g_strdup_printf("%s/clip-%03d.mkv", directory, i);
+        g_remove(location);
+        g_free(location);
+    }
+    g_rmdir(directory);
+}
+
+/* ======= Report ==========*/
+
+// Gap at every boundary is the worse of audio and video; *totalGap gets the sum in ms. Returns the boundaries seen.
+static size_t report(CustomData *data, gdouble *totalGap)
+{
+    std::lock_guard<std::mutex> guard(data->lock);
+    size_t boundaries = MAX(data->audio.mediaGapsMs.size(), data->video.mediaGapsMs.size());
+    gdouble total = 0, worst = 0, worstWall = 0;
+
+    for (size_t i = 0; i < boundaries; i++)
+    {
+        gdouble gap = 0, wall = 0;
+        for (GapTracker *tracker : {&data->audio, &data->video})
+        {
+            if (i < tracker->mediaGapsMs.size())
+            {
+                gap = MAX(gap, fabs(tracker->mediaGapsMs[i]));
+                wall = MAX(wall, tracker->wallGapsMs[i]);
+            }
+        }
+        total += gap;
+        worst = MAX(worst, gap);
+        worstWall = MAX(worstWall, wall);
+    }
+
+    g_print("\n%u items, %u boundaries: total gap %.2f ms, worst %.2f ms (running time), worst wall-clock gap %.2f ms",
+            (guint)data->uris.size(), (guint)boundaries, total, worst, worstWall);
+    if (boundaries + 1 < data->uris.size())
+    {
+        g_print("\nOnly %u of %u boundaries were seen.", (guint)boundaries, (guint)data->uris.size() - 1);
+    }
+    *totalGap = total;
+    return boundaries;
+}
+
+int main(int argc, char **argv)
+{
+    CustomData data;
+    GError *err = NULL;
+    gchar *testDirectory = NULL;
+
+    GOptionContext *context = g_option_context_new("<file-or-uri>... - play a playlist without gaps");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || (argc < 2 && !testClips))
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing playlist items.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    if (testClips)
+    {
+        testDirectory = g_dir_make_tmp("gapless-XXXXXX", NULL);
+        if (!testDirectory || !generateClips(testDirectory, testClips, data.uris))
+        {
+            return -1;
+        }
+    }
+    for (gint i = 1; i < argc; i++)
+    {
+        data.uris.push_back(gst_uri_is_valid(argv[i]) ? g_strdup(argv[i]) : gst_filename_to_uri(argv[i], NULL));
+    }
+
+    data.current = 0;
+    data.failed = FALSE;
+    data.playbin = gst_element_factory_make(usePlaybin3 ? "playbin3" : "playbin", "playbin");
+    if (!data.playbin)
+    {
+        gst_printerr("\nFailed to create %s.", usePlaybin3 ? "playbin3" : "playbin");
+        return -1;
+    }
+    g_object_set(data.playbin, "uri", data.uris[0],
+                 "video-sink", makeTrackedSink(&data, &data.video),
+                 "audio-sink", makeTrackedSink(&data, &data.audio), NULL);
+    g_signal_connect(data.playbin, "about-to-finish", G_CALLBACK(onAboutToFinish), &data);
+
+    BusDispatcher *dispatcher = busDispatcherNew(data.playbin, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_STREAM_START, NULL, (BusHandler)onStreamStart, &data);
+
+    if (gst_element_set_state(data.playbin, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the playbin.");
+        busDispatcherFree(dispatcher);
+        gst_object_unref(data.playbin);
+        return -1;
+    }
+
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(data.mainLoop);
+
+    g_main_loop_unref(data.mainLoop);
+    busDispatcherFree(dispatcher);
+    gst_element_set_state(data.playbin, GST_STATE_NULL);
+    gst_object_unref(data.playbin);
+
+    gdouble totalGap = 0;
+    size_t boundaries = report(&data, &totalGap);
+    // A missed boundary adds nothing to the total, so it has to fail on its own.
+    gboolean passed = !data.failed && data.current + 1 == data.uris.size() && boundaries + 1 == data.uris.size() &&
+                      totalGap <= gapBudgetMs;
+    g_print("\n%s: total gap %.2f ms, budget %.2f ms\n", passed ? "PASS" : "FAIL", totalGap, gapBudgetMs);
+
+    if (testDirectory)
+    {
+        removeClips(testDirectory, testClips);
+        g_free(testDirectory);
+    }
+    for (gchar *uri : data.uris)
+    {
+        g_free(uri);
+    }
+    return passed ? 0 : -1;
+}
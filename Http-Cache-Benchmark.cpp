@@ -0,0 +1,269 @@
+/*!
+ * @brief Startup and seek latency of playbin over HTTP: straight from the server, through a cold Http-Cache.h cache
+ * and through the same cache warm. The server is Http-Stand-In.h with an emulated round trip and bandwidth.
+ * @note Usage:- ./Http-Cache-Benchmark.o [--file=sintel_trailer-480p.webm] [--latency-ms=N] [--kbps=N] [--seeks=N]
+ * @link https://gstreamer.freedesktop.org/documentation/playback/playbin.html?gi-language=c#playbin::source-setup
+ *
+ * Without --file a 20 s 480p H.264/Matroska clip is encoded first (the sintel trailer is WebM of about that size).
+ * Each mode opens a fresh playbin with fakesinks:
+ *   startup  PAUSED request -> ASYNC_DONE (typefinding, demuxer headers, first frames)
+ *   seek     --seeks flushing key-unit seeks spread over the duration, each until ASYNC_DONE
+ * Modes:
+ *   direct   cachehttpsrc ranked down, so playbin takes souphttpsrc
+ *   cold     empty cache directory
+ *   warm     the same playback again on the cache the cold run filled
+ * One JSON line per mode, with the requests/bytes the server saw and the source's hits/misses.
+ * Fails if the cached runs fail, or the warm run waited for the network or started no faster than the cold one.
+ */
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <vector>
+#include "Http-Cache.h"
+#include "Http-Stand-In.h"
+
+typedef struct
+{
+    gdouble startupMs, seekMeanMs, seekMaxMs;
+    guint64 requests, bytes;
+    guint64 hits, misses;
+} PlaybackResult;
+
+typedef struct
+{
+    const gchar *cacheDir;
+    GstElement *source;
+} SourceSetup;
+
+static gchar *file = NULL;
+static gint latencyMs = 40;
+static gint kbps = 16000;
+static gint seeks = 5;
+
+static GOptionEntry entries[] = {
+    {"file", 'f', 0, G_OPTION_ARG_FILENAME, &file, "File to serve (default: an encoded test clip)", "PATH"},
+    {"latency-ms", 'l', 0, G_OPTION_ARG_INT, &latencyMs, "Server delay before each response", "N"},
+    {"kbps", 'k', 0, G_OPTION_ARG_INT, &kbps, "Server bandwidth in kbit/s, 0 for unlimited", "N"},
+    {"seeks", 's', 0, G_OPTION_ARG_INT, &seeks, "Seeks per run", "N"},
+    {NULL}};
+
+static void onSourceSetup(GstElement *playbin, GstElement *source, SourceSetup *setup)
+{
+    if (g_strcmp0(G_OBJECT_TYPE_NAME(source), "HttpCacheSrc") == 0)
+    {
+        g_object_set(source, "cache-dir", setup->cacheDir, NULL);
+        gst_object_replace((GstObject **)&setup->source, GST_OBJECT(source));
+    }
+}
+
+/*!
+ * @brief Waits for the pending state change or seek to complete. Returns milliseconds, or a negative value on error.
+ */
+static gdouble waitAsyncDone(GstBus *bus, gint64 startTime)
+{
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 60 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR));
+    gdouble elapsed = (g_get_monotonic_time() - startTime) / 1000.0;
+    if (!msg || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        GError *err = NULL;
+        if (msg)
+            gst_message_parse_error(msg, &err, NULL);
+        gst_printerr("\n%s", err ? err->message : "Timed out");
+        g_clear_error(&err);
+        elapsed = -1;
+    }
+    if (msg)
+        gst_message_unref(msg);
+    return elapsed;
+}
+
+static gboolean runPlayback(HttpStandIn *server, const gchar *cacheDir, PlaybackResult *result)
+{
+    GstElement *playbin = gst_element_factory_make("playbin", NULL);
+    if (!playbin)
+    {
+        return FALSE;
+    }
+    gchar *uri = httpStandInUri(server);
+    SourceSetup setup = {cacheDir, NULL};
+    g_object_set(playbin, "uri", uri, "video-sink", gst_element_factory_make("fakesink", NULL), "audio-sink",
+                 gst_element_factory_make("fakesink", NULL), NULL);
+    g_signal_connect(playbin, "source-setup", G_CALLBACK(onSourceSetup), &setup);
+    g_free(uri);
+
+    guint64 requestsBefore = server->requests, bytesBefore = server->bytes;
+    GstBus *bus = gst_element_get_bus(playbin);
+    gint64 startTime = g_get_monotonic_time();
+    gst_element_set_state(playbin, GST_STATE_PAUSED);
+    result->startupMs = waitAsyncDone(bus, startTime);
+    gboolean ok = result->startupMs >= 0;
+
+    gint64 duration = 0;
+    ok = ok && gst_element_query_duration(playbin, GST_FORMAT_TIME, &duration) && duration > 0;
+    std::vector<gdouble> seekMs;
+    for (gint i = 0; ok && i < seeks; i++)
+    {
+        // Alternately from the end and the start (5/6, 1/6, 4/6, ...), so a seek never lands in what read-ahead
+        // just fetched.
+        gint64 position = duration * (i % 2 ? i / 2 + 1 : seeks - i / 2) / (seeks + 1);
+        startTime = g_get_monotonic_time();
+        ok = gst_element_seek_simple(playbin, GST_FORMAT_TIME,
+                                     (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), position);
+        gdouble elapsed = ok ? waitAsyncDone(bus, startTime) : -1;
+        ok = elapsed >= 0;
+        seekMs.push_back(elapsed);
+    }
+
+    result->seekMeanMs = result->seekMaxMs = 0;
+    for (gdouble ms : seekMs)
+    {
+        result->seekMeanMs += ms / seekMs.size();
+        result->seekMaxMs = MAX(result->seekMaxMs, ms);
+    }
+    result->hits = result->misses = 0;
+    if (setup.source)
+    {
+        g_object_get(setup.source, "hits", &result->hits, "misses", &result->misses, NULL);
+        gst_object_unref(setup.source);
+    }
+
+    gst_element_set_state(playbin, GST_STATE_NULL);
+    result->requests = server->requests - requestsBefore;
+    result->bytes = server->bytes - bytesBefore;
+    gst_object_unref(bus);
+    gst_object_unref(playbin);
+    return ok;
+}
+
+static void printResult(const gchar *mode, gboolean ok, const PlaybackResult *result)
+{
+    g_print("{\"mode\": \"%s\", \"ok\": %s, \"startup_ms\": %.1f, \"seek_mean_ms\": %.1f, \"seek_max_ms\": %.1f, "
+            "\"requests\": %" G_GUINT64_FORMAT ", \"megabytes\": %.2f, \"hits\": %" G_GUINT64_FORMAT
+            ", \"misses\": %" G_GUINT64_FORMAT "}\n",
+            mode, ok ? "true" : "false", result->startupMs, result->seekMeanMs, result->seekMaxMs, result->requests,
+            result->bytes / 1e6, result->hits, result->misses);
+}
+
+static gboolean encodeTestClip(const gchar *location)
+{
+    GError *err = NULL;
+    gchar *description = g_strdup_printf(
+        "videotestsrc num-buffers=600 pattern=ball ! video/x-raw,width=854,height=480,framerate=30/1 ! "
+        "x264enc speed-preset=ultrafast bitrate=2000 key-int-max=30 ! h264parse ! matroskamux ! filesink location=%s",
+        location);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the encoder: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+static void removeDirectory(const gchar *directory)
+{
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    const gchar *name;
+    while (dir && (name = g_dir_read_name(dir)))
+    {
+        gchar *path = g_build_filename(directory, name, NULL);
+        g_remove(path);
+        g_free(path);
+    }
+    if (dir)
+        g_dir_close(dir);
+    g_rmdir(directory);
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- playbin over HTTP: direct, cold cache, warm cache");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    httpCacheRegister();
+    seeks = MAX(seeks, 1);
+
+    gchar *directory = g_dir_make_tmp("http-cache-XXXXXX", NULL);
+    if (!directory)
+    {
+        gst_printerr("\nFailed to create the cache directory.");
+        return -1;
+    }
+    gchar *clip = NULL;
+    if (!file)
+    {
+        clip = g_build_filename(g_get_tmp_dir(), "http-cache-test.mkv", NULL);
+        if (!encodeTestClip(clip))
+        {
+            gst_printerr("\nFailed to encode the test clip.");
+            g_free(clip);
+            removeDirectory(directory);
+            g_free(directory);
+            return -1;
+        }
+    }
+
+    HttpStandIn *server = httpStandInNew(file ? file : clip, latencyMs, (guint64)kbps * 1000 / 8, &err);
+    if (!server)
+    {
+        gst_printerr("\nFailed to start the server: %s", err->message);
+        g_clear_error(&err);
+        removeDirectory(directory);
+        g_free(directory);
+        if (clip)
+        {
+            g_remove(clip);
+            g_free(clip);
+        }
+        return -1;
+    }
+
+    PlaybackResult direct, cold, warm;
+    GstPluginFeature *feature = GST_PLUGIN_FEATURE(gst_element_factory_find("cachehttpsrc"));
+    gst_plugin_feature_set_rank(feature, GST_RANK_NONE);
+    gboolean directOk = runPlayback(server, directory, &direct);
+    printResult("direct", directOk, &direct);
+    gst_plugin_feature_set_rank(feature, GST_RANK_PRIMARY + 1);
+    gst_object_unref(feature);
+
+    gboolean coldOk = runPlayback(server, directory, &cold);
+    printResult("cold", coldOk, &cold);
+    gboolean warmOk = runPlayback(server, directory, &warm);
+    printResult("warm", warmOk, &warm);
+
+    httpStandInFree(server);
+    removeDirectory(directory);
+    g_free(directory);
+    if (clip)
+    {
+        g_remove(clip);
+        g_free(clip);
+    }
+    g_free(file);
+
+    gboolean passed = coldOk && warmOk && warm.misses == 0 && warm.startupMs < cold.startupMs;
+    g_print("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : -1;
+}
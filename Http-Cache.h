@@ -0,0 +1,1072 @@
+/*!
+ * @brief cachehttpsrc: an http(s):// source that keeps what it downloads in a disk-backed range cache, so reopening
+ * or seeking in the same URI reads local storage instead of the network.
+ * @link https://gstreamer.freedesktop.org/documentation/base/gstbasesrc.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/gstreamer/gsturihandler.html?gi-language=c
+ *
+ * The resource is cut into HTTP_CACHE_BLOCK blocks. <cache-dir>/<sha1 of uri>.data holds their bytes at their own
+ * offsets (a sparse file) and <sha1>.map has the resource size followed by one byte per block, set once the block
+ * is on disk. A map that exists at open time gives the size, so a warm start needs no request at all.
+ * One fetcher thread per URI owns the HTTP connection (kept alive) and fetches runs of missing blocks with Range
+ * requests:
+ * - a block a reader is waiting for comes first. A run that doesn't contain it is abandoned mid-body (the connection
+ *   is closed), so a seek doesn't queue behind read-ahead.
+ * - otherwise it fetches up to read-ahead bytes past the last block read.
+ * The source is random access (pull mode), so demuxers seek by reading other offsets, nothing is flushed upstream.
+ * Cached content is never revalidated or evicted: this is for media that doesn't change under its URL.
+ * The server must answer with a Content-Length (206 with a matching Content-Range, or 200): chunked responses and
+ * live streams without a length fail to open, they aren't streamed uncached.
+ * A failed fetch is only reported to the reader whose block it was; read-ahead that failed is retried with a backoff
+ * and a reader asking for a block retries it at once.
+ *
+ * httpCacheRegister() ranks the element above souphttpsrc, so playbin, uridecodebin and GstDiscoverer pick it for
+ * every http(s) URI in the process. Only call it in programs whose URIs are known static files (e.g. the sintel
+ * trailer), never where the URI comes from the user. The "hits" and "misses" properties count reads served from disk
+ * vs. reads that had to wait for the network.
+ */
+
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define HTTP_CACHE_BLOCK (256 * 1024)
+#define HTTP_CACHE_MAGIC 0x31434348 // "HCC1"
+#define HTTP_CACHE_UNKNOWN G_MAXUINT64
+#define HTTP_CACHE_MAX_REDIRECTS 5
+#define HTTP_CACHE_RETRY_MS 250      // First read-ahead retry after a failure, doubled per failure
+#define HTTP_CACHE_MAX_RETRY_MS 8000 // up to this.
+
+/* ======= HTTP client ==========*/
+
+typedef struct
+{
+    gchar *host, *target; // target: path and query, as sent in the request line
+    guint16 port;
+    gboolean tls;
+    GSocketClient *socketClient;
+    GSocketConnection *connection;
+    GDataInputStream *input;
+    gboolean closeAfter; // The current response can't be followed by another one on this connection.
+} HttpClient;
+
+static void httpClientClose(HttpClient *client)
+{
+    g_clear_object(&client->input);
+    if (client->connection)
+    {
+        g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+        g_clear_object(&client->connection);
+    }
+}
+
+static gboolean httpClientSetUri(HttpClient *client, const gchar *uri)
+{
+    GstUri *parsed = gst_uri_from_string(uri);
+    const gchar *authority = strstr(uri, "://");
+    if (!parsed || !gst_uri_get_host(parsed) || !authority)
+    {
+        if (parsed)
+            gst_uri_unref(parsed);
+        return FALSE;
+    }
+    httpClientClose(client);
+    g_free(client->host);
+    g_free(client->target);
+    client->tls = g_ascii_strcasecmp(gst_uri_get_scheme(parsed), "https") == 0;
+    client->host = g_strdup(gst_uri_get_host(parsed));
+    guint port = gst_uri_get_port(parsed);
+    client->port = port == GST_URI_NO_PORT ? (client->tls ? 443 : 80) : port;
+    // Keep the path exactly as escaped in the URI, without the fragment.
+    const gchar *path = strchr(authority + 3, '/');
+    client->target = path ? g_strndup(path, strcspn(path, "#")) : g_strdup("/");
+    gst_uri_unref(parsed);
+    return TRUE;
+}
+
+static gboolean httpClientConnect(HttpClient *client, GCancellable *cancellable, GError **err)
+{
+    if (!client->socketClient)
+    {
+        client->socketClient = g_socket_client_new();
+    }
+    g_socket_client_set_tls(client->socketClient, client->tls);
+    client->connection =
+        g_socket_client_connect_to_host(client->socketClient, client->host, client->port, cancellable, err);
+    if (!client->connection)
+    {
+        return FALSE;
+    }
+    g_socket_set_timeout(g_socket_connection_get_socket(client->connection), 30);
+    client->input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(client->connection)));
+    g_data_input_stream_set_newline_type(client->input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+    return TRUE;
+}
+
+/*!
+ * @brief Sends a GET for [offset, offset + length) and reads the response headers. On success *bodyLength bytes of
+ * it can be read from client->input and *total is the size of the whole resource. Follows redirects. A kept-alive
+ * connection the server closed in the meantime is reopened once.
+ */
+static gboolean httpClientRequest(HttpClient *client, guint64 offset, guint64 length, guint64 *bodyLength,
+                                  guint64 *total, GCancellable *cancellable, GError **err)
+{
+    guint redirects = 0;
+    gboolean retried = FALSE;
+    for (;;)
+    {
+        gboolean reused = client->connection != NULL;
+        if (!reused && !httpClientConnect(client, cancellable, err))
+        {
+            return FALSE;
+        }
+        client->closeAfter = FALSE;
+
+        gchar *defaultPort = g_strdup_printf(":%u", client->port);
+        gchar *request = g_strdup_printf("GET %s HTTP/1.1\r\nHost: %s%s\r\nRange: bytes=%" G_GUINT64_FORMAT
+                                         "-%" G_GUINT64_FORMAT "\r\nUser-Agent: GStreamer-Exercises\r\n\r\n",
+                                         client->target, client->host,
+                                         client->port == (client->tls ? 443 : 80) ? "" : defaultPort, offset,
+                                         offset + length - 1);
+        g_free(defaultPort);
+        GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(client->connection));
+        GError *sendError = NULL;
+        gboolean sent = g_output_stream_write_all(output, request, strlen(request), NULL, cancellable, &sendError);
+        g_free(request);
+        gchar *status = sent ? g_data_input_stream_read_line(client->input, NULL, cancellable, &sendError) : NULL;
+        if (!status)
+        {
+            httpClientClose(client);
+            if (reused && !retried && !g_cancellable_is_cancelled(cancellable))
+            {
+                retried = TRUE;
+                g_clear_error(&sendError);
+                continue;
+            }
+            if (!sendError)
+                g_set_error(&sendError, G_IO_ERROR, G_IO_ERROR_CLOSED, "Connection closed by %s", client->host);
+            g_propagate_error(err, sendError);
+            return FALSE;
+        }
+
+        guint code = 0;
+        sscanf(status, "HTTP/%*d.%*d %u", &code);
+        g_free(status);
+        guint64 contentLength = HTTP_CACHE_UNKNOWN, rangeTotal = HTTP_CACHE_UNKNOWN;
+        guint64 rangeFirst = HTTP_CACHE_UNKNOWN, rangeLast = HTTP_CACHE_UNKNOWN;
+        gchar *location = NULL;
+        gboolean chunked = FALSE;
+        gchar *line;
+        while ((line = g_data_input_stream_read_line(client->input, NULL, cancellable, err)) && *line)
+        {
+            const gchar *value = strchr(line, ':');
+            value = value ? value + 1 + strspn(value + 1, " \t") : "";
+            if (g_ascii_strncasecmp(line, "Content-Length:", 15) == 0)
+                contentLength = g_ascii_strtoull(value, NULL, 10);
+            else if (g_ascii_strncasecmp(line, "Content-Range:", 14) == 0)
+            {
+                // bytes a-b/total, or bytes */total with a 416
+                guint64 first, last, size;
+                if (sscanf(value, "bytes %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT, &first,
+                           &last, &size) == 3)
+                {
+                    rangeFirst = first;
+                    rangeLast = last;
+                    rangeTotal = size;
+                }
+                else if (sscanf(value, "bytes */%" G_GUINT64_FORMAT, &size) == 1)
+                    rangeTotal = size;
+            }
+            else if (g_ascii_strncasecmp(line, "Location:", 9) == 0)
+                location = g_strdup(value);
+            else if (g_ascii_strncasecmp(line, "Connection:", 11) == 0 && g_ascii_strcasecmp(value, "close") == 0)
+                client->closeAfter = TRUE;
+            else if (g_ascii_strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(value, "chunked"))
+                chunked = TRUE;
+            g_free(line);
+        }
+        if (!line)
+        {
+            g_free(location);
+            httpClientClose(client);
+            if (err && !*err)
+                g_set_error(err, G_IO_ERROR, G_IO_ERROR_CLOSED, "Connection closed by %s", client->host);
+            return FALSE;
+        }
+        g_free(line);
+
+        if (code >= 300 && code < 400 && location && redirects++ < HTTP_CACHE_MAX_REDIRECTS)
+        {
+            httpClientClose(client);
+            if (location[0] == '/')
+            {
+                g_free(client->target);
+                client->target = location;
+            }
+            else
+            {
+                gboolean ok = httpClientSetUri(client, location);
+                g_free(location);
+                if (!ok)
+                {
+                    g_set_error(err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Bad redirect from %s", client->host);
+                    return FALSE;
+                }
+            }
+            continue;
+        }
+        g_free(location);
+
+        if (chunked)
+        {
+            httpClientClose(client);
+            g_set_error(err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "%s sent a chunked response", client->host);
+            return FALSE;
+        }
+        if (code == 206)
+        {
+            // The body is stored block by block from the offset asked for: it must start there and end on a block
+            // boundary or at the end of the resource.
+            if (contentLength == HTTP_CACHE_UNKNOWN || rangeTotal == HTTP_CACHE_UNKNOWN || rangeFirst != offset ||
+                rangeLast < rangeFirst || rangeLast >= rangeTotal || rangeLast - rangeFirst + 1 != contentLength ||
+                contentLength > length || ((rangeLast + 1) % HTTP_CACHE_BLOCK != 0 && rangeLast + 1 != rangeTotal))
+            {
+                httpClientClose(client);
+                g_set_error(err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                            "%s answered a Range request from %" G_GUINT64_FORMAT " with another range", client->host,
+                            offset);
+                return FALSE;
+            }
+            *bodyLength = contentLength;
+            *total = rangeTotal;
+            return TRUE;
+        }
+        if (code == 416 && rangeTotal != HTTP_CACHE_UNKNOWN)
+        {
+            // Past the end, e.g. the first request of an empty resource.
+            *bodyLength = 0;
+            *total = rangeTotal;
+            client->closeAfter = TRUE;
+            return TRUE;
+        }
+        if (code == 200 && contentLength != HTTP_CACHE_UNKNOWN && offset <= contentLength)
+        {
+            // No range support: skip to the offset, and don't reuse a connection with the rest of the body on it.
+            for (guint64 skipped = 0; skipped < offset;)
+            {
+                gssize n = g_input_stream_skip(G_INPUT_STREAM(client->input), offset - skipped, cancellable, err);
+                if (n <= 0)
+                {
+                    httpClientClose(client);
+                    if (n == 0 && err && !*err)
+                        g_set_error(err, G_IO_ERROR, G_IO_ERROR_CLOSED, "Connection closed by %s", client->host);
+                    return FALSE;
+                }
+                skipped += n;
+            }
+            *bodyLength = MIN(length, contentLength - offset);
+            *total = contentLength;
+            client->closeAfter = TRUE;
+            return TRUE;
+        }
+        httpClientClose(client);
+        g_set_error(err, G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP %u from %s", code, client->host);
+        return FALSE;
+    }
+}
+
+/*!
+ * @brief Ends a response: the connection is kept for the next request if its body was read completely.
+ */
+static void httpClientFinish(HttpClient *client, gboolean complete)
+{
+    if (!complete || client->closeAfter)
+    {
+        httpClientClose(client);
+    }
+}
+
+static void httpClientFree(HttpClient *client)
+{
+    httpClientClose(client);
+    g_clear_object(&client->socketClient);
+    g_clear_pointer(&client->host, g_free);
+    g_clear_pointer(&client->target, g_free);
+}
+
+/* ======= Range cache ==========*/
+
+typedef struct
+{
+    guint32 magic;
+    guint32 blockSize;
+    guint64 size;
+} HttpCacheHeader;
+
+typedef struct
+{
+    std::string key;
+    gint refs;
+    gchar *uri;
+    int dataFd, mapFd;
+    guint readAhead; // blocks
+
+    std::mutex lock;
+    std::condition_variable changed; // Blocks arrived, a reader wants something, or quit.
+    guint64 size;
+    guint nBlocks;
+    std::vector<guint8> present;
+    gint64 wanted;   // Block a reader is waiting for, -1 if none.
+    guint readFrom;  // Read-ahead starts here: the block after the last one read.
+    gchar *error;    // Last failed fetch, of blocks errorFirst..errorLast. NULL once retried.
+    guint errorFirst, errorLast;
+    guint failures; // In a row, for the read-ahead backoff.
+    std::chrono::steady_clock::time_point retryAt;
+    gboolean quit;
+
+    std::thread fetcher;
+    HttpClient client;
+    GCancellable *cancellable;
+    guint8 *scratch;
+} HttpCache;
+
+static std::mutex httpCacheRegistryLock;
+static std::unordered_map<std::string, HttpCache *> httpCacheRegistry;
+
+/*!
+ * @brief Sizes the cache files for a resource of size bytes. If they can't be written the size stays unknown and
+ * the open fails: there is no cache without them. Called with cache->lock held.
+ */
+static gboolean httpCacheSetSize(HttpCache *cache, guint64 size, GError **err)
+{
+    HttpCacheHeader header = {HTTP_CACHE_MAGIC, HTTP_CACHE_BLOCK, size};
+    guint nBlocks = (guint)((size + HTTP_CACHE_BLOCK - 1) / HTTP_CACHE_BLOCK);
+    if (ftruncate(cache->dataFd, size) != 0 || ftruncate(cache->mapFd, 0) != 0 ||
+        pwrite(cache->mapFd, &header, sizeof(header), 0) != sizeof(header) ||
+        ftruncate(cache->mapFd, sizeof(header) + nBlocks) != 0)
+    {
+        int writeErrno = errno;
+        g_set_error(err, G_IO_ERROR, g_io_error_from_errno(writeErrno), "Can't write the cache files: %s",
+                    g_strerror(writeErrno));
+        return FALSE;
+    }
+    cache->size = size;
+    cache->nBlocks = nBlocks;
+    cache->present.assign(nBlocks, 0);
+    return TRUE;
+}
+
+/*!
+ * @brief Loads the block map of an earlier run. The data file must still have the size the map says.
+ */
+static void httpCacheLoadMap(HttpCache *cache)
+{
+    HttpCacheHeader header;
+    struct stat info;
+    if (pread(cache->mapFd, &header, sizeof(header), 0) != sizeof(header) || header.magic != HTTP_CACHE_MAGIC ||
+        header.blockSize != HTTP_CACHE_BLOCK || fstat(cache->dataFd, &info) != 0 || (guint64)info.st_size != header.size)
+    {
+        return;
+    }
+    cache->size = header.size;
+    cache->nBlocks = (guint)((header.size + HTTP_CACHE_BLOCK - 1) / HTTP_CACHE_BLOCK);
+    cache->present.assign(cache->nBlocks, 0);
+    if (cache->nBlocks && pread(cache->mapFd, cache->present.data(), cache->nBlocks, sizeof(header)) != cache->nBlocks)
+    {
+        cache->present.assign(cache->nBlocks, 0);
+    }
+}
+
+// Called with cache->lock held.
+static gboolean httpCacheNextRun(HttpCache *cache, guint *first, guint *count)
+{
+    if (cache->size == HTTP_CACHE_UNKNOWN)
+    {
+        // The first request also tells the size; only made once someone opens the source.
+        *first = 0;
+        *count = cache->readAhead;
+        return cache->wanted >= 0;
+    }
+    gint64 start = -1;
+    if (cache->wanted >= 0 && cache->wanted < cache->nBlocks && !cache->present[cache->wanted])
+    {
+        start = cache->wanted;
+    }
+    for (guint b = cache->readFrom; start < 0 && b < MIN(cache->nBlocks, cache->readFrom + cache->readAhead); b++)
+    {
+        if (!cache->present[b])
+            start = b;
+    }
+    if (start < 0)
+    {
+        return FALSE;
+    }
+    guint end = (guint)start;
+    while (end < cache->nBlocks && !cache->present[end] && end - start < cache->readAhead)
+        end++;
+    *first = (guint)start;
+    *count = end - (guint)start;
+    return TRUE;
+}
+
+/*!
+ * @brief Records that fetching blocks first..last failed. Called with cache->lock held.
+ */
+static void httpCacheFailLocked(HttpCache *cache, GError *err, guint first, guint last)
+{
+    if (!cache->quit)
+    {
+        GST_WARNING("%s: %s", cache->uri, err->message);
+        g_free(cache->error);
+        cache->error = g_strdup(err->message);
+        cache->errorFirst = first;
+        cache->errorLast = last;
+        guint delay = HTTP_CACHE_RETRY_MS << MIN(cache->failures, 5u);
+        cache->retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(MIN(delay, HTTP_CACHE_MAX_RETRY_MS));
+        cache->failures++;
+    }
+    g_error_free(err);
+    cache->changed.notify_all();
+}
+
+static void httpCacheFail(HttpCache *cache, GError *err, guint first, guint last)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+    httpCacheFailLocked(cache, err, first, last);
+}
+
+/*!
+ * @brief Downloads blocks first .. first + count - 1 in one Range request, storing each as soon as it is complete.
+ */
+static void httpCacheFetchRun(HttpCache *cache, guint first, guint count)
+{
+    guint64 offset = (guint64)first * HTTP_CACHE_BLOCK, length = (guint64)count * HTTP_CACHE_BLOCK;
+    guint64 bodyLength = 0, total = 0;
+    guint last = first + count - 1;
+    GError *err = NULL;
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        if (cache->size != HTTP_CACHE_UNKNOWN)
+            length = MIN(length, cache->size - offset);
+    }
+    if (!httpClientRequest(&cache->client, offset, length, &bodyLength, &total, cache->cancellable, &err))
+    {
+        httpCacheFail(cache, err, first, last);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        if (cache->size == HTTP_CACHE_UNKNOWN)
+        {
+            if (!httpCacheSetSize(cache, total, &err))
+            {
+                httpClientFinish(&cache->client, FALSE);
+                httpCacheFailLocked(cache, err, first, last);
+                return;
+            }
+            cache->changed.notify_all();
+        }
+    }
+
+    guint64 done = 0;
+    gboolean complete = TRUE;
+    for (guint b = first; done < bodyLength; b++)
+    {
+        gsize n = (gsize)MIN((guint64)HTTP_CACHE_BLOCK, bodyLength - done), got = 0;
+        if (!g_input_stream_read_all(G_INPUT_STREAM(cache->client.input), cache->scratch, n, &got,
+                                     cache->cancellable, &err) ||
+            got != n)
+        {
+            if (!err)
+                g_set_error(&err, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT, "Response from %s cut short", cache->client.host);
+            httpCacheFail(cache, err, b, last);
+            complete = FALSE;
+            break;
+        }
+        // Data before the map byte: a block marked present is on disk.
+        gboolean stored = pwrite(cache->dataFd, cache->scratch, n, offset + done) == (gssize)n;
+        int writeErrno = errno;
+        done += n;
+
+        std::lock_guard<std::mutex> guard(cache->lock);
+        if (!stored)
+        {
+            g_set_error(&err, G_IO_ERROR, g_io_error_from_errno(writeErrno), "Can't write the cache file: %s",
+                        g_strerror(writeErrno));
+            httpCacheFailLocked(cache, err, b, last);
+            complete = FALSE;
+            break;
+        }
+        const guint8 one = 1;
+        cache->present[b] = 1;
+        cache->failures = 0;
+        if (pwrite(cache->mapFd, &one, 1, sizeof(HttpCacheHeader) + b) != 1)
+            GST_WARNING("Can't update the block map of %s", cache->uri);
+        cache->changed.notify_all();
+        // A reader now waits for a block this run won't bring soon: drop the rest of it.
+        if (cache->quit || (cache->wanted >= 0 && cache->wanted < cache->nBlocks && !cache->present[cache->wanted] &&
+                            (cache->wanted < b || cache->wanted > last)))
+        {
+            complete = done == bodyLength;
+            break;
+        }
+    }
+    httpClientFinish(&cache->client, complete);
+}
+
+static void httpCacheFetcher(HttpCache *cache)
+{
+    for (;;)
+    {
+        guint first = 0, count = 0;
+        {
+            std::unique_lock<std::mutex> guard(cache->lock);
+            for (;;)
+            {
+                if (cache->quit)
+                {
+                    return;
+                }
+                gboolean ready = httpCacheNextRun(cache, &first, &count);
+                if (ready && !cache->error)
+                {
+                    break;
+                }
+                if (ready && cache->wanted < 0)
+                {
+                    // Only read-ahead failed: try again once the backoff is over.
+                    if (std::chrono::steady_clock::now() >= cache->retryAt)
+                    {
+                        g_clear_pointer(&cache->error, g_free);
+                        break;
+                    }
+                    cache->changed.wait_until(guard, cache->retryAt);
+                }
+                else
+                {
+                    // Nothing to do, or the waiting reader's block failed: it reports that, or asks again.
+                    cache->changed.wait(guard);
+                }
+            }
+        }
+        httpCacheFetchRun(cache, first, count);
+    }
+}
+
+/*!
+ * @brief Opens (or shares, if another source in the process has it open) the cache of uri under directory.
+ * readAhead is in bytes.
+ */
+static HttpCache *httpCacheOpen(const gchar *uri, const gchar *directory, guint64 readAhead, GError **err)
+{
+    HttpClient probe = {};
+    if (!httpClientSetUri(&probe, uri))
+    {
+        g_set_error(err, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid URI %s", uri);
+        return NULL;
+    }
+    httpClientFree(&probe);
+
+    gchar *name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, uri, -1);
+    gchar *base = g_build_filename(directory, name, NULL);
+    std::string key = base;
+    g_free(name);
+
+    std::lock_guard<std::mutex> registryGuard(httpCacheRegistryLock);
+    auto found = httpCacheRegistry.find(key);
+    if (found != httpCacheRegistry.end())
+    {
+        g_free(base);
+        found->second->refs++;
+        return found->second;
+    }
+
+    g_mkdir_with_parents(directory, 0755);
+    gchar *dataPath = g_strconcat(base, ".data", NULL), *mapPath = g_strconcat(base, ".map", NULL);
+    int dataFd = g_open(dataPath, O_RDWR | O_CREAT, 0644), mapFd = g_open(mapPath, O_RDWR | O_CREAT, 0644);
+    int openErrno = errno;
+    g_free(base);
+    g_free(mapPath);
+    if (dataFd < 0 || mapFd < 0)
+    {
+        g_set_error(err, G_IO_ERROR, g_io_error_from_errno(openErrno), "Can't open %s: %s", dataPath,
+                    g_strerror(openErrno));
+        g_free(dataPath);
+        if (dataFd >= 0)
+            close(dataFd);
+        if (mapFd >= 0)
+            close(mapFd);
+        return NULL;
+    }
+    g_free(dataPath);
+
+    HttpCache *cache = new HttpCache();
+    cache->key = key;
+    cache->refs = 1;
+    cache->uri = g_strdup(uri);
+    cache->dataFd = dataFd;
+    cache->mapFd = mapFd;
+    cache->readAhead = (guint)MAX(readAhead / HTTP_CACHE_BLOCK, (guint64)1);
+    cache->size = HTTP_CACHE_UNKNOWN;
+    cache->nBlocks = 0;
+    cache->wanted = -1;
+    cache->readFrom = 0;
+    cache->error = NULL;
+    cache->errorFirst = cache->errorLast = 0;
+    cache->failures = 0;
+    cache->quit = FALSE;
+    memset(&cache->client, 0, sizeof(cache->client));
+    httpClientSetUri(&cache->client, uri);
+    cache->cancellable = g_cancellable_new();
+    cache->scratch = (guint8 *)g_malloc(HTTP_CACHE_BLOCK);
+    httpCacheLoadMap(cache);
+    cache->fetcher = std::thread(httpCacheFetcher, cache);
+    httpCacheRegistry[key] = cache;
+    return cache;
+}
+
+static void httpCacheRelease(HttpCache *cache)
+{
+    {
+        std::lock_guard<std::mutex> registryGuard(httpCacheRegistryLock);
+        if (--cache->refs > 0)
+        {
+            return;
+        }
+        httpCacheRegistry.erase(cache->key);
+    }
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        cache->quit = TRUE;
+    }
+    cache->changed.notify_all();
+    g_cancellable_cancel(cache->cancellable);
+    cache->fetcher.join();
+
+    httpClientFree(&cache->client);
+    g_object_unref(cache->cancellable);
+    close(cache->dataFd);
+    close(cache->mapFd);
+    g_free(cache->scratch);
+    g_free(cache->error);
+    g_free(cache->uri);
+    delete cache;
+}
+
+/*!
+ * @brief Wakes readers blocked in httpCacheRead() / httpCacheWaitSize() so they can look at their flushing flag.
+ */
+static void httpCacheWake(HttpCache *cache)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+    cache->changed.notify_all();
+}
+
+/*!
+ * @brief Blocks until the resource size is known (immediately on a warm start).
+ */
+static GstFlowReturn httpCacheWaitSize(HttpCache *cache, gint *flushing, gchar **error)
+{
+    std::unique_lock<std::mutex> guard(cache->lock);
+    gboolean asked = FALSE;
+    while (cache->size == HTTP_CACHE_UNKNOWN)
+    {
+        if (g_atomic_int_get(flushing))
+            return GST_FLOW_FLUSHING;
+        if (cache->error)
+        {
+            // Only the first request tells the size: a failure after asking is this open's.
+            if (asked)
+            {
+                *error = g_strdup(cache->error);
+                cache->wanted = -1;
+                cache->changed.notify_all();
+                return GST_FLOW_ERROR;
+            }
+            g_clear_pointer(&cache->error, g_free);
+        }
+        asked = TRUE;
+        cache->wanted = 0;
+        cache->changed.notify_all();
+        cache->changed.wait(guard);
+    }
+    return GST_FLOW_OK;
+}
+
+/*!
+ * @brief Copies [offset, offset + size) into dest, waiting for missing blocks. *waited tells whether it had to.
+ */
+static GstFlowReturn httpCacheRead(HttpCache *cache, guint64 offset, guint size, guint8 *dest, gint *flushing,
+                                   gboolean *waited, gchar **error)
+{
+    guint first = (guint)(offset / HTTP_CACHE_BLOCK), last = (guint)((offset + size - 1) / HTTP_CACHE_BLOCK);
+    *waited = FALSE;
+    {
+        std::unique_lock<std::mutex> guard(cache->lock);
+        for (guint b = first; b <= last; b++)
+        {
+            gboolean asked = FALSE;
+            while (!cache->present[b])
+            {
+                if (g_atomic_int_get(flushing))
+                    return GST_FLOW_FLUSHING;
+                if (cache->error)
+                {
+                    if (asked && b >= cache->errorFirst && b <= cache->errorLast)
+                    {
+                        *error = g_strdup(cache->error);
+                        if (cache->wanted == b)
+                            cache->wanted = -1;
+                        cache->changed.notify_all();
+                        return GST_FLOW_ERROR;
+                    }
+                    // Failed read-ahead, or a failure from before this read: ask for the block again.
+                    g_clear_pointer(&cache->error, g_free);
+                }
+                asked = TRUE;
+                *waited = TRUE;
+                cache->wanted = b;
+                cache->changed.notify_all();
+                cache->changed.wait(guard);
+            }
+        }
+        if (cache->wanted >= 0 && cache->wanted < cache->nBlocks && cache->present[cache->wanted])
+            cache->wanted = -1;
+        cache->readFrom = last + 1;
+        cache->changed.notify_all();
+    }
+
+    for (guint done = 0; done < size;)
+    {
+        gssize got = pread(cache->dataFd, dest + done, size - done, offset + done);
+        if (got <= 0)
+        {
+            *error = g_strdup_printf("Can't read the cache file: %s", got < 0 ? g_strerror(errno) : "short file");
+            return GST_FLOW_ERROR;
+        }
+        done += got;
+    }
+    return GST_FLOW_OK;
+}
+
+/* ======= Element ==========*/
+
+typedef struct
+{
+    GstBaseSrc parent;
+    gchar *uri, *cacheDir;
+    guint64 readAhead;
+    HttpCache *cache;
+    gint flushing;
+    guint64 hits, misses;
+} HttpCacheSrc;
+
+typedef struct
+{
+    GstBaseSrcClass parentClass;
+} HttpCacheSrcClass;
+
+enum
+{
+    HTTP_CACHE_SRC_PROP_0,
+    HTTP_CACHE_SRC_PROP_LOCATION,
+    HTTP_CACHE_SRC_PROP_CACHE_DIR,
+    HTTP_CACHE_SRC_PROP_READ_AHEAD,
+    HTTP_CACHE_SRC_PROP_HITS,
+    HTTP_CACHE_SRC_PROP_MISSES
+};
+
+static void httpCacheSrcUriHandlerInit(gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE(HttpCacheSrc, http_cache_src, GST_TYPE_BASE_SRC,
+                        G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, httpCacheSrcUriHandlerInit))
+
+static gboolean httpCacheSrcStart(GstBaseSrc *src)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)src;
+    GError *err = NULL;
+    gchar *error = NULL;
+    if (!self->uri)
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No URI set"), (NULL));
+        return FALSE;
+    }
+    if (!self->cacheDir)
+    {
+        self->cacheDir = g_build_filename(g_get_user_cache_dir(), "gstreamer-exercises", "http", NULL);
+    }
+    self->cache = httpCacheOpen(self->uri, self->cacheDir, self->readAhead, &err);
+    if (!self->cache)
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ_WRITE, ("Could not open the cache"), ("%s", err->message));
+        g_clear_error(&err);
+        return FALSE;
+    }
+    self->hits = self->misses = 0;
+    GstFlowReturn ret = httpCacheWaitSize(self->cache, &self->flushing, &error);
+    if (ret == GST_FLOW_ERROR)
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("Could not open %s", self->uri), ("%s", error));
+        g_free(error);
+    }
+    if (ret != GST_FLOW_OK)
+    {
+        httpCacheRelease(self->cache);
+        self->cache = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean httpCacheSrcStop(GstBaseSrc *src)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)src;
+    if (self->cache)
+    {
+        httpCacheRelease(self->cache);
+        self->cache = NULL;
+    }
+    return TRUE;
+}
+
+static gboolean httpCacheSrcGetSize(GstBaseSrc *src, guint64 *size)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)src;
+    if (!self->cache)
+    {
+        return FALSE;
+    }
+    *size = self->cache->size;
+    return TRUE;
+}
+
+static gboolean httpCacheSrcIsSeekable(GstBaseSrc *src)
+{
+    return TRUE;
+}
+
+static gboolean httpCacheSrcUnlock(GstBaseSrc *src)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)src;
+    g_atomic_int_set(&self->flushing, 1);
+    if (self->cache)
+    {
+        httpCacheWake(self->cache);
+    }
+    return TRUE;
+}
+
+static gboolean httpCacheSrcUnlockStop(GstBaseSrc *src)
+{
+    g_atomic_int_set(&((HttpCacheSrc *)src)->flushing, 0);
+    return TRUE;
+}
+
+static GstFlowReturn httpCacheSrcFill(GstBaseSrc *src, guint64 offset, guint size, GstBuffer *buffer)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)src;
+    if (offset >= self->cache->size)
+    {
+        return GST_FLOW_EOS;
+    }
+    size = (guint)MIN((guint64)size, self->cache->size - offset);
+
+    GstMapInfo map;
+    gboolean waited = FALSE;
+    gchar *error = NULL;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    GstFlowReturn ret = httpCacheRead(self->cache, offset, size, map.data, &self->flushing, &waited, &error);
+    gst_buffer_unmap(buffer, &map);
+    if (ret == GST_FLOW_ERROR)
+    {
+        GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Could not read %s", self->uri), ("%s", error));
+        g_free(error);
+    }
+    if (ret != GST_FLOW_OK)
+    {
+        return ret;
+    }
+    gst_buffer_set_size(buffer, size);
+    GST_BUFFER_OFFSET(buffer) = offset;
+    GST_BUFFER_OFFSET_END(buffer) = offset + size;
+    if (waited)
+        self->misses++;
+    else
+        self->hits++;
+    return GST_FLOW_OK;
+}
+
+static GstURIType httpCacheSrcUriGetType(GType type)
+{
+    return GST_URI_SRC;
+}
+
+static const gchar *const *httpCacheSrcUriGetProtocols(GType type)
+{
+    static const gchar *protocols[] = {"http", "https", NULL};
+    return protocols;
+}
+
+static gchar *httpCacheSrcUriGetUri(GstURIHandler *handler)
+{
+    return g_strdup(((HttpCacheSrc *)handler)->uri);
+}
+
+static gboolean httpCacheSrcUriSetUri(GstURIHandler *handler, const gchar *uri, GError **err)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)handler;
+    if (GST_STATE(self) >= GST_STATE_PAUSED)
+    {
+        g_set_error(err, GST_URI_ERROR, GST_URI_ERROR_BAD_STATE, "Can't change the URI while running");
+        return FALSE;
+    }
+    g_free(self->uri);
+    self->uri = g_strdup(uri);
+    return TRUE;
+}
+
+static void httpCacheSrcUriHandlerInit(gpointer iface, gpointer data)
+{
+    GstURIHandlerInterface *handler = (GstURIHandlerInterface *)iface;
+    handler->get_type = httpCacheSrcUriGetType;
+    handler->get_protocols = httpCacheSrcUriGetProtocols;
+    handler->get_uri = httpCacheSrcUriGetUri;
+    handler->set_uri = httpCacheSrcUriSetUri;
+}
+
+static void httpCacheSrcSetProperty(GObject *object, guint id, const GValue *value, GParamSpec *spec)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)object;
+    switch (id)
+    {
+    case HTTP_CACHE_SRC_PROP_LOCATION:
+        httpCacheSrcUriSetUri(GST_URI_HANDLER(self), g_value_get_string(value), NULL);
+        break;
+    case HTTP_CACHE_SRC_PROP_CACHE_DIR:
+        g_free(self->cacheDir);
+        self->cacheDir = g_value_dup_string(value);
+        break;
+    case HTTP_CACHE_SRC_PROP_READ_AHEAD:
+        self->readAhead = g_value_get_uint64(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        break;
+    }
+}
+
+static void httpCacheSrcGetProperty(GObject *object, guint id, GValue *value, GParamSpec *spec)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)object;
+    switch (id)
+    {
+    case HTTP_CACHE_SRC_PROP_LOCATION:
+        g_value_set_string(value, self->uri);
+        break;
+    case HTTP_CACHE_SRC_PROP_CACHE_DIR:
+        g_value_set_string(value, self->cacheDir);
+        break;
+    case HTTP_CACHE_SRC_PROP_READ_AHEAD:
+        g_value_set_uint64(value, self->readAhead);
+        break;
+    case HTTP_CACHE_SRC_PROP_HITS:
+        g_value_set_uint64(value, self->hits);
+        break;
+    case HTTP_CACHE_SRC_PROP_MISSES:
+        g_value_set_uint64(value, self->misses);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        break;
+    }
+}
+
+static void httpCacheSrcFinalize(GObject *object)
+{
+    HttpCacheSrc *self = (HttpCacheSrc *)object;
+    g_free(self->uri);
+    g_free(self->cacheDir);
+    G_OBJECT_CLASS(http_cache_src_parent_class)->finalize(object);
+}
+
+static void http_cache_src_class_init(HttpCacheSrcClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+    GstBaseSrcClass *srcClass = GST_BASE_SRC_CLASS(klass);
+    GParamFlags readWrite = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    GParamFlags readOnly = (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    objectClass->set_property = httpCacheSrcSetProperty;
+    objectClass->get_property = httpCacheSrcGetProperty;
+    objectClass->finalize = httpCacheSrcFinalize;
+    g_object_class_install_property(objectClass, HTTP_CACHE_SRC_PROP_LOCATION,
+                                    g_param_spec_string("location", "Location", "http(s) URI to read", NULL, readWrite));
+    g_object_class_install_property(
+        objectClass, HTTP_CACHE_SRC_PROP_CACHE_DIR,
+        g_param_spec_string("cache-dir", "Cache directory", "Where cached resources are stored", NULL, readWrite));
+    g_object_class_install_property(
+        objectClass, HTTP_CACHE_SRC_PROP_READ_AHEAD,
+        g_param_spec_uint64("read-ahead", "Read-ahead", "Bytes fetched ahead of the last read", 0, G_MAXUINT64,
+                            4 * 1024 * 1024, readWrite));
+    g_object_class_install_property(
+        objectClass, HTTP_CACHE_SRC_PROP_HITS,
+        g_param_spec_uint64("hits", "Hits", "Reads served from disk since start", 0, G_MAXUINT64, 0, readOnly));
+    g_object_class_install_property(
+        objectClass, HTTP_CACHE_SRC_PROP_MISSES,
+        g_param_spec_uint64("misses", "Misses", "Reads that waited for the network since start", 0, G_MAXUINT64, 0,
+                            readOnly));
+
+    GstCaps *caps = gst_caps_new_any();
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    gst_element_class_set_static_metadata(elementClass, "Caching HTTP source", "Source/Network",
+                                          "Reads http(s) URIs through a disk-backed range cache with read-ahead",
+                                          "GStreamer Exercises");
+
+    srcClass->start = httpCacheSrcStart;
+    srcClass->stop = httpCacheSrcStop;
+    srcClass->get_size = httpCacheSrcGetSize;
+    srcClass->is_seekable = httpCacheSrcIsSeekable;
+    srcClass->unlock = httpCacheSrcUnlock;
+    srcClass->unlock_stop = httpCacheSrcUnlockStop;
+    srcClass->fill = httpCacheSrcFill;
+}
+
+static void http_cache_src_init(HttpCacheSrc *self)
+{
+    self->uri = NULL;
+    self->cacheDir = g_build_filename(g_get_user_cache_dir(), "gstreamer-exercises", "http", NULL);
+    self->readAhead = 4 * 1024 * 1024;
+    self->cache = NULL;
+    self->flushing = 0;
+    self->hits = self->misses = 0;
+    gst_base_src_set_blocksize(GST_BASE_SRC(self), 64 * 1024);
+}
+
+/*!
+ * @brief Makes "cachehttpsrc" the source for http(s) URIs in this process (it outranks souphttpsrc).
+ */
+static gboolean httpCacheRegister()
+{
+    return gst_element_register(NULL, "cachehttpsrc", GST_RANK_PRIMARY + 1, http_cache_src_get_type());
+}
+
+#endif // HTTP_CACHE_H
@@ -0,0 +1,273 @@
+/*!
+ * @brief HttpStandIn: a local HTTP/1.1 server for one file, standing in for a remote media server in tests and
+ * benchmarks (e.g. for the sintel trailer the tutorials stream from freedesktop.org).
+ * @link https://docs.gtk.org/gio/class.ThreadedSocketService.html
+ *
+ * It listens on 127.0.0.1 on a free port and serves GET and HEAD for /<file name>, with single Range requests
+ * (206, 416) and keep-alive. Every request waits latencyMs before answering and bodies are sent at no more than
+ * bytesPerSecond (0: no limit), so the network a cache is meant to hide is still there to measure.
+ * requests and bytes count what the server was asked for, e.g. to check that a warm cache didn't touch it.
+ * Connections are served by a GThreadedSocketService; its accept loop runs in a GMainContext on its own thread,
+ * so the caller doesn't need a main loop.
+ */
+
+#ifndef HTTP_STAND_IN_H
+#define HTTP_STAND_IN_H
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#define HTTP_STAND_IN_CHUNK (64 * 1024)
+
+typedef struct
+{
+    GSocketService *service;
+    GMainContext *context;
+    GMainLoop *loop;
+    std::thread thread;
+    guint16 port;
+    gchar *route; // "/<file name>"
+    int fd;
+    guint64 size;
+    guint latencyMs;
+    guint64 bytesPerSecond;
+
+    std::atomic<guint64> requests, bytes;
+    std::atomic<gint> active; // Connections being served.
+} HttpStandIn;
+
+static gboolean httpStandInWrite(GOutputStream *output, const gchar *text)
+{
+    return g_output_stream_write_all(output, text, strlen(text), NULL, NULL, NULL);
+}
+
+/*!
+ * @brief Sends [start, end] of the file, throttled to bytesPerSecond.
+ */
+static gboolean httpStandInSendBody(HttpStandIn *server, GOutputStream *output, guint64 start, guint64 end)
+{
+    guint8 *chunk = (guint8 *)g_malloc(HTTP_STAND_IN_CHUNK);
+    gboolean ok = TRUE;
+    for (guint64 offset = start; ok && offset <= end;)
+    {
+        gsize n = (gsize)MIN((guint64)HTTP_STAND_IN_CHUNK, end + 1 - offset);
+        ok = pread(server->fd, chunk, n, offset) == (gssize)n &&
+             g_output_stream_write_all(output, chunk, n, NULL, NULL, NULL);
+        offset += n;
+        server->bytes += n;
+        if (server->bytesPerSecond)
+        {
+            g_usleep(n * G_USEC_PER_SEC / server->bytesPerSecond);
+        }
+    }
+    g_free(chunk);
+    return ok;
+}
+
+/*!
+ * @brief "run" handler: serves requests on one connection until the client closes it or goes idle for 5 s.
+ */
+static gboolean httpStandInServe(GThreadedSocketService *service, GSocketConnection *connection, GObject *source,
+                                 HttpStandIn *server)
+{
+    server->active++;
+    g_socket_set_timeout(g_socket_connection_get_socket(connection), 5);
+    GDataInputStream *input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_data_input_stream_set_newline_type(input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    gboolean keepAlive = TRUE;
+
+    while (keepAlive)
+    {
+        gchar *requestLine = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+        if (!requestLine)
+        {
+            break;
+        }
+        gchar method[8] = "", target[1024] = "";
+        sscanf(requestLine, "%7s %1023s", method, target);
+        g_free(requestLine);
+
+        gchar *range = NULL, *line;
+        while ((line = g_data_input_stream_read_line(input, NULL, NULL, NULL)) && *line)
+        {
+            if (g_ascii_strncasecmp(line, "Range:", 6) == 0)
+                range = g_strstrip(g_strdup(line + 6));
+            else if (g_ascii_strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close"))
+                keepAlive = FALSE;
+            g_free(line);
+        }
+        if (!line)
+        {
+            g_free(range);
+            break;
+        }
+        g_free(line);
+        server->requests++;
+        g_usleep(server->latencyMs * 1000);
+
+        gboolean head = strcmp(method, "HEAD") == 0;
+        gchar *response;
+        guint64 start = 0, end = server->size - 1;
+        gboolean body = FALSE;
+        if ((!head && strcmp(method, "GET") != 0) || strcmp(target, server->route) != 0)
+        {
+            response = g_strdup("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        }
+        else if (range)
+        {
+            // bytes=a-b, bytes=a- or bytes=-n
+            guint64 first = 0, last = G_MAXUINT64;
+            gboolean valid = TRUE;
+            if (sscanf(range, "bytes=-%" G_GUINT64_FORMAT, &last) == 1)
+            {
+                first = server->size > last ? server->size - last : 0;
+                last = server->size - 1;
+            }
+            else
+            {
+                valid = sscanf(range, "bytes=%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT, &first, &last) >= 1;
+            }
+            if (!valid || first >= server->size || first > last)
+            {
+                response = g_strdup_printf("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%" G_GUINT64_FORMAT
+                                           "\r\nContent-Length: 0\r\n\r\n",
+                                           server->size);
+            }
+            else
+            {
+                start = first;
+                end = MIN(last, server->size - 1);
+                body = !head;
+                response = g_strdup_printf("HTTP/1.1 206 Partial Content\r\nAccept-Ranges: bytes\r\n"
+                                           "Content-Type: application/octet-stream\r\nContent-Range: bytes %" G_GUINT64_FORMAT
+                                           "-%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT "\r\nContent-Length: %" G_GUINT64_FORMAT
+                                           "\r\n\r\n",
+                                           start, end, server->size, end - start + 1);
+            }
+        }
+        else
+        {
+            body = !head && server->size > 0;
+            response = g_strdup_printf("HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n"
+                                       "Content-Length: %" G_GUINT64_FORMAT "\r\n\r\n",
+                                       server->size);
+        }
+        g_free(range);
+
+        gboolean sent = httpStandInWrite(output, response) && (!body || httpStandInSendBody(server, output, start, end));
+        g_free(response);
+        if (!sent)
+        {
+            break;
+        }
+    }
+
+    g_object_unref(input);
+    server->active--;
+    return TRUE;
+}
+
+static void httpStandInLoop(HttpStandIn *server)
+{
+    g_main_context_push_thread_default(server->context);
+    g_main_loop_run(server->loop);
+    g_main_context_pop_thread_default(server->context);
+}
+
+/*!
+ * @brief Starts serving path. bytesPerSecond 0 means unthrottled.
+ */
+static HttpStandIn *httpStandInNew(const gchar *path, guint latencyMs, guint64 bytesPerSecond, GError **err)
+{
+    int fd = g_open(path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        g_set_error(err, G_IO_ERROR, g_io_error_from_errno(errno), "Can't open %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    HttpStandIn *server = new HttpStandIn();
+    gchar *name = g_path_get_basename(path);
+    server->route = g_strconcat("/", name, NULL);
+    g_free(name);
+    server->fd = fd;
+    server->size = (guint64)lseek(fd, 0, SEEK_END);
+    server->latencyMs = latencyMs;
+    server->bytesPerSecond = bytesPerSecond;
+    server->requests = 0;
+    server->bytes = 0;
+    server->active = 0;
+    server->context = g_main_context_new();
+    server->loop = g_main_loop_new(server->context, FALSE);
+
+    // The service accepts in the thread-default context at the time its address is added.
+    g_main_context_push_thread_default(server->context);
+    server->service = g_threaded_socket_service_new(16);
+    GInetAddress *loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new(loopback, 0);
+    GSocketAddress *bound = NULL;
+    gboolean listening = g_socket_listener_add_address(G_SOCKET_LISTENER(server->service), address,
+                                                       G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL, &bound, err);
+    g_object_unref(address);
+    g_object_unref(loopback);
+    if (listening)
+    {
+        server->port = g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(bound));
+        g_object_unref(bound);
+        g_signal_connect(server->service, "run", G_CALLBACK(httpStandInServe), server);
+        g_socket_service_start(server->service);
+    }
+    g_main_context_pop_thread_default(server->context);
+
+    if (!listening)
+    {
+        g_object_unref(server->service);
+        g_main_loop_unref(server->loop);
+        g_main_context_unref(server->context);
+        close(server->fd);
+        g_free(server->route);
+        delete server;
+        return NULL;
+    }
+    server->thread = std::thread(httpStandInLoop, server);
+    return server;
+}
+
+/*!
+ * @brief http://127.0.0.1:<port>/<file name>. Free with g_free().
+ */
+static gchar *httpStandInUri(HttpStandIn *server)
+{
+    return g_strdup_printf("http://127.0.0.1:%u%s", server->port, server->route);
+}
+
+/*!
+ * @brief Stops accepting and waits for open connections to end (clients closing them, or the 5 s idle timeout).
+ */
+static void httpStandInFree(HttpStandIn *server)
+{
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+    g_main_loop_quit(server->loop);
+    server->thread.join();
+    while (server->active > 0)
+    {
+        g_usleep(10 * 1000);
+    }
+    g_object_unref(server->service);
+    g_main_loop_unref(server->loop);
+    g_main_context_unref(server->context);
+    close(server->fd);
+    g_free(server->route);
+    delete server;
+}
+
+#endif // HTTP_STAND_IN_H
@@ -0,0 +1,309 @@
+/*!
+ * @brief Pad-probe latency tracer. Finds out which element of a bin eats the frame budget.
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/probes.html?gi-language=c
+ *
+ * latencyTracerAttach() walks every element of a GstBin and puts a buffer probe on each of its pads.
+ * A buffer entering a sink pad is stamped with the monotonic clock, keyed by its PTS. When a buffer with the same PTS
+ * leaves one of the element's src pads, the difference is the time the element spent on it.
+ * For queues that time is the queue wait rather than processing, so they are reported separately.
+ *
+ * Elements which rewrite timestamps (e.g. muxers) never produce a match and simply report no samples.
+ * Elements created after attaching (e.g. inside decodebin) are not traced.
+ *
+ * Stats are posted on the bus as "latency-tracer" element messages every interval and can be printed at EOS.
+ * Samples go into a log-linear histogram (16 buckets per power of two), so memory and the cost of a report stay
+ * constant however long the pipeline runs; p99 is accurate to about 6%, min and mean are exact.
+ */
+
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <gst/gst.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Upper bound for buffers which went in but never came out with the same PTS.
+#define LATENCY_TRACER_MAX_PENDING 4096
+// Histogram: values below 16 us get a bucket each, then 16 buckets per power of two up to 2^63 us.
+#define LATENCY_TRACER_SUB_BUCKETS 16
+#define LATENCY_TRACER_BUCKETS ((64 - 3) * LATENCY_TRACER_SUB_BUCKETS)
+
+typedef struct
+{
+    std::string name;
+    gboolean isQueue;
+
+    // Probes fire on the element's streaming threads.
+    std::mutex lock;
+    // PTS -> (entry stamp, sequence number); order maps the sequence number back, oldest first, for eviction.
+    std::unordered_map<GstClockTime, std::pair<gint64, guint64>> pending;
+    std::map<guint64, GstClockTime> order;
+    guint64 sequence;
+    guint64 histogram[LATENCY_TRACER_BUCKETS];
+    guint64 count;
+    gint64 sum, minimum;
+} ElementLatency;
+
+typedef struct
+{
+    GstBin *bin;
+    std::vector<ElementLatency *> elements;
+    guint timeoutId;
+} LatencyTracer;
+
+static guint latencyTracerBucket(gint64 us)
+{
+    if (us < LATENCY_TRACER_SUB_BUCKETS)
+    {
+        return (guint)MAX(us, 0);
+    }
+    guint exponent = g_bit_nth_msf((gulong)us, -1); // >= 4
+    guint sub = (guint)(us >> (exponent - 4)) & (LATENCY_TRACER_SUB_BUCKETS - 1);
+    return (exponent - 3) * LATENCY_TRACER_SUB_BUCKETS + sub;
+}
+
+// Smallest value that falls into the bucket.
+static gint64 latencyTracerBucketValue(guint bucket)
+{
+    if (bucket < LATENCY_TRACER_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    guint exponent = bucket / LATENCY_TRACER_SUB_BUCKETS + 3;
+    return (gint64)(LATENCY_TRACER_SUB_BUCKETS + bucket % LATENCY_TRACER_SUB_BUCKETS) << (exponent - 4);
+}
+
+static GstPadProbeReturn latencyTracerOnSinkBuffer(GstPad *pad, GstPadProbeInfo *info, ElementLatency *stats)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    std::lock_guard<std::mutex> guard(stats->lock);
+    // Keep the earliest stamp if the same PTS comes in twice (e.g. several sink pads).
+    if (stats->pending.count(GST_BUFFER_PTS(buffer)))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    if (stats->pending.size() >= LATENCY_TRACER_MAX_PENDING)
+    {
+        // The oldest entry is the one least likely to still come out.
+        stats->pending.erase(stats->order.begin()->second);
+        stats->order.erase(stats->order.begin());
+    }
+    guint64 sequence = stats->sequence++;
+    stats->pending.emplace(GST_BUFFER_PTS(buffer), std::make_pair(g_get_monotonic_time(), sequence));
+    stats->order.emplace(sequence, GST_BUFFER_PTS(buffer));
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn latencyTracerOnSrcBuffer(GstPad *pad, GstPadProbeInfo *info, ElementLatency *stats)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(stats->lock);
+    auto it = stats->pending.find(GST_BUFFER_PTS(buffer));
+    if (it != stats->pending.end())
+    {
+        gint64 elapsed = now - it->second.first;
+        stats->histogram[latencyTracerBucket(elapsed)]++;
+        stats->minimum = stats->count ? MIN(stats->minimum, elapsed) : elapsed;
+        stats->count++;
+        stats->sum += elapsed;
+        stats->order.erase(it->second.second);
+        stats->pending.erase(it);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void latencyTracerAttachElement(LatencyTracer *tracer, GstElement *element)
+{
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *factoryName = factory ? GST_OBJECT_NAME(factory) : "";
+    ElementLatency *stats = new ElementLatency();
+
+    stats->name = GST_ELEMENT_NAME(element);
+    stats->isQueue = g_str_equal(factoryName, "queue") || g_str_equal(factoryName, "queue2") ||
+                     g_str_equal(factoryName, "multiqueue");
+    stats->sequence = 0;
+    memset(stats->histogram, 0, sizeof(stats->histogram));
+    stats->count = 0;
+    stats->sum = stats->minimum = 0;
+    tracer->elements.push_back(stats);
+
+    GstIterator *it = gst_element_iterate_pads(element);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        GstPad *pad = GST_PAD(g_value_get_object(&item));
+        gst_pad_add_probe(pad,
+                          GST_PAD_PROBE_TYPE_BUFFER,
+                          GST_PAD_IS_SINK(pad) ? (GstPadProbeCallback)latencyTracerOnSinkBuffer
+                                               : (GstPadProbeCallback)latencyTracerOnSrcBuffer,
+                          stats,
+                          NULL);
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+}
+
+/*!
+ * @brief Puts probes on every pad of every element in the bin (recursively). Call before going to PLAYING.
+ */
+static LatencyTracer *latencyTracerAttach(GstBin *bin)
+{
+    LatencyTracer *tracer = new LatencyTracer();
+    tracer->bin = GST_BIN(gst_object_ref(bin));
+    tracer->timeoutId = 0;
+
+    GstIterator *it = gst_bin_iterate_recurse(bin);
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+        // Child bins are covered by their own elements.
+        if (!GST_IS_BIN(element))
+        {
+            latencyTracerAttachElement(tracer, element);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    return tracer;
+}
+
+/*!
+ * @brief Computes the stats of one element into a "latency-tracer" structure. Values are in microseconds.
+ */
+static GstStructure *latencyTracerSnapshot(ElementLatency *stats)
+{
+    guint64 histogram[LATENCY_TRACER_BUCKETS];
+    guint64 count;
+    gint64 sum, minimum;
+    {
+        std::lock_guard<std::mutex> guard(stats->lock);
+        memcpy(histogram, stats->histogram, sizeof(histogram));
+        count = stats->count;
+        sum = stats->sum;
+        minimum = stats->minimum;
+    }
+
+    gint64 mean = count ? sum / (gint64)count : 0;
+    gint64 p99 = 0;
+    guint64 rank = (guint64)(0.99 * (count ? count - 1 : 0) + 0.5), seen = 0;
+    for (guint bucket = 0; count && bucket < LATENCY_TRACER_BUCKETS; bucket++)
+    {
+        seen += histogram[bucket];
+        if (seen > rank)
+        {
+            p99 = MAX(latencyTracerBucketValue(bucket), minimum);
+            break;
+        }
+    }
+
+    return gst_structure_new("latency-tracer",
+                             "element", G_TYPE_STRING, stats->name.c_str(),
+                             "kind", G_TYPE_STRING, stats->isQueue ? "queue-wait" : "processing",
+                             "count", G_TYPE_UINT64, count,
+                             "min-us", G_TYPE_INT64, minimum,
+                             "mean-us", G_TYPE_INT64, mean,
+                             "p99-us", G_TYPE_INT64, p99,
+                             NULL);
+}
+
+/*!
+ * @brief Posts one "latency-tracer" element message per traced element on the bin's bus.
+ */
+static void latencyTracerPost(LatencyTracer *tracer)
+{
+    for (ElementLatency *stats : tracer->elements)
+    {
+        gst_element_post_message(GST_ELEMENT(tracer->bin),
+                                 gst_message_new_element(GST_OBJECT(tracer->bin), latencyTracerSnapshot(stats)));
+    }
+}
+
+/*!
+ * @brief Prints a "latency-tracer" structure, whether it came from the bus or from latencyTracerPrint().
+ */
+static void latencyTracerPrintStructure(const GstStructure *structure)
+{
+    guint64 count = 0;
+    gint64 minimum = 0, mean = 0, p99 = 0;
+
+    gst_structure_get_uint64(structure, "count", &count);
+    gst_structure_get_int64(structure, "min-us", &minimum);
+    gst_structure_get_int64(structure, "mean-us", &mean);
+    gst_structure_get_int64(structure, "p99-us", &p99);
+
+    g_print("\n%-20s %-10s n=%-8" G_GUINT64_FORMAT " min=%-8" G_GINT64_FORMAT " mean=%-8" G_GINT64_FORMAT
+            " p99=%-8" G_GINT64_FORMAT " (us)",
+            gst_structure_get_string(structure, "element"),
+            gst_structure_get_string(structure, "kind"),
+            count, minimum, mean, p99);
+}
+
+/*!
+ * @brief Prints the current stats straight away. Meant for EOS, when nobody will read the bus anymore.
+ */
+static void latencyTracerPrint(LatencyTracer *tracer)
+{
+    g_print("\nPer-element latency:");
+    for (ElementLatency *stats : tracer->elements)
+    {
+        GstStructure *structure = latencyTracerSnapshot(stats);
+        latencyTracerPrintStructure(structure);
+        gst_structure_free(structure);
+    }
+}
+
+static gboolean latencyTracerOnTimeout(gpointer userData)
+{
+    latencyTracerPost((LatencyTracer *)userData);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * @brief Posts the stats on the bus every intervalMs on the default main context.
+ */
+static void latencyTracerStartPeriodic(LatencyTracer *tracer, guint intervalMs)
+{
+    if (tracer->timeoutId == 0)
+    {
+        tracer->timeoutId = g_timeout_add(intervalMs, latencyTracerOnTimeout, tracer);
+    }
+}
+
+/*!
+ * @brief Frees the tracer. The pipeline must be in NULL state so no probe can fire anymore.
+ */
+static void latencyTracerFree(LatencyTracer *tracer)
+{
+    if (tracer->timeoutId != 0)
+    {
+        g_source_remove(tracer->timeoutId);
+    }
+    for (ElementLatency *stats : tracer->elements)
+    {
+        delete stats;
+    }
+    gst_object_unref(tracer->bin);
+    delete tracer;
+}
+
+#endif // LATENCY_TRACER_H
@@ -0,0 +1,532 @@
+/*!
+ * @brief Hosts many independent pipelines in one process, all supervised from a single main loop.
+ * @note Usage:- ./Pipeline-Supervisor.o --count=100 --description="videotestsrc is-live=true ! fakesink name=sink"
+ *       Benchmark:- ./Pipeline-Supervisor.o --benchmark
+ *
+ * Every pipeline is built from a gst_parse_launch() description (like 01-Basic-Playbin) and gets a Bus-Dispatcher.h
+ * watch on the shared default context, so one thread handles all bus traffic.
+ *
+ * Faults:
+ *  - ERROR: the pipeline is stopped and rebuilt after an exponential backoff (100 ms doubling up to 30 s). The backoff
+ *    resets once a pipeline stayed up for 10 s.
+ *  - CPU: a bus sync handler catches STREAM_STATUS enter/leave, which runs on the streaming thread itself, and records
+ *    that thread's CPU clock. Summing them gives the CPU time of every single pipeline. A pipeline using more than
+ *    --cpu-limit cores for 3 seconds in a row is restarted like an ERROR. Threads a library spawns by itself (e.g.
+ *    x264's own workers) are invisible to this, which is why the benchmark runs x264enc with threads=1.
+ *  - Memory: per-pipeline heap usage can't be told apart inside one process, so --memory-limit is enforced twice.
+ *    Within a pipeline it is split over the max-size-bytes of its queues, which bounds what waits in them. For the
+ *    process, the RSS growth since startup may not exceed the limit times the number of running pipelines; when it
+ *    does for 3 seconds in a row, the longest-running pipeline (the likeliest to have accumulated something) is
+ *    restarted like an ERROR, one every 3 seconds until the process is back under. This also covers pipelines
+ *    without queues.
+ *
+ * --benchmark doubles the number of `videotestsrc ! x264enc ! fakesink` pipelines until they stop keeping up with real
+ * time, and reports the highest count that did.
+ */
+
+#include <gst/gst.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Bus-Dispatcher.h"
+
+#define BENCHMARK_FRAME_RATE 30
+#define BENCHMARK_DESCRIPTION                                                         \
+    "videotestsrc is-live=true ! video/x-raw,width=320,height=240,framerate=30/1" \
+    " ! x264enc tune=zerolatency speed-preset=ultrafast threads=1 ! fakesink name=sink sync=false"
+
+typedef struct
+{
+    pthread_t thread;
+    clockid_t clock;
+    gint64 baseNs; // Pooled threads may have worked for another pipeline before.
+    gint64 lastNs; // Last reading: the clock of a thread that has exited can't be read any more.
+} StreamingThread;
+
+typedef struct _Supervisor Supervisor;
+
+typedef struct
+{
+    Supervisor *supervisor;
+    guint id;
+    GstElement *pipeline;
+    BusDispatcher *dispatcher;
+
+    guint restarts, backoffMs, restartSourceId;
+    gint64 startedAt;
+
+    // Streaming threads of this pipeline. Filled from the sync handler, i.e. from those threads.
+    std::mutex lock;
+    std::vector<StreamingThread> threads;
+    gint64 finishedCpuNs;
+
+    gint64 lastCpuNs, lastSampleAt;
+    gdouble cores;
+    guint overBudgetSeconds;
+
+    std::atomic<guint64> frames;
+} SupervisedPipeline;
+
+struct _Supervisor
+{
+    GMainLoop *mainLoop;
+    std::string description;
+    std::vector<SupervisedPipeline *> pipelines;
+    gdouble cpuLimit;
+    guint64 memoryLimit;
+    gint64 baselineRssKb; // before the first pipeline was built
+    guint overMemorySeconds;
+    gboolean quiet;
+};
+
+static gint pipelineCount = 10;
+static gchar *description = (gchar *)BENCHMARK_DESCRIPTION;
+static gdouble cpuLimit = 0;
+static gint memoryLimitMb = 0;
+static gint durationSec = 0;
+static gboolean benchmark = FALSE;
+
+static GOptionEntry entries[] = {
+    {"count", 'n', 0, G_OPTION_ARG_INT, &pipelineCount, "Number of pipelines", "N"},
+    {"description", 'p', 0, G_OPTION_ARG_STRING, &description, "gst-launch description of every pipeline", "DESC"},
+    {"cpu-limit", 0, 0, G_OPTION_ARG_DOUBLE, &cpuLimit, "CPU limit per pipeline in cores (0 = none)", "CORES"},
+    {"memory-limit", 0, 0, G_OPTION_ARG_INT, &memoryLimitMb, "Memory per pipeline in MB: its queues and the process RSS (0 = none)", "MB"},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &durationSec, "Stop after this many seconds (0 = forever)", "SEC"},
+    {"benchmark", 'b', 0, G_OPTION_ARG_NONE, &benchmark, "Find how many encode pipelines run at real time", NULL},
+    {NULL}};
+
+// -1 if the thread is gone.
+static gint64 threadCpuNs(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0)
+    {
+        return -1;
+    }
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*!
+ * @brief Total CPU time of all streaming threads the pipeline ever had. A thread that exited without a LEAVE (or whose
+ * clock went away before it was read) counts with its last reading, so the total never goes down.
+ */
+static gint64 pipelineCpuNs(SupervisedPipeline *sp)
+{
+    std::lock_guard<std::mutex> guard(sp->lock);
+    gint64 total = sp->finishedCpuNs;
+    for (StreamingThread &t : sp->threads)
+    {
+        t.lastNs = MAX(t.lastNs, threadCpuNs(t.clock));
+        total += t.lastNs - t.baseNs;
+    }
+    return total;
+}
+
+// Runs in the thread that posted the message. For STREAM_STATUS that's the streaming thread itself.
+static GstBusSyncReply onSyncMessage(GstBus *bus, GstMessage *msg, SupervisedPipeline *sp)
+{
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_STREAM_STATUS)
+    {
+        return GST_BUS_PASS;
+    }
+
+    GstStreamStatusType type;
+    GstElement *owner;
+    gst_message_parse_stream_status(msg, &type, &owner);
+
+    std::lock_guard<std::mutex> guard(sp->lock);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER)
+    {
+        StreamingThread t;
+        t.thread = pthread_self();
+        if (pthread_getcpuclockid(t.thread, &t.clock) == 0)
+        {
+            t.baseNs = t.lastNs = threadCpuNs(t.clock);
+            sp->threads.push_back(t);
+        }
+    }
+    else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+    {
+        for (auto it = sp->threads.begin(); it != sp->threads.end(); ++it)
+        {
+            if (pthread_equal(it->thread, pthread_self()))
+            {
+                sp->finishedCpuNs += MAX(threadCpuNs(it->clock), it->lastNs) - it->baseNs;
+                sp->threads.erase(it);
+                break;
+            }
+        }
+    }
+    return GST_BUS_PASS;
+}
+
+static GstPadProbeReturn onSinkBuffer(GstPad *pad, GstPadProbeInfo *info, SupervisedPipeline *sp)
+{
+    sp->frames++;
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Splits the memory budget over the queues of the pipeline.
+ */
+static void applyMemoryLimit(GstElement *pipeline, guint64 limit)
+{
+    std::vector<GstElement *> queues;
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+        GstElementFactory *factory = gst_element_get_factory(element);
+        if (factory && g_str_equal(GST_OBJECT_NAME(factory), "queue"))
+        {
+            queues.push_back(element);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    for (GstElement *queue : queues)
+    {
+        g_object_set(queue,
+                     "max-size-bytes", (guint)MIN(limit / queues.size(), (guint64)G_MAXUINT),
+                     "max-size-buffers", 0,
+                     "max-size-time", (guint64)0,
+                     NULL);
+    }
+}
+
+static void scheduleRestart(SupervisedPipeline *sp, const gchar *reason);
+
+static void onError(GstMessage *msg, SupervisedPipeline *sp)
+{
+    GError *err;
+    gchar *debugInfo;
+    gst_message_parse_error(msg, &err, &debugInfo);
+    gchar *reason = g_strdup_printf("error from %s: %s", GST_OBJECT_NAME(msg->src), err->message);
+    scheduleRestart(sp, reason);
+    g_free(reason);
+    g_clear_error(&err);
+    g_free(debugInfo);
+}
+
+static void onEos(GstMessage *msg, SupervisedPipeline *sp)
+{
+    // A finite source finished; keep it running like a long-lived stream would.
+    scheduleRestart(sp, "end of stream");
+}
+
+/*!
+ * @brief Builds and starts the pipeline. On failure a restart is scheduled.
+ */
+static void startPipeline(SupervisedPipeline *sp)
+{
+    GError *err = NULL;
+    Supervisor *supervisor = sp->supervisor;
+
+    sp->pipeline = gst_parse_launch(supervisor->description.c_str(), &err);
+    if (!sp->pipeline)
+    {
+        gchar *reason = g_strdup_printf("failed to build: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        scheduleRestart(sp, reason);
+        g_free(reason);
+        return;
+    }
+    g_clear_error(&err);
+
+    if (supervisor->memoryLimit)
+    {
+        applyMemoryLimit(sp->pipeline, supervisor->memoryLimit);
+    }
+
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(sp->pipeline), "sink");
+    if (sink)
+    {
+        GstPad *pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onSinkBuffer, sp, NULL);
+        gst_object_unref(pad);
+        gst_object_unref(sink);
+    }
+
+    GstBus *bus = gst_element_get_bus(sp->pipeline);
+    gst_bus_set_sync_handler(bus, (GstBusSyncHandler)onSyncMessage, sp, NULL);
+    gst_object_unref(bus);
+
+    sp->dispatcher = busDispatcherNew(sp->pipeline, NULL);
+    busDispatcherConnect(sp->dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, sp);
+    busDispatcherConnect(sp->dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, sp);
+
+    sp->startedAt = g_get_monotonic_time();
+    sp->lastSampleAt = sp->startedAt;
+    sp->lastCpuNs = pipelineCpuNs(sp);
+    sp->overBudgetSeconds = 0;
+
+    if (gst_element_set_state(sp->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        scheduleRestart(sp, "failed to start");
+    }
+}
+
+static void stopPipeline(SupervisedPipeline *sp)
+{
+    if (sp->dispatcher)
+    {
+        busDispatcherFree(sp->dispatcher);
+        sp->dispatcher = NULL;
+    }
+    if (sp->pipeline)
+    {
+        gst_element_set_state(sp->pipeline, GST_STATE_NULL);
+        gst_object_unref(sp->pipeline);
+        sp->pipeline = NULL;
+    }
+
+    // All streaming threads are joined in NULL state.
+    std::lock_guard<std::mutex> guard(sp->lock);
+    for (const StreamingThread &t : sp->threads)
+    {
+        sp->finishedCpuNs += t.lastNs - t.baseNs;
+    }
+    sp->threads.clear();
+}
+
+static gboolean onRestart(SupervisedPipeline *sp)
+{
+    sp->restartSourceId = 0;
+    stopPipeline(sp);
+    startPipeline(sp);
+    return G_SOURCE_REMOVE;
+}
+
+static void scheduleRestart(SupervisedPipeline *sp, const gchar *reason)
+{
+    if (sp->restartSourceId != 0)
+    {
+        return;
+    }
+
+    // A pipeline that ran fine for a while starts over with a short backoff.
+    if (g_get_monotonic_time() - sp->startedAt > 10 * G_USEC_PER_SEC)
+    {
+        sp->backoffMs = 100;
+    }
+    if (!sp->supervisor->quiet)
+    {
+        g_print("\nPipeline %u: %s, restarting in %u ms", sp->id, reason, sp->backoffMs);
+    }
+
+    // Stop streaming now, but tear down from a fresh main loop iteration: we may be inside its bus dispatcher.
+    if (sp->pipeline)
+    {
+        gst_element_set_state(sp->pipeline, GST_STATE_NULL);
+    }
+    sp->restarts++;
+    sp->restartSourceId = g_timeout_add(sp->backoffMs, (GSourceFunc)onRestart, sp);
+    sp->backoffMs = MIN(sp->backoffMs * 2, 30000u);
+}
+
+static long residentKb()
+{
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*!
+ * @brief Restarts the longest-running pipeline when the process has stayed over its memory budget for 3 seconds.
+ */
+static void checkMemory(Supervisor *supervisor)
+{
+    SupervisedPipeline *oldest = NULL;
+    guint running = 0;
+    for (SupervisedPipeline *sp : supervisor->pipelines)
+    {
+        if (sp->pipeline && sp->restartSourceId == 0)
+        {
+            running++;
+            if (!oldest || sp->startedAt < oldest->startedAt)
+                oldest = sp;
+        }
+    }
+
+    gint64 grownKb = residentKb() - supervisor->baselineRssKb;
+    guint64 budgetKb = supervisor->memoryLimit / 1024 * running;
+    if (!oldest || grownKb <= 0 || (guint64)grownKb <= budgetKb)
+    {
+        supervisor->overMemorySeconds = 0;
+        return;
+    }
+    if (++supervisor->overMemorySeconds >= 3)
+    {
+        gchar *reason = g_strdup_printf("process RSS grew by %" G_GINT64_FORMAT " MB (limit %" G_GUINT64_FORMAT " MB)",
+                                        grownKb / 1024, budgetKb / 1024);
+        scheduleRestart(oldest, reason);
+        g_free(reason);
+        supervisor->overMemorySeconds = 0;
+    }
+}
+
+/*!
+ * @brief Once a second: per-pipeline CPU usage, and restart whoever stays above the limit.
+ */
+static gboolean onMonitor(Supervisor *supervisor)
+{
+    gint64 now = g_get_monotonic_time();
+    for (SupervisedPipeline *sp : supervisor->pipelines)
+    {
+        if (!sp->pipeline || sp->restartSourceId != 0)
+        {
+            continue;
+        }
+
+        gint64 cpuNs = pipelineCpuNs(sp);
+        gint64 wallUs = now - sp->lastSampleAt;
+        sp->cores = wallUs > 0 ? (cpuNs - sp->lastCpuNs) / 1000.0 / wallUs : 0.0;
+        sp->lastCpuNs = cpuNs;
+        sp->lastSampleAt = now;
+
+        if (supervisor->cpuLimit > 0 && sp->cores > supervisor->cpuLimit)
+        {
+            if (++sp->overBudgetSeconds >= 3)
+            {
+                gchar *reason = g_strdup_printf("using %.2f cores (limit %.2f)", sp->cores, supervisor->cpuLimit);
+                scheduleRestart(sp, reason);
+                g_free(reason);
+            }
+        }
+        else
+        {
+            sp->overBudgetSeconds = 0;
+        }
+    }
+    if (supervisor->memoryLimit)
+    {
+        checkMemory(supervisor);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean onDuration(Supervisor *supervisor)
+{
+    g_main_loop_quit(supervisor->mainLoop);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * @brief Runs count pipelines for durationSec (0 = forever). Returns the lowest frame rate any pipeline achieved.
+ */
+static gdouble supervise(const gchar *pipelineDescription, guint count, guint seconds, gboolean quiet)
+{
+    Supervisor supervisor;
+    supervisor.mainLoop = g_main_loop_new(NULL, FALSE);
+    supervisor.description = pipelineDescription;
+    supervisor.cpuLimit = cpuLimit;
+    supervisor.memoryLimit = (guint64)memoryLimitMb * 1024 * 1024;
+    supervisor.baselineRssKb = residentKb();
+    supervisor.overMemorySeconds = 0;
+    supervisor.quiet = quiet;
+
+    for (guint i = 0; i < count; i++)
+    {
+        SupervisedPipeline *sp = new SupervisedPipeline();
+        sp->supervisor = &supervisor;
+        sp->id = i;
+        sp->pipeline = NULL;
+        sp->dispatcher = NULL;
+        sp->restarts = sp->restartSourceId = 0;
+        sp->backoffMs = 100;
+        sp->finishedCpuNs = 0;
+        sp->cores = 0;
+        sp->frames = 0;
+        supervisor.pipelines.push_back(sp);
+        startPipeline(sp);
+    }
+
+    guint monitorId = g_timeout_add_seconds(1, (GSourceFunc)onMonitor, &supervisor);
+    if (seconds > 0)
+    {
+        g_timeout_add_seconds(seconds, (GSourceFunc)onDuration, &supervisor);
+    }
+
+    gint64 start = g_get_monotonic_time();
+    g_main_loop_run(supervisor.mainLoop);
+    gdouble elapsed = (g_get_monotonic_time() - start) / 1e6;
+    g_source_remove(monitorId);
+
+    gdouble minFps = G_MAXDOUBLE;
+    guint restarts = 0;
+    for (SupervisedPipeline *sp : supervisor.pipelines)
+    {
+        minFps = MIN(minFps, sp->frames / elapsed);
+        restarts += sp->restarts;
+        if (!quiet)
+        {
+            g_print("\nPipeline %-4u %.2f cores  %7.1f fps  %u restarts", sp->id, sp->cores, sp->frames / elapsed, sp->restarts);
+        }
+    }
+    g_print("\n%u pipelines for %.1f s: min %.1f fps, %u restarts, RSS %ld kB",
+            count, elapsed, minFps, restarts, residentKb());
+
+    for (SupervisedPipeline *sp : supervisor.pipelines)
+    {
+        if (sp->restartSourceId)
+        {
+            g_source_remove(sp->restartSourceId);
+        }
+        stopPipeline(sp);
+        delete sp;
+    }
+    g_main_loop_unref(supervisor.mainLoop);
+    return minFps;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- supervise many pipelines from one main loop");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\nFailed to parse options: %s", err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    if (!benchmark)
+    {
+        supervise(description, MAX(pipelineCount, 1), durationSec, FALSE);
+        g_print("\n");
+        return 0;
+    }
+
+    // Double the pipeline count until the slowest one falls below 95% of real time.
+    guint sustained = 0;
+    for (guint count = 1; count <= 1024; count *= 2)
+    {
+        gdouble minFps = supervise(BENCHMARK_DESCRIPTION, count, 5, TRUE);
+        if (minFps < BENCHMARK_FRAME_RATE * 0.95)
+        {
+            break;
+        }
+        sustained = count;
+    }
+    g_print("\n%u cores sustain at least %u real-time encode pipelines.\n", g_get_num_processors(), sustained);
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*!
+ * @brief Warm playbin pool. A play request starts from a playbin that is already prerolled instead of from NULL.
+ * @note Usage:- ./Playbin-Pool.o [--rounds=N] [--mode=cold|ready|paused|all] <file>...
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/states.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/preroll.html?gi-language=c
+ *
+ * 01-Basic-Playbin builds a fresh playbin and goes NULL -> PLAYING for each URI. The pool offers two warmer starts:
+ *  - ready:  playbins are parked in READY and reused by swapping the "uri" property. Plugin loading and element
+ *            creation are paid once, typefinding, decoder setup and negotiation are still paid per request.
+ *  - paused: the next URI is prepared ahead of time (uri set, PAUSED). By the time it is requested the pipeline has
+ *            typefound, negotiated and the sinks hold their first buffer, so PLAYING only has to start the clock.
+ *
+ * Every player has fakesinks with signal-handoffs, so time-to-first-frame and time-to-first-audio-sample are measured
+ * from the play request to the first buffer actually rendered (handoff only fires in PLAYING, after clock sync).
+ * main() plays the given local files round-robin in each mode and prints the median and max of both.
+ */
+
+#include <gst/gst.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+typedef struct
+{
+    GstElement *playbin;
+    gchar *preparedUri; // URI this player is prerolled to, NULL if in READY
+
+    gint64 requestedAt;
+    std::atomic<gint64> firstFrameAt, firstAudioAt;
+} Player;
+
+typedef struct
+{
+    std::vector<Player *> idle;
+    std::vector<Player *> prepared;
+} PlayerPool;
+
+static gint rounds = 3;
+static gchar *mode = NULL;
+
+static GOptionEntry entries[] = {
+    {"rounds", 'r', 0, G_OPTION_ARG_INT, &rounds, "How often every file is played per mode", "N"},
+    {"mode", 'm', 0, G_OPTION_ARG_STRING, &mode, "cold, ready, paused or all (default)", "MODE"},
+    {NULL}};
+
+/* ======= Player ==========*/
+
+static void onVideoHandoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, Player *player)
+{
+    gint64 none = 0;
+    player->firstFrameAt.compare_exchange_strong(none, g_get_monotonic_time());
+}
+
+static void onAudioHandoff(GstElement *sink, GstBuffer *buffer, GstPad *pad, Player *player)
+{
+    gint64 none = 0;
+    player->firstAudioAt.compare_exchange_strong(none, g_get_monotonic_time());
+}
+
+static Player *playerNew()
+{
+    Player *player = new Player();
+    player->playbin = gst_element_factory_make("playbin", NULL);
+    player->preparedUri = NULL;
+
+    GstElement *videoSink = gst_element_factory_make("fakesink", NULL);
+    GstElement *audioSink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(videoSink, "sync", TRUE, "signal-handoffs", TRUE, NULL);
+    g_object_set(audioSink, "sync", TRUE, "signal-handoffs", TRUE, NULL);
+    g_signal_connect(videoSink, "handoff", G_CALLBACK(onVideoHandoff), player);
+    g_signal_connect(audioSink, "handoff", G_CALLBACK(onAudioHandoff), player);
+    g_object_set(player->playbin, "video-sink", videoSink, "audio-sink", audioSink, NULL);
+    return player;
+}
+
+static void playerFree(Player *player)
+{
+    gst_element_set_state(player->playbin, GST_STATE_NULL);
+    gst_object_unref(player->playbin);
+    g_free(player->preparedUri);
+    delete player;
+}
+
+/*!
+ * @brief Back to READY with the URI cleared. Decoders are dropped, plugins and elements stay loaded.
+ */
+static void playerReset(Player *player)
+{
+    gst_element_set_state(player->playbin, GST_STATE_READY);
+    g_clear_pointer(&player->preparedUri, g_free);
+}
+
+static void playerStart(Player *player, const gchar *uri)
+{
+    player->firstFrameAt = 0;
+    player->firstAudioAt = 0;
+    player->requestedAt = g_get_monotonic_time();
+    if (uri)
+    {
+        g_object_set(player->playbin, "uri", uri, NULL);
+    }
+    gst_element_set_state(player->playbin, GST_STATE_PLAYING);
+}
+
+/*!
+ * @brief Waits until a frame and (if the file has audio) an audio sample were rendered. FALSE on error or timeout.
+ */
+static gboolean playerWaitFirstOutput(Player *player, GstClockTime timeout)
+{
+    GstBus *bus = gst_element_get_bus(player->playbin);
+    gint64 deadline = player->requestedAt + timeout / GST_USECOND;
+    gboolean ok = FALSE;
+
+    while (g_get_monotonic_time() < deadline)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_MSECOND, GST_MESSAGE_ERROR);
+        if (msg)
+        {
+            gst_message_unref(msg);
+            break;
+        }
+
+        gint numAudio = 0;
+        g_object_get(player->playbin, "n-audio", &numAudio, NULL);
+        if (player->firstFrameAt && (player->firstAudioAt || numAudio == 0))
+        {
+            ok = TRUE;
+            break;
+        }
+    }
+    gst_object_unref(bus);
+    return ok;
+}
+
+/* ======= Pool ==========*/
+
+static Player *poolAcquireIdle(PlayerPool *pool)
+{
+    if (pool->idle.empty())
+    {
+        Player *player = playerNew();
+        gst_element_set_state(player->playbin, GST_STATE_READY);
+        return player;
+    }
+    Player *player = pool->idle.back();
+    pool->idle.pop_back();
+    return player;
+}
+
+static void poolRelease(PlayerPool *pool, Player *player)
+{
+    playerReset(player);
+    pool->idle.push_back(player);
+}
+
+/*!
+ * @brief Prerolls a player to uri in the background, so a later poolPlay(uri) only has to go to PLAYING.
+ */
+static void poolPrepare(PlayerPool *pool, const gchar *uri)
+{
+    Player *player = poolAcquireIdle(pool);
+    player->preparedUri = g_strdup(uri);
+    g_object_set(player->playbin, "uri", uri, NULL);
+    gst_element_set_state(player->playbin, GST_STATE_PAUSED);
+    pool->prepared.push_back(player);
+}
+
+/*!
+ * @brief Starts uri. Uses a player prepared for it if there is one, otherwise a READY one with the URI swapped in.
+ */
+static Player *poolPlay(PlayerPool *pool, const gchar *uri)
+{
+    for (size_t i = 0; i < pool->prepared.size(); i++)
+    {
+        Player *player = pool->prepared[i];
+        if (g_strcmp0(player->preparedUri, uri) == 0)
+        {
+            pool->prepared.erase(pool->prepared.begin() + i);
+            playerStart(player, NULL);
+            return player;
+        }
+    }
+    Player *player = poolAcquireIdle(pool);
+    playerStart(player, uri);
+    return player;
+}
+
+static void poolFree(PlayerPool *pool)
+{
+    for (Player *player : pool->idle)
+        playerFree(player);
+    for (Player *player : pool->prepared)
+        playerFree(player);
+    pool->idle.clear();
+    pool->prepared.clear();
+}
+
+/* ======= Measurement ==========*/
+
+typedef struct
+{
+    std::vector<gint64> frame, audio;
+    guint failed;
+} Timings;
+
+static void record(Timings *timings, Player *player, gboolean ok)
+{
+    if (!ok)
+    {
+        timings->failed++;
+        return;
+    }
+    timings->frame.push_back(player->firstFrameAt - player->requestedAt);
+    if (player->firstAudioAt)
+    {
+        timings->audio.push_back(player->firstAudioAt - player->requestedAt);
+    }
+}
+
+static void printTimings(const gchar *name, Timings *timings)
+{
+    std::sort(timings->frame.begin(), timings->frame.end());
+    std::sort(timings->audio.begin(), timings->audio.end());
+
+    g_print("\n%-7s first frame: ", name);
+    if (timings->frame.empty())
+        g_print("%-30s", "n/a");
+    else
+        g_print("median %7.2f ms  max %7.2f ms", timings->frame[timings->frame.size() / 2] / 1000.0,
+                timings->frame.back() / 1000.0);
+
+    g_print("   first audio: ");
+    if (timings->audio.empty())
+        g_print("n/a");
+    else
+        g_print("median %7.2f ms  max %7.2f ms", timings->audio[timings->audio.size() / 2] / 1000.0,
+                timings->audio.back() / 1000.0);
+
+    if (timings->failed)
+        g_print("   (%u failed)", timings->failed);
+}
+
+// Playing time per item once output started, so each request is a real playback and not only a startup.
+#define PLAY_TIME (200 * GST_MSECOND)
+
+static void runCold(std::vector<gchar *> &uris)
+{
+    Timings timings = {{}, {}, 0};
+    for (gint round = 0; round < rounds; round++)
+    {
+        for (gchar *uri : uris)
+        {
+            Player *player = playerNew();
+            playerStart(player, uri);
+            record(&timings, player, playerWaitFirstOutput(player, 5 * GST_SECOND));
+            g_usleep(PLAY_TIME / GST_USECOND);
+            playerFree(player);
+        }
+    }
+    printTimings("cold", &timings);
+}
+
+static void runReady(std::vector<gchar *> &uris)
+{
+    PlayerPool pool;
+    Timings timings = {{}, {}, 0};
+    for (gint round = 0; round < rounds; round++)
+    {
+        for (gchar *uri : uris)
+        {
+            Player *player = poolPlay(&pool, uri);
+            record(&timings, player, playerWaitFirstOutput(player, 5 * GST_SECOND));
+            g_usleep(PLAY_TIME / GST_USECOND);
+            poolRelease(&pool, player);
+        }
+    }
+    poolFree(&pool);
+    printTimings("ready", &timings);
+}
+
+static void runPaused(std::vector<gchar *> &uris)
+{
+    PlayerPool pool;
+    Timings timings = {{}, {}, 0};
+    size_t total = uris.size() * rounds;
+
+    poolPrepare(&pool, uris[0]);
+    for (size_t i = 0; i < total; i++)
+    {
+        // Let the prepared player finish prerolling; a real player would have had the previous item's duration.
+        gst_element_get_state(pool.prepared.back()->playbin, NULL, NULL, 5 * GST_SECOND);
+
+        Player *player = poolPlay(&pool, uris[i % uris.size()]);
+        if (i + 1 < total)
+        {
+            poolPrepare(&pool, uris[(i + 1) % uris.size()]);
+        }
+        record(&timings, player, playerWaitFirstOutput(player, 5 * GST_SECOND));
+        g_usleep(PLAY_TIME / GST_USECOND);
+        poolRelease(&pool, player);
+    }
+    poolFree(&pool);
+    printTimings("paused", &timings);
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("<file>... - compare playback startup from a warm pool");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || argc < 2)
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing input files.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    rounds = MAX(rounds, 1);
+
+    std::vector<gchar *> uris;
+    for (gint i = 1; i < argc; i++)
+    {
+        uris.push_back(gst_uri_is_valid(argv[i]) ? g_strdup(argv[i]) : gst_filename_to_uri(argv[i], NULL));
+    }
+
+    gboolean all = !mode || strcmp(mode, "all") == 0;
+    if (all || strcmp(mode, "cold") == 0)
+        runCold(uris);
+    if (all || strcmp(mode, "ready") == 0)
+        runReady(uris);
+    if (all || strcmp(mode, "paused") == 0)
+        runPaused(uris);
+    g_print("\n");
+
+    for (gchar *uri : uris)
+        g_free(uri);
+    g_free(mode);
+    return 0;
+}
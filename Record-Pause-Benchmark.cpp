@@ -0,0 +1,250 @@
+/*!
+ * @brief Headless check for Record-Pause.h: pause/resume a live recording and verify the file has no gap.
+ * @note Usage:- ./Record-Pause-Benchmark.o [--cycles=N] [--active-ms=MS] [--paused-ms=MS] [--width=PX] [--height=PX]
+ *               [--zerolatency] [--keep]
+ * @link https://gstreamer.freedesktop.org/documentation/gstreamer/gstpad.html?gi-language=c#gst_pad_set_offset
+ *
+ * The 06-Pad-Caps-Play-Pause recording chain runs with videotestsrc is-live=true in place of the webcam, writing to
+ * a temporary MP4. The recording is paused and resumed --cycles times.
+ * A probe on the parser's src pad converts every encoded frame to running time. With the paused spans cut out, no
+ * two consecutive frames may be more than 1.5 frame durations apart, every resume has to produce a keyframe, and the
+ * finished file (GstDiscoverer) has to be about as long as the time spent recording.
+ * Resume latency (resume request -> keyframe out of x264enc) includes the encoder's lookahead; --zerolatency shows
+ * the latency without it.
+ */
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <glib/gstdio.h>
+#include <algorithm>
+#include "Record-Pause.h"
+
+typedef struct
+{
+    GstSegment segment;
+    GstClockTime lastRunningTime, maxGap;
+    guint64 frames, keyframes;
+} Continuity;
+
+static gint cycles = 5;
+static gint activeMs = 1000;
+static gint pausedMs = 1000;
+static gint width = 320;
+static gint height = 240;
+static gboolean zerolatency = FALSE;
+static gboolean keep = FALSE;
+
+static GOptionEntry entries[] = {
+    {"cycles", 'c', 0, G_OPTION_ARG_INT, &cycles, "Pause/resume this many times", "N"},
+    {"active-ms", 'a', 0, G_OPTION_ARG_INT, &activeMs, "Record this long between pauses", "MS"},
+    {"paused-ms", 'p', 0, G_OPTION_ARG_INT, &pausedMs, "Stay paused this long", "MS"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width", "PX"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height", "PX"},
+    {"zerolatency", 'z', 0, G_OPTION_ARG_NONE, &zerolatency, "x264enc tune=zerolatency (no lookahead)", NULL},
+    {"keep", 'k', 0, G_OPTION_ARG_NONE, &keep, "Keep the recorded file", NULL},
+    {NULL}};
+
+static GstPadProbeReturn onEncoded(GstPad *pad, GstPadProbeInfo *info, Continuity *continuity)
+{
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT)
+        {
+            gst_event_copy_segment(event, &continuity->segment);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime runningTime = gst_segment_to_running_time(&continuity->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (GST_CLOCK_TIME_IS_VALID(continuity->lastRunningTime) && GST_CLOCK_TIME_IS_VALID(runningTime) &&
+        runningTime > continuity->lastRunningTime)
+    {
+        continuity->maxGap = MAX(continuity->maxGap, runningTime - continuity->lastRunningTime);
+    }
+    if (GST_CLOCK_TIME_IS_VALID(runningTime))
+    {
+        continuity->lastRunningTime = runningTime;
+    }
+    continuity->frames++;
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    {
+        continuity->keyframes++;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Lets the pipeline run for ms while watching the bus. Returns FALSE on an error.
+ */
+static gboolean runFor(GstBus *bus, gint ms)
+{
+    gint64 deadline = g_get_monotonic_time() + ms * 1000;
+    gint64 now;
+    while ((now = g_get_monotonic_time()) < deadline)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, (deadline - now) * GST_USECOND, GST_MESSAGE_ERROR);
+        if (msg)
+        {
+            GError *err;
+            gst_message_parse_error(msg, &err, NULL);
+            gst_printerr("\nError: %s", err->message);
+            g_clear_error(&err);
+            gst_message_unref(msg);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static GstClockTime fileDuration(const gchar *location)
+{
+    GstDiscoverer *discoverer = gst_discoverer_new(10 * GST_SECOND, NULL);
+    if (!discoverer)
+    {
+        return GST_CLOCK_TIME_NONE;
+    }
+    gchar *uri = gst_filename_to_uri(location, NULL);
+    GstDiscovererInfo *info = gst_discoverer_discover_uri(discoverer, uri, NULL);
+    g_free(uri);
+
+    GstClockTime duration = GST_CLOCK_TIME_NONE;
+    if (info && gst_discoverer_info_get_result(info) == GST_DISCOVERER_OK)
+    {
+        duration = gst_discoverer_info_get_duration(info);
+    }
+    if (info)
+    {
+        gst_discoverer_info_unref(info);
+    }
+    g_object_unref(discoverer);
+    return duration;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- pause and resume a live recording and check for gaps");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    cycles = MAX(cycles, 1);
+
+    gchar *location = g_build_filename(g_get_tmp_dir(), "record-pause-test.mp4", NULL);
+    gchar *description = g_strdup_printf(
+        "videotestsrc is-live=true pattern=ball ! video/x-raw,format=YUY2,width=%d,height=%d,framerate=30/1 ! "
+        "videoconvert name=convert ! x264enc name=encoder %s ! h264parse name=parse ! mp4mux ! filesink location=%s",
+        width, height, zerolatency ? "tune=zerolatency" : "", location);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the recorder: %s", err->message);
+        g_clear_error(&err);
+        g_free(location);
+        return -1;
+    }
+
+    GstElement *converter = gst_bin_get_by_name(GST_BIN(pipeline), "convert");
+    GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), "encoder");
+    GstElement *parser = gst_bin_get_by_name(GST_BIN(pipeline), "parse");
+    RecordPause *recordPause = recordPauseAttach(converter, encoder);
+    if (!recordPause)
+    {
+        gst_object_unref(converter);
+        gst_object_unref(encoder);
+        gst_object_unref(parser);
+        gst_object_unref(pipeline);
+        g_free(location);
+        return -1;
+    }
+
+    Continuity continuity;
+    gst_segment_init(&continuity.segment, GST_FORMAT_TIME);
+    continuity.lastRunningTime = GST_CLOCK_TIME_NONE;
+    continuity.maxGap = 0;
+    continuity.frames = 0;
+    continuity.keyframes = 0;
+    GstPad *pad = gst_element_get_static_pad(parser, "src");
+    gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      (GstPadProbeCallback)onEncoded, &continuity, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(converter);
+    gst_object_unref(encoder);
+    gst_object_unref(parser);
+
+    // Record, then pause/resume cycles times, then record once more and finish the file.
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gboolean ok = gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE;
+    for (gint i = 0; ok && i < cycles; i++)
+    {
+        ok = runFor(bus, activeMs);
+        recordPauseSet(recordPause, TRUE);
+        ok = ok && runFor(bus, pausedMs);
+        recordPauseSet(recordPause, FALSE);
+    }
+    ok = ok && runFor(bus, activeMs);
+    if (ok)
+    {
+        gst_element_send_event(pipeline, gst_event_new_eos());
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND,
+                                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+        ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+        if (msg)
+            gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    recordPausePrint(recordPause);
+    GstClockTime frameDuration = GST_SECOND / 30;
+    GstClockTime expected = (GstClockTime)(cycles + 1) * activeMs * GST_MSECOND;
+    GstClockTime duration = ok ? fileDuration(location) : GST_CLOCK_TIME_NONE;
+    gint64 worstLatency = 0;
+    gint64 sumLatency = 0;
+    guint resumes = (guint)recordPause->resumeLatencies.size();
+    for (gint64 latency : recordPause->resumeLatencies)
+    {
+        worstLatency = std::max(worstLatency, latency);
+        sumLatency += latency;
+    }
+
+    g_print("\n%" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " keyframes, largest running-time gap %.1f ms",
+            continuity.frames, continuity.keyframes, continuity.maxGap / (gdouble)GST_MSECOND);
+    g_print("\nResume latency: mean %.1f ms, max %.1f ms", resumes ? sumLatency / 1000.0 / resumes : 0.0,
+            worstLatency / 1000.0);
+    g_print("\nFile duration %" GST_TIME_FORMAT ", recorded %" GST_TIME_FORMAT, GST_TIME_ARGS(duration),
+            GST_TIME_ARGS(expected));
+
+    // The file may be up to a few frames off: the pause/resume requests land between frames.
+    gboolean continuous = continuity.maxGap <= frameDuration * 3 / 2;
+    gboolean keyed = resumes == (guint)cycles;
+    gboolean complete = GST_CLOCK_TIME_IS_VALID(duration) &&
+                        (duration > expected ? duration - expected : expected - duration) <= expected / 10;
+    gboolean passed = ok && continuous && keyed && complete;
+    if (!continuous)
+        gst_printerr("\nThe recording has a gap.");
+    if (!keyed)
+        gst_printerr("\nOnly %u of %d resumes produced a keyframe.", resumes, cycles);
+    if (!complete)
+        gst_printerr("\nThe file is not as long as the time spent recording.");
+    g_print("\n%s\n", passed ? "PASS" : "FAIL");
+
+    recordPauseFree(recordPause);
+    gst_object_unref(pipeline);
+    if (keep)
+        g_print("\nRecording kept in %s\n", location);
+    else
+        g_remove(location);
+    g_free(location);
+    return passed ? 0 : -1;
+}
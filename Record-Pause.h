@@ -0,0 +1,167 @@
+/*!
+ * @brief Record-pause for a live encoding chain: drops frames in front of the encoder instead of pausing the pipeline.
+ * @link https://gstreamer.freedesktop.org/documentation/gstreamer/gstpad.html?gi-language=c#gst_pad_set_offset
+ * @link https://gstreamer.freedesktop.org/documentation/video/gstvideoevent.html?gi-language=c#gst_video_event_new_downstream_force_key_unit
+ *
+ * Setting a live pipeline to PAUSED leaves a hole in the recorded timestamps, and x264enc flushes and restarts on
+ * resume. Here source and encoder keep running. A buffer probe on the sink pad of the element just in front of the
+ * encoder (the "gate", e.g. videoconvert) drops every frame while paused, so nothing is converted or encoded.
+ * On the first frame after resume the paused span (first dropped PTS to first kept PTS) is added to a negative
+ * running-time offset on the gate's src pad. gst_pad_set_offset() makes that pad resend its segment with the new
+ * offset, so the encoder, the parser and the muxer see one continuous timeline.
+ * The same frame is preceded by a downstream force-key-unit event, so the recording continues with an IDR frame.
+ * Resume latency is the wall time from recordPauseSet(FALSE) until that keyframe leaves the encoder.
+ */
+
+#ifndef RECORD_PAUSE_H
+#define RECORD_PAUSE_H
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+typedef struct
+{
+    GstPad *gateSink, *gateSrc, *encoderSrc;
+    gulong gateProbe, encoderProbe;
+
+    std::atomic<gboolean> paused;
+    std::atomic<gint64> resumeRequestedAt; // monotonic us
+    std::atomic<gboolean> awaitingKeyframe;
+
+    // Only touched by the gate's streaming thread.
+    GstClockTime pausedAt, pausedTotal;
+    guint64 dropped;
+
+    std::mutex lock;
+    std::vector<gint64> resumeLatencies; // us
+} RecordPause;
+
+static GstPadProbeReturn recordPauseOnGateBuffer(GstPad *pad, GstPadProbeInfo *info, RecordPause *pause)
+{
+    GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    if (pause->paused.load())
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(pause->pausedAt))
+        {
+            pause->pausedAt = pts;
+        }
+        pause->dropped++;
+        return GST_PAD_PROBE_DROP;
+    }
+    if (!GST_CLOCK_TIME_IS_VALID(pause->pausedAt) || !GST_CLOCK_TIME_IS_VALID(pts))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // First frame after resume: close the gap, then ask for a keyframe. Both reach the encoder before this frame.
+    if (pts > pause->pausedAt)
+    {
+        pause->pausedTotal += pts - pause->pausedAt;
+    }
+    pause->pausedAt = GST_CLOCK_TIME_NONE;
+    gst_pad_set_offset(pause->gateSrc, -(gint64)pause->pausedTotal);
+    pause->awaitingKeyframe = TRUE;
+    gst_pad_send_event(pad, gst_video_event_new_downstream_force_key_unit(GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE,
+                                                                          GST_CLOCK_TIME_NONE, TRUE, 0));
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn recordPauseOnEncoded(GstPad *pad, GstPadProbeInfo *info, RecordPause *pause)
+{
+    if (!pause->awaitingKeyframe.load() || GST_BUFFER_FLAG_IS_SET(GST_PAD_PROBE_INFO_BUFFER(info), GST_BUFFER_FLAG_DELTA_UNIT))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    pause->awaitingKeyframe = FALSE;
+    std::lock_guard<std::mutex> guard(pause->lock);
+    pause->resumeLatencies.push_back(g_get_monotonic_time() - pause->resumeRequestedAt.load());
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief gate is the element linked directly in front of encoder, e.g. videoconvert ! x264enc.
+ * Attach before the pipeline starts; returns NULL if either element lacks the always pads.
+ */
+static RecordPause *recordPauseAttach(GstElement *gate, GstElement *encoder)
+{
+    GstPad *gateSink = gst_element_get_static_pad(gate, "sink");
+    GstPad *gateSrc = gst_element_get_static_pad(gate, "src");
+    GstPad *encoderSrc = gst_element_get_static_pad(encoder, "src");
+    if (!gateSink || !gateSrc || !encoderSrc)
+    {
+        gst_printerr("\nRecord-pause needs the gate's sink/src and the encoder's src pad.");
+        if (gateSink)
+            gst_object_unref(gateSink);
+        if (gateSrc)
+            gst_object_unref(gateSrc);
+        if (encoderSrc)
+            gst_object_unref(encoderSrc);
+        return NULL;
+    }
+
+    RecordPause *pause = new RecordPause();
+    pause->gateSink = gateSink;
+    pause->gateSrc = gateSrc;
+    pause->encoderSrc = encoderSrc;
+    pause->paused = FALSE;
+    pause->resumeRequestedAt = 0;
+    pause->awaitingKeyframe = FALSE;
+    pause->pausedAt = GST_CLOCK_TIME_NONE;
+    pause->pausedTotal = 0;
+    pause->dropped = 0;
+    pause->gateProbe = gst_pad_add_probe(gateSink, GST_PAD_PROBE_TYPE_BUFFER,
+                                         (GstPadProbeCallback)recordPauseOnGateBuffer, pause, NULL);
+    pause->encoderProbe = gst_pad_add_probe(encoderSrc, GST_PAD_PROBE_TYPE_BUFFER,
+                                            (GstPadProbeCallback)recordPauseOnEncoded, pause, NULL);
+    return pause;
+}
+
+/*!
+ * @brief Pauses or resumes the recording. Safe to call from any thread.
+ */
+static void recordPauseSet(RecordPause *pause, gboolean paused)
+{
+    if (pause->paused.load() == paused)
+    {
+        return;
+    }
+    if (!paused)
+    {
+        pause->resumeRequestedAt = g_get_monotonic_time();
+    }
+    pause->paused = paused;
+}
+
+static gboolean recordPauseIsPaused(RecordPause *pause)
+{
+    return pause->paused.load();
+}
+
+static void recordPausePrint(RecordPause *pause)
+{
+    std::lock_guard<std::mutex> guard(pause->lock);
+    g_print("\nRecord-pause: %" G_GUINT64_FORMAT " frames dropped, %" GST_TIME_FORMAT " cut out, %u resumes",
+            pause->dropped, GST_TIME_ARGS(pause->pausedTotal), (guint)pause->resumeLatencies.size());
+    for (gint64 latency : pause->resumeLatencies)
+    {
+        g_print("\n  resume -> keyframe: %.1f ms", latency / 1000.0);
+    }
+}
+
+/*!
+ * @brief Call after the pipeline is back in NULL.
+ */
+static void recordPauseFree(RecordPause *pause)
+{
+    gst_pad_remove_probe(pause->gateSink, pause->gateProbe);
+    gst_pad_remove_probe(pause->encoderSrc, pause->encoderProbe);
+    gst_object_unref(pause->gateSink);
+    gst_object_unref(pause->gateSrc);
+    gst_object_unref(pause->encoderSrc);
+    delete pause;
+}
+
+#endif // RECORD_PAUSE_H
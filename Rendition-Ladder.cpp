@@ -0,0 +1,466 @@
+/*!
+ * @brief Production form of 07-Multi-Threading's tee. Decodes one input once and encodes a whole rendition ladder
+ * from it in parallel, every rendition into its own file.
+ * @note Usage:- ./Rendition-Ladder.o <file-or-uri> [--output-dir=DIR] [--baseline]
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/multithreading-and-pad-availability.html?gi-language=c
+ *
+ * Pipeline:-
+ *   uridecodebin ─ video ─ tee ─┬─ queue ! videoscale ! videoconvert ! 1080p ! x264enc ! h264parse ! mp4mux ! filesink
+ *                               ├─ queue ! ... 720p ...
+ *                               └─ queue ! ... 480p ...
+ *                ─ audio ─ tee ─┬─ queue ! audioconvert ! audioresample ! aac 128k ! mp4mux ! filesink
+ *                               └─ queue ! ... aac 64k ...
+ *
+ * Every branch starts with a queue, so each rendition is scaled and encoded on its own streaming thread.
+ * At the end each branch reports frames, fps and bitrate. With --baseline the same ladder is also run as N independent
+ * transcodes (one decode per rendition, all running at the same time) to compare the wall time.
+ */
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+
+typedef struct
+{
+    const gchar *name;
+    gint width, height, bitrate; // kbit/s
+} VideoRendition;
+
+typedef struct
+{
+    const gchar *name;
+    gint bitrate; // kbit/s
+} AudioRendition;
+
+static const VideoRendition videoLadder[] = {
+    {"1080p", 1920, 1080, 5000},
+    {"720p", 1280, 720, 2500},
+    {"480p", 854, 480, 1000},
+};
+
+static const AudioRendition audioLadder[] = {
+    {"aac-128k", 128},
+    {"aac-64k", 64},
+};
+
+typedef struct
+{
+    std::string name;
+    // Owned by the pipeline. NULL once dropped because its tee never got a stream.
+    GstElement *bin, *tee;
+    guint64 buffers, bytes;
+    GstClockTime firstPts, lastPts;
+} Branch;
+
+typedef struct
+{
+    GstElement *pipeline, *source, *videoTee, *audioTee;
+    std::vector<Branch *> branches;
+} CustomData;
+
+static gchar *outputDir = (gchar *)".";
+static gboolean runBaseline = FALSE;
+
+static GOptionEntry entries[] = {
+    {"output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &outputDir, "Where the renditions are written", "DIR"},
+    {"baseline", 'b', 0, G_OPTION_ARG_NONE, &runBaseline, "Also run N independent transcodes for comparison", NULL},
+    {NULL}};
+
+static const gchar *findAacEncoder()
+{
+    const gchar *candidates[] = {"avenc_aac", "fdkaacenc", "voaacenc", "faac"};
+    for (const gchar *name : candidates)
+    {
+        GstElementFactory *factory = gst_element_factory_find(name);
+        if (factory)
+        {
+            gst_object_unref(factory);
+            return name;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief The description of one branch, from its queue up to the filesink. The encoder is always named "enc".
+ */
+static std::string videoBranchDescription(const VideoRendition &rendition)
+{
+    gchar *location = g_strdup_printf("%s/%s.mp4", outputDir, rendition.name);
+    gchar *quoted = g_shell_quote(location);
+    gchar *description = g_strdup_printf(
+        "queue max-size-time=2000000000 max-size-bytes=0 max-size-buffers=0"
+        " ! videoscale ! videoconvert ! video/x-raw,width=%d,height=%d,pixel-aspect-ratio=1/1"
+        " ! x264enc name=enc bitrate=%d speed-preset=veryfast ! h264parse ! mp4mux ! filesink location=%s",
+        rendition.width, rendition.height, rendition.bitrate, quoted);
+    std::string result = description;
+    g_free(description);
+    g_free(quoted);
+    g_free(location);
+    return result;
+}
+
+static std::string audioBranchDescription(const AudioRendition &rendition, const gchar *encoder)
+{
+    gchar *location = g_strdup_printf("%s/%s.m4a", outputDir, rendition.name);
+    gchar *quoted = g_shell_quote(location);
+    gchar *description = g_strdup_printf(
+        "queue max-size-time=2000000000 max-size-bytes=0 max-size-buffers=0"
+        " ! audioconvert ! audioresample ! %s name=enc bitrate=%d ! mp4mux ! filesink location=%s",
+        encoder, rendition.bitrate * 1000, quoted);
+    std::string result = description;
+    g_free(description);
+    g_free(quoted);
+    g_free(location);
+    return result;
+}
+
+static GstPadProbeReturn onEncodedBuffer(GstPad *pad, GstPadProbeInfo *info, Branch *branch)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    branch->buffers++;
+    branch->bytes += gst_buffer_get_size(buffer);
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(branch->firstPts))
+            branch->firstPts = GST_BUFFER_PTS(buffer);
+        branch->lastPts = GST_BUFFER_PTS(buffer);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Builds a branch bin and counts what its encoder produces.
+ */
+static Branch *makeBranch(const gchar *name, const std::string &description)
+{
+    GError *err = NULL;
+    GstElement *bin = gst_parse_bin_from_description(description.c_str(), TRUE, &err);
+    if (!bin)
+    {
+        gst_printerr("\nFailed to build branch %s: %s", name, err ? err->message : "unknown");
+        g_clear_error(&err);
+        return NULL;
+    }
+    g_clear_error(&err);
+
+    Branch *branch = new Branch();
+    branch->name = name;
+    branch->bin = bin;
+    branch->tee = NULL;
+    branch->buffers = branch->bytes = 0;
+    branch->firstPts = branch->lastPts = GST_CLOCK_TIME_NONE;
+
+    GstElement *encoder = gst_bin_get_by_name(GST_BIN(bin), "enc");
+    GstPad *pad = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onEncodedBuffer, branch, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(encoder);
+    return branch;
+}
+
+/*!
+ * @brief Adds the branch to the pipeline and links it to a new request pad of the tee.
+ */
+static gboolean attachBranch(CustomData *data, GstElement *tee, Branch *branch)
+{
+    gst_bin_add(GST_BIN(data->pipeline), branch->bin);
+    branch->tee = tee;
+
+    GstPad *teePad = gst_element_get_request_pad(tee, "src_%u");
+    GstPad *sinkPad = gst_element_get_static_pad(branch->bin, "sink");
+    gboolean ok = gst_pad_link(teePad, sinkPad) == GST_PAD_LINK_OK;
+    gst_object_unref(teePad);
+    gst_object_unref(sinkPad);
+
+    data->branches.push_back(branch);
+    return ok;
+}
+
+static const gchar *padMediaType(GstPad *pad, GstCaps **capsOut)
+{
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps)
+    {
+        caps = gst_pad_query_caps(pad, NULL);
+    }
+    *capsOut = caps;
+    return gst_structure_get_name(gst_caps_get_structure(caps, 0));
+}
+
+static void padAddedHandler(GstElement *source, GstPad *newPad, CustomData *data)
+{
+    GstCaps *caps;
+    const gchar *type = padMediaType(newPad, &caps);
+    GstElement *target = NULL;
+
+    if (g_str_has_prefix(type, "video/x-raw"))
+        target = data->videoTee;
+    else if (g_str_has_prefix(type, "audio/x-raw"))
+        target = data->audioTee;
+
+    GstPad *sinkPad = target ? gst_element_get_static_pad(target, "sink") : NULL;
+    if (sinkPad && !gst_pad_is_linked(sinkPad))
+    {
+        if (GST_PAD_LINK_FAILED(gst_pad_link(newPad, sinkPad)))
+        {
+            gst_printerr("\nFailed to link %s pad.", type);
+        }
+    }
+    else
+    {
+        // Second video track, subtitles, ... Keep them flowing into a fakesink so the demuxer never stalls.
+        GstElement *fakeSink = gst_element_factory_make("fakesink", NULL);
+        g_object_set(fakeSink, "sync", FALSE, "async", FALSE, NULL);
+        gst_bin_add(GST_BIN(data->pipeline), fakeSink);
+        gst_element_sync_state_with_parent(fakeSink);
+        GstPad *fakePad = gst_element_get_static_pad(fakeSink, "sink");
+        gst_pad_link(newPad, fakePad);
+        gst_object_unref(fakePad);
+    }
+
+    if (sinkPad)
+    {
+        gst_object_unref(sinkPad);
+    }
+    gst_caps_unref(caps);
+}
+
+/*!
+ * @brief If the input has no audio (or video) the matching tee never gets data and its branches would never finish.
+ * Those branches and the tee are dropped from the pipeline; with neither stream there is nothing to encode, which is
+ * an error.
+ */
+static void noMorePadsHandler(GstElement *source, CustomData *data)
+{
+    GstElement *tees[] = {data->videoTee, data->audioTee};
+    guint unlinked = 0;
+    for (GstElement *tee : tees)
+    {
+        GstPad *sinkPad = gst_element_get_static_pad(tee, "sink");
+        gboolean linked = gst_pad_is_linked(sinkPad);
+        gst_object_unref(sinkPad);
+        if (linked)
+        {
+            continue;
+        }
+        unlinked++;
+
+        for (Branch *branch : data->branches)
+        {
+            if (branch->tee != tee || !branch->bin)
+                continue;
+            // Never got data, so nothing is streaming in it. Locked so the pipeline's state change leaves it alone.
+            gst_element_set_locked_state(branch->bin, TRUE);
+            gst_element_set_state(branch->bin, GST_STATE_NULL);
+            gst_bin_remove(GST_BIN(data->pipeline), branch->bin);
+            branch->bin = branch->tee = NULL;
+            gst_printerr("
+No %s stream, dropped branch %s.", tee == data->videoTee ? "video" : "audio",
+                         branch->name.c_str());
+        }
+        gst_element_set_locked_state(tee, TRUE);
+        gst_element_set_state(tee, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(data->pipeline), tee);
+    }
+
+    if (unlinked == G_N_ELEMENTS(tees))
+    {
+        GST_ELEMENT_ERROR(source, STREAM, WRONG_TYPE, ("The input has neither audio nor video."), (NULL));
+    }
+}
+
+/*!
+ * @brief Waits for EOS or an error. Returns the wall time in seconds, or a negative value on error.
+ */
+static gdouble runPipeline(GstElement *pipeline)
+{
+    gint64 start = g_get_monotonic_time();
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the pipeline.");
+        return -1;
+    }
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+    {
+        GError *err;
+        gchar *debugInfo;
+        gst_message_parse_error(msg, &err, &debugInfo);
+        gst_printerr("\nError from %s: %s", GST_OBJECT_NAME(msg->src), err->message);
+        g_clear_error(&err);
+        g_free(debugInfo);
+        seconds = -1;
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    return seconds;
+}
+
+/*!
+ * @brief Frees the branches and the pipeline, which owns every element.
+ */
+static void freeLadder(CustomData *data)
+{
+    for (Branch *branch : data->branches)
+    {
+        delete branch;
+    }
+    data->branches.clear();
+    gst_object_unref(data->pipeline);
+}
+
+/*!
+ * @brief The ladder with a single decode, fanned out by tees.
+ */
+static gdouble runLadder(const gchar *uri, const gchar *aacEncoder)
+{
+    CustomData data;
+
+    data.pipeline = gst_pipeline_new("ladder-pipeline");
+    data.source = gst_element_factory_make("uridecodebin", NULL);
+    data.videoTee = gst_element_factory_make("tee", "videoTee");
+    data.audioTee = gst_element_factory_make("tee", "audioTee");
+    if (!data.pipeline || !data.source || !data.videoTee || !data.audioTee)
+    {
+        gst_printerr("\nFailed to make one of the GST elements.");
+        // Not in the pipeline yet, so each is released on its own.
+        GstElement *elements[] = {data.pipeline, data.source, data.videoTee, data.audioTee};
+        for (GstElement *element : elements)
+        {
+            if (element)
+                gst_object_unref(gst_object_ref_sink(element));
+        }
+        return -1;
+    }
+
+    g_object_set(data.source, "uri", uri, NULL);
+    gst_bin_add_many(GST_BIN(data.pipeline), data.source, data.videoTee, data.audioTee, NULL);
+
+    for (const VideoRendition &rendition : videoLadder)
+    {
+        Branch *branch = makeBranch(rendition.name, videoBranchDescription(rendition));
+        if (!branch || !attachBranch(&data, data.videoTee, branch))
+        {
+            gst_printerr("\nFailed to attach branch %s.", rendition.name);
+            freeLadder(&data);
+            return -1;
+        }
+    }
+    for (const AudioRendition &rendition : audioLadder)
+    {
+        Branch *branch = makeBranch(rendition.name, audioBranchDescription(rendition, aacEncoder));
+        if (!branch || !attachBranch(&data, data.audioTee, branch))
+        {
+            gst_printerr("\nFailed to attach branch %s.", rendition.name);
+            freeLadder(&data);
+            return -1;
+        }
+    }
+
+    g_signal_connect(data.source, "pad-added", G_CALLBACK(padAddedHandler), &data);
+    g_signal_connect(data.source, "no-more-pads", G_CALLBACK(noMorePadsHandler), &data);
+
+    gdouble seconds = runPipeline(data.pipeline);
+
+    g_print("\nLadder (single decode): %.2f s", seconds);
+    for (Branch *branch : data.branches)
+    {
+        gdouble mediaSeconds = GST_CLOCK_TIME_IS_VALID(branch->firstPts)
+                                   ? (branch->lastPts - branch->firstPts) / (gdouble)GST_SECOND
+                                   : 0.0;
+        g_print("\n  %-10s buffers %-7" G_GUINT64_FORMAT " %7.1f buffers/s  %7.1f kbit/s  %.1f MB",
+                branch->name.c_str(),
+                branch->buffers,
+                seconds > 0 ? branch->buffers / seconds : 0.0,
+                mediaSeconds > 0 ? branch->bytes * 8 / mediaSeconds / 1000 : 0.0,
+                branch->bytes / 1e6);
+    }
+
+    freeLadder(&data);
+    return seconds;
+}
+
+/*!
+ * @brief The same renditions as N independent transcodes (each decoding the input) running side by side.
+ */
+static gdouble runBaselineTranscodes(const gchar *uri, const gchar *aacEncoder)
+{
+    GError *err = NULL;
+    std::string description;
+    gchar *quotedUri = g_shell_quote(uri);
+
+    // One pipeline holding N independent chains, so they run concurrently and EOS once all are done.
+    for (const VideoRendition &rendition : videoLadder)
+    {
+        description += std::string(" uridecodebin uri=") + quotedUri + " caps=video/x-raw expose-all-streams=false ! " +
+                       videoBranchDescription(rendition);
+    }
+    for (const AudioRendition &rendition : audioLadder)
+    {
+        description += std::string(" uridecodebin uri=") + quotedUri + " caps=audio/x-raw expose-all-streams=false ! " +
+                       audioBranchDescription(rendition, aacEncoder);
+    }
+    g_free(quotedUri);
+
+    GstElement *pipeline = gst_parse_launch(description.c_str(), &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the baseline: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return -1;
+    }
+    g_clear_error(&err);
+
+    gdouble seconds = runPipeline(pipeline);
+    g_print("\nBaseline (%u independent transcodes): %.2f s",
+            (guint)(G_N_ELEMENTS(videoLadder) + G_N_ELEMENTS(audioLadder)), seconds);
+    gst_object_unref(pipeline);
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("<file-or-uri> - encode a rendition ladder with one decode");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || argc < 2)
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing input file.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    gchar *uri = gst_uri_is_valid(argv[1]) ? g_strdup(argv[1]) : gst_filename_to_uri(argv[1], NULL);
+    const gchar *aacEncoder = findAacEncoder();
+    if (!aacEncoder)
+    {
+        gst_printerr("\nNo AAC encoder found.");
+        g_free(uri);
+        return -1;
+    }
+
+    gdouble ladderSeconds = runLadder(uri, aacEncoder);
+    if (ladderSeconds > 0 && runBaseline)
+    {
+        gdouble baselineSeconds = runBaselineTranscodes(uri, aacEncoder);
+        if (baselineSeconds > 0)
+        {
+            g_print("\nSingle decode is %.2fx the speed of independent transcodes.", baselineSeconds / ladderSeconds);
+        }
+    }
+    g_print("\n");
+
+    g_free(uri);
+    return ladderSeconds > 0 ? 0 : -1;
+}
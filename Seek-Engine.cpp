@@ -0,0 +1,521 @@
+/*!
+ * @brief Seek engine for scrubbing. 04-Seekable-Streams does a single KEY_UNIT seek, which is fast but lands on the
+ * keyframe before the target. ACCURATE lands on the target but decodes everything from that keyframe on.
+ * @note Usage:- ./Seek-Engine.o <local-file> [num-seeks]
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/seeking.html?gi-language=c
+ *
+ * On first open the file is run through parsebin (demux + parse, no decoding) and the PTS of every video keyframe is
+ * recorded. The index is cached under the user cache dir, keyed by path, size and mtime.
+ *
+ * With the index every seek request picks its own flags:
+ *  - a keyframe within one frame of the target:        KEY_UNIT to that keyframe. Exact, and the cheapest seek.
+ *  - precise requests:                                 ACCURATE.
+ *  - scrubbing requests, keyframe before in tolerance: KEY_UNIT | SNAP_BEFORE, so the picture never runs ahead of
+ *                                                      the scrub position.
+ *  - scrubbing requests, only the next one in it:      KEY_UNIT | SNAP_AFTER.
+ *  - scrubbing requests deep into a long GOP:          KEY_UNIT | SNAP_NEAREST. Never decodes more than one frame.
+ * While a seek is in flight (until ASYNC_DONE) new requests only replace the pending target, so a burst of scrub
+ * events results in one seek for the latest position. A seek the pipeline refuses is counted and dropped.
+ *
+ * main() opens the file PAUSED and measures seek-to-first-frame latency and landing error for KEY_UNIT, ACCURATE and
+ * the engine's precise and scrubbing choices, plus a coalesced burst.
+ */
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#define SNAP_TOLERANCE (500 * GST_MSECOND)
+
+typedef struct
+{
+    std::vector<GstClockTime> keyframes;
+    GstClockTime frameDuration;
+} KeyframeIndex;
+
+typedef struct
+{
+    GstElement *pipeline;
+    KeyframeIndex *index;
+
+    gboolean inFlight;
+    gboolean hasPending;
+    GstClockTime pendingTarget;
+    gboolean pendingPrecise;
+    guint requested, executed, failed;
+    guint snapBefore, snapAfter, snapNearest, accurate; // what chooseSeekFlags() picked
+
+    // Measurement of the seek in flight. The probe writes it on the streaming thread: frameLock guards it.
+    std::mutex frameLock;
+    gint64 seekIssuedAt;
+    gint64 firstFrameLatency;
+    GstClockTime firstFramePts;
+    gboolean waitingForFrame;
+} SeekEngine;
+
+/* ======= Keyframe index ==========*/
+
+typedef struct
+{
+    GstElement *pipeline;
+    KeyframeIndex *index;
+    gboolean hasVideo; // only the first video stream is indexed
+} IndexBuilder;
+
+static GstPadProbeReturn onParsedVideo(GstPad *pad, GstPadProbeInfo *info, IndexBuilder *builder)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime ts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) : GST_BUFFER_DTS(buffer);
+
+    if (GST_CLOCK_TIME_IS_VALID(ts))
+    {
+        if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        {
+            builder->index->keyframes.push_back(ts);
+        }
+        if (GST_BUFFER_DURATION_IS_VALID(buffer) && !GST_CLOCK_TIME_IS_VALID(builder->index->frameDuration))
+        {
+            builder->index->frameDuration = GST_BUFFER_DURATION(buffer);
+        }
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void onParsebinPad(GstElement *parsebin, GstPad *newPad, IndexBuilder *builder)
+{
+    GstCaps *caps = gst_pad_get_current_caps(newPad);
+    if (!caps)
+    {
+        caps = gst_pad_query_caps(newPad, NULL);
+    }
+    gboolean isVideo = g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/");
+    gst_caps_unref(caps);
+
+    // Every stream needs a sink, or the demuxer stops with not-linked.
+    GstElement *sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(sink, "sync", FALSE, NULL);
+    gst_bin_add(GST_BIN(builder->pipeline), sink);
+    gst_element_sync_state_with_parent(sink);
+
+    GstPad *sinkPad = gst_element_get_static_pad(sink, "sink");
+    if (isVideo && !builder->hasVideo)
+    {
+        builder->hasVideo = TRUE;
+        gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onParsedVideo, builder, NULL);
+    }
+    gst_pad_link(newPad, sinkPad);
+    gst_object_unref(sinkPad);
+}
+
+static gchar *indexCachePath(const gchar *filename)
+{
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, filename, -1);
+    gchar *directory = g_build_filename(g_get_user_cache_dir(), "gst-keyframe-index", NULL);
+    g_mkdir_with_parents(directory, 0755);
+    gchar *path = g_strdup_printf("%s/%s.idx", directory, hash);
+    g_free(directory);
+    g_free(hash);
+    return path;
+}
+
+static gboolean loadIndex(const gchar *cachePath, GStatBuf *st, KeyframeIndex *index)
+{
+    FILE *file = fopen(cachePath, "rb");
+    if (!file)
+    {
+        return FALSE;
+    }
+
+    gint64 header[4]; // size, mtime, frame duration, count
+    gboolean ok = fread(header, sizeof(header), 1, file) == 1 &&
+                  header[0] == (gint64)st->st_size && header[1] == (gint64)st->st_mtime;
+    if (ok)
+    {
+        index->frameDuration = (GstClockTime)header[2];
+        index->keyframes.resize(header[3]);
+        ok = fread(index->keyframes.data(), sizeof(GstClockTime), header[3], file) == (size_t)header[3];
+    }
+    fclose(file);
+    return ok;
+}
+
+static void saveIndex(const gchar *cachePath, GStatBuf *st, KeyframeIndex *index)
+{
+    FILE *file = fopen(cachePath, "wb");
+    if (!file)
+    {
+        return;
+    }
+    gint64 header[4] = {(gint64)st->st_size, (gint64)st->st_mtime, (gint64)index->frameDuration,
+                        (gint64)index->keyframes.size()};
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(index->keyframes.data(), sizeof(GstClockTime), index->keyframes.size(), file);
+    fclose(file);
+}
+
+/*!
+ * @brief Loads the keyframe index from the cache, or builds it by demuxing the file once.
+ */
+static KeyframeIndex *keyframeIndexOpen(const gchar *filename)
+{
+    GStatBuf st;
+    if (g_stat(filename, &st) != 0)
+    {
+        gst_printerr("\nCannot stat %s", filename);
+        return NULL;
+    }
+
+    KeyframeIndex *index = new KeyframeIndex();
+    index->frameDuration = GST_CLOCK_TIME_NONE;
+    gchar *cachePath = indexCachePath(filename);
+    gint64 start = g_get_monotonic_time();
+
+    if (loadIndex(cachePath, &st, index))
+    {
+        g_print("\nLoaded %u keyframes from the index cache in %.2f ms",
+                (guint)index->keyframes.size(), (g_get_monotonic_time() - start) / 1000.0);
+        g_free(cachePath);
+        return index;
+    }
+    index->keyframes.clear();
+    index->frameDuration = GST_CLOCK_TIME_NONE;
+
+    IndexBuilder builder;
+    builder.index = index;
+    builder.hasVideo = FALSE;
+    builder.pipeline = gst_pipeline_new("index-pipeline");
+    GstElement *source = gst_element_factory_make("filesrc", NULL);
+    GstElement *parsebin = gst_element_factory_make("parsebin", NULL);
+    if (!builder.pipeline || !source || !parsebin)
+    {
+        gst_printerr("\nFailed to create the indexing pipeline.");
+        delete index;
+        g_free(cachePath);
+        return NULL;
+    }
+    g_object_set(source, "location", filename, NULL);
+    gst_bin_add_many(GST_BIN(builder.pipeline), source, parsebin, NULL);
+    gst_element_link(source, parsebin);
+    g_signal_connect(parsebin, "pad-added", G_CALLBACK(onParsebinPad), &builder);
+
+    gst_element_set_state(builder.pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(builder.pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(builder.pipeline, GST_STATE_NULL);
+    gst_object_unref(builder.pipeline);
+
+    std::sort(index->keyframes.begin(), index->keyframes.end());
+    index->keyframes.erase(std::unique(index->keyframes.begin(), index->keyframes.end()), index->keyframes.end());
+
+    if (!ok || index->keyframes.empty())
+    {
+        gst_printerr("\nFailed to index %s", filename);
+        delete index;
+        g_free(cachePath);
+        return NULL;
+    }
+
+    g_print("\nIndexed %u keyframes in %.1f ms", (guint)index->keyframes.size(), (g_get_monotonic_time() - start) / 1000.0);
+    saveIndex(cachePath, &st, index);
+    g_free(cachePath);
+    return index;
+}
+
+/* ======= Seek engine ==========*/
+
+// GST_CLOCK_TIME_NONE if target is before the first keyframe.
+static GstClockTime keyframeBefore(KeyframeIndex *index, GstClockTime target)
+{
+    auto it = std::upper_bound(index->keyframes.begin(), index->keyframes.end(), target);
+    return it == index->keyframes.begin() ? GST_CLOCK_TIME_NONE : *(it - 1);
+}
+
+static GstClockTime keyframeAfter(KeyframeIndex *index, GstClockTime target)
+{
+    auto it = std::lower_bound(index->keyframes.begin(), index->keyframes.end(), target);
+    return it == index->keyframes.end() ? GST_CLOCK_TIME_NONE : *it;
+}
+
+/*!
+ * @brief Picks the flags for a seek to target. See the policy in the header comment.
+ */
+static GstSeekFlags chooseSeekFlags(SeekEngine *engine, GstClockTime target, gboolean precise)
+{
+    KeyframeIndex *index = engine->index;
+    GstClockTime frame = GST_CLOCK_TIME_IS_VALID(index->frameDuration) ? index->frameDuration : 40 * GST_MSECOND;
+    GstClockTime before = keyframeBefore(index, target);
+    GstClockTime after = keyframeAfter(index, target);
+    GstSeekFlags keyUnit = (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT);
+
+    // Before the first keyframe there is nothing to decode from: only the keyframe after counts.
+    gboolean hasBefore = GST_CLOCK_TIME_IS_VALID(before);
+
+    if ((hasBefore && target - before < frame) || (GST_CLOCK_TIME_IS_VALID(after) && after - target < frame))
+    {
+        engine->snapNearest++;
+        return (GstSeekFlags)(keyUnit | GST_SEEK_FLAG_SNAP_NEAREST);
+    }
+    if (precise)
+    {
+        engine->accurate++;
+        return (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE);
+    }
+    if (hasBefore && target - before <= SNAP_TOLERANCE)
+    {
+        engine->snapBefore++;
+        return (GstSeekFlags)(keyUnit | GST_SEEK_FLAG_SNAP_BEFORE);
+    }
+    if (GST_CLOCK_TIME_IS_VALID(after) && after - target <= SNAP_TOLERANCE)
+    {
+        engine->snapAfter++;
+        return (GstSeekFlags)(keyUnit | GST_SEEK_FLAG_SNAP_AFTER);
+    }
+    engine->snapNearest++;
+    return (GstSeekFlags)(keyUnit | GST_SEEK_FLAG_SNAP_NEAREST);
+}
+
+static GstPadProbeReturn onVideoFrame(GstPad *pad, GstPadProbeInfo *info, SeekEngine *engine)
+{
+    std::lock_guard<std::mutex> guard(engine->frameLock);
+    if (engine->waitingForFrame)
+    {
+        engine->waitingForFrame = FALSE;
+        engine->firstFrameLatency = g_get_monotonic_time() - engine->seekIssuedAt;
+        engine->firstFramePts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Issues the seek. Returns FALSE if the pipeline refused it; nothing is in flight then.
+ */
+static gboolean seekEngineExecute(SeekEngine *engine, GstClockTime target, GstSeekFlags flags)
+{
+    engine->inFlight = TRUE;
+    engine->executed++;
+    {
+        std::lock_guard<std::mutex> guard(engine->frameLock);
+        engine->waitingForFrame = TRUE;
+        engine->seekIssuedAt = g_get_monotonic_time();
+    }
+    if (gst_element_seek_simple(engine->pipeline, GST_FORMAT_TIME, flags, target))
+    {
+        return TRUE;
+    }
+    // No ASYNC_DONE will come for it.
+    engine->inFlight = FALSE;
+    engine->failed++;
+    std::lock_guard<std::mutex> guard(engine->frameLock);
+    engine->waitingForFrame = FALSE;
+    return FALSE;
+}
+
+/*!
+ * @brief Asks for a seek. Runs at once if idle, otherwise replaces whatever request is still waiting.
+ * Returns FALSE if the seek was run and refused.
+ */
+static gboolean seekEngineRequest(SeekEngine *engine, GstClockTime target, gboolean precise)
+{
+    engine->requested++;
+    if (engine->inFlight)
+    {
+        engine->hasPending = TRUE;
+        engine->pendingTarget = target;
+        engine->pendingPrecise = precise;
+        return TRUE;
+    }
+    return seekEngineExecute(engine, target, chooseSeekFlags(engine, target, precise));
+}
+
+/*!
+ * @brief Call on ASYNC_DONE: the seek in flight completed. Starts the latest pending one, if any.
+ */
+static void seekEngineOnAsyncDone(SeekEngine *engine)
+{
+    engine->inFlight = FALSE;
+    if (engine->hasPending)
+    {
+        engine->hasPending = FALSE;
+        seekEngineExecute(engine, engine->pendingTarget,
+                          chooseSeekFlags(engine, engine->pendingTarget, engine->pendingPrecise));
+    }
+}
+
+/* ======= Measurement ==========*/
+
+// Waits until the seek (and any pending one started after it) completed. Returns FALSE on error.
+static gboolean waitForSeeks(SeekEngine *engine, GstBus *bus)
+{
+    while (engine->inFlight)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, 10 * GST_SECOND,
+                                                     (GstMessageType)(GST_MESSAGE_ASYNC_DONE | GST_MESSAGE_ERROR));
+        if (!msg || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+        {
+            if (msg)
+                gst_message_unref(msg);
+            return FALSE;
+        }
+        gst_message_unref(msg);
+        seekEngineOnAsyncDone(engine);
+    }
+    return TRUE;
+}
+
+typedef enum
+{
+    MODE_KEY_UNIT,
+    MODE_ACCURATE,
+    MODE_ENGINE_PRECISE,
+    MODE_ENGINE_SCRUB
+} SeekMode;
+
+static void measure(SeekEngine *engine, GstBus *bus, SeekMode mode, const std::vector<GstClockTime> &targets)
+{
+    static const gchar *names[] = {"key-unit", "accurate", "precise", "scrub"};
+    std::vector<gint64> latencies;
+    GstClockTimeDiff errorSum = 0;
+    guint failedBefore = engine->failed;
+
+    for (GstClockTime target : targets)
+    {
+        gboolean issued;
+        if (mode == MODE_ENGINE_PRECISE || mode == MODE_ENGINE_SCRUB)
+        {
+            issued = seekEngineRequest(engine, target, mode == MODE_ENGINE_PRECISE);
+        }
+        else
+        {
+            GstSeekFlags flags = mode == MODE_KEY_UNIT ? GST_SEEK_FLAG_KEY_UNIT : GST_SEEK_FLAG_ACCURATE;
+            issued = seekEngineExecute(engine, target, (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | flags));
+        }
+        if (!issued)
+        {
+            continue;
+        }
+        if (!waitForSeeks(engine, bus))
+        {
+            gst_printerr("\nSeek to %" GST_TIME_FORMAT " failed.", GST_TIME_ARGS(target));
+            return;
+        }
+        std::lock_guard<std::mutex> guard(engine->frameLock);
+        latencies.push_back(engine->firstFrameLatency);
+        errorSum += ABS(GST_CLOCK_DIFF(target, engine->firstFramePts));
+    }
+
+    if (latencies.empty())
+    {
+        g_print("\n%-9s every seek was refused", names[mode]);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    g_print("\n%-9s seek-to-first-frame: median %6.1f ms  max %6.1f ms  mean landing error %6.1f ms  %u refused",
+            names[mode],
+            latencies[latencies.size() / 2] / 1000.0,
+            latencies.back() / 1000.0,
+            errorSum / (gdouble)latencies.size() / GST_MSECOND,
+            engine->failed - failedBefore);
+}
+
+int main(int argc, char **argv)
+{
+    SeekEngine engine;
+    guint numSeeks = 20;
+
+    if (argc < 2)
+    {
+        gst_printerr("\nUsage: %s <local-file> [num-seeks]\n", argv[0]);
+        return -1;
+    }
+    if (argc > 2)
+    {
+        numSeeks = MAX((guint)g_ascii_strtoull(argv[2], NULL, 10), 1u);
+    }
+
+    gst_init(NULL, NULL);
+
+    engine.index = keyframeIndexOpen(argv[1]);
+    if (!engine.index)
+    {
+        return -1;
+    }
+    engine.inFlight = engine.hasPending = engine.waitingForFrame = FALSE;
+    engine.requested = engine.executed = engine.failed = 0;
+    engine.snapBefore = engine.snapAfter = engine.snapNearest = engine.accurate = 0;
+
+    // Headless playbin. The probe on the video sink catches the first frame after each seek.
+    engine.pipeline = gst_element_factory_make("playbin", NULL);
+    GstElement *videoSink = gst_element_factory_make("fakesink", NULL);
+    GstElement *audioSink = gst_element_factory_make("fakesink", NULL);
+    gchar *uri = gst_filename_to_uri(argv[1], NULL);
+    g_object_set(engine.pipeline, "uri", uri, "video-sink", videoSink, "audio-sink", audioSink, NULL);
+    g_free(uri);
+
+    GstPad *pad = gst_element_get_static_pad(videoSink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onVideoFrame, &engine, NULL);
+    gst_object_unref(pad);
+
+    // Scrubbing happens in PAUSED: every seek ends with one prerolled frame.
+    gst_element_set_state(engine.pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(engine.pipeline, NULL, NULL, 10 * GST_SECOND) != GST_STATE_CHANGE_SUCCESS)
+    {
+        gst_printerr("\nFailed to preroll %s", argv[1]);
+        gst_element_set_state(engine.pipeline, GST_STATE_NULL);
+        gst_object_unref(engine.pipeline);
+        delete engine.index;
+        return -1;
+    }
+
+    gint64 duration = 0;
+    gst_element_query_duration(engine.pipeline, GST_FORMAT_TIME, &duration);
+    if (duration <= 0)
+    {
+        duration = engine.index->keyframes.back();
+    }
+
+    // Spread targets over the file, deliberately off the keyframes.
+    std::vector<GstClockTime> targets;
+    GRand *rand = g_rand_new_with_seed(42);
+    for (guint i = 0; i < numSeeks; i++)
+    {
+        targets.push_back((GstClockTime)(g_rand_double(rand) * duration * 0.95));
+    }
+    g_rand_free(rand);
+
+    // Drop the preroll's ASYNC_DONE so it isn't taken for the first seek's.
+    GstBus *bus = gst_element_get_bus(engine.pipeline);
+    GstMessage *msg;
+    while ((msg = gst_bus_pop(bus)))
+    {
+        gst_message_unref(msg);
+    }
+    measure(&engine, bus, MODE_KEY_UNIT, targets);
+    measure(&engine, bus, MODE_ACCURATE, targets);
+    measure(&engine, bus, MODE_ENGINE_PRECISE, targets);
+    measure(&engine, bus, MODE_ENGINE_SCRUB, targets);
+    g_print("\nEngine picked: %u accurate, %u snap-before, %u snap-after, %u snap-nearest", engine.accurate,
+            engine.snapBefore, engine.snapAfter, engine.snapNearest);
+
+    // A scrub burst: ten requests in a row while the first one is in flight.
+    engine.requested = engine.executed = 0;
+    for (guint i = 0; i < 10; i++)
+    {
+        seekEngineRequest(&engine, targets[i % targets.size()], FALSE);
+    }
+    waitForSeeks(&engine, bus);
+    g_print("\nScrub burst: %u requests coalesced into %u seeks\n", engine.requested, engine.executed);
+
+    gst_object_unref(bus);
+    gst_element_set_state(engine.pipeline, GST_STATE_NULL);
+    gst_object_unref(engine.pipeline);
+    delete engine.index;
+
+    return 0;
+}
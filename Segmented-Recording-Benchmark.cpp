@@ -0,0 +1,401 @@
+/*!
+ * @brief Crash test for Segmented-Sink.h: record, SIGKILL the recorder, count what is still playable.
+ * @note Usage:- ./Segmented-Recording-Benchmark.o [--seconds=SEC] [--segment-time=SEC] [--fragment-ms=MS] [--width=PX]
+ *               [--height=PX] [--keep]
+ * @link https://gstreamer.freedesktop.org/documentation/multifile/splitmuxsink.html?gi-language=c
+ *
+ * A child process (this program again, spawned with --record-to) runs the 06-Pad-Caps-Play-Pause recording chain
+ * with a live videotestsrc in place of the webcam and splitmuxsink as sink. A probe on the parser's src pad, which
+ * feeds splitmuxsink, tracks frames, bytes and the longest gap between two frames; with a live 30 fps source anything
+ * well above 33 ms is a stall (e.g. a segment being finalized in the streaming thread). It also remembers each
+ * frame's running time, so that at every rollover (splitmuxsink-fragment-opened) the child knows how many frames went
+ * into the segments before it. The child reports all of this every second on its stdout.
+ * After --seconds the parent SIGKILLs it (no EOS, no finalization), runs every segment through GstDiscoverer and
+ * demuxes the closed ones to count their frames.
+ * Expected: every segment but the last is playable, the last one too with --fragment-ms, and the closed segments hold
+ * exactly the frames pushed into them (none dropped at a rollover).
+ */
+
+#include <gst/gst.h>
+#include <gst/pbutils/pbutils.h>
+#include <glib/gstdio.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Segmented-Sink.h"
+
+typedef struct
+{
+    // The probe runs on the streaming thread, the reports on the main thread.
+    std::mutex lock;
+    guint64 frames, bytes;
+    gint64 lastFrameAt, maxGapUs;
+    std::vector<GstClockTime> frameTimes; // running time of every frame, increasing
+} WriteStats;
+
+static gint seconds = 11;
+static gint segmentTime = 2;
+static gint fragmentMs = 0;
+static gint width = 1280;
+static gint height = 720;
+static gboolean keep = FALSE;
+static gchar *recordTo = NULL;
+
+static GOptionEntry entries[] = {
+    {"seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "Record this long before the SIGKILL", "SEC"},
+    {"segment-time", 't', 0, G_OPTION_ARG_INT, &segmentTime, "Segment length", "SEC"},
+    {"fragment-ms", 'f', 0, G_OPTION_ARG_INT, &fragmentMs, "Write fragmented MP4 with fragments of MS milliseconds", "MS"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Frame width", "PX"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height, "Frame height", "PX"},
+    {"keep", 'k', 0, G_OPTION_ARG_NONE, &keep, "Keep the segments", NULL},
+    {"record-to", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &recordTo, "Run as the recorder child", "DIR"},
+    {NULL}};
+
+/* ======= Recorder (child) ==========*/
+
+static GstPadProbeReturn onSegmentInput(GstPad *pad, GstPadProbeInfo *info, WriteStats *stats)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime runningTime = GST_CLOCK_TIME_NONE;
+    GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    if (event)
+    {
+        const GstSegment *segment;
+        gst_event_parse_segment(event, &segment);
+        runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+        gst_event_unref(event);
+    }
+
+    gint64 now = g_get_monotonic_time();
+    std::lock_guard<std::mutex> guard(stats->lock);
+    if (stats->lastFrameAt)
+    {
+        stats->maxGapUs = MAX(stats->maxGapUs, now - stats->lastFrameAt);
+    }
+    stats->lastFrameAt = now;
+    stats->frames++;
+    stats->bytes += gst_buffer_get_size(buffer);
+    stats->frameTimes.push_back(runningTime);
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Records until killed, writing "report frames bytes max-gap-us closed-segments counted-segments
+ * counted-frames" to fd every second: the first counted-segments segments (all closed) got counted-frames frames.
+ */
+static void record(const gchar *directory, int fd)
+{
+    WriteStats stats;
+    stats.frames = stats.bytes = 0;
+    stats.lastFrameAt = stats.maxGapUs = 0;
+    std::vector<GstClockTime> openedAt; // running time of every segment's first frame
+    guint closed = 0;
+    GError *err = NULL;
+
+    gchar *description = g_strdup_printf(
+        "videotestsrc is-live=true pattern=ball ! video/x-raw,format=YUY2,width=%d,height=%d,framerate=30/1 ! "
+        "videoconvert ! x264enc tune=zerolatency speed-preset=ultrafast ! h264parse name=parse",
+        width, height);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the recorder: %s", err->message);
+        g_clear_error(&err);
+        return;
+    }
+    gchar *pattern = g_build_filename(directory, "segment-%05d.mp4", NULL);
+    GstElement *sink = segmentedSinkNew(pattern, (guint64)segmentTime * GST_SECOND, 0, fragmentMs);
+    g_free(pattern);
+    GstElement *parser = gst_bin_get_by_name(GST_BIN(pipeline), "parse");
+    gst_bin_add(GST_BIN(pipeline), sink);
+    gst_element_link(parser, sink);
+
+    GstPad *pad = gst_element_get_static_pad(parser, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onSegmentInput, &stats, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(parser);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    for (;;)
+    {
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_SECOND,
+                                                     (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT));
+        if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+        {
+            gst_message_unref(msg);
+            break;
+        }
+        if (msg)
+        {
+            const GstStructure *structure = gst_message_get_structure(msg);
+            GstClockTime runningTime;
+            if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ELEMENT && structure &&
+                gst_structure_has_name(structure, "splitmuxsink-fragment-opened") &&
+                gst_structure_get_clock_time(structure, "running-time", &runningTime))
+            {
+                openedAt.push_back(runningTime);
+            }
+            closed += segmentedSinkHandleMessage(msg) ? 1 : 0;
+            gst_message_unref(msg);
+        }
+
+        // Segments 0..counted-1 are closed and the next one has started, so everything before its first frame is in
+        // them. Lines start on their own: segmentedSinkHandleMessage() prints to the same stdout.
+        guint counted = openedAt.empty() ? 0 : MIN(closed, (guint)openedAt.size() - 1);
+        gchar *line;
+        {
+            std::lock_guard<std::mutex> guard(stats.lock);
+            guint64 countedFrames = 0;
+            if (counted)
+            {
+                auto end = std::lower_bound(stats.frameTimes.begin(), stats.frameTimes.end(), openedAt[counted]);
+                countedFrames = end - stats.frameTimes.begin();
+            }
+            line = g_strdup_printf("\nreport %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT
+                                   " %u %u %" G_GUINT64_FORMAT "\n",
+                                   stats.frames, stats.bytes, stats.maxGapUs, closed, counted, countedFrames);
+        }
+        if (write(fd, line, strlen(line)) < 0)
+        {
+            g_free(line);
+            break;
+        }
+        g_free(line);
+    }
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+}
+
+/* ======= Recovery (parent) ==========*/
+
+static GstPadProbeReturn onDemuxedFrame(GstPad *pad, GstPadProbeInfo *info, guint64 *frames)
+{
+    (*frames)++;
+    return GST_PAD_PROBE_OK;
+}
+
+/*!
+ * @brief Number of video frames in one segment, or -1 if it can't be demuxed to the end.
+ */
+static gint64 countFrames(const gchar *location)
+{
+    GError *err = NULL;
+    gchar *escaped = g_strescape(location, NULL);
+    gchar *description = g_strdup_printf("filesrc location=\"%s\" ! qtdemux ! fakesink name=sink sync=false", escaped);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    g_free(escaped);
+    if (!pipeline)
+    {
+        g_clear_error(&err);
+        return -1;
+    }
+
+    guint64 frames = 0;
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onDemuxedFrame, &frames, NULL);
+    gst_object_unref(pad);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 30 * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok ? (gint64)frames : -1;
+}
+
+/*!
+ * @brief Playable duration of one segment, or GST_CLOCK_TIME_NONE if it can't be played.
+ */
+static GstClockTime playableDuration(GstDiscoverer *discoverer, const gchar *location)
+{
+    gchar *uri = gst_filename_to_uri(location, NULL);
+    GstDiscovererInfo *info = gst_discoverer_discover_uri(discoverer, uri, NULL);
+    g_free(uri);
+
+    GstClockTime duration = GST_CLOCK_TIME_NONE;
+    if (info && gst_discoverer_info_get_result(info) == GST_DISCOVERER_OK)
+    {
+        GList *videos = gst_discoverer_info_get_video_streams(info);
+        if (videos)
+        {
+            duration = gst_discoverer_info_get_duration(info);
+        }
+        gst_discoverer_stream_info_list_free(videos);
+    }
+    if (info)
+    {
+        gst_discoverer_info_unref(info);
+    }
+    return duration;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- SIGKILL a segmented recording and check what survives");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    seconds = MAX(seconds, 1);
+    segmentTime = MAX(segmentTime, 1);
+
+    if (recordTo)
+    {
+        record(recordTo, STDOUT_FILENO);
+        return 0;
+    }
+
+    gchar *directory = g_dir_make_tmp("segments-XXXXXX", NULL);
+    if (!directory)
+    {
+        gst_printerr("\nFailed to create the output directory.");
+        return -1;
+    }
+
+    // A fresh process rather than fork(): GStreamer's threads (registry loading, ...) don't survive a fork.
+    gchar *childArgs[] = {argv[0],
+                          g_strdup_printf("--record-to=%s", directory),
+                          g_strdup_printf("--segment-time=%d", segmentTime),
+                          g_strdup_printf("--fragment-ms=%d", fragmentMs),
+                          g_strdup_printf("--width=%d", width),
+                          g_strdup_printf("--height=%d", height),
+                          NULL};
+    GPid child;
+    gint output;
+    gboolean spawned = g_spawn_async_with_pipes(NULL, childArgs, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &child,
+                                                NULL, &output, NULL, &err);
+    for (guint i = 1; childArgs[i]; i++)
+        g_free(childArgs[i]);
+    if (!spawned)
+    {
+        gst_printerr("\nFailed to start the recorder: %s", err->message);
+        g_clear_error(&err);
+        g_rmdir(directory);
+        g_free(directory);
+        return -1;
+    }
+
+    // Keep the last report line the child managed to write before it died.
+    FILE *reports = fdopen(output, "r");
+    gint64 deadline = g_get_monotonic_time() + seconds * G_USEC_PER_SEC;
+    guint64 frames = 0, bytes = 0, countedFrames = 0;
+    gint64 maxGapUs = 0;
+    guint closed = 0, counted = 0;
+    gint64 startedAt = g_get_monotonic_time();
+    char line[256];
+    while (g_get_monotonic_time() < deadline && fgets(line, sizeof(line), reports))
+    {
+        const char *report = strstr(line, "report ");
+        if (report)
+        {
+            sscanf(report, "report %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT " %u %u %" G_GUINT64_FORMAT,
+                   &frames, &bytes, &maxGapUs, &closed, &counted, &countedFrames);
+        }
+    }
+    gdouble recorded = (g_get_monotonic_time() - startedAt) / 1e6;
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    g_spawn_close_pid(child);
+    fclose(reports);
+
+    g_print("\nRecorded %.1f s: %" G_GUINT64_FORMAT " frames (%.1f fps), %.1f MiB (%.2f MiB/s), longest frame gap %.1f ms, %u segments closed",
+            recorded, frames, frames / recorded, bytes / 1048576.0, bytes / 1048576.0 / recorded, maxGapUs / 1000.0, closed);
+
+    // Check every segment the child left behind.
+    GstDiscoverer *discoverer = gst_discoverer_new(10 * GST_SECOND, &err);
+    if (!discoverer)
+    {
+        gst_printerr("\nFailed to create the discoverer: %s", err->message);
+        g_clear_error(&err);
+        return -1;
+    }
+
+    std::vector<std::string> names;
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    const gchar *name;
+    while (dir && (name = g_dir_read_name(dir)))
+    {
+        names.push_back(name);
+    }
+    if (dir)
+        g_dir_close(dir);
+    std::sort(names.begin(), names.end());
+
+    guint playable = 0;
+    gboolean earlierLost = FALSE, lastLost = FALSE;
+    GstClockTime recovered = 0;
+    gint64 writtenFrames = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const std::string &entry = names[i];
+        gchar *location = g_build_filename(directory, entry.c_str(), NULL);
+        GstClockTime duration = playableDuration(discoverer, location);
+        if (GST_CLOCK_TIME_IS_VALID(duration))
+        {
+            playable++;
+            recovered += duration;
+        }
+        else if (i + 1 < names.size())
+        {
+            earlierLost = TRUE;
+        }
+        else
+        {
+            lastLost = TRUE;
+        }
+        g_print("\n  %s: %s", entry.c_str(), GST_CLOCK_TIME_IS_VALID(duration) ? "playable" : "NOT playable");
+        if (GST_CLOCK_TIME_IS_VALID(duration))
+            g_print(" (%" GST_TIME_FORMAT ")", GST_TIME_ARGS(duration));
+        if (i < counted)
+        {
+            gint64 segmentFrames = countFrames(location);
+            writtenFrames = writtenFrames < 0 || segmentFrames < 0 ? -1 : writtenFrames + segmentFrames;
+            g_print(", %" G_GINT64_FORMAT " frames", segmentFrames);
+        }
+        if (!keep)
+            g_remove(location);
+        g_free(location);
+    }
+    g_object_unref(discoverer);
+    if (!keep)
+        g_rmdir(directory);
+    else
+        g_print("\nSegments kept in %s", directory);
+
+    // Only the last segment may be lost, and not even that one with fragments. The closed segments must hold every
+    // frame pushed into them; without a rollover before the kill there is nothing to check.
+    gboolean framesKept = counted > 0 && writtenFrames == (gint64)countedFrames;
+    gboolean passed = names.size() > 0 && !earlierLost && !(lastLost && fragmentMs > 0) && framesKept;
+    g_print("\n%u of %u segments playable, %.1f of %.1f s recovered, %" G_GINT64_FORMAT " of %" G_GUINT64_FORMAT
+            " frames in the first %u segments: %s\n",
+            playable, (guint)names.size(), recovered / (gdouble)GST_SECOND, recorded, writtenFrames, countedFrames,
+            counted, passed ? "PASS" : "FAIL");
+
+    g_free(directory);
+    return passed ? 0 : -1;
+}
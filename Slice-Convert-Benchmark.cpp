@@ -0,0 +1,164 @@
+/*!
+ * @brief Frames per second of Slice-Convert.h against thread count at 1080p and 2160p, with videoconvert (and
+ * videoscale) as the single-threaded baseline, and a check that the output doesn't depend on the slice count.
+ * @note Usage:- ./Slice-Convert-Benchmark.o [--frames=N] [--max-threads=N]
+ * @link https://gstreamer.freedesktop.org/documentation/videoconvertscale/videoconvert.html?gi-language=c
+ *
+ * Every run is videotestsrc pattern=snow ! <from> ! <stage> ! <to> ! fakesink, for three operations:
+ *   convert            YUY2 -> I420 at the same size (the 06/AV-Multi-Threading capture step)
+ *   convert+scale      YUY2 -> I420 at half the size
+ *   convert-converter  I420 -> BGRx at the same size, through the per-slice GstVideoConverter fallback
+ * The stage is timed with pad probes (Stage-Timer.h), from its first sink pad to its last src pad, so the cost of
+ * generating 4K test frames in videotestsrc doesn't count. sliceconvert runs with 1, 2, 4, ... threads up to --max-threads (default:
+ * the number of cores) and with n-threads=0 (auto). One JSON line per run.
+ * The first frame of every sliceconvert run is compared with the one n-threads=1 (a single slice) produced. The
+ * kernels and the scaler must match it byte for byte; the fallback may not (see Slice-Convert.h), its differing
+ * bytes are only reported.
+ */
+
+#include <gst/gst.h>
+#include "Slice-Convert.h"
+#include "Stage-Timer.h"
+
+typedef struct
+{
+    const gchar *name, *from, *to;
+    gint divisor;
+    // Whether the output must not depend on the slice count.
+    gboolean exact;
+} Operation;
+
+static gint frames = 60;
+static gint maxThreads = 0;
+
+static GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &frames, "Frames per run", "N"},
+    {"max-threads", 't', 0, G_OPTION_ARG_INT, &maxThreads, "Highest thread count to try (default: cores)", "N"},
+    {NULL}};
+
+// The pool goes away in READY, so its counter is read right after EOS.
+static void readSteals(GstElement *first, GstElement *last, guint64 *steals)
+{
+    SliceConvert *slicer = (SliceConvert *)first;
+    *steals = slicer->pool ? slicer->pool->steals.load() : 0;
+}
+
+/*!
+ * @brief stage is a pipeline fragment as in Stage-Timer.h.
+ * Returns the stage's frames per second, or a negative value on failure. firstFrame (may be NULL) receives the first
+ * output buffer, to be unreffed by the caller.
+ */
+static gdouble runStage(const gchar *stage, const Operation *operation, gint width, gint height, guint64 *steals,
+                        GstBuffer **firstFrame)
+{
+    gchar *description = g_strdup_printf(
+        "videotestsrc num-buffers=%d pattern=snow ! video/x-raw,format=%s,width=%d,height=%d,framerate=30/1 ! "
+        "%s ! video/x-raw,format=%s,width=%d,height=%d ! fakesink",
+        frames, operation->from, width, height, stage, operation->to, width / operation->divisor,
+        height / operation->divisor);
+    StageTimer timer;
+    gboolean ok = stageTimerRun(description, &timer, NULL, steals ? (StageCallback)readSteals : NULL, steals);
+    g_free(description);
+
+    if (firstFrame)
+    {
+        *firstFrame = timer.firstBuffer;
+        timer.firstBuffer = NULL;
+    }
+    stageTimerClear(&timer);
+    return ok ? timer.frames * 1e6 / timer.busyUs : -1;
+}
+
+/*!
+ * @brief Number of differing bytes. Both buffers come from the same caps, so the layouts are the same.
+ */
+static guint64 compareBuffers(GstBuffer *a, GstBuffer *b)
+{
+    GstMapInfo mapA, mapB;
+    if (!a || !b || !gst_buffer_map(a, &mapA, GST_MAP_READ))
+    {
+        return G_MAXUINT64;
+    }
+    if (!gst_buffer_map(b, &mapB, GST_MAP_READ))
+    {
+        gst_buffer_unmap(a, &mapA);
+        return G_MAXUINT64;
+    }
+    guint64 differences = mapA.size == mapB.size ? 0 : G_MAXUINT64;
+    for (gsize i = 0; differences != G_MAXUINT64 && i < mapA.size; i++)
+    {
+        differences += mapA.data[i] != mapB.data[i];
+    }
+    gst_buffer_unmap(a, &mapA);
+    gst_buffer_unmap(b, &mapB);
+    return differences;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- sliceconvert fps against thread count");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    sliceConvertRegister();
+    if (maxThreads <= 0)
+        maxThreads = g_get_num_processors();
+
+    const gint sizes[][2] = {{1920, 1080}, {3840, 2160}};
+    const Operation operations[] = {{"convert", "YUY2", "I420", 1, TRUE},
+                                    {"convert+scale", "YUY2", "I420", 2, TRUE},
+                                    {"convert-converter", "I420", "BGRx", 1, FALSE}};
+    gboolean passed = TRUE;
+
+    for (const auto &size : sizes)
+    {
+        for (const Operation &operation : operations)
+        {
+            const gchar *baseline = operation.divisor == 1 ? "videoconvert name=first ! identity name=last"
+                                                           : "videoconvert name=first ! videoscale name=last";
+            gdouble baselineFps = runStage(baseline, &operation, size[0], size[1], NULL, NULL);
+            GstBuffer *singleSlice = NULL;
+            g_print("{\"size\": \"%dx%d\", \"operation\": \"%s\", \"element\": \"videoconvert\", \"threads\": 1, "
+                    "\"fps\": %.1f}\n",
+                    size[0], size[1], operation.name, baselineFps);
+
+            // 1, 2, 4, ..., maxThreads, then 0 for the automatic choice.
+            for (gint threads = 1;; threads = threads >= maxThreads ? 0 : MIN(threads * 2, maxThreads))
+            {
+                gchar *stage = g_strdup_printf("sliceconvert name=first n-threads=%d ! identity name=last", threads);
+                guint64 steals = 0;
+                GstBuffer *frame = NULL;
+                gdouble fps = runStage(stage, &operation, size[0], size[1], &steals, &frame);
+                g_free(stage);
+                // n-threads=1 runs first and is the single-slice reference.
+                if (threads == 1)
+                    singleSlice = frame ? gst_buffer_ref(frame) : NULL;
+                guint64 differences = compareBuffers(singleSlice, frame);
+                if (frame)
+                    gst_buffer_unref(frame);
+                passed = passed && fps > 0 && (differences == 0 || !operation.exact);
+                g_print("{\"size\": \"%dx%d\", \"operation\": \"%s\", \"element\": \"sliceconvert\", \"threads\": %d, "
+                        "\"fps\": %.1f, \"speedup\": %.2f, \"steals_per_frame\": %.1f, "
+                        "\"differing_bytes\": %" G_GINT64_FORMAT "}\n",
+                        size[0], size[1], operation.name, threads, fps, baselineFps > 0 ? fps / baselineFps : 0.0,
+                        (gdouble)steals / frames, differences == G_MAXUINT64 ? (gint64)-1 : (gint64)differences);
+                if (threads == 0)
+                    break;
+            }
+            if (singleSlice)
+                gst_buffer_unref(singleSlice);
+        }
+    }
+
+    g_print("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : -1;
+}
@@ -0,0 +1,475 @@
+/*!
+ * @brief sliceconvert: a colorspace conversion + bilinear scaling GstVideoFilter that splits every frame into
+ * horizontal slices and runs them on a Slice-Pool.h work-stealing pool.
+ * @link https://gstreamer.freedesktop.org/documentation/video/video-converter.html?gi-language=c
+ *
+ * At 4K a single-threaded videoconvert (and videoscale) in front of a multi-threaded x264enc limits the frame rate.
+ * Here a frame goes through up to two passes, each cut into slices of even row ranges:
+ * 1. conversion to the output format at the input size, with the Yuy2-Convert.h kernels for YUY2 <-> I420/NV12 and
+ *    one GstVideoConverter per slice (restricted to the slice's rows with the SRC_Y/DEST_Y options) otherwise.
+ *    The kernels work on row pairs that never straddle a slice, so their output doesn't depend on the slice count.
+ *    The GstVideoConverter fallback does: each converter only sees its slice, so vertical chroma resampling (from
+ *    4:2:0 sources) and dithering restart at every slice edge and the rows next to it can differ from a single-slice
+ *    convert by a few levels. Use videoconvert where that matters.
+ * 2. bilinear scaling to the output size, per component, when the sizes differ. Every output row only reads the
+ *    intermediate frame, so slices don't depend on each other and the result doesn't depend on the slice count.
+ * Scaling needs a planar 8-bit output format (I420, YV12, NV12, Y42B, Y444, GRAY8).
+ *
+ * The pool lives as long as the element and is only rebuilt when the thread count changes. n-threads=0 picks one
+ * thread per 256K output pixels, at most one per core, so 320x240 stays on the streaming thread.
+ * Call sliceConvertRegister() once after gst_init().
+ */
+
+#ifndef SLICE_CONVERT_H
+#define SLICE_CONVERT_H
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include "Slice-Pool.h"
+#include "Yuy2-Convert.h"
+
+#define SLICE_CONVERT_FORMATS "{ I420, NV12, YV12, YUY2, UYVY, Y42B, Y444, GRAY8, RGBx, BGRx, xRGB, xBGR, RGBA, BGRA, RGB, BGR }"
+// One thread per this many output pixels with n-threads=0.
+#define SLICE_CONVERT_PIXELS_PER_THREAD (256 * 1024)
+// Slices per thread, so that stealing can even out slow slices.
+#define SLICE_CONVERT_SLICES_PER_THREAD 4
+#define SLICE_CONVERT_MIN_SLICE_ROWS 16
+
+// Bilinear tables for one component: source byte offsets of the two taps, the weight of the right one (0..255) and
+// the destination byte offset, per output pixel.
+typedef struct
+{
+    guint plane;
+    gint width, height, srcWidth, srcHeight;
+    gint *left, *right, *weight, *destination;
+} ScaleComponent;
+
+typedef struct
+{
+    GstVideoFilter parent;
+    guint nThreads;
+
+    SlicePool *pool;
+    gboolean convert, scale;
+    const Yuy2Kernels *kernels;
+    GPtrArray *converters; // GstVideoConverter per conversion slice when kernels is NULL
+    guint convertSlices, scaleSlices;
+    GstVideoInfo intermediateInfo;
+    GstBuffer *intermediate;
+    ScaleComponent components[GST_VIDEO_MAX_COMPONENTS];
+    guint nComponents;
+} SliceConvert;
+
+typedef struct
+{
+    GstVideoFilterClass parentClass;
+} SliceConvertClass;
+
+typedef struct
+{
+    SliceConvert *self;
+    GstVideoFrame *in, *out;
+    gint rows;
+} SliceJob;
+
+enum
+{
+    SLICE_CONVERT_PROP_0,
+    SLICE_CONVERT_PROP_N_THREADS
+};
+
+G_DEFINE_TYPE(SliceConvert, slice_convert, GST_TYPE_VIDEO_FILTER)
+
+/* ======= Slices ==========*/
+
+/*!
+ * @brief Row range [from, to) of slice out of nSlices over rows rows. Slices start on even rows for 4:2:0 chroma.
+ */
+static void sliceRows(gint rows, guint nSlices, guint slice, gint *from, gint *to)
+{
+    *from = (gint)((gint64)rows * slice / nSlices) & ~1;
+    *to = slice + 1 == nSlices ? rows : (gint)((gint64)rows * (slice + 1) / nSlices) & ~1;
+}
+
+static guint sliceCount(guint nThreads, gint rows)
+{
+    if (nThreads <= 1)
+        return 1;
+    return CLAMP(nThreads * SLICE_CONVERT_SLICES_PER_THREAD, 1, (guint)MAX(rows / SLICE_CONVERT_MIN_SLICE_ROWS, 1));
+}
+
+static void sliceConvertPass(guint slice, SliceJob *job)
+{
+    SliceConvert *self = job->self;
+    gint from, to;
+    sliceRows(job->rows, self->convertSlices, slice, &from, &to);
+    if (self->kernels)
+        yuy2ConvertRows(self->kernels, job->in, job->out, from, to);
+    else
+        gst_video_converter_frame((GstVideoConverter *)g_ptr_array_index(self->converters, slice), job->in, job->out);
+}
+
+static void scaleComponentRows(const ScaleComponent *component, GstVideoFrame *in, GstVideoFrame *out, gint from, gint to)
+{
+    const guint8 *src = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(in, component->plane);
+    guint8 *dst = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(out, component->plane);
+    gint srcStride = GST_VIDEO_FRAME_PLANE_STRIDE(in, component->plane);
+    gint dstStride = GST_VIDEO_FRAME_PLANE_STRIDE(out, component->plane);
+
+    for (gint y = from; y < to; y++)
+    {
+        // Same mapping as the horizontal tables: pixel centres, clamped at the edges.
+        gint64 position = MAX(((gint64)(2 * y + 1) * component->srcHeight - component->height) * 256 / (2 * component->height), 0);
+        gint top = MIN((gint)(position >> 8), component->srcHeight - 1);
+        gint bottom = MIN(top + 1, component->srcHeight - 1);
+        gint fy = (gint)(position & 255);
+        const guint8 *rowTop = src + (gsize)top * srcStride;
+        const guint8 *rowBottom = src + (gsize)bottom * srcStride;
+        guint8 *row = dst + (gsize)y * dstStride;
+
+        for (gint x = 0; x < component->width; x++)
+        {
+            gint left = component->left[x], right = component->right[x], fx = component->weight[x];
+            gint upper = rowTop[left] * (256 - fx) + rowTop[right] * fx;
+            gint lower = rowBottom[left] * (256 - fx) + rowBottom[right] * fx;
+            row[component->destination[x]] = (guint8)((upper * (256 - fy) + lower * fy + 32768) >> 16);
+        }
+    }
+}
+
+static void sliceScalePass(guint slice, SliceJob *job)
+{
+    SliceConvert *self = job->self;
+    gint from, to;
+    sliceRows(job->rows, self->scaleSlices, slice, &from, &to);
+    for (guint c = 0; c < self->nComponents; c++)
+    {
+        const ScaleComponent *component = &self->components[c];
+        // Component rows of this slice, e.g. half of the luma rows for 4:2:0 chroma.
+        gint componentFrom = (gint)((gint64)from * component->height / job->rows);
+        gint componentTo = to == job->rows ? component->height : (gint)((gint64)to * component->height / job->rows);
+        scaleComponentRows(component, job->in, job->out, componentFrom, componentTo);
+    }
+}
+
+/* ======= Element ==========*/
+
+static gboolean sliceConvertScalable(GstVideoFormat format)
+{
+    switch (format)
+    {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_Y42B:
+    case GST_VIDEO_FORMAT_Y444:
+    case GST_VIDEO_FORMAT_GRAY8:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static guint sliceConvertAutoThreads(const GstVideoInfo *info)
+{
+    guint threads = (guint)((gint64)GST_VIDEO_INFO_WIDTH(info) * GST_VIDEO_INFO_HEIGHT(info) / SLICE_CONVERT_PIXELS_PER_THREAD);
+    return CLAMP(threads, 1, (guint)g_get_num_processors());
+}
+
+static void sliceConvertReset(SliceConvert *self)
+{
+    if (self->converters)
+    {
+        g_ptr_array_free(self->converters, TRUE);
+        self->converters = NULL;
+    }
+    gst_clear_buffer(&self->intermediate);
+    for (guint c = 0; c < self->nComponents; c++)
+    {
+        g_free(self->components[c].left);
+        g_free(self->components[c].right);
+        g_free(self->components[c].weight);
+        g_free(self->components[c].destination);
+    }
+    self->nComponents = 0;
+    self->kernels = NULL;
+    self->convert = self->scale = FALSE;
+}
+
+/*!
+ * @brief Tables for scaling one component from the intermediate (input size) to the output size.
+ */
+static void sliceConvertBuildComponent(ScaleComponent *component, guint c, const GstVideoInfo *from, const GstVideoInfo *to)
+{
+    gint pstride = GST_VIDEO_INFO_COMP_PSTRIDE(to, c);
+    gint poffset = GST_VIDEO_INFO_COMP_POFFSET(to, c);
+    component->plane = GST_VIDEO_INFO_COMP_PLANE(to, c);
+    component->width = GST_VIDEO_INFO_COMP_WIDTH(to, c);
+    component->height = GST_VIDEO_INFO_COMP_HEIGHT(to, c);
+    component->srcWidth = GST_VIDEO_INFO_COMP_WIDTH(from, c);
+    component->srcHeight = GST_VIDEO_INFO_COMP_HEIGHT(from, c);
+    component->left = g_new(gint, component->width);
+    component->right = g_new(gint, component->width);
+    component->weight = g_new(gint, component->width);
+    component->destination = g_new(gint, component->width);
+
+    for (gint x = 0; x < component->width; x++)
+    {
+        gint64 position = MAX(((gint64)(2 * x + 1) * component->srcWidth - component->width) * 256 / (2 * component->width), 0);
+        gint left = MIN((gint)(position >> 8), component->srcWidth - 1);
+        component->left[x] = left * pstride + poffset;
+        component->right[x] = MIN(left + 1, component->srcWidth - 1) * pstride + poffset;
+        component->weight[x] = (gint)(position & 255);
+        component->destination[x] = x * pstride + poffset;
+    }
+}
+
+static gboolean sliceConvertSetInfo(GstVideoFilter *filter, GstCaps *incaps, GstVideoInfo *inInfo, GstCaps *outcaps,
+                                    GstVideoInfo *outInfo)
+{
+    SliceConvert *self = (SliceConvert *)filter;
+    sliceConvertReset(self);
+
+    self->scale = GST_VIDEO_INFO_WIDTH(inInfo) != GST_VIDEO_INFO_WIDTH(outInfo) ||
+                  GST_VIDEO_INFO_HEIGHT(inInfo) != GST_VIDEO_INFO_HEIGHT(outInfo);
+    if (self->scale && !sliceConvertScalable(GST_VIDEO_INFO_FORMAT(outInfo)))
+    {
+        GST_ERROR_OBJECT(self, "can only scale to planar 8-bit formats, not %s",
+                         gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(outInfo)));
+        return FALSE;
+    }
+
+    // Pass 1 writes the output format at the input size: the output frame itself, or the intermediate when scaling.
+    gst_video_info_set_format(&self->intermediateInfo, GST_VIDEO_INFO_FORMAT(outInfo), GST_VIDEO_INFO_WIDTH(inInfo),
+                              GST_VIDEO_INFO_HEIGHT(inInfo));
+    self->convert = GST_VIDEO_INFO_FORMAT(inInfo) != GST_VIDEO_INFO_FORMAT(outInfo);
+
+    guint nThreads = self->nThreads ? self->nThreads : sliceConvertAutoThreads(outInfo);
+    if (!self->pool || self->pool->nThreads != nThreads)
+    {
+        if (self->pool)
+            slicePoolFree(self->pool);
+        self->pool = slicePoolNew(nThreads);
+    }
+    self->convertSlices = sliceCount(nThreads, GST_VIDEO_INFO_HEIGHT(inInfo));
+    self->scaleSlices = sliceCount(nThreads, GST_VIDEO_INFO_HEIGHT(outInfo));
+
+    if (self->convert && yuy2ConvertSupports(GST_VIDEO_INFO_FORMAT(inInfo), GST_VIDEO_INFO_FORMAT(outInfo)))
+    {
+        self->kernels = yuy2KernelsFind(NULL);
+    }
+    else if (self->convert)
+    {
+        GstVideoInfo *target = self->scale ? &self->intermediateInfo : outInfo;
+        self->converters = g_ptr_array_new_with_free_func((GDestroyNotify)gst_video_converter_free);
+        for (guint slice = 0; slice < self->convertSlices; slice++)
+        {
+            gint from, to;
+            sliceRows(GST_VIDEO_INFO_HEIGHT(inInfo), self->convertSlices, slice, &from, &to);
+            GstStructure *config = gst_structure_new("GstVideoConverter",
+                                                     GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, from,
+                                                     GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, to - from,
+                                                     GST_VIDEO_CONVERTER_OPT_DEST_Y, G_TYPE_INT, from,
+                                                     GST_VIDEO_CONVERTER_OPT_DEST_HEIGHT, G_TYPE_INT, to - from,
+                                                     GST_VIDEO_CONVERTER_OPT_FILL_BORDER, G_TYPE_BOOLEAN, FALSE,
+                                                     GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, 1,
+                                                     NULL);
+            GstVideoConverter *converter = gst_video_converter_new(inInfo, target, config);
+            if (!converter)
+            {
+                GST_ERROR_OBJECT(self, "no converter from %s to %s", gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(inInfo)),
+                                 gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(target)));
+                return FALSE;
+            }
+            g_ptr_array_add(self->converters, converter);
+        }
+    }
+
+    if (self->scale)
+    {
+        if (self->convert)
+        {
+            self->intermediate = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&self->intermediateInfo), NULL);
+        }
+        self->nComponents = GST_VIDEO_INFO_N_COMPONENTS(outInfo);
+        for (guint c = 0; c < self->nComponents; c++)
+        {
+            sliceConvertBuildComponent(&self->components[c], c, &self->intermediateInfo, outInfo);
+        }
+    }
+    GST_INFO_OBJECT(self, "%u threads, %u conversion slices (%s), %u scaling slices", nThreads, self->convertSlices,
+                    self->kernels ? self->kernels->name : "GstVideoConverter", self->scale ? self->scaleSlices : 0);
+    return TRUE;
+}
+
+static GstFlowReturn sliceConvertTransformFrame(GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+    SliceConvert *self = (SliceConvert *)filter;
+    SliceJob job = {self, in, out, GST_VIDEO_FRAME_HEIGHT(in)};
+    if (!self->scale)
+    {
+        slicePoolRun(self->pool, self->convertSlices, (SliceFunc)sliceConvertPass, &job);
+        return GST_FLOW_OK;
+    }
+
+    GstVideoFrame intermediate;
+    if (self->convert)
+    {
+        if (!gst_video_frame_map(&intermediate, &self->intermediateInfo, self->intermediate, GST_MAP_READWRITE))
+        {
+            return GST_FLOW_ERROR;
+        }
+        job.out = &intermediate;
+        slicePoolRun(self->pool, self->convertSlices, (SliceFunc)sliceConvertPass, &job);
+        job.in = &intermediate;
+        job.out = out;
+    }
+    job.rows = GST_VIDEO_FRAME_HEIGHT(out);
+    slicePoolRun(self->pool, self->scaleSlices, (SliceFunc)sliceScalePass, &job);
+    if (self->convert)
+    {
+        gst_video_frame_unmap(&intermediate);
+    }
+    return GST_FLOW_OK;
+}
+
+/*!
+ * @brief Any supported format and size on the other side; fixation below prefers the input's.
+ */
+static GstCaps *sliceConvertTransformCaps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps,
+                                          GstCaps *filter)
+{
+    GstCaps *result = gst_caps_new_empty();
+    for (guint i = 0; i < gst_caps_get_size(caps); i++)
+    {
+        GstStructure *structure = gst_structure_copy(gst_caps_get_structure(caps, i));
+        gst_structure_remove_fields(structure, "format", "colorimetry", "chroma-site", "width", "height", NULL);
+        result = gst_caps_merge_structure(result, structure);
+    }
+    GstCaps *templateCaps = gst_pad_get_pad_template_caps(direction == GST_PAD_SINK ? GST_BASE_TRANSFORM_SRC_PAD(trans)
+                                                                                    : GST_BASE_TRANSFORM_SINK_PAD(trans));
+    GstCaps *intersection = gst_caps_intersect(templateCaps, result);
+    gst_caps_unref(templateCaps);
+    gst_caps_unref(result);
+    result = intersection;
+
+    if (filter)
+    {
+        intersection = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(result);
+        result = intersection;
+    }
+    return result;
+}
+
+static GstCaps *sliceConvertFixateCaps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, GstCaps *othercaps)
+{
+    othercaps = gst_caps_truncate(othercaps);
+    othercaps = gst_caps_make_writable(othercaps);
+    GstStructure *from = gst_caps_get_structure(caps, 0);
+    GstStructure *to = gst_caps_get_structure(othercaps, 0);
+    gint width, height;
+    const gchar *format = gst_structure_get_string(from, "format");
+
+    if (gst_structure_get_int(from, "width", &width))
+        gst_structure_fixate_field_nearest_int(to, "width", width);
+    if (gst_structure_get_int(from, "height", &height))
+        gst_structure_fixate_field_nearest_int(to, "height", height);
+    if (format)
+        gst_structure_fixate_field_string(to, "format", format);
+    return gst_caps_fixate(othercaps);
+}
+
+static void sliceConvertSetProperty(GObject *object, guint id, const GValue *value, GParamSpec *spec)
+{
+    SliceConvert *self = (SliceConvert *)object;
+    if (id != SLICE_CONVERT_PROP_N_THREADS)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    // Takes effect at the next caps.
+    self->nThreads = g_value_get_uint(value);
+}
+
+static void sliceConvertGetProperty(GObject *object, guint id, GValue *value, GParamSpec *spec)
+{
+    SliceConvert *self = (SliceConvert *)object;
+    if (id != SLICE_CONVERT_PROP_N_THREADS)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    g_value_set_uint(value, self->nThreads);
+}
+
+static gboolean sliceConvertStop(GstBaseTransform *trans)
+{
+    SliceConvert *self = (SliceConvert *)trans;
+    sliceConvertReset(self);
+    if (self->pool)
+    {
+        slicePoolFree(self->pool);
+        self->pool = NULL;
+    }
+    return TRUE;
+}
+
+static void sliceConvertFinalize(GObject *object)
+{
+    sliceConvertStop(GST_BASE_TRANSFORM(object));
+    G_OBJECT_CLASS(slice_convert_parent_class)->finalize(object);
+}
+
+static void slice_convert_class_init(SliceConvertClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass *transformClass = GST_BASE_TRANSFORM_CLASS(klass);
+    GstVideoFilterClass *filterClass = GST_VIDEO_FILTER_CLASS(klass);
+
+    objectClass->set_property = sliceConvertSetProperty;
+    objectClass->get_property = sliceConvertGetProperty;
+    objectClass->finalize = sliceConvertFinalize;
+    g_object_class_install_property(
+        objectClass, SLICE_CONVERT_PROP_N_THREADS,
+        g_param_spec_uint("n-threads", "Threads", "Worker threads including the streaming thread (0 = by frame size and cores)",
+                          0, 256, 0, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    GstCaps *caps = gst_caps_from_string(GST_VIDEO_CAPS_MAKE(SLICE_CONVERT_FORMATS));
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    gst_element_class_set_static_metadata(elementClass, "Slice-parallel converter", "Filter/Converter/Video/Scaler",
+                                          "Converts and scales video in parallel horizontal slices",
+                                          "GStreamer Exercises");
+
+    transformClass->transform_caps = sliceConvertTransformCaps;
+    transformClass->fixate_caps = sliceConvertFixateCaps;
+    transformClass->stop = sliceConvertStop;
+    transformClass->passthrough_on_same_caps = TRUE;
+    filterClass->set_info = sliceConvertSetInfo;
+    filterClass->transform_frame = sliceConvertTransformFrame;
+}
+
+static void slice_convert_init(SliceConvert *self)
+{
+    self->nThreads = 0;
+    self->pool = NULL;
+    self->converters = NULL;
+    self->intermediate = NULL;
+    self->nComponents = 0;
+    self->kernels = NULL;
+    self->convert = self->scale = FALSE;
+}
+
+/*!
+ * @brief Makes "sliceconvert" available to gst_element_factory_make() and gst_parse_launch() in this process.
+ */
+static gboolean sliceConvertRegister()
+{
+    return gst_element_register(NULL, "sliceconvert", GST_RANK_NONE, slice_convert_get_type());
+}
+
+#endif // SLICE_CONVERT_H
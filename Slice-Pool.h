@@ -0,0 +1,190 @@
+/*!
+ * @brief SlicePool: a persistent work-stealing thread pool for cutting one frame into slices and processing them in
+ * parallel from a streaming thread.
+ *
+ * The threads are created once and sleep on a condition variable between frames, so a frame costs one wake-up
+ * instead of a thread creation per slice. slicePoolRun() deals the slices round-robin into one deque per thread
+ * (the calling streaming thread takes part as thread 0). Every thread works from the front of its own deque and,
+ * once that is empty, steals from the back of the others. Slices that take longer than the rest (e.g. a busy
+ * region, or a thread that got preempted) are therefore picked up by whoever is idle.
+ * slicePoolRun() returns when all slices are done.
+ */
+
+#ifndef SLICE_POOL_H
+#define SLICE_POOL_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*SliceFunc)(guint slice, gpointer userData);
+
+typedef struct
+{
+    SliceFunc func;
+    gpointer userData;
+    guint slice;
+} SliceTask;
+
+typedef struct
+{
+    std::mutex lock;
+    std::deque<SliceTask> tasks;
+} SliceQueue;
+
+typedef struct
+{
+    guint nThreads; // Including the caller of slicePoolRun().
+    std::vector<std::thread> workers;
+    SliceQueue *queues;
+
+    std::mutex lock;
+    std::condition_variable wake, done;
+    guint64 generation;
+    guint remaining;
+    gboolean quit;
+
+    std::atomic<guint64> steals;
+} SlicePool;
+
+static gboolean slicePoolTake(SlicePool *pool, guint self, SliceTask *task)
+{
+    for (guint i = 0; i < pool->nThreads; i++)
+    {
+        SliceQueue *queue = &pool->queues[(self + i) % pool->nThreads];
+        std::lock_guard<std::mutex> guard(queue->lock);
+        if (queue->tasks.empty())
+        {
+            continue;
+        }
+        // Own work from the front, stolen work from the back.
+        if (i == 0)
+        {
+            *task = queue->tasks.front();
+            queue->tasks.pop_front();
+        }
+        else
+        {
+            *task = queue->tasks.back();
+            queue->tasks.pop_back();
+            pool->steals++;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void slicePoolWork(SlicePool *pool, guint self)
+{
+    SliceTask task;
+    guint finished = 0;
+    while (slicePoolTake(pool, self, &task))
+    {
+        task.func(task.slice, task.userData);
+        finished++;
+    }
+    if (finished)
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->remaining -= finished;
+        if (pool->remaining == 0)
+        {
+            pool->done.notify_all();
+        }
+    }
+}
+
+static void slicePoolWorker(SlicePool *pool, guint self)
+{
+    guint64 seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->wake.wait(guard, [&] { return pool->quit || pool->generation != seen; });
+            if (pool->quit)
+            {
+                return;
+            }
+            seen = pool->generation;
+        }
+        slicePoolWork(pool, self);
+    }
+}
+
+/*!
+ * @brief nThreads counts the caller, so 1 runs everything on the calling thread.
+ */
+static SlicePool *slicePoolNew(guint nThreads)
+{
+    SlicePool *pool = new SlicePool();
+    pool->nThreads = MAX(nThreads, 1);
+    pool->queues = new SliceQueue[pool->nThreads];
+    pool->generation = 0;
+    pool->remaining = 0;
+    pool->quit = FALSE;
+    pool->steals = 0;
+    for (guint i = 1; i < pool->nThreads; i++)
+    {
+        pool->workers.emplace_back(slicePoolWorker, pool, i);
+    }
+    return pool;
+}
+
+/*!
+ * @brief Calls func(slice, userData) for slice 0 .. nSlices - 1 on the pool and waits for all of them.
+ * Not reentrant: one caller at a time.
+ */
+static void slicePoolRun(SlicePool *pool, guint nSlices, SliceFunc func, gpointer userData)
+{
+    if (pool->nThreads == 1 || nSlices <= 1)
+    {
+        for (guint slice = 0; slice < nSlices; slice++)
+        {
+            func(slice, userData);
+        }
+        return;
+    }
+
+    // A worker still scanning from the last run may pick up a slice as soon as it is queued, so count first.
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->remaining = nSlices;
+    }
+    for (guint slice = 0; slice < nSlices; slice++)
+    {
+        SliceQueue *queue = &pool->queues[slice % pool->nThreads];
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->tasks.push_back({func, userData, slice});
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+
+    slicePoolWork(pool, 0);
+    std::unique_lock<std::mutex> guard(pool->lock);
+    pool->done.wait(guard, [&] { return pool->remaining == 0; });
+}
+
+static void slicePoolFree(SlicePool *pool)
+{
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->quit = TRUE;
+    }
+    pool->wake.notify_all();
+    for (std::thread &worker : pool->workers)
+    {
+        worker.join();
+    }
+    delete[] pool->queues;
+    delete pool;
+}
+
+#endif // SLICE_POOL_H
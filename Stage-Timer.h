@@ -0,0 +1,131 @@
+/*!
+ * @brief Times one stage of a benchmark pipeline with pad probes, from its first sink pad to its last src pad.
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/probes.html?gi-language=c
+ *
+ * The stage is a pipeline fragment whose first element is named "first" and last one "last" (the same element for a
+ * single-element stage), so whatever feeds or drains it (e.g. generating 4K test frames) doesn't count.
+ * Streams are expected to be serial through the stage: one buffer in, one buffer out.
+ * Used by Slice-Convert-Benchmark.cpp and Fused-Audio-Benchmark.cpp.
+ */
+
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+typedef struct
+{
+    gint64 enteredAt, busyUs;
+    guint64 buffers;
+    // Audio frames for audio/x-raw, otherwise one per buffer.
+    guint64 frames;
+    GstBuffer *firstBuffer;
+} StageTimer;
+
+// Called with the stage's first and last elements, before PLAYING and after EOS (before NULL) respectively.
+typedef void (*StageCallback)(GstElement *first, GstElement *last, gpointer userData);
+
+static GstPadProbeReturn stageTimerOnEnter(GstPad *pad, GstPadProbeInfo *info, StageTimer *timer)
+{
+    timer->enteredAt = g_get_monotonic_time();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn stageTimerOnLeave(GstPad *pad, GstPadProbeInfo *info, StageTimer *timer)
+{
+    timer->busyUs += g_get_monotonic_time() - timer->enteredAt;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (timer->buffers++ == 0)
+    {
+        timer->firstBuffer = gst_buffer_ref(buffer);
+    }
+
+    GstAudioInfo audioInfo;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (caps && gst_structure_has_name(gst_caps_get_structure(caps, 0), "audio/x-raw") &&
+        gst_audio_info_from_caps(&audioInfo, caps))
+        timer->frames += gst_buffer_get_size(buffer) / GST_AUDIO_INFO_BPF(&audioInfo);
+    else
+        timer->frames++;
+    if (caps)
+        gst_caps_unref(caps);
+    return GST_PAD_PROBE_OK;
+}
+
+static void stageTimerAddProbe(GstElement *element, const gchar *padName, GstPadProbeCallback callback,
+                               gpointer userData)
+{
+    GstPad *pad = gst_element_get_static_pad(element, padName);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, callback, userData, NULL);
+    gst_object_unref(pad);
+}
+
+/*!
+ * @brief Runs description (which contains the stage, see above) to EOS and fills timer. before and after may be NULL.
+ * Returns FALSE if the pipeline fails or no buffer came out of the stage. timer->firstBuffer, if any, is the caller's
+ * to unref (see stageTimerClear()).
+ */
+static gboolean stageTimerRun(const gchar *description, StageTimer *timer, StageCallback before, StageCallback after,
+                              gpointer userData)
+{
+    GError *err = NULL;
+    *timer = {0, 0, 0, 0, NULL};
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    GstElement *first = gst_bin_get_by_name(GST_BIN(pipeline), "first");
+    GstElement *last = gst_bin_get_by_name(GST_BIN(pipeline), "last");
+    if (!first || !last)
+    {
+        gst_printerr("\nNo element named first or last in: %s", description);
+        if (first)
+            gst_object_unref(first);
+        if (last)
+            gst_object_unref(last);
+        gst_object_unref(pipeline);
+        return FALSE;
+    }
+    stageTimerAddProbe(first, "sink", (GstPadProbeCallback)stageTimerOnEnter, timer);
+    stageTimerAddProbe(last, "src", (GstPadProbeCallback)stageTimerOnLeave, timer);
+    if (before)
+        before(first, last, userData);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok)
+    {
+        gst_message_parse_error(msg, &err, NULL);
+        gst_printerr("\n%s: %s", GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)), err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    if (after)
+        after(first, last, userData);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(first);
+    gst_object_unref(last);
+    gst_object_unref(pipeline);
+    return ok && timer->busyUs > 0;
+}
+
+static void stageTimerClear(StageTimer *timer)
+{
+    if (timer->firstBuffer)
+    {
+        gst_buffer_unref(timer->firstBuffer);
+        timer->firstBuffer = NULL;
+    }
+}
+
+#endif // STAGE_TIMER_H
@@ -0,0 +1,227 @@
+/*!
+ * @brief Plays every track of a multi-track file through Stream-Router.h and checks that none of them stalls.
+ * @note Usage:- ./Stream-Router.o [--max-audio=N] [--max-video=N] [--max-subtitle=N] [--sync] <file-or-uri>
+ *               ./Stream-Router.o --generate [--duration=SEC] (writes and checks a 2 video + 3 audio Matroska file)
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/dynamic-pipelines.html?gi-language=c
+ *
+ * uridecodebin exposes one pad per track. The router gives each wanted track a queue-backed branch and every other
+ * one a fakesink. A 500 ms timer watches the per-stream counters: if a routed stream that hasn't seen EOS goes
+ * --stall-timeout without a buffer, the run fails. At EOS every routed stream must have reached EOS and delivered
+ * (almost) the whole duration. Without --sync the branches don't sync, so the report shows how much faster than
+ * real time each track was decoded.
+ */
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include "Bus-Dispatcher.h"
+#include "Stream-Router.h"
+
+typedef struct
+{
+    GstElement *pipeline;
+    GMainLoop *mainLoop;
+    StreamRouter *router;
+    gboolean failed;
+} CustomData;
+
+static gint maxAudio = -1;
+static gint maxVideo = -1;
+static gint maxSubtitle = -1;
+static gboolean syncBranches = FALSE;
+static gboolean generate = FALSE;
+static gint durationSec = 5;
+static gint stallTimeoutMs = 2000;
+
+static GOptionEntry entries[] = {
+    {"max-audio", 0, 0, G_OPTION_ARG_INT, &maxAudio, "Audio streams to route (-1 = all)", "N"},
+    {"max-video", 0, 0, G_OPTION_ARG_INT, &maxVideo, "Video streams to route (-1 = all)", "N"},
+    {"max-subtitle", 0, 0, G_OPTION_ARG_INT, &maxSubtitle, "Subtitle streams to route (-1 = all)", "N"},
+    {"sync", 's', 0, G_OPTION_ARG_NONE, &syncBranches, "Routed branches sync to the clock (real-time playback)", NULL},
+    {"generate", 'g', 0, G_OPTION_ARG_NONE, &generate, "Generate a multi-track Matroska test file and check it", NULL},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &durationSec, "Duration of the generated file in seconds", "SEC"},
+    {"stall-timeout", 0, 0, G_OPTION_ARG_INT, &stallTimeoutMs, "A routed stream without buffers for this long fails", "MS"},
+    {NULL}};
+
+/*!
+ * @brief Raw I420 video and S16 audio, so the check only depends on matroskamux/matroskademux.
+ */
+static gboolean generateFile(const gchar *location)
+{
+    GError *err = NULL;
+    gint frames = durationSec * 30;
+    gchar *description = g_strdup_printf(
+        "matroskamux name=mux ! filesink location=%s "
+        "videotestsrc num-buffers=%d pattern=smpte ! video/x-raw,format=I420,width=320,height=240,framerate=30/1 ! mux. "
+        "videotestsrc num-buffers=%d pattern=ball ! video/x-raw,format=I420,width=160,height=120,framerate=30/1 ! mux. "
+        "audiotestsrc num-buffers=%d samplesperbuffer=1600 freq=440 ! audio/x-raw,format=S16LE,rate=48000,channels=2 ! mux. "
+        "audiotestsrc num-buffers=%d samplesperbuffer=1600 freq=660 ! audio/x-raw,format=S16LE,rate=48000,channels=2 ! mux. "
+        "audiotestsrc num-buffers=%d samplesperbuffer=1600 freq=880 ! audio/x-raw,format=S16LE,rate=48000,channels=1 ! mux.",
+        location, frames, frames, frames, frames, frames);
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    g_free(description);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the generator: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+static void onError(GstMessage *msg, CustomData *data)
+{
+    GError *err;
+    gchar *debug_info;
+
+    gst_message_parse_error(msg, &err, &debug_info);
+    gst_printerr("\nError Message: %s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
+    gst_printerr("\nDebug Message: \n %s", debug_info ? debug_info : "none");
+    g_clear_error(&err);
+    g_free(debug_info);
+    data->failed = TRUE;
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onEos(GstMessage *msg, CustomData *data)
+{
+    g_main_loop_quit(data->mainLoop);
+}
+
+static gboolean onWatchdog(CustomData *data)
+{
+    gint64 idle = streamRouterLongestIdle(data->router);
+    if (idle > stallTimeoutMs * 1000)
+    {
+        gst_printerr("\nA routed stream stalled for %.0f ms.", idle / 1000.0);
+        data->failed = TRUE;
+        g_main_loop_quit(data->mainLoop);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * @brief Every routed stream reached EOS and covered at least 95% of the duration.
+ */
+static gboolean checkStreams(CustomData *data, gint64 duration)
+{
+    gboolean ok = TRUE;
+    guint routed = 0;
+    std::lock_guard<std::mutex> guard(data->router->lock);
+    for (RoutedStream *stream : data->router->streams)
+    {
+        if (!stream->routed)
+        {
+            continue;
+        }
+        routed++;
+        GstClockTime covered = GST_CLOCK_TIME_IS_VALID(stream->firstPts) ? stream->lastEnd - stream->firstPts : 0;
+        if (!stream->eos || (duration > 0 && covered < duration * 0.95))
+        {
+            gst_printerr("\nStream %s only delivered %" GST_TIME_FORMAT "%s", stream->name.c_str(),
+                         GST_TIME_ARGS(covered), stream->eos ? "" : " and never reached EOS");
+            ok = FALSE;
+        }
+    }
+    return ok && routed > 0;
+}
+
+int main(int argc, char **argv)
+{
+    CustomData data;
+    GError *err = NULL;
+    gchar *generated = NULL;
+    gchar *uri = NULL;
+
+    GOptionContext *context = g_option_context_new("<file-or-uri> - route every stream of a file");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || (argc < 2 && !generate))
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing input file.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    if (generate)
+    {
+        generated = g_build_filename(g_get_tmp_dir(), "stream-router-test.mkv", NULL);
+        if (!generateFile(generated))
+        {
+            gst_printerr("\nFailed to generate %s", generated);
+            g_free(generated);
+            return -1;
+        }
+        uri = gst_filename_to_uri(generated, NULL);
+    }
+    else
+    {
+        uri = gst_uri_is_valid(argv[1]) ? g_strdup(argv[1]) : gst_filename_to_uri(argv[1], NULL);
+    }
+
+    StreamPolicy policy = streamPolicyDefault();
+    const gchar *branch = syncBranches ? "fakesink sync=true" : "fakesink sync=false";
+    policy.maxStreams[STREAM_KIND_AUDIO] = maxAudio;
+    policy.maxStreams[STREAM_KIND_VIDEO] = maxVideo;
+    policy.maxStreams[STREAM_KIND_SUBTITLE] = maxSubtitle;
+    policy.branch[STREAM_KIND_AUDIO] = branch;
+    policy.branch[STREAM_KIND_VIDEO] = branch;
+    policy.branch[STREAM_KIND_SUBTITLE] = branch;
+
+    data.failed = FALSE;
+    data.pipeline = gst_pipeline_new("router-pipeline");
+    GstElement *decoder = gst_element_factory_make("uridecodebin", "source");
+    gst_bin_add(GST_BIN(data.pipeline), decoder);
+    g_object_set(decoder, "uri", uri, NULL);
+    g_free(uri);
+    data.router = streamRouterAttach(decoder, GST_BIN(data.pipeline), &policy);
+
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    BusDispatcher *dispatcher = busDispatcherNew(data.pipeline, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, &data);
+    busDispatcherAddTimer(dispatcher, 500, (GSourceFunc)onWatchdog, &data);
+
+    gint64 start = g_get_monotonic_time();
+    if (gst_element_set_state(data.pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        gst_printerr("\nFailed to start the pipeline.");
+        data.failed = TRUE;
+    }
+    else
+    {
+        g_main_loop_run(data.mainLoop);
+    }
+    gdouble wall = (g_get_monotonic_time() - start) / 1e6;
+
+    gint64 duration = -1;
+    gst_element_query_duration(data.pipeline, GST_FORMAT_TIME, &duration);
+    gst_element_set_state(data.pipeline, GST_STATE_NULL);
+
+    g_print("\nStreams after %.2f s:", wall);
+    streamRouterPrint(data.router, wall);
+    gboolean passed = !data.failed && checkStreams(&data, duration);
+    g_print("\n%s\n", passed ? "PASS" : "FAIL");
+
+    busDispatcherFree(dispatcher);
+    g_main_loop_unref(data.mainLoop);
+    gst_object_unref(data.pipeline);
+    streamRouterFree(data.router);
+    if (generated)
+    {
+        g_remove(generated);
+        g_free(generated);
+    }
+    return passed ? 0 : -1;
+}
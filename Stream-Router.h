@@ -0,0 +1,264 @@
+/*!
+ * @brief Stream router for decodebin/uridecodebin pads. Every pad that appears gets a branch, so nothing stalls.
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/dynamic-pipelines.html?gi-language=c
+ *
+ * 03-Dynamic-Linking only links the first audio/x-raw pad. Every other pad stays unlinked, its pushes return
+ * NOT_LINKED and, depending on the demuxer, the whole file stalls or errors out.
+ *
+ * streamRouterAttach() handles pad-added instead. Each pad is classified as audio, video or subtitle by its caps.
+ * The policy decides how many streams of each kind are wanted and what their branch looks like (a bin description,
+ * always behind its own queue, so one slow branch can't starve the demuxer's other outputs). Pads over the limit,
+ * or of unknown kind, go to a fakesink that drops everything without syncing. A buffer probe on every branch keeps
+ * per-stream counters, which streamRouterPrint() reports.
+ */
+
+#ifndef STREAM_ROUTER_H
+#define STREAM_ROUTER_H
+
+#include <gst/gst.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef enum
+{
+    STREAM_KIND_AUDIO,
+    STREAM_KIND_VIDEO,
+    STREAM_KIND_SUBTITLE,
+    STREAM_KIND_OTHER,
+    STREAM_KIND_COUNT
+} StreamKind;
+
+typedef struct
+{
+    gint maxStreams[STREAM_KIND_COUNT]; // -1 = all; OTHER is always dropped
+    const gchar *branch[STREAM_KIND_COUNT]; // bin description after the queue, NULL = fakesink
+} StreamPolicy;
+
+typedef struct
+{
+    std::string name, caps;
+    StreamKind kind;
+    gboolean routed; // FALSE: dropped into a fakesink by policy
+    guint64 buffers, bytes;
+    GstClockTime firstPts, lastEnd;
+    // Also read by streamRouterLongestIdle() from other threads.
+    std::atomic<gint64> lastBufferAt; // monotonic us
+    std::atomic<gboolean> eos;
+} RoutedStream;
+
+typedef struct
+{
+    GstBin *pipeline;
+    StreamPolicy policy;
+    std::mutex lock;
+    std::vector<RoutedStream *> streams;
+    gint counts[STREAM_KIND_COUNT];
+    gboolean noMorePads;
+} StreamRouter;
+
+static const gchar *streamKindName(StreamKind kind)
+{
+    static const gchar *names[] = {"audio", "video", "subtitle", "other"};
+    return names[kind];
+}
+
+static StreamKind streamKindFromCaps(GstCaps *caps)
+{
+    const gchar *name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    if (g_str_has_prefix(name, "audio/"))
+        return STREAM_KIND_AUDIO;
+    if (g_str_has_prefix(name, "video/") || g_str_has_prefix(name, "image/"))
+        return STREAM_KIND_VIDEO;
+    if (g_str_has_prefix(name, "text/") || g_str_has_prefix(name, "subpicture/") ||
+        g_str_has_prefix(name, "application/x-ssa") || g_str_has_prefix(name, "application/x-ass") ||
+        g_str_has_prefix(name, "application/x-subtitle"))
+        return STREAM_KIND_SUBTITLE;
+    return STREAM_KIND_OTHER;
+}
+
+/*!
+ * @brief Policy that keeps every audio, video and subtitle stream and sends each to a non-syncing fakesink.
+ */
+static StreamPolicy streamPolicyDefault()
+{
+    StreamPolicy policy;
+    for (gint i = 0; i < STREAM_KIND_COUNT; i++)
+    {
+        policy.maxStreams[i] = i == STREAM_KIND_OTHER ? 0 : -1;
+        policy.branch[i] = NULL;
+    }
+    return policy;
+}
+
+static GstPadProbeReturn streamRouterOnData(GstPad *pad, GstPadProbeInfo *info, RoutedStream *stream)
+{
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS)
+        {
+            stream->eos = TRUE;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    stream->buffers++;
+    stream->bytes += gst_buffer_get_size(buffer);
+    stream->lastBufferAt = g_get_monotonic_time();
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        if (!GST_CLOCK_TIME_IS_VALID(stream->firstPts))
+        {
+            stream->firstPts = GST_BUFFER_PTS(buffer);
+        }
+        stream->lastEnd = GST_BUFFER_PTS(buffer) +
+                          (GST_BUFFER_DURATION_IS_VALID(buffer) ? GST_BUFFER_DURATION(buffer) : 0);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstElement *streamRouterMakeBranch(const gchar *description)
+{
+    GError *err = NULL;
+    gchar *full = description ? g_strdup_printf("queue ! %s", description)
+                              : g_strdup("fakesink sync=false async=false");
+    GstElement *branch = gst_parse_bin_from_description(full, TRUE, &err);
+    if (!branch)
+    {
+        gst_printerr("\nFailed to build branch \"%s\": %s", full, err->message);
+        g_clear_error(&err);
+    }
+    g_free(full);
+    return branch;
+}
+
+static void streamRouterOnPadAdded(GstElement *decoder, GstPad *newPad, StreamRouter *router)
+{
+    GstCaps *caps = gst_pad_get_current_caps(newPad);
+    if (!caps)
+    {
+        caps = gst_pad_query_caps(newPad, NULL);
+    }
+    gchar *capsString = gst_caps_to_string(caps);
+    StreamKind kind = streamKindFromCaps(caps);
+    gst_caps_unref(caps);
+
+    RoutedStream *stream = new RoutedStream();
+    stream->name = GST_PAD_NAME(newPad);
+    stream->caps = capsString;
+    stream->kind = kind;
+    stream->buffers = stream->bytes = 0;
+    stream->firstPts = stream->lastEnd = GST_CLOCK_TIME_NONE;
+    stream->lastBufferAt = g_get_monotonic_time();
+    stream->eos = FALSE;
+    g_free(capsString);
+
+    {
+        std::lock_guard<std::mutex> guard(router->lock);
+        gint max = router->policy.maxStreams[kind];
+        stream->routed = kind != STREAM_KIND_OTHER && (max < 0 || router->counts[kind] < max);
+        if (stream->routed)
+        {
+            router->counts[kind]++;
+        }
+        router->streams.push_back(stream);
+    }
+
+    GstElement *branch = streamRouterMakeBranch(stream->routed ? router->policy.branch[kind] : NULL);
+    if (!branch && stream->routed)
+    {
+        // A broken branch description must not stall the file either.
+        stream->routed = FALSE;
+        branch = streamRouterMakeBranch(NULL);
+    }
+    if (!branch)
+    {
+        return;
+    }
+
+    gst_bin_add(router->pipeline, branch);
+    gst_element_sync_state_with_parent(branch);
+
+    GstPad *sinkPad = gst_element_get_static_pad(branch, "sink");
+    gst_pad_add_probe(sinkPad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                      (GstPadProbeCallback)streamRouterOnData, stream, NULL);
+    if (GST_PAD_LINK_FAILED(gst_pad_link(newPad, sinkPad)))
+    {
+        gst_printerr("\nFailed to link %s (%s).", stream->name.c_str(), streamKindName(kind));
+    }
+    gst_object_unref(sinkPad);
+
+    g_print("\nStream %s: %s, %s", stream->name.c_str(), streamKindName(kind), stream->routed ? "routed" : "dropped");
+}
+
+static void streamRouterOnNoMorePads(GstElement *decoder, StreamRouter *router)
+{
+    router->noMorePads = TRUE;
+}
+
+/*!
+ * @brief Routes every pad decoder exposes into pipeline according to policy.
+ */
+static StreamRouter *streamRouterAttach(GstElement *decoder, GstBin *pipeline, const StreamPolicy *policy)
+{
+    StreamRouter *router = new StreamRouter();
+    router->pipeline = pipeline;
+    router->policy = *policy;
+    router->noMorePads = FALSE;
+    for (gint i = 0; i < STREAM_KIND_COUNT; i++)
+    {
+        router->counts[i] = 0;
+    }
+
+    g_signal_connect(decoder, "pad-added", G_CALLBACK(streamRouterOnPadAdded), router);
+    g_signal_connect(decoder, "no-more-pads", G_CALLBACK(streamRouterOnNoMorePads), router);
+    return router;
+}
+
+/*!
+ * @brief Longest time since any routed stream that hasn't reached EOS received a buffer, in us.
+ */
+static gint64 streamRouterLongestIdle(StreamRouter *router)
+{
+    std::lock_guard<std::mutex> guard(router->lock);
+    gint64 now = g_get_monotonic_time(), idle = 0;
+    for (RoutedStream *stream : router->streams)
+    {
+        if (stream->routed && !stream->eos)
+        {
+            idle = MAX(idle, now - stream->lastBufferAt);
+        }
+    }
+    return idle;
+}
+
+static void streamRouterPrint(StreamRouter *router, gdouble wallSeconds)
+{
+    std::lock_guard<std::mutex> guard(router->lock);
+    for (RoutedStream *stream : router->streams)
+    {
+        gdouble media = GST_CLOCK_TIME_IS_VALID(stream->firstPts)
+                            ? (stream->lastEnd - stream->firstPts) / (gdouble)GST_SECOND
+                            : 0.0;
+        g_print("\n  %-10s %-8s %-7s %8" G_GUINT64_FORMAT " buffers %10.1f KiB  %8.2f s media  %6.1fx real time%s",
+                stream->name.c_str(), streamKindName(stream->kind), stream->routed ? "routed" : "dropped",
+                stream->buffers, stream->bytes / 1024.0, media, wallSeconds > 0 ? media / wallSeconds : 0.0,
+                stream->eos ? "  eos" : "");
+    }
+}
+
+/*!
+ * @brief Free after the pipeline went to NULL: the probes still point at the streams.
+ */
+static void streamRouterFree(StreamRouter *router)
+{
+    for (RoutedStream *stream : router->streams)
+    {
+        delete stream;
+    }
+    delete router;
+}
+
+#endif // STREAM_ROUTER_H
@@ -0,0 +1,165 @@
+/*!
+ * @brief TeeBranch. Attaches and detaches tee branches while the pipeline keeps PLAYING, without pausing the main path.
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/probes.html?gi-language=c#dynamically-switching-an-element-in-a-playing-pipeline
+ *
+ * Adding:   the branch bin is added, brought to the pipeline's state, and only then linked to a new tee request pad.
+ * Removing: an IDLE probe on the tee pad unlinks it at a moment no buffer is in flight, then EOS is sent into the
+ *           branch so encoders/muxers drain. Once every sink of the branch has seen EOS, the bin is set to NULL,
+ *           removed and the tee pad released from the default main context, which must be running.
+ * Sinks of dynamic branches should use async=false so they don't make the running pipeline re-preroll.
+ *
+ * The removed callback given to teeBranchAdd() runs on the default main context once the branch is gone, with the
+ * time it took since teeBranchRemove(). The branch is freed right after it returns.
+ */
+
+#ifndef TEE_BRANCH_H
+#define TEE_BRANCH_H
+
+#include <gst/gst.h>
+
+// The branch has drained and left the pipeline. latencyUs: since teeBranchRemove().
+typedef void (*TeeBranchRemovedCallback)(gint64 latencyUs, gpointer userData);
+
+typedef struct
+{
+    GstElement *pipeline, *tee, *bin;
+    GstPad *teePad;
+    guint pendingSinks;
+    gint64 removeRequested;
+    gboolean removing;
+    TeeBranchRemovedCallback onRemoved;
+    gpointer userData;
+} TeeBranch;
+
+static gboolean teeBranchFinish(gpointer userData)
+{
+    TeeBranch *branch = (TeeBranch *)userData;
+    gst_element_set_state(branch->bin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(branch->pipeline), branch->bin);
+    gst_element_release_request_pad(branch->tee, branch->teePad);
+    gst_object_unref(branch->teePad);
+
+    if (branch->onRemoved)
+    {
+        branch->onRemoved(g_get_monotonic_time() - branch->removeRequested, branch->userData);
+    }
+    delete branch;
+    return G_SOURCE_REMOVE;
+}
+
+// Fired on a branch sink once EOS has made it through everything in front of it.
+static GstPadProbeReturn teeBranchOnEos(GstPad *pad, GstPadProbeInfo *info, TeeBranch *branch)
+{
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS)
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    if (g_atomic_int_dec_and_test((gint *)&branch->pendingSinks))
+    {
+        // State changes must not happen from a streaming thread of the branch itself.
+        g_idle_add(teeBranchFinish, branch);
+    }
+    return GST_PAD_PROBE_DROP;
+}
+
+/*!
+ * @brief Builds a branch from a gst-launch description and links it to a new tee request pad while PLAYING.
+ * onRemoved (may be NULL) is called with userData once the branch has been removed.
+ */
+static TeeBranch *teeBranchAdd(GstElement *pipeline, GstElement *tee, const gchar *description,
+                               TeeBranchRemovedCallback onRemoved, gpointer userData)
+{
+    GError *err = NULL;
+    GstElement *bin = gst_parse_bin_from_description(description, TRUE, &err);
+    if (!bin)
+    {
+        gst_printerr("\nFailed to build branch: %s", err ? err->message : "unknown");
+        g_clear_error(&err);
+        return NULL;
+    }
+    g_clear_error(&err);
+
+    TeeBranch *branch = new TeeBranch();
+    branch->pipeline = pipeline;
+    branch->tee = tee;
+    branch->bin = bin;
+    branch->pendingSinks = 0;
+    branch->removeRequested = 0;
+    branch->removing = FALSE;
+    branch->onRemoved = onRemoved;
+    branch->userData = userData;
+
+    // Watch for the EOS that marks the end of draining on every sink of the branch.
+    GstIterator *it = gst_bin_iterate_sinks(GST_BIN(bin));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+    {
+        GstPad *sinkPad = gst_element_get_static_pad(GST_ELEMENT(g_value_get_object(&item)), "sink");
+        if (sinkPad)
+        {
+            gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                              (GstPadProbeCallback)teeBranchOnEos, branch, NULL);
+            branch->pendingSinks++;
+            gst_object_unref(sinkPad);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    // Bring the branch up before linking, so the first buffer from the tee finds it ready.
+    gst_bin_add(GST_BIN(pipeline), bin);
+    gst_element_sync_state_with_parent(bin);
+
+    branch->teePad = gst_element_get_request_pad(tee, "src_%u");
+    GstPad *binPad = gst_element_get_static_pad(bin, "sink");
+    GstPadLinkReturn ret = gst_pad_link(branch->teePad, binPad);
+    gst_object_unref(binPad);
+
+    if (GST_PAD_LINK_FAILED(ret))
+    {
+        gst_printerr("\nFailed to link the branch.");
+        gst_element_release_request_pad(tee, branch->teePad);
+        gst_object_unref(branch->teePad);
+        gst_element_set_state(bin, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), bin);
+        delete branch;
+        return NULL;
+    }
+    return branch;
+}
+
+// Runs when the tee pad is idle: no buffer is being pushed on it right now.
+static GstPadProbeReturn teeBranchOnIdle(GstPad *teePad, GstPadProbeInfo *info, TeeBranch *branch)
+{
+    GstPad *binPad = gst_element_get_static_pad(branch->bin, "sink");
+    gst_pad_unlink(teePad, binPad);
+
+    if (branch->pendingSinks == 0)
+    {
+        g_idle_add(teeBranchFinish, branch);
+    }
+    else
+    {
+        // Drain whatever is queued in the branch (and let muxers finalize).
+        gst_pad_send_event(binPad, gst_event_new_eos());
+    }
+    gst_object_unref(binPad);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/*!
+ * @brief Detaches the branch. Returns immediately; the branch is freed once it has drained.
+ */
+static void teeBranchRemove(TeeBranch *branch)
+{
+    if (branch->removing)
+    {
+        return;
+    }
+    branch->removing = TRUE;
+    branch->removeRequested = g_get_monotonic_time();
+    gst_pad_add_probe(branch->teePad, GST_PAD_PROBE_TYPE_IDLE, (GstPadProbeCallback)teeBranchOnIdle, branch, NULL);
+}
+
+#endif // TEE_BRANCH_H
@@ -0,0 +1,391 @@
+/*!
+ * @brief Thumbnail / sprite-sheet extractor. Opens every file once and key-unit seeks to evenly spaced timestamps.
+ * @note Usage:- ./Thumbnail-Extractor.o [--count=N] [--width=PX] [--columns=N] [--png] [--jobs=N] [--naive]
+ *               [--output-dir=DIR] <file>...
+ * @link https://gstreamer.freedesktop.org/documentation/app/appsink.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/seeking.html?gi-language=c
+ *
+ * Per file: uridecodebin ! videoconvert ! videoscale ! video/x-raw,format=RGB,width=W ! appsink, kept in PAUSED.
+ * For each timestamp a FLUSH | KEY_UNIT seek prerolls exactly one frame: the demuxer starts at the keyframe and the
+ * decoder only decodes that one picture. It is pulled with gst_app_sink_try_pull_preroll() and copied into its cell
+ * of the sprite sheet. Audio and other streams go to a fakesink so the demuxer never sees not-linked.
+ *
+ * Files are spread over a pool of worker threads, one pipeline per file.
+ * The sheet is written as raw RGB (<name>.<W>x<H>.rgb) or, with --png, encoded through appsrc ! pngenc ! filesink.
+ * --naive decodes every frame in PLAYING and keeps the first frame at or past each timestamp instead, for comparison.
+ * The summary with thumbnails/second goes to stderr.
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct
+{
+    gchar **files;
+    guint numFiles;
+    std::atomic<guint> next;
+
+    std::mutex outputLock;
+    guint thumbnails, failed;
+} CustomData;
+
+typedef struct
+{
+    guint8 *pixels; // packed RGB
+    gint width, height, stride;
+    gint cellWidth, cellHeight;
+} SpriteSheet;
+
+static gint count = 10;
+static gint width = 160;
+static gint columns = 5;
+static gint jobs = 0;
+static gboolean png = FALSE;
+static gboolean naive = FALSE;
+static gchar *outputDir = NULL;
+
+static GOptionEntry entries[] = {
+    {"count", 'n', 0, G_OPTION_ARG_INT, &count, "Thumbnails per file", "N"},
+    {"width", 'w', 0, G_OPTION_ARG_INT, &width, "Thumbnail width in pixels (height keeps the aspect ratio)", "PX"},
+    {"columns", 'c', 0, G_OPTION_ARG_INT, &columns, "Thumbnails per sprite sheet row", "N"},
+    {"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of worker threads (default: number of cores)", "N"},
+    {"png", 0, 0, G_OPTION_ARG_NONE, &png, "Write PNG instead of raw RGB", NULL},
+    {"naive", 0, 0, G_OPTION_ARG_NONE, &naive, "Decode every frame instead of seeking (for comparison)", NULL},
+    {"output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &outputDir, "Where sprite sheets go (default: current directory)", "DIR"},
+    {NULL}};
+
+/* ======= Pipeline ==========*/
+
+static void onPadAdded(GstElement *decoder, GstPad *newPad, GstElement *pipeline)
+{
+    GstCaps *caps = gst_pad_get_current_caps(newPad);
+    if (!caps)
+    {
+        caps = gst_pad_query_caps(newPad, NULL);
+    }
+    gboolean isVideo = g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/x-raw");
+    gst_caps_unref(caps);
+
+    GstElement *convert = gst_bin_get_by_name(GST_BIN(pipeline), "convert");
+    GstPad *convertPad = gst_element_get_static_pad(convert, "sink");
+    gst_object_unref(convert);
+
+    if (isVideo && !gst_pad_is_linked(convertPad))
+    {
+        gst_pad_link(newPad, convertPad);
+    }
+    else
+    {
+        GstElement *sink = gst_element_factory_make("fakesink", NULL);
+        g_object_set(sink, "sync", FALSE, NULL);
+        gst_bin_add(GST_BIN(pipeline), sink);
+        gst_element_sync_state_with_parent(sink);
+        GstPad *sinkPad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_link(newPad, sinkPad);
+        gst_object_unref(sinkPad);
+    }
+    gst_object_unref(convertPad);
+}
+
+static GstElement *buildPipeline(const gchar *uri, GstElement **appSink)
+{
+    GstElement *pipeline = gst_pipeline_new(NULL);
+    GstElement *decoder = gst_element_factory_make("uridecodebin", NULL);
+    GstElement *convert = gst_element_factory_make("videoconvert", "convert");
+    GstElement *scale = gst_element_factory_make("videoscale", NULL);
+    GstElement *filter = gst_element_factory_make("capsfilter", NULL);
+    GstElement *sink = gst_element_factory_make("appsink", "sink");
+
+    if (!pipeline || !decoder || !convert || !scale || !filter || !sink)
+    {
+        gst_printerr("\nNot all elements could be created.");
+        if (pipeline)
+            gst_object_unref(pipeline);
+        return NULL;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "format", G_TYPE_STRING, "RGB",
+                                        "width", G_TYPE_INT, width,
+                                        "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                        NULL);
+    g_object_set(filter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(decoder, "uri", uri, NULL);
+    // Seek mode only ever pulls the preroll sample. Naive mode pulls everything as fast as it decodes.
+    g_object_set(sink, "sync", FALSE, "max-buffers", 2, NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), decoder, convert, scale, filter, sink, NULL);
+    gst_element_link_many(convert, scale, filter, sink, NULL);
+    g_signal_connect(decoder, "pad-added", G_CALLBACK(onPadAdded), pipeline);
+
+    *appSink = sink;
+    return pipeline;
+}
+
+/* ======= Sprite sheet ==========*/
+
+static gboolean spritePut(SpriteSheet *sheet, GstSample *sample, guint cell)
+{
+    GstVideoInfo info;
+    GstVideoFrame frame;
+
+    if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+        !gst_video_frame_map(&frame, &info, gst_sample_get_buffer(sample), GST_MAP_READ))
+    {
+        return FALSE;
+    }
+
+    // The first frame fixes the cell size.
+    if (!sheet->pixels)
+    {
+        sheet->cellWidth = GST_VIDEO_INFO_WIDTH(&info);
+        sheet->cellHeight = GST_VIDEO_INFO_HEIGHT(&info);
+        sheet->width = sheet->cellWidth * MIN(columns, count);
+        sheet->height = sheet->cellHeight * ((count + columns - 1) / columns);
+        sheet->stride = sheet->width * 3;
+        sheet->pixels = (guint8 *)g_malloc0(sheet->stride * sheet->height);
+    }
+
+    gint x = (cell % columns) * sheet->cellWidth;
+    gint y = (cell / columns) * sheet->cellHeight;
+    gint rows = MIN(sheet->cellHeight, GST_VIDEO_FRAME_HEIGHT(&frame));
+    gint rowBytes = MIN(sheet->cellWidth, GST_VIDEO_FRAME_WIDTH(&frame)) * 3;
+    const guint8 *src = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+    gint srcStride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+
+    for (gint row = 0; row < rows; row++)
+    {
+        memcpy(sheet->pixels + (y + row) * sheet->stride + x * 3, src + row * srcStride, rowBytes);
+    }
+    gst_video_frame_unmap(&frame);
+    return TRUE;
+}
+
+static gboolean writePng(SpriteSheet *sheet, const gchar *location)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch("appsrc name=src ! videoconvert ! pngenc ! filesink name=out", &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the PNG encoder: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *out = gst_bin_get_by_name(GST_BIN(pipeline), "out");
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, GST_VIDEO_FORMAT_RGB, sheet->width, sheet->height);
+    GstCaps *caps = gst_video_info_to_caps(&info);
+    gst_caps_set_simple(caps, "framerate", GST_TYPE_FRACTION, 0, 1, NULL);
+    g_object_set(src, "caps", caps, "format", GST_FORMAT_TIME, NULL);
+    g_object_set(out, "location", location, NULL);
+    gst_caps_unref(caps);
+
+    // Video buffers want 4-byte aligned rows, the sheet is packed: copy row by row.
+    GstBuffer *buffer = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&info), NULL);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    for (gint row = 0; row < sheet->height; row++)
+    {
+        memcpy(map.data + row * GST_VIDEO_INFO_PLANE_STRIDE(&info, 0), sheet->pixels + row * sheet->stride, sheet->stride);
+    }
+    gst_buffer_unmap(buffer, &map);
+    GST_BUFFER_PTS(buffer) = 0;
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    gst_app_src_push_buffer(GST_APP_SRC(src), buffer);
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(src);
+    gst_object_unref(out);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+static gboolean writeSheet(SpriteSheet *sheet, const gchar *file)
+{
+    gchar *base = g_path_get_basename(file);
+    gchar *name = png ? g_strdup_printf("%s.png", base)
+                      : g_strdup_printf("%s.%dx%d.rgb", base, sheet->width, sheet->height);
+    gchar *location = g_build_filename(outputDir ? outputDir : ".", name, NULL);
+
+    gboolean ok = png ? writePng(sheet, location)
+                      : g_file_set_contents(location, (const gchar *)sheet->pixels, sheet->stride * sheet->height, NULL);
+
+    g_free(location);
+    g_free(name);
+    g_free(base);
+    return ok;
+}
+
+/* ======= Extraction ==========*/
+
+static GstClockTime targetFor(gint64 duration, guint i)
+{
+    // Centre of each of the count equal slices, so the first thumbnail isn't a black intro frame.
+    return (GstClockTime)(duration * (i + 0.5) / count);
+}
+
+/*!
+ * @brief Seek mode: one KEY_UNIT seek and one prerolled frame per thumbnail. Returns the number of thumbnails.
+ */
+static guint extractBySeeking(GstElement *pipeline, GstElement *sink, gint64 duration, SpriteSheet *sheet)
+{
+    guint done = 0;
+    for (guint i = 0; i < (guint)count; i++)
+    {
+        if (!gst_element_seek_simple(pipeline, GST_FORMAT_TIME,
+                                     (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST),
+                                     targetFor(duration, i)))
+        {
+            break;
+        }
+        GstSample *sample = gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), 10 * GST_SECOND);
+        if (!sample)
+        {
+            break;
+        }
+        if (spritePut(sheet, sample, i))
+        {
+            done++;
+        }
+        gst_sample_unref(sample);
+    }
+    return done;
+}
+
+/*!
+ * @brief Naive mode: decode everything and keep the first frame at or past each timestamp.
+ */
+static guint extractByDecoding(GstElement *pipeline, GstElement *sink, gint64 duration, SpriteSheet *sheet)
+{
+    guint done = 0;
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstSample *sample;
+    while (done < (guint)count && (sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 10 * GST_SECOND)))
+    {
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        if (GST_BUFFER_PTS(buffer) >= targetFor(duration, done) && spritePut(sheet, sample, done))
+        {
+            done++;
+        }
+        gst_sample_unref(sample);
+    }
+    return done;
+}
+
+static void processFile(CustomData *data, const gchar *file)
+{
+    GstElement *sink;
+    SpriteSheet sheet = {NULL, 0, 0, 0, 0, 0};
+    gchar *uri = gst_uri_is_valid(file) ? g_strdup(file) : gst_filename_to_uri(file, NULL);
+    GstElement *pipeline = uri ? buildPipeline(uri, &sink) : NULL;
+    g_free(uri);
+
+    guint done = 0;
+    gint64 duration = 0;
+    if (pipeline)
+    {
+        gst_element_set_state(pipeline, GST_STATE_PAUSED);
+        if (gst_element_get_state(pipeline, NULL, NULL, 10 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS &&
+            gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration) && duration > 0)
+        {
+            done = naive ? extractByDecoding(pipeline, sink, duration, &sheet)
+                         : extractBySeeking(pipeline, sink, duration, &sheet);
+        }
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+
+    gboolean ok = done > 0 && writeSheet(&sheet, file);
+    g_free(sheet.pixels);
+
+    std::lock_guard<std::mutex> guard(data->outputLock);
+    if (ok)
+    {
+        data->thumbnails += done;
+        g_print("%s: %u thumbnails\n", file, done);
+    }
+    else
+    {
+        data->failed++;
+        gst_printerr("%s: failed\n", file);
+    }
+}
+
+static void worker(CustomData *data)
+{
+    guint i;
+    while ((i = data->next++) < data->numFiles)
+    {
+        processFile(data, data->files[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    CustomData data;
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("<file>... - build thumbnail sprite sheets");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err) || argc < 2)
+    {
+        gst_printerr("\n%s", err ? err->message : "Missing input files.");
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+
+    count = MAX(count, 1);
+    columns = MAX(columns, 1);
+    width = MAX(width, 16);
+    if (jobs <= 0)
+    {
+        jobs = g_get_num_processors();
+    }
+
+    data.files = argv + 1;
+    data.numFiles = argc - 1;
+    data.next = 0;
+    data.thumbnails = data.failed = 0;
+
+    gint64 start = g_get_monotonic_time();
+    std::vector<std::thread> workers;
+    for (gint i = 0; i < MIN(jobs, (gint)data.numFiles); i++)
+    {
+        workers.emplace_back(worker, &data);
+    }
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+    gdouble seconds = (g_get_monotonic_time() - start) / 1e6;
+
+    gst_printerr("\n%s: %u thumbnails from %u files (%u failed) with %d workers in %.2f s, %.1f thumbnails/s\n",
+                 naive ? "naive" : "key-unit seek", data.thumbnails, data.numFiles, data.failed, (gint)workers.size(),
+                 seconds, data.thumbnails / seconds);
+
+    g_free(outputDir);
+    return data.failed ? -1 : 0;
+}
@@ -0,0 +1,319 @@
+/*!
+ * @brief Trick-play: 2x to 32x playback, forwards and backwards, for review workflows.
+ * @note Usage:- ./Trick-Play.o <file-or-uri>             (interactive)
+ *               ./Trick-Play.o <file-or-uri> --benchmark [seconds-per-rate]
+ * @link https://gstreamer.freedesktop.org/documentation/tutorials/basic/playback-speed.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/additional/design/trickmodes.html?gi-language=c
+ *
+ * 04-Seekable-Streams only jumps to a position at normal rate. Here the rate itself is changed with a seek:
+ *  - Above TRICK_THRESHOLD the seek carries TRICKMODE | TRICKMODE_KEY_UNITS | TRICKMODE_NO_AUDIO, so demuxers only push
+ *    keyframes and audio is dropped before it is decoded. Without it a 32x stream decodes 32x the frames and throws
+ *    nearly all of them away at the sink.
+ *  - When only the speed changes (same direction, same trick mode) an INSTANT_RATE_CHANGE seek is tried first. It
+ *    needs no flush, so playback doesn't stutter. Older GStreamer or elements that can't do it get a flushing seek.
+ *  - Reverse playback plays the segment [0, position] with a negative rate.
+ *
+ * Interactive keys: 'f' faster, 's' slower, 'd' change direction, 'k' toggle keyframe trick mode, 'q' quit.
+ * --benchmark plays a while at every rate, once with keyframe trick mode and once decoding everything, and prints CPU
+ * time per second of media.
+ */
+
+#include <gst/gst.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Bus-Dispatcher.h"
+
+#define TRICK_THRESHOLD 2.0
+
+typedef struct
+{
+    GstElement *playbin;
+    GMainLoop *mainLoop;
+    gdouble rate;
+    gboolean keyframeTrickMode;
+    gboolean trickActive; // trick flags of the segment currently playing
+} CustomData;
+
+static gboolean wantsTrick(CustomData *data, gdouble rate)
+{
+    return data->keyframeTrickMode && fabs(rate) > TRICK_THRESHOLD;
+}
+
+/*!
+ * @brief Switches playback to the given rate, continuing from the current position.
+ */
+static gboolean setRate(CustomData *data, gdouble rate)
+{
+    gint64 position;
+    gboolean trick = wantsTrick(data, rate);
+    GstSeekFlags trickFlags = trick ? (GstSeekFlags)(GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS |
+                                                     GST_SEEK_FLAG_TRICKMODE_NO_AUDIO)
+                                    : GST_SEEK_FLAG_NONE;
+
+#if GST_CHECK_VERSION(1, 18, 0)
+    // Same direction and same decoding mode: only the speed changes, which doesn't need a flush.
+    if ((rate > 0) == (data->rate > 0) && trick == data->trickActive)
+    {
+        if (gst_element_seek(data->playbin, rate, GST_FORMAT_TIME,
+                             (GstSeekFlags)(GST_SEEK_FLAG_INSTANT_RATE_CHANGE | trickFlags),
+                             GST_SEEK_TYPE_NONE, 0, GST_SEEK_TYPE_NONE, 0))
+        {
+            data->rate = rate;
+            return TRUE;
+        }
+    }
+#endif
+
+    if (!gst_element_query_position(data->playbin, GST_FORMAT_TIME, &position))
+    {
+        g_print("\nCouldn't retrive current position");
+        return FALSE;
+    }
+
+    GstSeekFlags flags = (GstSeekFlags)(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE | trickFlags);
+    gboolean ok;
+    if (rate > 0)
+    {
+        ok = gst_element_seek(data->playbin, rate, GST_FORMAT_TIME, flags,
+                              GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_END, 0);
+    }
+    else
+    {
+        ok = gst_element_seek(data->playbin, rate, GST_FORMAT_TIME, flags,
+                              GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_SET, position);
+    }
+    if (ok)
+    {
+        data->rate = rate;
+        data->trickActive = trick;
+    }
+    return ok;
+}
+
+/* ======= Interactive mode ==========*/
+
+static void onError(GstMessage *msg, CustomData *data)
+{
+    GError *err;
+    gchar *debug_info;
+
+    gst_message_parse_error(msg, &err, &debug_info);
+    gst_printerr("\nError Message: %s:\n %s", GST_OBJECT_NAME(msg->src), err->message);
+    gst_printerr("\nDebug Message: \n %s", debug_info ? debug_info : "none");
+    g_clear_error(&err);
+    g_free(debug_info);
+    g_main_loop_quit(data->mainLoop);
+}
+
+static void onEos(GstMessage *msg, CustomData *data)
+{
+    g_print("\nReached End of Stream.");
+    g_main_loop_quit(data->mainLoop);
+}
+
+static gboolean onRefresh(CustomData *data)
+{
+    gint64 position = -1, duration = -1;
+    gst_element_query_position(data->playbin, GST_FORMAT_TIME, &position);
+    gst_element_query_duration(data->playbin, GST_FORMAT_TIME, &duration);
+    g_print("\rPosition %" GST_TIME_FORMAT " / %" GST_TIME_FORMAT "  rate %+.0fx %s   ",
+            GST_TIME_ARGS(position), GST_TIME_ARGS(duration), data->rate,
+            data->trickActive ? "(keyframes only)" : "(all frames)    ");
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean onKeyboard(GIOChannel *source, GIOCondition cond, CustomData *data)
+{
+    gchar *line = NULL;
+    if (g_io_channel_read_line(source, &line, NULL, NULL, NULL) != G_IO_STATUS_NORMAL)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    gdouble rate = data->rate;
+    switch (g_ascii_tolower(line[0]))
+    {
+    case 'f':
+        rate = fabs(rate) < 32.0 ? rate * 2.0 : rate;
+        break;
+    case 's':
+        rate = fabs(rate) > 1.0 ? rate / 2.0 : rate;
+        break;
+    case 'd':
+        rate = -rate;
+        break;
+    case 'k':
+        data->keyframeTrickMode = !data->keyframeTrickMode;
+        g_print("\nKeyframe trick mode %s", data->keyframeTrickMode ? "on" : "off");
+        // If that changes the decoding mode at this rate, trickActive no longer matches and the check below seeks.
+        // setRate() only updates trickActive once the seek went through.
+        break;
+    case 'q':
+        g_main_loop_quit(data->mainLoop);
+        break;
+    }
+    g_free(line);
+
+    if (rate != data->rate || data->trickActive != wantsTrick(data, rate))
+    {
+        if (!setRate(data, rate))
+        {
+            g_print("\nRate change to %+.0fx failed.", rate);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* ======= Benchmark ==========*/
+
+static gdouble cpuSeconds(const struct rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/*!
+ * @brief Plays wallSeconds at rate from a fresh pipeline and prints CPU per second of media.
+ * Reverse rates start from the end of the stream.
+ */
+static void benchmarkRate(const gchar *uri, gdouble rate, gboolean keyframes, guint wallSeconds)
+{
+    CustomData data;
+    data.playbin = gst_element_factory_make("playbin", NULL);
+    data.rate = 1.0;
+    data.trickActive = FALSE;
+    data.keyframeTrickMode = keyframes;
+    g_object_set(data.playbin, "uri", uri,
+                 "video-sink", gst_element_factory_make("fakesink", NULL),
+                 "audio-sink", gst_element_factory_make("fakesink", NULL), NULL);
+
+    GstBus *bus = gst_element_get_bus(data.playbin);
+    gst_element_set_state(data.playbin, GST_STATE_PAUSED);
+    if (gst_element_get_state(data.playbin, NULL, NULL, 10 * GST_SECOND) != GST_STATE_CHANGE_SUCCESS)
+    {
+        gst_printerr("\nFailed to preroll %s", uri);
+        gst_element_set_state(data.playbin, GST_STATE_NULL);
+        gst_object_unref(bus);
+        gst_object_unref(data.playbin);
+        return;
+    }
+
+    gint64 duration = 0, startPos = 0, endPos = 0;
+    gst_element_query_duration(data.playbin, GST_FORMAT_TIME, &duration);
+    if (rate < 0 && duration > GST_SECOND)
+    {
+        // Just before the end: prerolling exactly at the end would only give EOS.
+        gst_element_seek_simple(data.playbin, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH, duration - GST_SECOND);
+        gst_element_get_state(data.playbin, NULL, NULL, 10 * GST_SECOND);
+    }
+    setRate(&data, rate);
+    gst_element_get_state(data.playbin, NULL, NULL, 10 * GST_SECOND);
+    gst_element_query_position(data.playbin, GST_FORMAT_TIME, &startPos);
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    gint64 startTime = g_get_monotonic_time();
+    gst_element_set_state(data.playbin, GST_STATE_PLAYING);
+
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, wallSeconds * GST_SECOND,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gboolean failed = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR;
+    if (msg)
+    {
+        gst_message_unref(msg);
+    }
+
+    if (!gst_element_query_position(data.playbin, GST_FORMAT_TIME, &endPos))
+    {
+        endPos = rate > 0 ? duration : 0;
+    }
+    gdouble wall = (g_get_monotonic_time() - startTime) / 1e6;
+    getrusage(RUSAGE_SELF, &after);
+
+    gst_element_set_state(data.playbin, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(data.playbin);
+
+    gdouble mediaSeconds = fabs((gdouble)(endPos - startPos)) / GST_SECOND;
+    if (failed || mediaSeconds <= 0)
+    {
+        g_print("\n%+5.0fx  %-10s  failed", rate, keyframes ? "keyframes" : "all");
+        return;
+    }
+    gdouble cpu = cpuSeconds(after) - cpuSeconds(before);
+    g_print("\n%+5.0fx  %-10s  achieved %+6.1fx  cpu %7.1f ms per media second",
+            rate, keyframes ? "keyframes" : "all", (rate > 0 ? 1 : -1) * mediaSeconds / wall,
+            cpu * 1000.0 / mediaSeconds);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        gst_printerr("\nUsage: %s <file-or-uri> [--benchmark [seconds-per-rate]]\n", argv[0]);
+        return -1;
+    }
+
+    gst_init(NULL, NULL);
+
+    gchar *uri = gst_uri_is_valid(argv[1]) ? g_strdup(argv[1]) : gst_filename_to_uri(argv[1], NULL);
+
+    if (argc > 2 && strcmp(argv[2], "--benchmark") == 0)
+    {
+        guint seconds = argc > 3 ? MAX(atoi(argv[3]), 1) : 3;
+        static const gdouble rates[] = {1, 2, 4, 8, 16, 32, -2, -4, -8, -16, -32};
+
+        for (gdouble rate : rates)
+        {
+            benchmarkRate(uri, rate, TRUE, seconds);
+            benchmarkRate(uri, rate, FALSE, seconds);
+        }
+        g_print("\n");
+        g_free(uri);
+        return 0;
+    }
+
+    CustomData data;
+    data.rate = 1.0;
+    data.keyframeTrickMode = TRUE;
+    data.trickActive = FALSE;
+    data.playbin = gst_element_factory_make("playbin", "playbin");
+    g_object_set(data.playbin, "uri", uri, NULL);
+    g_free(uri);
+
+    BusDispatcher *dispatcher = busDispatcherNew(data.playbin, NULL);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_ERROR, NULL, (BusHandler)onError, &data);
+    busDispatcherConnect(dispatcher, GST_MESSAGE_EOS, NULL, (BusHandler)onEos, &data);
+    busDispatcherAddTimer(dispatcher, 200, (GSourceFunc)onRefresh, &data);
+
+    GIOChannel *keyboard = g_io_channel_unix_new(STDIN_FILENO);
+    guint keyboardWatch = g_io_add_watch(keyboard, G_IO_IN, (GIOFunc)onKeyboard, &data);
+
+    g_print("\nKeys (then Enter): 'f' faster, 's' slower, 'd' direction, 'k' keyframe trick mode, 'q' quit\n");
+
+    if (gst_element_set_state(data.playbin, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    {
+        g_print("\nFailed to start the plabin.");
+        g_source_remove(keyboardWatch);
+        g_io_channel_unref(keyboard);
+        busDispatcherFree(dispatcher);
+        gst_object_unref(data.playbin);
+        return -1;
+    }
+
+    data.mainLoop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(data.mainLoop);
+
+    g_print("\n");
+    g_main_loop_unref(data.mainLoop);
+    g_source_remove(keyboardWatch);
+    g_io_channel_unref(keyboard);
+    busDispatcherFree(dispatcher);
+    gst_element_set_state(data.playbin, GST_STATE_NULL);
+    gst_object_unref(data.playbin);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*!
+ * @brief CPU per stream of waveformscope (Waveform-Scope.h) against the wavescope ! videoconvert branch of
+ * 07-Multi-Threading.cpp, with many scopes running at once.
+ * @note Usage:- ./Waveform-Scope-Benchmark.o [--streams=N] [--seconds=S] [--width=W] [--height=H] [--fps=F] [--format=I420]
+ * @link https://gstreamer.freedesktop.org/documentation/audiovisualizers/wavescope.html?gi-language=c
+ *
+ * One pipeline holds --streams independent branches of
+ *   audiotestsrc ! S16 stereo 44.1k ! <scope> ! video/x-raw,format=<format>,WxH@F ! fakesink sync=false
+ * where <scope> is "wavescope shader=none ! videoconvert" or "waveformscope". Every source has its own streaming
+ * thread, so they all compete for the cores the way concurrent streams would. The process CPU time (getrusage),
+ * divided by streams and audio seconds, gives the share of one core a real-time stream costs.
+ * waveformscope also runs with 256 and 4096 samples per buffer: the frame count must stay at audio duration * fps.
+ * One JSON line per run.
+ */
+
+#include <gst/gst.h>
+#include <sys/resource.h>
+#include <vector>
+#include "Waveform-Scope.h"
+
+#define AUDIO_RATE 44100
+
+typedef struct
+{
+    gdouble cpuSeconds, wallSeconds;
+    gdouble framesPerStream;
+    guint64 minFrames, maxFrames, expectedFrames;
+} ScopeResult;
+
+static gint streams = 64;
+static gint seconds = 10;
+static gint width = 320;
+static gint height = 200;
+static gint fps = 25;
+static gchar *format = NULL;
+
+static GOptionEntry entries[] = {
+    {"streams", 'n', 0, G_OPTION_ARG_INT, &streams, "Concurrent scopes", "N"},
+    {"seconds", 's', 0, G_OPTION_ARG_INT, &seconds, "Audio seconds per stream", "S"},
+    {"width", 0, 0, G_OPTION_ARG_INT, &width, "Video width", "W"},
+    {"height", 0, 0, G_OPTION_ARG_INT, &height, "Video height", "H"},
+    {"fps", 'f', 0, G_OPTION_ARG_INT, &fps, "Video frames per second", "F"},
+    {"format", 0, 0, G_OPTION_ARG_STRING, &format, "Format the sink takes (default: I420)", "FORMAT"},
+    {NULL}};
+
+static gdouble cpuSeconds(const struct rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static GstPadProbeReturn onFrame(GstPad *pad, GstPadProbeInfo *info, guint64 *frames)
+{
+    (*frames)++;
+    return GST_PAD_PROBE_OK;
+}
+
+static gboolean runScopes(const gchar *scope, gint samplesPerBuffer, ScopeResult *result)
+{
+    // Whole buffers: round up to at least the requested duration.
+    gint buffers = (gint)(((gint64)seconds * AUDIO_RATE + samplesPerBuffer - 1) / samplesPerBuffer);
+    GString *description = g_string_new(NULL);
+    for (gint i = 0; i < streams; i++)
+    {
+        g_string_append_printf(description,
+                               "audiotestsrc num-buffers=%d samplesperbuffer=%d freq=%d ! "
+                               "audio/x-raw,format=S16LE,rate=%d,channels=2 ! %s ! "
+                               "video/x-raw,format=%s,width=%d,height=%d,framerate=%d/1 ! fakesink name=sink%d sync=false ",
+                               buffers, samplesPerBuffer, 200 + i * 10,
+                               AUDIO_RATE, scope, format, width, height, fps, i);
+    }
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description->str, &err);
+    g_string_free(description, TRUE);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build the pipeline: %s", err->message);
+        g_clear_error(&err);
+        return FALSE;
+    }
+
+    // One counter per branch, each only touched by its branch's streaming thread.
+    std::vector<guint64> frames(streams, 0);
+    for (gint i = 0; i < streams; i++)
+    {
+        gchar *name = g_strdup_printf("sink%d", i);
+        GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), name);
+        GstPad *pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, (GstPadProbeCallback)onFrame, &frames[i], NULL);
+        gst_object_unref(pad);
+        gst_object_unref(sink);
+        g_free(name);
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    gint64 startTime = g_get_monotonic_time();
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+                                                 (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    gint64 endTime = g_get_monotonic_time();
+    getrusage(RUSAGE_SELF, &after);
+
+    gboolean ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok)
+    {
+        gst_message_parse_error(msg, &err, NULL);
+        gst_printerr("\n%s: %s", scope, err->message);
+        g_clear_error(&err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    result->cpuSeconds = cpuSeconds(after) - cpuSeconds(before);
+    result->wallSeconds = (endTime - startTime) / 1e6;
+    result->minFrames = G_MAXUINT64;
+    result->maxFrames = 0;
+    guint64 total = 0;
+    for (guint64 count : frames)
+    {
+        total += count;
+        result->minFrames = MIN(result->minFrames, count);
+        result->maxFrames = MAX(result->maxFrames, count);
+    }
+    result->framesPerStream = (gdouble)total / streams;
+    // Only whole frames go out.
+    result->expectedFrames = (guint64)buffers * samplesPerBuffer * fps / AUDIO_RATE;
+    return ok;
+}
+
+static void printResult(const gchar *element, gint samplesPerBuffer, const ScopeResult *result)
+{
+    g_print("{\"element\": \"%s\", \"format\": \"%s\", \"streams\": %d, \"samples_per_buffer\": %d, \"cpu_s\": %.2f, "
+            "\"wall_s\": %.2f, \"cpu_percent_per_stream\": %.3f, \"frames_per_stream\": %.1f}\n",
+            element, format, streams, samplesPerBuffer, result->cpuSeconds, result->wallSeconds,
+            result->cpuSeconds * 100.0 / ((gdouble)streams * seconds), result->framesPerStream);
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- waveformscope against wavescope ! videoconvert");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    waveformScopeRegister();
+    if (!format)
+        format = g_strdup("I420");
+
+    ScopeResult result;
+    gboolean passed = TRUE;
+
+    if (runScopes("wavescope shader=none ! videoconvert", 1024, &result))
+        printResult("wavescope+videoconvert", 1024, &result);
+
+    for (gint samplesPerBuffer : {1024, 256, 4096})
+    {
+        gboolean ok = runScopes("waveformscope", samplesPerBuffer, &result);
+        printResult("waveformscope", samplesPerBuffer, &result);
+        if (!ok || result.minFrames != result.expectedFrames || result.maxFrames != result.expectedFrames)
+        {
+            gst_printerr("\nwaveformscope with %d samples per buffer: %" G_GUINT64_FORMAT "..%" G_GUINT64_FORMAT
+                         " frames per stream, expected %" G_GUINT64_FORMAT,
+                         samplesPerBuffer, result.minFrames, result.maxFrames, result.expectedFrames);
+            passed = FALSE;
+        }
+    }
+
+    g_free(format);
+    g_print("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : -1;
+}
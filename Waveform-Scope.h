@@ -0,0 +1,672 @@
+/*!
+ * @brief waveformscope: draws the min/max envelope of an audio stream straight into pooled I420 or 32-bit RGB video
+ * frames, in place of wavescope ! videoconvert.
+ * @link https://gstreamer.freedesktop.org/documentation/audiovisualizers/wavescope.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/gstreamer/gstbufferpool.html?gi-language=c
+ *
+ * wavescope renders xRGB frames through the audio visualizer base class, which copies the audio into an adapter,
+ * shades the previous frame and plots every sample as a dot. The output then needs videoconvert before most sinks.
+ * waveformscope instead:
+ * - offers I420 and the 32-bit RGB orders on its src pad, so negotiation picks what the sink takes as is.
+ * - draws one vertical span per column, from the lowest to the highest sample that falls into it, for every
+ *   channel in its own band. The min/max over each column is reduced with SIMD (AVX2, SSE2, scalar), straight from
+ *   the mapped input, without copying it.
+ * - produces frames at the negotiated framerate: frame n covers the samples of [n / fps, (n + 1) / fps), however the
+ *   audio happens to be cut into buffers.
+ * - takes its output buffers from downstream's pool, or its own GstVideoBufferPool.
+ *
+ * Call waveformScopeRegister() once after gst_init().
+ */
+
+#ifndef WAVEFORM_SCOPE_H
+#define WAVEFORM_SCOPE_H
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/video/video.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVEFORM_SCOPE_X86 1
+#endif
+
+#define WAVEFORM_SCOPE_SINK_CAPS                                                                       \
+    "audio/x-raw, format = (string) { " GST_AUDIO_NE(S16) ", " GST_AUDIO_NE(F32) " }, "                \
+    "rate = (int) [ 1, MAX ], channels = (int) [ 1, 8 ], layout = (string) interleaved"
+#define WAVEFORM_SCOPE_SRC_CAPS                                                                        \
+    "video/x-raw, format = (string) { I420, BGRx, RGBx, BGRA, RGBA }, width = (int) [ 16, 4096 ], "     \
+    "height = (int) [ 16, 4096 ], framerate = (fraction) [ 1/1, 120/1 ]"
+
+/* ======= Kernels ==========*/
+
+/*!
+ * Lower mins[c] and raise maxs[c] with frames interleaved frames of channels channels. The SIMD versions keep one
+ * running min/max per vector lane; when the lane count is a multiple of channels every lane always holds the same
+ * channel, so the lanes reduce per channel at the end. Other channel counts take the scalar loop.
+ */
+typedef struct
+{
+    const gchar *name;
+    void (*minMaxS16)(const gint16 *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs);
+    void (*minMaxF32)(const gfloat *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs);
+} WaveformKernels;
+
+static void minMaxS16Scalar(const gint16 *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs)
+{
+    for (guint c = 0; c < channels; c++)
+    {
+        gint low = G_MAXINT16, high = G_MININT16;
+        for (guint f = 0; f < frames; f++)
+        {
+            gint value = samples[f * channels + c];
+            low = MIN(low, value);
+            high = MAX(high, value);
+        }
+        if (frames)
+        {
+            mins[c] = MIN(mins[c], low / 32768.0f);
+            maxs[c] = MAX(maxs[c], high / 32768.0f);
+        }
+    }
+}
+
+static void minMaxF32Scalar(const gfloat *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs)
+{
+    for (guint f = 0; f < frames; f++)
+    {
+        for (guint c = 0; c < channels; c++)
+        {
+            mins[c] = MIN(mins[c], samples[f * channels + c]);
+            maxs[c] = MAX(maxs[c], samples[f * channels + c]);
+        }
+    }
+}
+
+static const WaveformKernels waveformKernelsScalar = {"scalar", minMaxS16Scalar, minMaxF32Scalar};
+
+#ifdef WAVEFORM_SCOPE_X86
+
+static void minMaxS16Sse2(const gint16 *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs)
+{
+    guint total = frames * channels, i = 0;
+    if (8 % channels || total < 8)
+    {
+        minMaxS16Scalar(samples, frames, channels, mins, maxs);
+        return;
+    }
+    __m128i low = _mm_set1_epi16(G_MAXINT16), high = _mm_set1_epi16(G_MININT16);
+    for (; i + 8 <= total; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(samples + i));
+        low = _mm_min_epi16(low, v);
+        high = _mm_max_epi16(high, v);
+    }
+    gint16 lows[8], highs[8];
+    _mm_storeu_si128((__m128i *)lows, low);
+    _mm_storeu_si128((__m128i *)highs, high);
+    for (guint lane = 0; lane < 8; lane++)
+    {
+        mins[lane % channels] = MIN(mins[lane % channels], lows[lane] / 32768.0f);
+        maxs[lane % channels] = MAX(maxs[lane % channels], highs[lane] / 32768.0f);
+    }
+    minMaxS16Scalar(samples + i, (total - i) / channels, channels, mins, maxs);
+}
+
+static void minMaxF32Sse2(const gfloat *samples, guint frames, guint channels, gfloat *mins, gfloat *maxs)
+{
+    guint total = frames * channels, i = 0;
+    if (4 % channels || total < 4)
+    {
+        minMaxF32Scalar(samples, frames, channels, mins, maxs);
+        return;
+    }
+    __m128 low = _mm_set1_ps(G_MAXFLOAT), high = _mm_set1_ps(-G_MAXFLOAT);
+    for (; i + 4 <= total; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(samples + i);
+        low = _mm_min_ps(low, v);
+        high = _mm_max_ps(high, v);
+    }
+    gfloat lows[4], highs[4];
+    _mm_storeu_ps(lows, low);
+    _mm_storeu_ps(highs, high);
+    for (guint lane = 0; lane < 4; lane++)
+    {
+        mins[lane % channels] = MIN(mins[lane % channels], lows[lane]);
+        maxs[lane % channels] = MAX(maxs[lane % channels], highs[lane]);
+    }
+    minMaxF32Scalar(samples + i, (total - i) / channels, channels, mins, maxs);
+}
+
+static const WaveformKernels waveformKernelsSse2 = {"sse2", minMaxS16Sse2, minMaxF32Sse2};
+
+__attribute__((target("avx2"))) static void minMaxS16Avx2(const gint16 *samples, guint frames, guint channels,
+                                                          gfloat *mins, gfloat *maxs)
+{
+    guint total = frames * channels, i = 0;
+    if (16 % channels || total < 16)
+    {
+        minMaxS16Sse2(samples, frames, channels, mins, maxs);
+        return;
+    }
+    __m256i low = _mm256_set1_epi16(G_MAXINT16), high = _mm256_set1_epi16(G_MININT16);
+    for (; i + 16 <= total; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(samples + i));
+        low = _mm256_min_epi16(low, v);
+        high = _mm256_max_epi16(high, v);
+    }
+    gint16 lows[16], highs[16];
+    _mm256_storeu_si256((__m256i *)lows, low);
+    _mm256_storeu_si256((__m256i *)highs, high);
+    for (guint lane = 0; lane < 16; lane++)
+    {
+        mins[lane % channels] = MIN(mins[lane % channels], lows[lane] / 32768.0f);
+        maxs[lane % channels] = MAX(maxs[lane % channels], highs[lane] / 32768.0f);
+    }
+    minMaxS16Sse2(samples + i, (total - i) / channels, channels, mins, maxs);
+}
+
+__attribute__((target("avx2"))) static void minMaxF32Avx2(const gfloat *samples, guint frames, guint channels,
+                                                          gfloat *mins, gfloat *maxs)
+{
+    guint total = frames * channels, i = 0;
+    if (8 % channels || total < 8)
+    {
+        minMaxF32Sse2(samples, frames, channels, mins, maxs);
+        return;
+    }
+    __m256 low = _mm256_set1_ps(G_MAXFLOAT), high = _mm256_set1_ps(-G_MAXFLOAT);
+    for (; i + 8 <= total; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(samples + i);
+        low = _mm256_min_ps(low, v);
+        high = _mm256_max_ps(high, v);
+    }
+    gfloat lows[8], highs[8];
+    _mm256_storeu_ps(lows, low);
+    _mm256_storeu_ps(highs, high);
+    for (guint lane = 0; lane < 8; lane++)
+    {
+        mins[lane % channels] = MIN(mins[lane % channels], lows[lane]);
+        maxs[lane % channels] = MAX(maxs[lane % channels], highs[lane]);
+    }
+    minMaxF32Sse2(samples + i, (total - i) / channels, channels, mins, maxs);
+}
+
+static const WaveformKernels waveformKernelsAvx2 = {"avx2", minMaxS16Avx2, minMaxF32Avx2};
+
+#endif // WAVEFORM_SCOPE_X86
+
+static const WaveformKernels *waveformKernelsBest()
+{
+#ifdef WAVEFORM_SCOPE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &waveformKernelsAvx2;
+    return &waveformKernelsSse2;
+#else
+    return &waveformKernelsScalar;
+#endif
+}
+
+/* ======= Element ==========*/
+
+typedef struct
+{
+    GstElement parent;
+    GstPad *sinkPad, *srcPad;
+    guint color; // ARGB
+
+    const WaveformKernels *kernels;
+    GstAudioInfo audioInfo;
+    GstVideoInfo videoInfo;
+    GstBufferPool *pool;
+    gboolean negotiated;
+
+    // Column min/max of the frame being collected, width x channels each.
+    gfloat *mins, *maxs;
+    gint column;
+    guint64 frame, samples; // Since startTime.
+    GstClockTime startTime;
+} WaveformScope;
+
+typedef struct
+{
+    GstElementClass parentClass;
+} WaveformScopeClass;
+
+enum
+{
+    WAVEFORM_SCOPE_PROP_0,
+    WAVEFORM_SCOPE_PROP_COLOR
+};
+
+G_DEFINE_TYPE(WaveformScope, waveform_scope, GST_TYPE_ELEMENT)
+
+static void waveformScopeClearColumns(WaveformScope *self)
+{
+    guint count = GST_VIDEO_INFO_WIDTH(&self->videoInfo) * GST_AUDIO_INFO_CHANNELS(&self->audioInfo);
+    for (guint i = 0; i < count; i++)
+    {
+        self->mins[i] = G_MAXFLOAT;
+        self->maxs[i] = -G_MAXFLOAT;
+    }
+    self->column = 0;
+}
+
+static void waveformScopeReset(WaveformScope *self)
+{
+    self->frame = self->samples = 0;
+    self->startTime = GST_CLOCK_TIME_NONE;
+    if (self->mins)
+        waveformScopeClearColumns(self);
+}
+
+static void waveformScopeFreeState(WaveformScope *self)
+{
+    if (self->pool)
+    {
+        gst_buffer_pool_set_active(self->pool, FALSE);
+        gst_clear_object(&self->pool);
+    }
+    g_clear_pointer(&self->mins, g_free);
+    g_clear_pointer(&self->maxs, g_free);
+    self->negotiated = FALSE;
+}
+
+/*!
+ * @brief First sample of frame n, counted from startTime.
+ */
+static guint64 waveformScopeFrameStart(WaveformScope *self, guint64 n)
+{
+    return gst_util_uint64_scale(n, (guint64)GST_AUDIO_INFO_RATE(&self->audioInfo) * GST_VIDEO_INFO_FPS_D(&self->videoInfo),
+                                 GST_VIDEO_INFO_FPS_N(&self->videoInfo));
+}
+
+static GstClockTime waveformScopeFrameTime(WaveformScope *self, guint64 n)
+{
+    return self->startTime + gst_util_uint64_scale(n, GST_SECOND * GST_VIDEO_INFO_FPS_D(&self->videoInfo),
+                                                   GST_VIDEO_INFO_FPS_N(&self->videoInfo));
+}
+
+/*!
+ * @brief Picks the first format/size/rate downstream accepts (320x200 at 25 fps like wavescope when it doesn't care)
+ * and sets up the buffer pool from the allocation query.
+ */
+static gboolean waveformScopeNegotiate(WaveformScope *self)
+{
+    GstCaps *templateCaps = gst_pad_get_pad_template_caps(self->srcPad);
+    GstCaps *caps = gst_pad_peer_query_caps(self->srcPad, templateCaps);
+    gst_caps_unref(templateCaps);
+    if (gst_caps_is_empty(caps))
+    {
+        gst_caps_unref(caps);
+        return FALSE;
+    }
+    caps = gst_caps_make_writable(gst_caps_truncate(caps));
+    GstStructure *structure = gst_caps_get_structure(caps, 0);
+    gst_structure_fixate_field_nearest_int(structure, "width", 320);
+    gst_structure_fixate_field_nearest_int(structure, "height", 200);
+    gst_structure_fixate_field_nearest_fraction(structure, "framerate", 25, 1);
+    caps = gst_caps_fixate(caps);
+
+    self->negotiated = FALSE;
+    if (!gst_video_info_from_caps(&self->videoInfo, caps) || !gst_pad_set_caps(self->srcPad, caps))
+    {
+        gst_caps_unref(caps);
+        return FALSE;
+    }
+
+    GstQuery *query = gst_query_new_allocation(caps, TRUE);
+    GstBufferPool *pool = NULL;
+    guint size = GST_VIDEO_INFO_SIZE(&self->videoInfo), min = 2, max = 0;
+    if (gst_pad_peer_query(self->srcPad, query) && gst_query_get_n_allocation_pools(query) > 0)
+    {
+        gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+        size = MAX(size, (guint)GST_VIDEO_INFO_SIZE(&self->videoInfo));
+    }
+    if (!pool)
+    {
+        pool = gst_video_buffer_pool_new();
+    }
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, size, min, max);
+    if (gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL))
+    {
+        gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+    }
+    gst_query_unref(query);
+    gst_caps_unref(caps);
+
+    if (self->pool)
+    {
+        gst_buffer_pool_set_active(self->pool, FALSE);
+        gst_object_unref(self->pool);
+    }
+    self->pool = pool;
+    if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE))
+    {
+        return FALSE;
+    }
+
+    guint count = GST_VIDEO_INFO_WIDTH(&self->videoInfo) * GST_AUDIO_INFO_CHANNELS(&self->audioInfo);
+    g_free(self->mins);
+    g_free(self->maxs);
+    self->mins = g_new(gfloat, count);
+    self->maxs = g_new(gfloat, count);
+    waveformScopeReset(self);
+    self->negotiated = TRUE;
+    GST_INFO_OBJECT(self, "%s %dx%d, kernels %s", GST_VIDEO_INFO_NAME(&self->videoInfo),
+                    GST_VIDEO_INFO_WIDTH(&self->videoInfo), GST_VIDEO_INFO_HEIGHT(&self->videoInfo),
+                    self->kernels->name);
+    return TRUE;
+}
+
+/*!
+ * @brief Paints one frame: black background, then a vertical span per column and channel. A column that got no
+ * samples (more columns than samples per frame) repeats the previous one.
+ */
+static void waveformScopeRender(WaveformScope *self, GstVideoFrame *frame)
+{
+    gint width = GST_VIDEO_FRAME_WIDTH(frame), height = GST_VIDEO_FRAME_HEIGHT(frame);
+    guint channels = GST_AUDIO_INFO_CHANNELS(&self->audioInfo);
+    gint band = height / channels;
+    guint8 r = (self->color >> 16) & 0xff, g = (self->color >> 8) & 0xff, b = self->color & 0xff;
+    gboolean planar = GST_VIDEO_FRAME_FORMAT(frame) == GST_VIDEO_FORMAT_I420;
+    guint8 *pixels = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 0);
+    gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+    guint8 foreground[4], background[4];
+
+    if (planar)
+    {
+        // BT.601 studio range, like videoconvert's default for SD.
+        foreground[0] = (guint8)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        foreground[1] = (guint8)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        foreground[2] = (guint8)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        for (gint plane = 0; plane < 3; plane++)
+        {
+            guint8 *data = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, plane);
+            gint rows = plane == 0 ? height : GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane);
+            memset(data, plane == 0 ? 16 : 128, (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane) * rows);
+        }
+    }
+    else
+    {
+        // Byte positions of R, G, B and alpha for this 32-bit layout.
+        gint red = GST_VIDEO_FRAME_COMP_OFFSET(frame, GST_VIDEO_COMP_R);
+        gint green = GST_VIDEO_FRAME_COMP_OFFSET(frame, GST_VIDEO_COMP_G);
+        gint blue = GST_VIDEO_FRAME_COMP_OFFSET(frame, GST_VIDEO_COMP_B);
+        gint alpha = 6 - red - green - blue;
+        memset(background, 0, 4);
+        background[alpha] = 0xff;
+        foreground[red] = r;
+        foreground[green] = g;
+        foreground[blue] = b;
+        foreground[alpha] = 0xff;
+        // Paint one row, copy it to the others.
+        for (gint x = 0; x < width; x++)
+            memcpy(pixels + x * 4, background, 4);
+        for (gint y = 1; y < height; y++)
+            memcpy(pixels + y * stride, pixels, width * 4);
+    }
+
+    for (guint c = 0; c < channels; c++)
+    {
+        gint top = c * band, centre = top + band / 2;
+        gfloat low = 0.0f, high = 0.0f;
+        for (gint x = 0; x < width; x++)
+        {
+            if (self->mins[x * channels + c] <= self->maxs[x * channels + c])
+            {
+                low = self->mins[x * channels + c];
+                high = self->maxs[x * channels + c];
+            }
+            gint y0 = CLAMP(centre - (gint)(high * (band / 2)), top, top + band - 1);
+            gint y1 = CLAMP(centre - (gint)(low * (band / 2)), top, top + band - 1);
+            if (planar)
+            {
+                guint8 *u = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 1);
+                guint8 *v = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, 2);
+                gint chromaStride = GST_VIDEO_FRAME_PLANE_STRIDE(frame, 1);
+                for (gint y = y0; y <= y1; y++)
+                    pixels[y * stride + x] = foreground[0];
+                for (gint y = y0 / 2; y <= y1 / 2; y++)
+                {
+                    u[y * chromaStride + x / 2] = foreground[1];
+                    v[y * GST_VIDEO_FRAME_PLANE_STRIDE(frame, 2) + x / 2] = foreground[2];
+                }
+            }
+            else
+            {
+                for (gint y = y0; y <= y1; y++)
+                    memcpy(pixels + y * stride + x * 4, foreground, 4);
+            }
+        }
+    }
+}
+
+static GstFlowReturn waveformScopePushFrame(WaveformScope *self)
+{
+    GstBuffer *buffer = NULL;
+    GstFlowReturn ret = gst_buffer_pool_acquire_buffer(self->pool, &buffer, NULL);
+    if (ret != GST_FLOW_OK)
+    {
+        return ret;
+    }
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &self->videoInfo, buffer, GST_MAP_WRITE))
+    {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_ERROR;
+    }
+    waveformScopeRender(self, &frame);
+    gst_video_frame_unmap(&frame);
+
+    GST_BUFFER_PTS(buffer) = waveformScopeFrameTime(self, self->frame);
+    GST_BUFFER_DURATION(buffer) = waveformScopeFrameTime(self, self->frame + 1) - GST_BUFFER_PTS(buffer);
+    GST_BUFFER_OFFSET(buffer) = self->frame;
+    self->frame++;
+    waveformScopeClearColumns(self);
+    return gst_pad_push(self->srcPad, buffer);
+}
+
+/*!
+ * @brief Spreads the buffer's samples over the columns of the current frame, pushing every frame that completes.
+ */
+static GstFlowReturn waveformScopeChain(GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+    WaveformScope *self = (WaveformScope *)parent;
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!self->negotiated || gst_pad_check_reconfigure(self->srcPad))
+    {
+        if (!waveformScopeNegotiate(self))
+        {
+            gst_pad_mark_reconfigure(self->srcPad);
+            gst_buffer_unref(buffer);
+            return GST_PAD_IS_FLUSHING(self->srcPad) ? GST_FLOW_FLUSHING : GST_FLOW_NOT_NEGOTIATED;
+        }
+    }
+    if (GST_BUFFER_IS_DISCONT(buffer) || !GST_CLOCK_TIME_IS_VALID(self->startTime))
+    {
+        waveformScopeReset(self);
+        self->startTime = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) : 0;
+    }
+
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_READ);
+    guint channels = GST_AUDIO_INFO_CHANNELS(&self->audioInfo), bpf = GST_AUDIO_INFO_BPF(&self->audioInfo);
+    gint width = GST_VIDEO_INFO_WIDTH(&self->videoInfo);
+    gboolean s16 = GST_AUDIO_INFO_FORMAT(&self->audioInfo) == GST_AUDIO_FORMAT_S16;
+    const guint8 *data = map.data;
+    guint64 remaining = map.size / bpf;
+
+    while (remaining > 0 && ret == GST_FLOW_OK)
+    {
+        guint64 frameStart = waveformScopeFrameStart(self, self->frame);
+        guint64 span = waveformScopeFrameStart(self, self->frame + 1) - frameStart;
+        guint64 columnEnd = frameStart + span * (self->column + 1) / width;
+        guint take = (guint)MIN(remaining, columnEnd - self->samples);
+
+        gfloat *mins = self->mins + self->column * channels, *maxs = self->maxs + self->column * channels;
+        if (s16)
+            self->kernels->minMaxS16((const gint16 *)data, take, channels, mins, maxs);
+        else
+            self->kernels->minMaxF32((const gfloat *)data, take, channels, mins, maxs);
+        data += (gsize)take * bpf;
+        remaining -= take;
+        self->samples += take;
+
+        // Columns can be empty when a frame has fewer samples than columns.
+        while (ret == GST_FLOW_OK && self->samples == frameStart + span * (self->column + 1) / width)
+        {
+            if (++self->column == width)
+            {
+                ret = waveformScopePushFrame(self);
+                break;
+            }
+        }
+    }
+    gst_buffer_unmap(buffer, &map);
+    gst_buffer_unref(buffer);
+    return ret;
+}
+
+static gboolean waveformScopeSinkEvent(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+    WaveformScope *self = (WaveformScope *)parent;
+    switch (GST_EVENT_TYPE(event))
+    {
+    case GST_EVENT_CAPS:
+    {
+        // Audio caps stay here; video caps go out instead, ahead of the segment.
+        GstCaps *caps;
+        gst_event_parse_caps(event, &caps);
+        gboolean ok = gst_audio_info_from_caps(&self->audioInfo, caps) && waveformScopeNegotiate(self);
+        gst_event_unref(event);
+        return ok;
+    }
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_SEGMENT:
+        waveformScopeReset(self);
+        break;
+    default:
+        break;
+    }
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static gboolean waveformScopeSrcQuery(GstPad *pad, GstObject *parent, GstQuery *query)
+{
+    WaveformScope *self = (WaveformScope *)parent;
+    if (GST_QUERY_TYPE(query) != GST_QUERY_LATENCY)
+    {
+        return gst_pad_query_default(pad, parent, query);
+    }
+    if (!gst_pad_peer_query(self->sinkPad, query))
+    {
+        return FALSE;
+    }
+    // A frame goes out once its last sample has arrived.
+    gboolean live;
+    GstClockTime min, max;
+    gst_query_parse_latency(query, &live, &min, &max);
+    GstClockTime frame = self->negotiated ? gst_util_uint64_scale(GST_SECOND, GST_VIDEO_INFO_FPS_D(&self->videoInfo),
+                                                                  GST_VIDEO_INFO_FPS_N(&self->videoInfo))
+                                          : 0;
+    gst_query_set_latency(query, live, min + frame, GST_CLOCK_TIME_IS_VALID(max) ? max + frame : max);
+    return TRUE;
+}
+
+static GstStateChangeReturn waveformScopeChangeState(GstElement *element, GstStateChange transition)
+{
+    GstStateChangeReturn ret = GST_ELEMENT_CLASS(waveform_scope_parent_class)->change_state(element, transition);
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+    {
+        waveformScopeFreeState((WaveformScope *)element);
+    }
+    return ret;
+}
+
+static void waveformScopeFinalize(GObject *object)
+{
+    waveformScopeFreeState((WaveformScope *)object);
+    G_OBJECT_CLASS(waveform_scope_parent_class)->finalize(object);
+}
+
+static void waveformScopeSetProperty(GObject *object, guint id, const GValue *value, GParamSpec *spec)
+{
+    if (id != WAVEFORM_SCOPE_PROP_COLOR)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    ((WaveformScope *)object)->color = g_value_get_uint(value);
+}
+
+static void waveformScopeGetProperty(GObject *object, guint id, GValue *value, GParamSpec *spec)
+{
+    if (id != WAVEFORM_SCOPE_PROP_COLOR)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    g_value_set_uint(value, ((WaveformScope *)object)->color);
+}
+
+static void waveform_scope_class_init(WaveformScopeClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+
+    objectClass->set_property = waveformScopeSetProperty;
+    objectClass->get_property = waveformScopeGetProperty;
+    objectClass->finalize = waveformScopeFinalize;
+    g_object_class_install_property(objectClass, WAVEFORM_SCOPE_PROP_COLOR,
+                                    g_param_spec_uint("color", "Color", "Waveform color as 0xAARRGGBB", 0, G_MAXUINT32,
+                                                      0xff00ff00,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    GstCaps *caps = gst_caps_from_string(WAVEFORM_SCOPE_SINK_CAPS);
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    caps = gst_caps_from_string(WAVEFORM_SCOPE_SRC_CAPS);
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    gst_element_class_set_static_metadata(elementClass, "Waveform scope", "Visualization",
+                                          "Min/max waveform rendered into pooled I420 or RGB frames",
+                                          "GStreamer Exercises");
+    elementClass->change_state = waveformScopeChangeState;
+}
+
+static void waveform_scope_init(WaveformScope *self)
+{
+    GstElementClass *klass = GST_ELEMENT_GET_CLASS(self);
+    self->sinkPad = gst_pad_new_from_template(gst_element_class_get_pad_template(klass, "sink"), "sink");
+    gst_pad_set_chain_function(self->sinkPad, waveformScopeChain);
+    gst_pad_set_event_function(self->sinkPad, waveformScopeSinkEvent);
+    gst_element_add_pad(GST_ELEMENT(self), self->sinkPad);
+    self->srcPad = gst_pad_new_from_template(gst_element_class_get_pad_template(klass, "src"), "src");
+    gst_pad_set_query_function(self->srcPad, waveformScopeSrcQuery);
+    gst_element_add_pad(GST_ELEMENT(self), self->srcPad);
+
+    self->color = 0xff00ff00;
+    self->kernels = waveformKernelsBest();
+    self->pool = NULL;
+    self->negotiated = FALSE;
+    self->mins = self->maxs = NULL;
+    self->column = 0;
+    self->frame = self->samples = 0;
+    self->startTime = GST_CLOCK_TIME_NONE;
+}
+
+/*!
+ * @brief Makes "waveformscope" available to gst_element_factory_make() and gst_parse_launch() in this process.
+ */
+static gboolean waveformScopeRegister()
+{
+    return gst_element_register(NULL, "waveformscope", GST_RANK_NONE, waveform_scope_get_type());
+}
+
+#endif // WAVEFORM_SCOPE_H
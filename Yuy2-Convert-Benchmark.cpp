@@ -0,0 +1,237 @@
+/*!
+ * @brief Bit-exactness test and micro-benchmark of Yuy2-Convert.h against videoconvert, 320x240 up to 4K plus widths
+ * that leave a tail after the SIMD loops.
+ * @note Usage:- ./Yuy2-Convert-Benchmark.o [--min-ms=MS]
+ * @link https://gstreamer.freedesktop.org/documentation/video/video-converter.html?gi-language=c
+ *
+ * For every size and every conversion (YUY2 -> I420, YUY2 -> NV12, I420 -> YUY2, NV12 -> YUY2) one videotestsrc
+ * snow frame is pushed through appsrc ! videoconvert ! appsink and through appsrc ! yuy2convert kernel=K ! appsink
+ * for every kernel this CPU supports. The outputs must be identical byte for byte (visible area only, strides
+ * may differ).
+ * The speed test then calls the kernels directly on mapped frames for at least --min-ms and compares them with a
+ * GstVideoConverter, which is what videoconvert runs internally. One JSON line per size/conversion/kernel.
+ */
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include "Yuy2-Convert.h"
+
+typedef struct
+{
+    gint width, height;
+} FrameSize;
+
+typedef struct
+{
+    GstVideoFormat from, to;
+} Conversion;
+
+static gint minMs = 300;
+
+static GOptionEntry entries[] = {
+    {"min-ms", 'm', 0, G_OPTION_ARG_INT, &minMs, "Run every speed measurement for at least MS milliseconds", "MS"},
+    {NULL}};
+
+// 1366 and 322 aren't multiples of 16 or 32, so the SSE2 and scalar tails after the wider loops are compared too.
+static const FrameSize sizes[] = {{322, 242}, {320, 240}, {640, 480}, {1280, 720}, {1366, 768}, {1920, 1080}, {3840, 2160}};
+static const Conversion conversions[] = {
+    {GST_VIDEO_FORMAT_YUY2, GST_VIDEO_FORMAT_I420},
+    {GST_VIDEO_FORMAT_YUY2, GST_VIDEO_FORMAT_NV12},
+    {GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_YUY2},
+    {GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_YUY2},
+};
+static const gchar *kernelNames[] = {"avx2", "sse2", "scalar"};
+
+static GstCaps *makeCaps(GstVideoFormat format, const FrameSize *size)
+{
+    return gst_caps_new_simple("video/x-raw",
+                               "format", G_TYPE_STRING, gst_video_format_to_string(format),
+                               "width", G_TYPE_INT, size->width,
+                               "height", G_TYPE_INT, size->height,
+                               "framerate", GST_TYPE_FRACTION, 30, 1,
+                               NULL);
+}
+
+/*!
+ * @brief Runs description (a pipeline with an appsink named "sink") and returns the first sample.
+ */
+static GstSample *pullFirstSample(const gchar *description, GstSample *input)
+{
+    GError *err = NULL;
+    GstElement *pipeline = gst_parse_launch(description, &err);
+    if (!pipeline)
+    {
+        gst_printerr("\nFailed to build '%s': %s", description, err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    if (input)
+    {
+        GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+        gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(input));
+        gst_app_src_push_buffer(GST_APP_SRC(src), gst_buffer_ref(gst_sample_get_buffer(input)));
+        gst_app_src_end_of_stream(GST_APP_SRC(src));
+        gst_object_unref(src);
+    }
+
+    GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 10 * GST_SECOND);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return sample;
+}
+
+static GstSample *convertThrough(const gchar *element, GstSample *input, GstVideoFormat to)
+{
+    gchar *description = g_strdup_printf("appsrc name=src format=time ! %s ! video/x-raw,format=%s ! appsink name=sink",
+                                         element, gst_video_format_to_string(to));
+    GstSample *sample = pullFirstSample(description, input);
+    g_free(description);
+    return sample;
+}
+
+/*!
+ * @brief Number of differing bytes in the visible area. Plane p starts with component p for YUY2, I420 and NV12.
+ */
+static guint64 compareSamples(GstSample *a, GstSample *b)
+{
+    GstVideoInfo infoA, infoB;
+    GstVideoFrame frameA, frameB;
+    if (!gst_video_info_from_caps(&infoA, gst_sample_get_caps(a)) || !gst_video_info_from_caps(&infoB, gst_sample_get_caps(b)) ||
+        GST_VIDEO_INFO_FORMAT(&infoA) != GST_VIDEO_INFO_FORMAT(&infoB))
+    {
+        return G_MAXUINT64;
+    }
+    gst_video_frame_map(&frameA, &infoA, gst_sample_get_buffer(a), GST_MAP_READ);
+    gst_video_frame_map(&frameB, &infoB, gst_sample_get_buffer(b), GST_MAP_READ);
+
+    guint64 differences = 0;
+    for (guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frameA); plane++)
+    {
+        gint rowBytes = GST_VIDEO_FRAME_COMP_WIDTH(&frameA, plane) * GST_VIDEO_FRAME_COMP_PSTRIDE(&frameA, plane);
+        for (gint row = 0; row < GST_VIDEO_FRAME_COMP_HEIGHT(&frameA, plane); row++)
+        {
+            const guint8 *rowA = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frameA, plane) + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frameA, plane);
+            const guint8 *rowB = (const guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&frameB, plane) + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frameB, plane);
+            for (gint i = 0; i < rowBytes; i++)
+            {
+                differences += rowA[i] != rowB[i];
+            }
+        }
+    }
+    gst_video_frame_unmap(&frameA);
+    gst_video_frame_unmap(&frameB);
+    return differences;
+}
+
+/*!
+ * @brief Frames per second of the kernels (or of a GstVideoConverter when kernels is NULL) on one frame.
+ */
+static gdouble measureFps(const Yuy2Kernels *kernels, GstSample *input, GstVideoFormat to)
+{
+    GstVideoInfo inInfo, outInfo;
+    gst_video_info_from_caps(&inInfo, gst_sample_get_caps(input));
+    gst_video_info_set_format(&outInfo, to, GST_VIDEO_INFO_WIDTH(&inInfo), GST_VIDEO_INFO_HEIGHT(&inInfo));
+    GstBuffer *output = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&outInfo), NULL);
+
+    GstVideoFrame in, out;
+    gst_video_frame_map(&in, &inInfo, gst_sample_get_buffer(input), GST_MAP_READ);
+    gst_video_frame_map(&out, &outInfo, output, GST_MAP_WRITE);
+    GstVideoConverter *converter = kernels ? NULL : gst_video_converter_new(&inInfo, &outInfo, NULL);
+
+    guint frames = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed;
+    do
+    {
+        if (kernels)
+            yuy2ConvertFrame(kernels, &in, &out);
+        else
+            gst_video_converter_frame(converter, &in, &out);
+        frames++;
+    } while ((elapsed = g_get_monotonic_time() - start) < minMs * 1000);
+
+    if (converter)
+        gst_video_converter_free(converter);
+    gst_video_frame_unmap(&in);
+    gst_video_frame_unmap(&out);
+    gst_buffer_unref(output);
+    return frames * 1e6 / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    GError *err = NULL;
+
+    GOptionContext *context = g_option_context_new("- compare yuy2convert with videoconvert");
+    g_option_context_add_main_entries(context, entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &err))
+    {
+        gst_printerr("\n%s", err->message);
+        g_clear_error(&err);
+        g_option_context_free(context);
+        return -1;
+    }
+    g_option_context_free(context);
+    yuy2ConvertRegister();
+    g_print("Fastest kernel on this CPU: %s\n", yuy2KernelsFind(NULL)->name);
+
+    gboolean passed = TRUE;
+    for (const FrameSize &size : sizes)
+    {
+        for (const Conversion &conversion : conversions)
+        {
+            const gchar *from = gst_video_format_to_string(conversion.from);
+            const gchar *to = gst_video_format_to_string(conversion.to);
+            gchar *description = g_strdup_printf(
+                "videotestsrc num-buffers=1 pattern=snow ! video/x-raw,format=%s,width=%d,height=%d ! appsink name=sink",
+                from, size.width, size.height);
+            GstSample *input = pullFirstSample(description, NULL);
+            g_free(description);
+            GstSample *reference = input ? convertThrough("videoconvert", input, conversion.to) : NULL;
+            if (!reference)
+            {
+                gst_printerr("\nFailed to produce the %s -> %s reference at %dx%d.", from, to, size.width, size.height);
+                passed = FALSE;
+                if (input)
+                    gst_sample_unref(input);
+                continue;
+            }
+            gdouble referenceFps = measureFps(NULL, input, conversion.to);
+
+            for (const gchar *name : kernelNames)
+            {
+                const Yuy2Kernels *kernels = yuy2KernelsFind(name);
+                if (!kernels)
+                {
+                    continue;
+                }
+                gchar *element = g_strdup_printf("yuy2convert kernel=%s", name);
+                GstSample *result = convertThrough(element, input, conversion.to);
+                g_free(element);
+                guint64 differences = result ? compareSamples(reference, result) : G_MAXUINT64;
+                if (result)
+                    gst_sample_unref(result);
+                passed = passed && differences == 0;
+
+                gdouble fps = measureFps(kernels, input, conversion.to);
+                g_print("{\"size\": \"%dx%d\", \"conversion\": \"%s->%s\", \"kernel\": \"%s\", \"bit_exact\": %s, "
+                        "\"differing_bytes\": %" G_GINT64_FORMAT ", \"fps\": %.1f, \"videoconvert_fps\": %.1f, "
+                        "\"speedup\": %.2f}\n",
+                        size.width, size.height, from, to, name, differences == 0 ? "true" : "false",
+                        differences == G_MAXUINT64 ? (gint64)-1 : (gint64)differences, fps, referenceFps,
+                        fps / referenceFps);
+            }
+            gst_sample_unref(reference);
+            gst_sample_unref(input);
+        }
+    }
+
+    g_print("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : -1;
+}
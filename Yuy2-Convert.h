@@ -0,0 +1,498 @@
+/*!
+ * @brief yuy2convert: a GstVideoFilter converting YUY2 <-> I420/NV12 with SIMD kernels, used in place of videoconvert
+ * on the webcam capture path.
+ * @link https://gstreamer.freedesktop.org/documentation/video/gstvideofilter.html?gi-language=c
+ * @link https://gstreamer.freedesktop.org/documentation/gstreamer/gstelementfactory.html?gi-language=c#gst_element_register
+ *
+ * videoconvert builds a generic GstVideoConverter for whatever the caps say. The capture chains only ever need the
+ * packed 4:2:2 -> planar 4:2:0 step (and back for display), which is a byte shuffle plus averaging the chroma of
+ * two lines. The kernels do exactly what videoconvert's fast path does ((a + b + 1) >> 1 for the chroma of a line
+ * pair, chroma repeated on both lines going back to 4:2:2), so the output is bit-exact with videoconvert.
+ *
+ * Kernels come in three flavours: AVX2 (32 pixels per step), SSE2 (16 pixels, baseline on x86-64) and scalar.
+ * The best one is picked at runtime with __builtin_cpu_supports(); the "kernel" property forces one for testing.
+ * SSE4.1 would add nothing here: every operation is a pack, unpack, mask or average available in SSE2.
+ *
+ * The element lives in the application, not in a plugin: call yuy2ConvertRegister() once after gst_init() and
+ * create it with gst_element_factory_make("yuy2convert", ...).
+ */
+
+#ifndef YUY2_CONVERT_H
+#define YUY2_CONVERT_H
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YUY2_CONVERT_X86 1
+#endif
+
+#define YUY2_CONVERT_CAPS GST_VIDEO_CAPS_MAKE("{ YUY2, I420, NV12 }")
+
+/* ======= Kernels ==========*/
+
+// Two YUY2 lines -> two luma lines and one line of subsampled chroma (u/v planes or interleaved uv). Pixels from x on.
+typedef void (*Yuy2ToPlanarRows)(const guint8 *src0, const guint8 *src1, guint8 *y0, guint8 *y1, guint8 *u,
+                                 guint8 *v, gint x, gint width);
+// One luma line and its chroma line -> one YUY2 line. For NV12 u is the interleaved uv line and v is unused.
+typedef void (*PlanarToYuy2Row)(const guint8 *y, const guint8 *u, const guint8 *v, guint8 *dst, gint x, gint width);
+
+typedef struct
+{
+    const gchar *name;
+    Yuy2ToPlanarRows yuy2ToI420, yuy2ToNv12;
+    PlanarToYuy2Row i420ToYuy2, nv12ToYuy2;
+} Yuy2Kernels;
+
+static inline guint8 yuy2Average(guint8 a, guint8 b)
+{
+    return (guint8)((a + b + 1) >> 1);
+}
+
+static void yuy2ToI420Scalar(const guint8 *src0, const guint8 *src1, guint8 *y0, guint8 *y1, guint8 *u, guint8 *v,
+                             gint x, gint width)
+{
+    for (; x < width; x += 2)
+    {
+        const guint8 *a = src0 + x * 2, *b = src1 + x * 2;
+        y0[x] = a[0];
+        y1[x] = b[0];
+        if (x + 1 < width)
+        {
+            y0[x + 1] = a[2];
+            y1[x + 1] = b[2];
+        }
+        u[x / 2] = yuy2Average(a[1], b[1]);
+        v[x / 2] = yuy2Average(a[3], b[3]);
+    }
+}
+
+static void yuy2ToNv12Scalar(const guint8 *src0, const guint8 *src1, guint8 *y0, guint8 *y1, guint8 *uv, guint8 *unused,
+                             gint x, gint width)
+{
+    for (; x < width; x += 2)
+    {
+        const guint8 *a = src0 + x * 2, *b = src1 + x * 2;
+        y0[x] = a[0];
+        y1[x] = b[0];
+        if (x + 1 < width)
+        {
+            y0[x + 1] = a[2];
+            y1[x + 1] = b[2];
+        }
+        uv[x] = yuy2Average(a[1], b[1]);
+        uv[x + 1] = yuy2Average(a[3], b[3]);
+    }
+}
+
+static void i420ToYuy2Scalar(const guint8 *y, const guint8 *u, const guint8 *v, guint8 *dst, gint x, gint width)
+{
+    for (; x < width; x += 2)
+    {
+        guint8 *d = dst + x * 2;
+        d[0] = y[x];
+        d[1] = u[x / 2];
+        d[2] = x + 1 < width ? y[x + 1] : y[x];
+        d[3] = v[x / 2];
+    }
+}
+
+static void nv12ToYuy2Scalar(const guint8 *y, const guint8 *uv, const guint8 *unused, guint8 *dst, gint x, gint width)
+{
+    for (; x < width; x += 2)
+    {
+        guint8 *d = dst + x * 2;
+        d[0] = y[x];
+        d[1] = uv[x];
+        d[2] = x + 1 < width ? y[x + 1] : y[x];
+        d[3] = uv[x + 1];
+    }
+}
+
+static const Yuy2Kernels yuy2KernelsScalar = {"scalar", yuy2ToI420Scalar, yuy2ToNv12Scalar, i420ToYuy2Scalar,
+                                              nv12ToYuy2Scalar};
+
+#ifdef YUY2_CONVERT_X86
+
+// 16 YUY2 pixels of one line -> 16 luma bytes and 16 bytes of interleaved u/v (8 pairs).
+static inline void yuy2SplitSse2(const guint8 *src, __m128i *y, __m128i *uv)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    __m128i a = _mm_loadu_si128((const __m128i *)src);
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+    *y = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+    *uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+static void yuy2ToI420Sse2(const guint8 *src0, const guint8 *src1, guint8 *y0, guint8 *y1, guint8 *u, guint8 *v,
+                           gint x, gint width)
+{
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i ya, yb, uva, uvb;
+        yuy2SplitSse2(src0 + x * 2, &ya, &uva);
+        yuy2SplitSse2(src1 + x * 2, &yb, &uvb);
+        _mm_storeu_si128((__m128i *)(y0 + x), ya);
+        _mm_storeu_si128((__m128i *)(y1 + x), yb);
+        __m128i uv = _mm_avg_epu8(uva, uvb);
+        __m128i planar = _mm_packus_epi16(_mm_and_si128(uv, lowBytes), _mm_srli_epi16(uv, 8));
+        _mm_storel_epi64((__m128i *)(u + x / 2), planar);
+        _mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(planar, 8));
+    }
+    yuy2ToI420Scalar(src0, src1, y0, y1, u, v, x, width);
+}
+
+static void yuy2ToNv12Sse2(const guint8 *src0, const guint8 *src1, guint8 *y0, guint8 *y1, guint8 *uv, guint8 *unused,
+                           gint x, gint width)
+{
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i ya, yb, uva, uvb;
+        yuy2SplitSse2(src0 + x * 2, &ya, &uva);
+        yuy2SplitSse2(src1 + x * 2, &yb, &uvb);
+        _mm_storeu_si128((__m128i *)(y0 + x), ya);
+        _mm_storeu_si128((__m128i *)(y1 + x), yb);
+        _mm_storeu_si128((__m128i *)(uv + x), _mm_avg_epu8(uva, uvb));
+    }
+    yuy2ToNv12Scalar(src0, src1, y0, y1, uv, unused, x, width);
+}
+
+static inline void yuy2MergeSse2(const guint8 *y, __m128i uv, guint8 *dst)
+{
+    __m128i luma = _mm_loadu_si128((const __m128i *)y);
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(luma, uv));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(luma, uv));
+}
+
+static void i420ToYuy2Sse2(const guint8 *y, const guint8 *u, const guint8 *v, guint8 *dst, gint x, gint width)
+{
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)),
+                                       _mm_loadl_epi64((const __m128i *)(v + x / 2)));
+        yuy2MergeSse2(y + x, uv, dst + x * 2);
+    }
+    i420ToYuy2Scalar(y, u, v, dst, x, width);
+}
+
+static void nv12ToYuy2Sse2(const guint8 *y, const guint8 *uv, const guint8 *unused, guint8 *dst, gint x, gint width)
+{
+    for (; x + 16 <= width; x += 16)
+    {
+        yuy2MergeSse2(y + x, _mm_loadu_si128((const __m128i *)(uv + x)), dst + x * 2);
+    }
+    nv12ToYuy2Scalar(y, uv, unused, dst, x, width);
+}
+
+static const Yuy2Kernels yuy2KernelsSse2 = {"sse2", yuy2ToI420Sse2, yuy2ToNv12Sse2, i420ToYuy2Sse2, nv12ToYuy2Sse2};
+
+// AVX2 packs and unpacks work per 128-bit lane; the 0xD8 qword permute (0, 2, 1, 3) puts the halves back in order.
+
+__attribute__((target("avx2"))) static inline void yuy2SplitAvx2(const guint8 *src, __m256i *y, __m256i *uv)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+    __m256i a = _mm256_loadu_si256((const __m256i *)src);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+    *y = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_and_si256(a, lowBytes), _mm256_and_si256(b, lowBytes)), 0xd8);
+    *uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8)), 0xd8);
+}
+
+__attribute__((target("avx2"))) static void yuy2ToI420Avx2(const guint8 *src0, const guint8 *src1, guint8 *y0,
+                                                           guint8 *y1, guint8 *u, guint8 *v, gint x, gint width)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i ya, yb, uva, uvb;
+        yuy2SplitAvx2(src0 + x * 2, &ya, &uva);
+        yuy2SplitAvx2(src1 + x * 2, &yb, &uvb);
+        _mm256_storeu_si256((__m256i *)(y0 + x), ya);
+        _mm256_storeu_si256((__m256i *)(y1 + x), yb);
+        __m256i uv = _mm256_avg_epu8(uva, uvb);
+        __m256i planar = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_and_si256(uv, lowBytes), _mm256_srli_epi16(uv, 8)), 0xd8);
+        _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(planar));
+        _mm_storeu_si128((__m128i *)(v + x / 2), _mm256_extracti128_si256(planar, 1));
+    }
+    yuy2ToI420Sse2(src0, src1, y0, y1, u, v, x, width);
+}
+
+__attribute__((target("avx2"))) static void yuy2ToNv12Avx2(const guint8 *src0, const guint8 *src1, guint8 *y0,
+                                                           guint8 *y1, guint8 *uv, guint8 *unused, gint x, gint width)
+{
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i ya, yb, uva, uvb;
+        yuy2SplitAvx2(src0 + x * 2, &ya, &uva);
+        yuy2SplitAvx2(src1 + x * 2, &yb, &uvb);
+        _mm256_storeu_si256((__m256i *)(y0 + x), ya);
+        _mm256_storeu_si256((__m256i *)(y1 + x), yb);
+        _mm256_storeu_si256((__m256i *)(uv + x), _mm256_avg_epu8(uva, uvb));
+    }
+    yuy2ToNv12Sse2(src0, src1, y0, y1, uv, unused, x, width);
+}
+
+// 32 luma bytes and 32 bytes of u/v pairs -> 32 YUY2 pixels.
+__attribute__((target("avx2"))) static inline void yuy2MergeAvx2(const guint8 *y, __m256i uv, guint8 *dst)
+{
+    __m256i luma = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)y), 0xd8);
+    uv = _mm256_permute4x64_epi64(uv, 0xd8);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_unpacklo_epi8(luma, uv));
+    _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_unpackhi_epi8(luma, uv));
+}
+
+__attribute__((target("avx2"))) static void i420ToYuy2Avx2(const guint8 *y, const guint8 *u, const guint8 *v,
+                                                           guint8 *dst, gint x, gint width)
+{
+    for (; x + 32 <= width; x += 32)
+    {
+        __m128i cb = _mm_loadu_si128((const __m128i *)(u + x / 2));
+        __m128i cr = _mm_loadu_si128((const __m128i *)(v + x / 2));
+        __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(cb, cr)),
+                                             _mm_unpackhi_epi8(cb, cr), 1);
+        yuy2MergeAvx2(y + x, uv, dst + x * 2);
+    }
+    i420ToYuy2Sse2(y, u, v, dst, x, width);
+}
+
+__attribute__((target("avx2"))) static void nv12ToYuy2Avx2(const guint8 *y, const guint8 *uv, const guint8 *unused,
+                                                           guint8 *dst, gint x, gint width)
+{
+    for (; x + 32 <= width; x += 32)
+    {
+        yuy2MergeAvx2(y + x, _mm256_loadu_si256((const __m256i *)(uv + x)), dst + x * 2);
+    }
+    nv12ToYuy2Sse2(y, uv, unused, dst, x, width);
+}
+
+static const Yuy2Kernels yuy2KernelsAvx2 = {"avx2", yuy2ToI420Avx2, yuy2ToNv12Avx2, i420ToYuy2Avx2, nv12ToYuy2Avx2};
+
+#endif // YUY2_CONVERT_X86
+
+/*!
+ * @brief Kernels by name ("avx2", "sse2", "scalar"), or the fastest one this CPU runs for NULL/"auto".
+ * Returns NULL for a kernel the CPU or the build doesn't support.
+ */
+static const Yuy2Kernels *yuy2KernelsFind(const gchar *name)
+{
+    gboolean any = !name || g_strcmp0(name, "auto") == 0;
+#ifdef YUY2_CONVERT_X86
+    __builtin_cpu_init();
+    if ((any || g_strcmp0(name, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+        return &yuy2KernelsAvx2;
+    if (any || g_strcmp0(name, "sse2") == 0)
+        return &yuy2KernelsSse2;
+#endif
+    if (any || g_strcmp0(name, "scalar") == 0)
+        return &yuy2KernelsScalar;
+    return NULL;
+}
+
+static gboolean yuy2ConvertSupports(GstVideoFormat from, GstVideoFormat to)
+{
+    return (from == GST_VIDEO_FORMAT_YUY2 && (to == GST_VIDEO_FORMAT_I420 || to == GST_VIDEO_FORMAT_NV12)) ||
+           ((from == GST_VIDEO_FORMAT_I420 || from == GST_VIDEO_FORMAT_NV12) && to == GST_VIDEO_FORMAT_YUY2);
+}
+
+/*!
+ * @brief Converts the rows [rowFrom, rowTo) of a frame, e.g. one slice of it. rowFrom must be even.
+ * Supported pairs: see yuy2ConvertSupports(), same size. Returns FALSE otherwise.
+ */
+static gboolean yuy2ConvertRows(const Yuy2Kernels *kernels, GstVideoFrame *in, GstVideoFrame *out, gint rowFrom, gint rowTo)
+{
+    GstVideoFormat from = GST_VIDEO_FRAME_FORMAT(in), to = GST_VIDEO_FRAME_FORMAT(out);
+    gint width = GST_VIDEO_FRAME_WIDTH(in), height = GST_VIDEO_FRAME_HEIGHT(in);
+    if (!yuy2ConvertSupports(from, to) || width != GST_VIDEO_FRAME_WIDTH(out) || height != GST_VIDEO_FRAME_HEIGHT(out))
+    {
+        return FALSE;
+    }
+    rowTo = MIN(rowTo, height);
+
+#define PLANE_ROW(frame, plane, row) \
+    ((guint8 *)GST_VIDEO_FRAME_PLANE_DATA(frame, plane) + (gsize)(row) * GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane))
+
+    if (from == GST_VIDEO_FORMAT_YUY2)
+    {
+        gboolean nv12 = to == GST_VIDEO_FORMAT_NV12;
+        for (gint row = rowFrom; row < rowTo; row += 2)
+        {
+            // An odd last line is its own pair.
+            gint next = MIN(row + 1, height - 1);
+            if (nv12)
+                kernels->yuy2ToNv12(PLANE_ROW(in, 0, row), PLANE_ROW(in, 0, next), PLANE_ROW(out, 0, row),
+                                    PLANE_ROW(out, 0, next), PLANE_ROW(out, 1, row / 2), NULL, 0, width);
+            else
+                kernels->yuy2ToI420(PLANE_ROW(in, 0, row), PLANE_ROW(in, 0, next), PLANE_ROW(out, 0, row),
+                                    PLANE_ROW(out, 0, next), PLANE_ROW(out, 1, row / 2), PLANE_ROW(out, 2, row / 2),
+                                    0, width);
+        }
+        return TRUE;
+    }
+
+    gboolean nv12 = from == GST_VIDEO_FORMAT_NV12;
+    for (gint row = rowFrom; row < rowTo; row++)
+    {
+        if (nv12)
+            kernels->nv12ToYuy2(PLANE_ROW(in, 0, row), PLANE_ROW(in, 1, row / 2), NULL, PLANE_ROW(out, 0, row),
+                                0, width);
+        else
+            kernels->i420ToYuy2(PLANE_ROW(in, 0, row), PLANE_ROW(in, 1, row / 2), PLANE_ROW(in, 2, row / 2),
+                                PLANE_ROW(out, 0, row), 0, width);
+    }
+    return TRUE;
+#undef PLANE_ROW
+}
+
+static gboolean yuy2ConvertFrame(const Yuy2Kernels *kernels, GstVideoFrame *in, GstVideoFrame *out)
+{
+    return yuy2ConvertRows(kernels, in, out, 0, GST_VIDEO_FRAME_HEIGHT(in));
+}
+
+/* ======= Element ==========*/
+
+typedef struct
+{
+    GstVideoFilter parent;
+    const Yuy2Kernels *kernels;
+} Yuy2Convert;
+
+typedef struct
+{
+    GstVideoFilterClass parentClass;
+} Yuy2ConvertClass;
+
+enum
+{
+    YUY2_CONVERT_PROP_0,
+    YUY2_CONVERT_PROP_KERNEL
+};
+
+G_DEFINE_TYPE(Yuy2Convert, yuy2_convert, GST_TYPE_VIDEO_FILTER)
+
+static void yuy2ConvertSetProperty(GObject *object, guint id, const GValue *value, GParamSpec *spec)
+{
+    Yuy2Convert *self = (Yuy2Convert *)object;
+    if (id != YUY2_CONVERT_PROP_KERNEL)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    const Yuy2Kernels *kernels = yuy2KernelsFind(g_value_get_string(value));
+    if (!kernels)
+    {
+        GST_WARNING_OBJECT(self, "kernel %s is not supported here, keeping %s", g_value_get_string(value),
+                           self->kernels->name);
+        return;
+    }
+    self->kernels = kernels;
+}
+
+static void yuy2ConvertGetProperty(GObject *object, guint id, GValue *value, GParamSpec *spec)
+{
+    Yuy2Convert *self = (Yuy2Convert *)object;
+    if (id != YUY2_CONVERT_PROP_KERNEL)
+    {
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+        return;
+    }
+    g_value_set_string(value, self->kernels->name);
+}
+
+/*!
+ * @brief YUY2 on one side allows I420/NV12 (and YUY2 for passthrough) on the other, and vice versa.
+ */
+static GstCaps *yuy2ConvertTransformCaps(GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps,
+                                         GstCaps *filter)
+{
+    GstCaps *result = gst_caps_new_empty();
+    for (guint i = 0; i < gst_caps_get_size(caps); i++)
+    {
+        GstStructure *structure = gst_structure_copy(gst_caps_get_structure(caps, i));
+        const gchar *format = gst_structure_get_string(structure, "format");
+        GValue formats = G_VALUE_INIT;
+        gst_value_list_init(&formats, 3);
+        const gchar *names[3] = {"I420", "NV12", "YUY2"};
+        if (format && g_strcmp0(format, "YUY2") != 0)
+        {
+            // Planar in: YUY2 first, then passthrough.
+            names[0] = "YUY2";
+            names[1] = format;
+            names[2] = NULL;
+        }
+        for (guint n = 0; n < 3 && names[n]; n++)
+        {
+            GValue name = G_VALUE_INIT;
+            g_value_init(&name, G_TYPE_STRING);
+            g_value_set_string(&name, names[n]);
+            gst_value_list_append_and_take_value(&formats, &name);
+        }
+        gst_structure_take_value(structure, "format", &formats);
+        result = gst_caps_merge_structure(result, structure);
+    }
+
+    if (filter)
+    {
+        GstCaps *intersection = gst_caps_intersect_full(filter, result, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(result);
+        result = intersection;
+    }
+    return result;
+}
+
+static GstFlowReturn yuy2ConvertTransformFrame(GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+    Yuy2Convert *self = (Yuy2Convert *)filter;
+    if (!yuy2ConvertFrame(self->kernels, in, out))
+    {
+        GST_ELEMENT_ERROR(self, CORE, NEGOTIATION, (NULL),
+                          ("can't convert %s to %s", gst_video_format_to_string(GST_VIDEO_FRAME_FORMAT(in)),
+                           gst_video_format_to_string(GST_VIDEO_FRAME_FORMAT(out))));
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    return GST_FLOW_OK;
+}
+
+static void yuy2_convert_class_init(Yuy2ConvertClass *klass)
+{
+    GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+    GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass *transformClass = GST_BASE_TRANSFORM_CLASS(klass);
+    GstVideoFilterClass *filterClass = GST_VIDEO_FILTER_CLASS(klass);
+
+    objectClass->set_property = yuy2ConvertSetProperty;
+    objectClass->get_property = yuy2ConvertGetProperty;
+    g_object_class_install_property(
+        objectClass, YUY2_CONVERT_PROP_KERNEL,
+        g_param_spec_string("kernel", "Kernel", "SIMD kernel: auto, avx2, sse2 or scalar", "auto",
+                            (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+    GstCaps *caps = gst_caps_from_string(YUY2_CONVERT_CAPS);
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps));
+    gst_element_class_add_pad_template(elementClass, gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps));
+    gst_caps_unref(caps);
+    gst_element_class_set_static_metadata(elementClass, "YUY2 converter", "Filter/Converter/Video",
+                                          "Converts YUY2 to I420/NV12 and back with SIMD kernels",
+                                          "GStreamer Exercises");
+
+    transformClass->transform_caps = yuy2ConvertTransformCaps;
+    transformClass->passthrough_on_same_caps = TRUE;
+    filterClass->transform_frame = yuy2ConvertTransformFrame;
+}
+
+static void yuy2_convert_init(Yuy2Convert *self)
+{
+    self->kernels = yuy2KernelsFind(NULL);
+}
+
+/*!
+ * @brief Makes "yuy2convert" available to gst_element_factory_make() and gst_parse_launch() in this process.
+ */
+static gboolean yuy2ConvertRegister()
+{
+    return gst_element_register(NULL, "yuy2convert", GST_RANK_NONE, yuy2_convert_get_type());
+}
+
+#endif // YUY2_CONVERT_H